@@ -30,6 +30,7 @@ DEALINGS IN THE SOFTWARE.
 #include "Pin.h"
 #include "CoordinateSystem.h"
 #include "CodalUtil.h"
+#include "ManagedBuffer.h"
 
 /**
   * Status flags
@@ -81,6 +82,13 @@ DEALINGS IN THE SOFTWARE.
 #define ACCELEROMETER_8G_THRESHOLD                 ((uint32_t)ACCELEROMETER_8G_TOLERANCE * (uint32_t)ACCELEROMETER_8G_TOLERANCE)
 #define ACCELEROMETER_SHAKE_COUNT_THRESHOLD        4
 
+/**
+  * The largest number of samples that may be read from a hardware FIFO in a single batch.
+  */
+#ifndef ACCELEROMETER_MAX_BATCH_SIZE
+#define ACCELEROMETER_MAX_BATCH_SIZE               32
+#endif
+
 namespace codal
 {
     struct ShakeHistory
@@ -107,6 +115,8 @@ namespace codal
 
         uint16_t        samplePeriod;       // The time between samples, in milliseconds.
         uint8_t         sampleRange;        // The sample range of the accelerometer in g.
+        uint8_t         batchSize;          // The number of samples buffered in the hardware FIFO before they are read, or 1 if the FIFO is not in use.
+        ManagedBuffer   batch;              // The most recent block of samples, as Sample3D in the coordinate system specified by the coordinateSpace variable.
         Sample3D        sample;             // The last sample read, in the coordinate system specified by the coordinateSpace variable.
         Sample3D        sampleENU;          // The last sample read, in raw ENU format (stored in case requests are made for data in other coordinate spaces)
         CoordinateSpace &coordinateSpace;   // The coordinate space transform (if any) to apply to the raw data from the hardware.
@@ -173,6 +183,36 @@ namespace codal
           */
         virtual int getRange();
 
+        /**
+          * Attempts to enable batched operation, where samples are collected in the hardware FIFO of the
+          * accelerometer and read in a single burst once the given number are available. All of the samples
+          * read are passed through gesture detection, but only one ACCELEROMETER_EVT_DATA_UPDATE event is raised
+          * for each batch. The samples of the most recent batch are available via getBatch().
+          *
+          * @param samples The number of samples in each batch, or 1 to read every sample as it becomes available.
+          *
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_I2C_ERROR if the request fails.
+          *
+          * @note The requested batch size may not be possible on the hardware. In this case, the
+          * nearest lower size is chosen (1 if the hardware has no FIFO).
+          */
+        virtual int setBatchSize(int samples);
+
+        /**
+          * Reads the currently configured batch size of the accelerometer.
+          *
+          * @return The number of samples read in each batch.
+          */
+        virtual int getBatchSize();
+
+        /**
+          * Provides the samples read in the most recent batch, in the coordinate system defined in the constructor.
+          * A new buffer is allocated for each batch, so the buffer returned is not modified by later updates.
+          *
+          * @return A buffer of Sample3D values, in milli-g, oldest first. Empty if batched operation has not been used.
+          */
+        ManagedBuffer getBatch();
+
         /**
          * Configures the accelerometer for G range and sample rate defined
          * in this object. The nearest values are chosen to those defined
@@ -213,6 +253,17 @@ namespace codal
          */
         virtual int update();
 
+        /**
+         * Stores a block of samples read from the hardware FIFO, and performs gesture tracking on each in turn.
+         * The last sample of the block becomes the current sample, and a single ACCELEROMETER_EVT_DATA_UPDATE event is raised.
+         *
+         * @param samples The samples read, oldest first, in raw ENU format (milli-g).
+         * @param count The number of samples.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES.
+         */
+        int updateBatch(const Sample3D *samples, int count);
+
         /**
           * Reads the last accelerometer value stored, and provides it in the coordinate system requested.
           *
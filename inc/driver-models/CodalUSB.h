@@ -244,6 +244,8 @@ class CodalUSBInterface
 {
 public:
     uint8_t interfaceIdx;
+    // first of the endpoint numbers reserved by getExtraEndpointCount()
+    uint8_t extraEndpointIdx;
     UsbEndpointIn *in;
     UsbEndpointOut *out;
     CodalUSBInterface *next;
@@ -253,6 +255,7 @@ public:
         in = 0;
         out = 0;
         interfaceIdx = 0;
+        extraEndpointIdx = 0;
         next = NULL;
     }
 
@@ -263,6 +266,15 @@ public:
     virtual const InterfaceInfo *getInterfaceInfo() { return NULL; }
     void fillInterfaceInfo(InterfaceDescriptor *desc);
     virtual bool enableWebUSB() { return false; }
+    // number of consecutive interface numbers used, starting at interfaceIdx
+    virtual int getInterfaceCount() { return 1; }
+    // interfaces needing more than getInterfaceInfo() can express (several interfaces, alternate
+    // settings, class specific endpoint descriptors) build their own descriptors here;
+    // returns their size (only writing them when buf is not NULL), or 0 to use getInterfaceInfo()
+    virtual int fillDescriptors(uint8_t *buf) { return 0; }
+    // number of endpoint numbers needed in addition to those of in and out (eg. for a feedback
+    // endpoint); they are never shared, and are numbered consecutively from extraEndpointIdx
+    virtual int getExtraEndpointCount() { return 0; }
 };
 
 class CodalDummyUSBInterface : public CodalUSBInterface {
@@ -40,6 +40,7 @@ DEALINGS IN THE SOFTWARE.
 #define COMPASS_STATUS_CALIBRATED               0x02
 #define COMPASS_STATUS_CALIBRATING              0x04
 #define COMPASS_STATUS_ADDED_TO_IDLE            0x08
+#define COMPASS_STATUS_ONLINE_CALIBRATION       0x10
 
 /**
   * Accelerometer events
@@ -48,6 +49,45 @@ DEALINGS IN THE SOFTWARE.
 #define COMPASS_EVT_CONFIG_NEEDED               2
 #define COMPASS_EVT_CALIBRATE                   3
 #define COMPASS_EVT_CALIBRATION_NEEDED          4
+#define COMPASS_EVT_CALIBRATION_UPDATED         5
+
+/**
+  * Online calibration configuration.
+  */
+
+// The effective number of samples contributing to the fit. Older samples are progressively forgotten.
+#ifndef COMPASS_CALIBRATION_WINDOW
+#define COMPASS_CALIBRATION_WINDOW              128
+#endif
+
+// The minimum number of samples collected before a calibration is published.
+#ifndef COMPASS_CALIBRATION_MIN_SAMPLES
+#define COMPASS_CALIBRATION_MIN_SAMPLES         48
+#endif
+
+// The number of samples collected between each solution of the fit.
+#ifndef COMPASS_CALIBRATION_SOLVE_INTERVAL
+#define COMPASS_CALIBRATION_SOLVE_INTERVAL      16
+#endif
+
+// The minimum change in field, as a fraction of its strength, for a sample to be collected.
+// This stops the fit from being dominated by the device sitting still.
+#ifndef COMPASS_CALIBRATION_MIN_DISTANCE
+#define COMPASS_CALIBRATION_MIN_DISTANCE        0.1f
+#endif
+
+// The fraction of each axis (relative to the diameter of the fitted ellipsoid) that the samples must span.
+#ifndef COMPASS_CALIBRATION_MIN_COVERAGE
+#define COMPASS_CALIBRATION_MIN_COVERAGE        0.6f
+#endif
+
+// The largest ratio between the fitted radii in each axis that is considered plausible.
+#ifndef COMPASS_CALIBRATION_MAX_ELLIPTICITY
+#define COMPASS_CALIBRATION_MAX_ELLIPTICITY     2.0f
+#endif
+
+// The key used to persist the calibration in a KeyValueStorage.
+#define COMPASS_CALIBRATION_KEY                 "compassCal"
 
 namespace codal
 {
@@ -64,6 +104,56 @@ namespace codal
         }
     };
 
+    class KeyValueStorage;
+
+    /**
+     * An incremental, bounded memory estimator of compass calibration.
+     *
+     * Fits an axis aligned ellipsoid (a x^2 + b y^2 + c z^2 + d x + e y + f z = 1) to the raw samples of a magnetometer,
+     * giving the hard iron offset (centre) and soft iron distortion (scale in each axis). Only the normal equations of the
+     * least squares fit are held, with older samples progressively forgotten, so the cost per sample and the memory used are
+     * constant regardless of how long the calibrator runs.
+     */
+    class CompassCalibrator
+    {
+        float       normal[6][6];           // The normal matrix of the fit (sum of outer products of each sample's terms).
+        float       target[6];              // The right hand side of the normal equations.
+        float       last[3];                // The most recently collected sample, normalised.
+        float       low[3];                 // The smallest value collected in each axis, normalised.
+        float       high[3];                // The largest value collected in each axis, normalised.
+        float       normalisation;          // Divisor applied to raw samples, to keep the fit well conditioned.
+        int         samples;                // The number of samples collected.
+        CompassCalibration  published;      // The most recently published calibration.
+
+        public:
+
+        /**
+          * Constructor.
+          */
+        CompassCalibrator();
+
+        /**
+          * Discards all collected samples.
+          */
+        void reset();
+
+        /**
+          * Considers a raw sample for inclusion in the fit.
+          *
+          * @param sample The uncalibrated sample.
+          * @param result Receives a new calibration, when one is available.
+          * @return true if a new calibration has been written to result, false otherwise.
+          */
+        bool addSample(const Sample3D &sample, CompassCalibration &result);
+
+        private:
+
+        /**
+          * Solves the normal equations, and checks that the resulting ellipsoid is plausible.
+          */
+        bool solve(CompassCalibration &result);
+    };
+
     /**
      * Class definition for a general e-compass.
      */
@@ -77,6 +167,7 @@ namespace codal
         Sample3D              sampleENU;          // The last sample read, in raw ENU format (stored in case requests are made for data in other coordinate spaces)
         CoordinateSpace       &coordinateSpace;   // The coordinate space transform (if any) to apply to the raw data from the hardware.
         Accelerometer*        accelerometer;      // The accelerometer to use for tilt compensation.
+        CompassCalibrator*    calibrator;         // The online calibrator, if enabled.
 
         public:
 
@@ -180,6 +271,36 @@ namespace codal
          */
         void clearCalibration();
 
+        /**
+         * Enables or disables online calibration.
+         *
+         * When enabled, the calibration is continuously refined from the normal stream of samples, without blocking.
+         * Once enough of the sphere of possible orientations has been seen, the calibration is applied and a
+         * COMPASS_EVT_CALIBRATION_UPDATED event is raised. Further events are raised as the calibration changes significantly
+         * (for instance, if the device is moved into a different magnetic environment), which an application may use to persist it.
+         * While online calibration is enabled, heading() does not block waiting for the user to calibrate the compass.
+         *
+         * @param enable true to enable online calibration, false to disable it.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES.
+         */
+        int setOnlineCalibration(bool enable);
+
+        /**
+         * Stores the current calibration in the given storage, so that it may be restored after a reset.
+         *
+         * @param storage The storage to use.
+         * @return DEVICE_OK on success, DEVICE_CALIBRATION_REQUIRED if the compass is not calibrated, or DEVICE_NO_RESOURCES.
+         */
+        int saveCalibration(KeyValueStorage &storage);
+
+        /**
+         * Restores a calibration previously stored with saveCalibration().
+         *
+         * @param storage The storage to use.
+         * @return DEVICE_OK on success, or DEVICE_NO_DATA if no calibration has been stored.
+         */
+        int loadCalibration(KeyValueStorage &storage);
+
         /**
          * Defines the accelerometer to be used for tilt compensation.
          *
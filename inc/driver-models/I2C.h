@@ -28,6 +28,16 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalConfig.h"
 #include "ErrorNo.h"
 #include "Pin.h"
+#include "CodalFiber.h"
+
+// The maximum number of segments that may be held in a single I2CTransaction.
+#ifndef I2C_TRANSACTION_MAX_SEGMENTS
+#define I2C_TRANSACTION_MAX_SEGMENTS    4
+#endif
+
+// Direction of an I2CSegment.
+#define I2C_SEGMENT_WRITE               0x00
+#define I2C_SEGMENT_READ                0x01
 
 namespace codal
 {
@@ -37,6 +47,64 @@ namespace codal
 
 enum AcknowledgeType {ACK, NACK};
 
+/**
+  * A single write or read phase of an I2CTransaction.
+  * Consecutive segments are separated by a repeated START condition.
+  */
+struct I2CSegment
+{
+    uint8_t     *data;              // Bytes to write, or the buffer to read into.
+    uint16_t    length;             // Number of bytes to transfer.
+    uint8_t     flags;              // I2C_SEGMENT_WRITE or I2C_SEGMENT_READ.
+};
+
+struct I2CTransaction;
+
+typedef void (*I2CCallback)(I2CTransaction *);
+
+/**
+  * A sequence of segments to be performed with a single device, as one bus transaction
+  * (START, segments separated by repeated STARTs, STOP).
+  *
+  * Transactions are queued with I2C::submit(), and must remain valid until they complete.
+  */
+struct I2CTransaction
+{
+    I2CTransaction  *next;                                      // Next transaction in the queue of the bus.
+    uint16_t        address;                                    // The 8 bit I2C address of the device.
+    uint8_t         segmentCount;                               // Number of segments in use.
+    I2CSegment      segments[I2C_TRANSACTION_MAX_SEGMENTS];
+    volatile int    status;                                     // DEVICE_BUSY while queued or in progress, then the result of the transaction.
+    I2CCallback     callback;                                   // Called on completion, if not NULL. May be called in interrupt context.
+    void            *context;                                   // Available for use by the owner of the transaction.
+    FiberLock       *lock;                                      // Notified on completion, if not NULL.
+
+    /**
+      * Constructor. Creates an empty transaction with the given device.
+      *
+      * @param address The 8bit I2C address of the device.
+      */
+    I2CTransaction(uint16_t address = 0);
+
+    /**
+      * Appends a write segment to this transaction.
+      *
+      * @param data The bytes to write. These are not copied.
+      * @param length The number of bytes to write.
+      * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the transaction is full.
+      */
+    int write(uint8_t *data, int length);
+
+    /**
+      * Appends a read segment to this transaction.
+      *
+      * @param data The buffer to read into.
+      * @param length The number of bytes to read.
+      * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the transaction is full.
+      */
+    int read(uint8_t *data, int length);
+};
+
 class I2C : public PinPeripheral
 {
 public:
@@ -79,6 +147,48 @@ protected:
     */
     virtual int read(AcknowledgeType ack = ACK);
 
+    I2CTransaction *transactions;   // Queue of pending transactions. The head of the queue is the one in progress.
+    bool synchronous;               // Set while a transaction is being performed synchronously by processQueue().
+
+    /**
+      * Begins the given transaction using asynchronous (interrupt or DMA driven) hardware.
+      *
+      * Drivers that support asynchronous operation should override this method, start the transfer, and return DEVICE_OK
+      * without waiting. They must then call transactionComplete() (typically from their interrupt handler) once the
+      * transaction has finished. The default implementation returns DEVICE_NOT_SUPPORTED, in which case the transaction
+      * is performed synchronously with the blocking read() and write() operations.
+      *
+      * @param t The transaction to perform.
+      * @return DEVICE_OK if the transaction was started, or DEVICE_NOT_SUPPORTED.
+      */
+    virtual int startTransaction(I2CTransaction *t);
+
+    /**
+      * Records the result of the transaction in progress, notifies its owner, and starts the next queued transaction.
+      *
+      * @param status DEVICE_OK on success, or DEVICE_I2C_ERROR.
+      */
+    void transactionComplete(int status);
+
+    /**
+      * Removes the transaction in progress from the queue, records its status and notifies its owner.
+      */
+    void completeTransaction(int status);
+
+    /**
+      * Performs a transaction synchronously, with the blocking read() and write() operations.
+      *
+      * @param t The transaction to perform.
+      * @return DEVICE_OK on success, or DEVICE_I2C_ERROR.
+      */
+    int performTransaction(I2CTransaction *t);
+
+    /**
+      * Starts the transaction at the head of the queue, running queued transactions back to back
+      * until the queue is empty or an asynchronous transfer is in progress.
+      */
+    void processQueue();
+
 public:
     /**
       * Change the pins used by this I2C peripheral to those provided.
@@ -200,6 +310,41 @@ public:
      * @return the byte read on success, DEVICE_INVALID_PARAMETER or DEVICE_I2C_ERROR if the the read request failed.
      */
     virtual int readRegister(uint8_t address, uint8_t reg);
+
+    /**
+      * Queues a transaction to be performed as soon as the bus is free, and returns immediately.
+      * Queued transactions are performed back to back in the order they are submitted.
+      *
+      * On completion the status of the transaction is updated, its callback (if any) is invoked and its lock (if any) is notified.
+      * If the driver does not support asynchronous operation, the transaction is performed before this call returns.
+      *
+      * @param t The transaction to queue. This must remain valid until the transaction completes.
+      * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_BUSY if the transaction is already queued.
+      */
+    int submit(I2CTransaction *t);
+
+    /**
+      * Queues a transaction, and blocks the calling fiber (but not the scheduler) until it completes.
+      *
+      * @param t The transaction to perform.
+      * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, DEVICE_BUSY or DEVICE_I2C_ERROR.
+      */
+    int transfer(I2CTransaction *t);
+
+    /**
+      * Performs a typical register read operation as a single queued transaction, using a repeated START.
+      *
+      * Only the calling fiber is blocked while the transfer takes place, so other fibers continue to run
+      * on drivers that support asynchronous operation.
+      *
+      * @param address 8bit I2C address of the device to read from
+      * @param reg The 8bit register address of the to read.
+      * @param data A pointer to a memory location to store the result of the read operation
+      * @param length The number of bytes to read
+      *
+      * @return DEVICE_OK, DEVICE_INVALID_PARAMETER or DEVICE_I2C_ERROR if the the read request failed.
+      */
+    int readRegisterAsync(uint16_t address, uint8_t reg, uint8_t *data, int length);
 };
 }
 
@@ -47,6 +47,17 @@ public:
     virtual int eraseSmallRow(uint32_t addr) = 0;
     virtual int eraseBigRow(uint32_t addr) = 0;
     virtual int eraseChip() = 0;
+
+    /**
+     * Programs a buffer of any length, splitting it into writeBytes() calls at page boundaries.
+     * The region must have been erased beforehand.
+     *
+     * @param addr The address to start writing at.
+     * @param buffer The data to write.
+     * @param len The number of bytes to write.
+     * @return DEVICE_OK, or the error returned by writeBytes().
+     */
+    int writeBuffer(uint32_t addr, const void *buffer, uint32_t len);
 };
 }
 
@@ -27,6 +27,7 @@ DEALINGS IN THE SOFTWARE.
 
 #include "Display.h"
 #include "BitmapFont.h"
+#include "PackedImage.h"
 
 /**
   * Event codes raised by a Display
@@ -104,16 +105,19 @@ namespace codal
 
         //
         // State for scrollString() method.
-        // This is a surprisingly intricate method.
+        // The text is rendered once, when the scroll starts, and each frame is a window onto it.
         //
-        // The text being displayed.
-        ManagedString scrollingText;
+        // The text being displayed, pre-rendered as the packed glyph columns of each character, without the gaps between them.
+        PackedImage scrollingStrip;
 
-        // The index of the character currently being displayed.
-        int16_t scrollingChar;
+        // The contents of the display when the scroll started, which scroll off to the left ahead of the text.
+        Image scrollingBackground;
+
+        // The number of pixels the display has been shifted since the scroll started.
+        int scrollingPosition;
 
-        // The number of pixels the current character has been shifted on the display.
-        int8_t scrollingPosition;
+        // The number of pixels the display is shifted in total, before the scroll is complete.
+        int scrollingLength;
 
         //
         // State for printString() method.
@@ -153,10 +157,19 @@ namespace codal
 
         /**
          * Internal scrollText update method.
-         * Shift the screen image by one pixel to the left. If necessary, paste in the next char.
+         * Shift the screen image by one pixel to the left, by drawing the next window of the pre-rendered text.
          */
         void updateScrollText();
 
+        /**
+         * Renders the given string into scrollingStrip, ready to be scrolled across the display.
+         *
+         * @param s The string to render.
+         *
+         * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the string is too long to be rendered.
+         */
+        int renderScrollText(ManagedString s);
+
         /**
          * Internal printText update method.
          * Paste the next character in the string.
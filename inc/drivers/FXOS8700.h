@@ -162,6 +162,11 @@ DEALINGS IN THE SOFTWARE.
 #define FXOS8700_STATUS_DATA_READY  0x07
 #define FXOS8700_WHOAMI_VAL         0xC7
 
+// FIFO constants
+#define FXOS8700_FIFO_DEPTH         32
+#define FXOS8700_F_STATUS_COUNT     0x3F
+#define FXOS8700_F_MODE_CIRCULAR    0x40
+
 /**
   * Term to convert sample data into SI units. 
   */
@@ -247,6 +252,14 @@ class FXOS8700 : public Accelerometer, public Compass
           */
         ~FXOS8700();
 
+        private:
+
+        /**
+          * Drains the accelerometer samples held in the FIFO with a single burst read, and reads the latest magnetometer sample.
+          *
+          * @return DEVICE_OK on success, DEVICE_I2C_ERROR if the read request fails.
+          */
+        int requestBatch();
     };
 }
 
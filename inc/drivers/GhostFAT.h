@@ -53,8 +53,14 @@ struct GFATEntry
 
 class GhostFAT : public USBMSC
 {
+    GFATEntry **index; // entries by start cluster, built by finalizeFiles()
+    int numEntries;
+    uint8_t *blockBuf;
+
     void buildBlock(uint32_t block_no, uint8_t *data);
+    void buildFATBlock(uint32_t sectionIdx, uint16_t *dest);
     void readDirData(uint8_t *dest, int blkno, uint8_t dirid);
+    int findEntry(uint32_t cluster);
 
 protected:
     GFATEntry *files;
@@ -36,6 +36,13 @@ DEALINGS IN THE SOFTWARE.
 #define HID_REQUEST_SET_IDLE 0x0A
 #define HID_REQUEST_SET_PROTOCOL 0x0B
 
+// the number of input reports that may be waiting for the host to poll the interface
+#ifndef HID_REPORT_QUEUE_SIZE
+#define HID_REPORT_QUEUE_SIZE 16
+#endif
+
+#define HID_REPORT_MAX_SIZE 16
+
 namespace codal
 {
     typedef struct {
@@ -48,14 +55,58 @@ namespace codal
         uint16_t sizeOfReport;
     } __attribute__((packed)) HIDReportDescriptor;
 
+    typedef struct {
+        uint8_t len;
+        uint8_t data[HID_REPORT_MAX_SIZE];
+    } HIDQueuedReport;
+
     class USBHID : public CodalUSBInterface
     {
+        HIDQueuedReport reportQueue[HID_REPORT_QUEUE_SIZE];
+        volatile uint8_t reportHead;
+        volatile uint8_t reportCount;
+        volatile bool reportSending;
+
+        void sendReports();
+        static void drainReports(void *hid);
+
+        protected:
+
+        /**
+          * Adds an input report to the queue, and returns without waiting for the host to collect it.
+          * If the queue is full, waits until there is space.
+          *
+          * @param report The report, including its report ID if the interface uses them.
+          * @param len The length of the report, up to HID_REPORT_MAX_SIZE.
+          *
+          * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_INVALID_STATE if USB is not initialised.
+          */
+        int queueReport(const void *report, int len);
+
+        /**
+          * Called when a report is queued behind one of the same length that hasn't been sent yet.
+          * Interfaces can combine the two into the queued report, so the host sees the same result from one report.
+          *
+          * @param queued The report waiting to be sent, which may be updated.
+          * @param report The new report.
+          * @param len The length of both reports.
+          *
+          * @return true if the new report was merged into the queued one, and need not be sent.
+          */
+        virtual bool mergeReport(uint8_t *queued, const uint8_t *report, int len) { return false; }
+
         public:
         USBHID();
 
         virtual int classRequest(UsbEndpointIn &ctrl, USBSetup& setup);
         virtual int stdRequest(UsbEndpointIn &ctrl, USBSetup& setup);
         virtual const InterfaceInfo *getInterfaceInfo();
+        virtual int endpointRequest();
+
+        /**
+          * Returns the number of reports waiting to be collected by the host.
+          */
+        int getQueuedReports() { return reportCount; }
     };
 }
 
@@ -62,6 +62,7 @@ public:
 
 private:
         int sendReport();
+        virtual bool mergeReport(uint8_t *queued, const uint8_t *report, int len);
     };
 }
 
@@ -63,12 +63,17 @@ namespace codal
         uint8_t keyStateConsumer[HID_KEYBOARD_KEYSTATE_SIZE_CONSUMER];
 
         /**
-          * Writes the given report out over USB.
+          * Queues the given report to be sent over USB.
           *
           * @param report A pointer to the report to copy to USB
           */
         int updateReport(HIDKeyboardReport* report);
 
+        /**
+          * Drops a report that repeats the one queued before it, as the host would see no change.
+          */
+        virtual bool mergeReport(uint8_t *queued, const uint8_t *report, int len);
+
         /**
           * sets the media key buffer to the given Key, without affecting the state of other media keys.
           *
@@ -251,6 +256,9 @@ namespace codal
         /**
           * Type a sequence of characters
           *
+          * Reports are queued, so this returns before the host has seen them all. Once HID_REPORT_QUEUE_SIZE
+          * reports are waiting, it waits for the host to collect them.
+          *
           * @param s A valid pointer to a char array
           *
           * @param len The length of s.
@@ -74,6 +74,14 @@ DEALINGS IN THE SOFTWARE.
 #define LIS3DH_INT2_THS        0x36
 #define LIS3DH_INT2_DURATION   0x37
 
+/**
+  * FIFO constants
+  */
+#define LIS3DH_FIFO_DEPTH      32
+#define LIS3DH_FIFO_EMPTY      0x20
+#define LIS3DH_FIFO_OVERRUN    0x40
+#define LIS3DH_FIFO_COUNT_MASK 0x1F
+
 /**
   * MMA8653 constants
   */
@@ -157,6 +165,15 @@ namespace codal
          */
         virtual int requestUpdate() override;
 
+        private:
+
+        /**
+          * Converts a single raw XYZ sample read from the device into milli-g, in ENU format.
+          */
+        Sample3D convertSample(int8_t *data);
+
+        public:
+
         /**
           * Destructor.
           */
@@ -87,6 +87,10 @@ DEALINGS IN THE SOFTWARE.
   */
 #define LSM303_A_WHOAMI_VAL           0x33
 #define LSM303_A_STATUS_DATA_READY    0x08
+#define LSM303_A_FIFO_DEPTH           32
+#define LSM303_A_FIFO_EMPTY           0x20
+#define LSM303_A_FIFO_OVERRUN         0x40
+#define LSM303_A_FIFO_COUNT_MASK      0x1F
 
 /**
  * LSM303 Status flags
@@ -168,6 +172,15 @@ namespace codal
       * Destructor.
       */
     ~LSM303Accelerometer();
+
+    private:
+
+    /**
+      * Drains the samples held in the FIFO with a single burst read.
+      *
+      * @return DEVICE_OK on success, DEVICE_I2C_ERROR if the read request fails.
+      */
+    int requestBatch();
   };
 }
 #endif
@@ -25,16 +25,31 @@ DEALINGS IN THE SOFTWARE.
 #include "Event.h"
 #include "Pin.h"
 #include "CodalFiber.h"
+#include "DataStream.h"
 
 #ifndef CODAL_PULSE_IN_H
 #define CODAL_PULSE_IN_H
 
 #define DEVICE_EVT_PULSE_IN_TIMEOUT           10000
 
+// The maximum number of PulseIn instances that may be capturing at the same time.
+#ifndef PULSE_IN_MAX_CAPTURES
+#define PULSE_IN_MAX_CAPTURES                 4
+#endif
+
+// The default number of edges held by the capture ring.
+#ifndef PULSE_IN_DEFAULT_CAPTURE_SIZE
+#define PULSE_IN_DEFAULT_CAPTURE_SIZE         128
+#endif
+
+// Set in a captured duration if the pin was high during that period.
+#define PULSE_IN_LEVEL_HIGH                   0x80000000
+#define PULSE_IN_DURATION_MASK                0x7FFFFFFF
+
 namespace codal
 {
 
-class PulseIn : public PinPeripheral
+class PulseIn : public PinPeripheral, public DataSource
 {
     Pin             &pin;
     uint32_t        lastPeriod;
@@ -43,6 +58,17 @@ class PulseIn : public PinPeripheral
     static bool     timeoutGeneratorStarted;
     bool            enabled;
 
+    uint32_t        *ring;                  // Captured durations, when capturing.
+    int             ringSize;               // The number of entries in the ring.
+    volatile int    head;                   // The entry the next duration is written to.
+    volatile int    tail;                   // The oldest unread entry.
+    int             slot;                   // The capture slot in use, or -1 when not capturing.
+    int             watermark;              // The number of durations at which the downstream component is notified.
+    CODAL_TIMESTAMP lastEdgeTime;           // The time of the previous edge, or zero.
+    uint32_t        overflows;              // The number of durations dropped as the ring was full.
+    DataSink        *downstream;            // The component consuming captured durations, if any.
+    bool            pullRequested;          // Set once the downstream component has been notified of data.
+
     public:
     uint32_t        lastEdge;
     
@@ -74,6 +100,84 @@ class PulseIn : public PinPeripheral
     void
     onTimeout(Event e);
 
+    /**
+     * Starts recording the time between every edge on the pin into a ring buffer, without raising an event per pulse.
+     * While capturing, awaitPulse() is unavailable.
+     *
+     * Each captured duration is a number of microseconds, ORed with PULSE_IN_LEVEL_HIGH if the pin was high during that period.
+     *
+     * @param size The number of durations the ring can hold.
+     * @param watermark The number of unread durations at which a connected DataSink is notified. Defaults to half the ring.
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, DEVICE_NO_RESOURCES, or DEVICE_NOT_SUPPORTED if the pin cannot interrupt on edges.
+     */
+    int startCapture(int size = PULSE_IN_DEFAULT_CAPTURE_SIZE, int watermark = 0);
+
+    /**
+     * Stops recording edges, and releases the ring buffer. Unread durations are discarded.
+     */
+    void stopCapture();
+
+    /**
+     * Determines if edges are being captured.
+     */
+    bool isCapturing();
+
+    /**
+     * Determines the number of captured durations waiting to be read.
+     */
+    int available();
+
+    /**
+     * Reads captured durations, oldest first.
+     *
+     * @param durations The buffer to fill.
+     * @param count The maximum number of durations to read.
+     * @return The number of durations read.
+     */
+    int read(uint32_t *durations, int count);
+
+    /**
+     * Determines the number of durations dropped since capture started, because the ring was full.
+     */
+    uint32_t getOverflowCount();
+
+    /**
+     * Records an edge. Called from interrupt context while capturing.
+     *
+     * @param state The new state of the pin.
+     */
+    void onEdge(int state);
+
+    /**
+     * Provides all unread durations, as DATASTREAM_FORMAT_32BIT_UNSIGNED values.
+     */
+    virtual ManagedBuffer pull();
+
+    /**
+     * Define a downstream component for captured durations.
+     *
+     * @sink The component that data will be delivered to, when it is available
+     */
+    virtual void connect(DataSink &sink);
+
+    /**
+     * Determines if this source is connected to a downstream component
+     *
+     * @return true If a downstream is connected
+     * @return false If a downstream is not connected
+     */
+    virtual bool isConnected();
+
+    /**
+     * Disconnects the downstream component.
+     */
+    virtual void disconnect();
+
+    /**
+     *  Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat();
+
     /**
     * Method to release the given pin from a peripheral, if already bound.
     * Device drivers should override this method to disconnect themselves from the give pin
@@ -0,0 +1,185 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_SPIFLASH_FTL_H
+#define CODAL_SPIFLASH_FTL_H
+
+#include "CodalComponent.h"
+#include "CodalFiber.h"
+#include "SPIFlash.h"
+
+// each 4k row holds a header page, followed by 15 sectors of one page each
+#define SPIFLASH_FTL_SECTOR_SIZE SPIFLASH_PAGE_SIZE
+#define SPIFLASH_FTL_ROW_SIZE SPIFLASH_SMALL_ROW_SIZE
+#define SPIFLASH_FTL_SECTORS_PER_ROW (SPIFLASH_FTL_ROW_SIZE / SPIFLASH_FTL_SECTOR_SIZE - 1)
+
+// rows held back from the logical capacity, so that garbage collection can always make progress
+#ifndef SPIFLASH_FTL_RESERVED_ROWS
+#define SPIFLASH_FTL_RESERVED_ROWS 3
+#endif
+
+// background garbage collection runs until this many erased rows are available
+#ifndef SPIFLASH_FTL_GC_FREE_ROWS
+#define SPIFLASH_FTL_GC_FREE_ROWS 3
+#endif
+
+// once the most worn row has this many more erases than the least worn row holding data,
+// the data in the least worn row is moved, so the row can be reused
+#ifndef SPIFLASH_FTL_WEAR_THRESHOLD
+#define SPIFLASH_FTL_WEAR_THRESHOLD 16
+#endif
+
+// the map uses 16 bit sector numbers
+#define SPIFLASH_FTL_MAX_ROWS (0xfffe / SPIFLASH_FTL_SECTORS_PER_ROW)
+
+#define SPIFLASH_FTL_EVT_GC 1
+
+namespace codal
+{
+
+/**
+ * A flash translation layer, presenting an SPI flash chip as an array of logical 256 byte sectors
+ * that can be rewritten at will.
+ *
+ * Writes never overwrite data in place. Each write goes to the next pre-erased sector of the current
+ * row, and is recorded in the row's header page as a journal entry holding the logical sector number
+ * and a sequence number. Superseded copies become garbage, which is reclaimed by copying any live
+ * sectors out of a row and erasing it; this normally happens on a background fiber, ahead of demand.
+ * Erased rows are reused least-worn first, and rows holding static data are recycled once they fall
+ * too far behind in wear.
+ *
+ * All state is rebuilt from the journal when the layer starts, with the newest copy of each sector
+ * winning, so a power failure at any point loses at most the write in progress.
+ *
+ * RAM use is 2 bytes per logical sector, plus 6 bytes per row.
+ */
+class SPIFlashFTL : public CodalComponent
+{
+    SPIFlash &flash;
+    uint32_t offset;
+    uint16_t rows;
+    uint16_t sectors;
+    uint16_t *map;
+    uint8_t *rowValid;
+    uint8_t *rowFlags;
+    uint32_t *rowErases;
+    uint8_t *buffer;
+    uint16_t freeRows;
+    int activeRow;
+    int activeNext;
+    uint32_t sequence;
+    uint32_t eraseCount;
+    uint32_t programCount;
+    bool collecting;
+    bool wearPending;
+    FiberLock lock;
+
+    int readEntry(int slot, uint32_t *seq, uint16_t *sector);
+    int eraseRow(int row);
+    int allocateSlot(bool forGC);
+    int writeSlot(int slot, uint16_t sector, const void *data);
+    int pickVictim(bool wear);
+    int collectRow(bool wear);
+    void requestCollection();
+    void onCollect(Event);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param flash The flash chip to use.
+     * @param offset The address of the region of the flash to use, rounded up to a whole row.
+     * @param size The size of the region in bytes, or 0 to use the rest of the flash.
+     * @param id The id to use for the message bus when transmitting events.
+     */
+    SPIFlashFTL(SPIFlash &flash, uint32_t offset = 0, uint32_t size = 0,
+                uint16_t id = CodalComponent::generateDynamicID());
+
+    ~SPIFlashFTL();
+
+    /**
+     * Rebuilds the sector map from the journal held in flash. Called automatically on first use.
+     * A region that has never been used (or holds other data) appears as a blank disk.
+     *
+     * @return DEVICE_OK, DEVICE_NO_RESOURCES, or the error returned by the flash.
+     */
+    virtual int init();
+
+    /**
+     * Discards all data, erasing every row of the region.
+     *
+     * @return DEVICE_OK, or the error returned by the flash.
+     */
+    int format();
+
+    /**
+     * Returns the number of logical sectors available.
+     */
+    int getSectorCount();
+
+    /**
+     * Reads a logical sector. Sectors that have never been written read as 0xff.
+     *
+     * @param sector The sector to read.
+     * @param data Buffer of SPIFLASH_FTL_SECTOR_SIZE bytes to receive the data.
+     * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or the error returned by the flash.
+     */
+    int read(int sector, void *data);
+
+    /**
+     * Writes a logical sector.
+     *
+     * @param sector The sector to write.
+     * @param data SPIFLASH_FTL_SECTOR_SIZE bytes of data.
+     * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, DEVICE_NO_RESOURCES, or the error returned by the flash.
+     */
+    int write(int sector, const void *data);
+
+    /**
+     * Reclaims garbage until SPIFLASH_FTL_GC_FREE_ROWS erased rows are available, or no more can be reclaimed.
+     * This normally happens in the background, but may be called before a burst of writes.
+     *
+     * @return DEVICE_OK, or the error returned by the flash.
+     */
+    int collect();
+
+    /**
+     * Returns the number of rows erased since the layer started.
+     */
+    uint32_t getEraseCount() { return eraseCount; }
+
+    /**
+     * Returns the number of sectors programmed since the layer started, including those moved
+     * by garbage collection.
+     */
+    uint32_t getProgramCount() { return programCount; }
+
+    /**
+     * Returns the difference in erase count between the most and least worn rows.
+     */
+    uint32_t getWearSpread();
+};
+}
+
+#endif
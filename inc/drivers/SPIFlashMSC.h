@@ -0,0 +1,122 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef DEVICE_SPIFLASH_MSC_H
+#define DEVICE_SPIFLASH_MSC_H
+
+#include "USBMSC.h"
+#include "SPIFlash.h"
+#include "CodalFiber.h"
+
+#if CONFIG_ENABLED(DEVICE_USB)
+
+#define SPIFLASH_MSC_BLOCK_SIZE 512
+#define SPIFLASH_MSC_ROW_SIZE SPIFLASH_SMALL_ROW_SIZE
+#define SPIFLASH_MSC_BLOCKS_PER_ROW (SPIFLASH_MSC_ROW_SIZE / SPIFLASH_MSC_BLOCK_SIZE)
+
+// number of 4k erase rows held in the RAM write-back cache
+#ifndef SPIFLASH_MSC_CACHE_ROWS
+#define SPIFLASH_MSC_CACHE_ROWS 2
+#endif
+
+// time without writes from the host after which the cache is written to flash (ms)
+#ifndef SPIFLASH_MSC_FLUSH_DELAY
+#define SPIFLASH_MSC_FLUSH_DELAY 500
+#endif
+
+// raised on DEVICE_ID_MSC by the idle timer; values 1 and 2 are used by USBMSC
+#define SPIFLASH_MSC_EVT_FLUSH 3
+
+namespace codal
+{
+
+struct SPIFlashMSCRow
+{
+    uint32_t addr;     // flash address of the row, or 0xffffffff if unused
+    uint32_t lastUsed; // for least-recently-used replacement
+    uint8_t valid;     // bitmask of blocks held in data
+    uint8_t dirty;     // bitmask of blocks changed since the row was written to flash
+    uint8_t *data;
+};
+
+/**
+ * A read/write USB mass storage device, stored in a region of an SPI flash chip.
+ *
+ * The host reads and writes 512 byte blocks, while the flash can only be erased in 4k rows.
+ * Writes are collected in a small RAM cache of whole rows, and each row is written back to flash
+ * when it is evicted, or once the host has stopped writing for SPIFLASH_MSC_FLUSH_DELAY ms.
+ * A row is only erased when the new data needs a bit to go from 0 to 1; rows that are unchanged
+ * are not written at all. Only the blocks the host didn't write are read back before an erase.
+ */
+class SPIFlashMSC : public USBMSC
+{
+    SPIFlash &flash;
+    uint32_t offset;
+    uint32_t size;
+    SPIFlashMSCRow cache[SPIFLASH_MSC_CACHE_ROWS];
+    uint32_t useCount;
+    uint32_t eraseCount;
+    CODAL_TIMESTAMP lastWrite;
+    bool flushPending;
+    bool listening;
+    FiberLock lock;
+
+    SPIFlashMSCRow *findRow(uint32_t addr);
+    SPIFlashMSCRow *getRow(uint32_t addr);
+    int flushRow(SPIFlashMSCRow *row);
+    void onFlushTimer(Event);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param flash The flash chip to store the disk in.
+     * @param offset The address of the start of the disk in the flash, rounded up to a whole row.
+     * @param size The size of the disk in bytes, or 0 to use the rest of the flash.
+     */
+    SPIFlashMSC(SPIFlash &flash, uint32_t offset = 0, uint32_t size = 0);
+
+    ~SPIFlashMSC();
+
+    virtual uint32_t getCapacity();
+    virtual void readBlocks(int blockAddr, int numBlocks);
+    virtual void writeBlocks(int blockAddr, int numBlocks);
+
+    /**
+     * Writes any changes held in the cache to flash.
+     *
+     * @return DEVICE_OK, or the error returned by the flash.
+     */
+    int flush();
+
+    /**
+     * Returns the number of rows erased since the disk was created.
+     */
+    uint32_t getEraseCount() { return eraseCount; }
+};
+}
+
+#endif
+
+#endif
@@ -69,6 +69,7 @@ protected:
     void sendWords(unsigned numBytes);
     void startTransfer(unsigned size);
     void sendBytes(unsigned num);
+    void sendPacked(unsigned numBytes);
     void startRAMWR(int cmd = 0);
 
     static void sendColorsStep(ST7735 *st);
@@ -94,6 +95,14 @@ public:
      * NULL if unchanged).
      */
     int sendIndexedImage(const uint8_t *src, unsigned width, unsigned height, uint32_t *palette);
+    /**
+     * Send 1, 2 or 4 bit indexed color image, in the same column-major layout as sendIndexedImage()
+     * (see PackedImage), using the first 2, 4 or 16 entries of the specified palette (use NULL if
+     * unchanged). Pixels are expanded straight into the transfer buffer, so no intermediate copy of
+     * the image is needed.
+     */
+    int sendPackedImage(const uint8_t *src, unsigned width, unsigned height, int bitsPerPixel,
+                        uint32_t *palette);
     /**
      * Waits for the previous sendIndexedImage() operation to complete (it normally executes in
      * background).
@@ -0,0 +1,209 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_SENSOR_FUSION_H
+#define CODAL_SENSOR_FUSION_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "Accelerometer.h"
+#include "Gyroscope.h"
+#include "Compass.h"
+
+/**
+  * Status flags
+  */
+#define SENSOR_FUSION_ANGLES_VALID              0x02
+#define SENSOR_FUSION_INITIALISED               0x04
+
+/**
+  * Sensor fusion events
+  */
+#define SENSOR_FUSION_EVT_DATA_UPDATE           1
+
+/**
+  * The fixed point representation used for the orientation quaternion and intermediate values (Q4.28).
+  */
+#define SENSOR_FUSION_FIXED_POINT_SHIFT         28
+#define SENSOR_FUSION_ONE                       (1 << SENSOR_FUSION_FIXED_POINT_SHIFT)
+
+/**
+  * Default filter gains. The proportional gain sets how quickly the estimate follows the accelerometer and compass,
+  * and the integral gain how quickly gyroscope bias is learnt (zero to disable).
+  */
+#ifndef SENSOR_FUSION_DEFAULT_KP
+#define SENSOR_FUSION_DEFAULT_KP                1.0f
+#endif
+
+#ifndef SENSOR_FUSION_DEFAULT_KI
+#define SENSOR_FUSION_DEFAULT_KI                0.0f
+#endif
+
+namespace codal
+{
+    /**
+     * An orientation quaternion, with each component in Q4.28 fixed point format.
+     */
+    struct FusionQuaternion
+    {
+        int32_t         w;
+        int32_t         x;
+        int32_t         y;
+        int32_t         z;
+    };
+
+    /**
+     * Class definition for SensorFusion.
+     *
+     * Maintains an estimate of the orientation of the device by combining the readings of a gyroscope, an accelerometer and
+     * (optionally) a compass, using a fixed point Mahony complementary filter. The gyroscope is integrated to track rotation,
+     * while the accelerometer and compass correct the resulting drift in tilt and heading respectively.
+     *
+     * The filter runs each time the gyroscope provides a new sample. All arithmetic is performed in fixed point,
+     * and no memory is allocated after construction. Angles follow the aerospace (NORTH_EAST_DOWN) convention.
+     */
+    class SensorFusion : public CodalComponent
+    {
+        Accelerometer       &accelerometer;     // The accelerometer used to correct tilt.
+        Gyroscope           &gyroscope;         // The gyroscope used to track rotation.
+        Compass             *compass;           // The compass used to correct heading, or NULL.
+
+        FusionQuaternion    q;                  // The current orientation estimate.
+        int32_t             kp;                 // Proportional gain, in Q4.28.
+        int32_t             ki;                 // Integral gain, in Q4.28.
+        int32_t             integral[3];        // Integral error term (estimated gyroscope bias), in Q4.28 radians per second.
+        uint64_t            lastUpdate;         // Time of the previous update, in microseconds.
+        int32_t             heading;            // Heading (yaw), in Q16 degrees.
+        int32_t             pitch;              // Pitch, in Q16 degrees.
+        int32_t             roll;               // Roll, in Q16 degrees.
+        bool                updating;           // Set while an update is in progress.
+
+        public:
+
+        /**
+          * Constructor.
+          * Create a fusion filter combining the given gyroscope, accelerometer and compass.
+          *
+          * @param accelerometer The accelerometer to use.
+          * @param gyroscope The gyroscope to use.
+          * @param compass The compass to use.
+          * @param id the unique EventModel id of this component.
+          */
+        SensorFusion(Accelerometer &accelerometer, Gyroscope &gyroscope, Compass &compass, uint16_t id = CodalComponent::generateDynamicID());
+
+        /**
+          * Constructor.
+          * Create a fusion filter combining the given gyroscope and accelerometer only. Without a compass,
+          * the heading is relative to the orientation at startup, and drifts over time.
+          *
+          * @param accelerometer The accelerometer to use.
+          * @param gyroscope The gyroscope to use.
+          * @param id the unique EventModel id of this component.
+          */
+        SensorFusion(Accelerometer &accelerometer, Gyroscope &gyroscope, uint16_t id = CodalComponent::generateDynamicID());
+
+        /**
+          * Destructor.
+          */
+        ~SensorFusion();
+
+        /**
+          * Defines the gains of the filter.
+          *
+          * @param kp The proportional gain. Larger values follow the accelerometer and compass more closely, but admit more noise.
+          * @param ki The integral gain, used to learn and remove gyroscope bias. Zero to disable.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int setGains(float kp, float ki);
+
+        /**
+          * Resets the orientation estimate. The next update initialises it directly from the accelerometer and compass.
+          */
+        void reset();
+
+        /**
+          * Advances the filter by one step, using the given readings. This is called automatically as the gyroscope is
+          * sampled, but may also be used to process recorded data.
+          *
+          * @param acceleration The acceleration of the device, in milli-g, in the NORTH_EAST_DOWN coordinate system.
+          * @param rotation The angular velocity of the device, in degrees per second, in the NORTH_EAST_DOWN coordinate system.
+          * @param field The magnetic field, in the NORTH_EAST_DOWN coordinate system. Any unit may be used. NULL if not available.
+          * @param period The time since the previous readings, in microseconds.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int update(const Sample3D &acceleration, const Sample3D &rotation, const Sample3D *field, uint32_t period);
+
+        /**
+          * Provides the current orientation estimate.
+          *
+          * @return The rotation from the earth (NORTH_EAST_DOWN) frame to the frame of the device, in Q4.28 format.
+          */
+        FusionQuaternion getQuaternion();
+
+        /**
+          * Provides the tilt compensated heading of the device.
+          *
+          * @return The heading, in degrees clockwise from magnetic north (0..359).
+          */
+        int getHeading();
+
+        /**
+          * Provides the pitch of the device.
+          *
+          * @return The pitch, in degrees (-90..90). Positive when the nose (the x axis) points upwards.
+          */
+        int getPitch();
+
+        /**
+          * Provides the roll of the device.
+          *
+          * @return The roll, in degrees (-180..180). Positive when the right side (the y axis) points downwards.
+          */
+        int getRoll();
+
+        private:
+
+        /**
+          * Common initialisation for all constructors.
+          */
+        void initialiseFilter();
+
+        /**
+          * Runs the filter when new gyroscope data is available.
+          */
+        void onGyroscopeUpdate(Event);
+
+        /**
+          * Sets the orientation estimate directly from the given readings, ignoring history.
+          */
+        void initialiseOrientation(int32_t *a, int32_t *m);
+
+        /**
+          * Recalculates the heading, pitch and roll of the current orientation estimate.
+          */
+        void recalculateAngles();
+    };
+}
+
+#endif
@@ -28,6 +28,22 @@ DEALINGS IN THE SOFTWARE.
 #include "SPIFlash.h"
 #include "SPI.h"
 
+// how often the status of an erase is checked; the bus is free for other fibers in between
+#ifndef STANDARD_SPIFLASH_ERASE_POLL_MS
+#define STANDARD_SPIFLASH_ERASE_POLL_MS 2
+#endif
+
+// time an erase is left to run between a resume and the next suspend, so that it always makes progress
+#ifndef STANDARD_SPIFLASH_RESUME_US
+#define STANDARD_SPIFLASH_RESUME_US 100
+#endif
+
+#define STANDARD_SPIFLASH_ERASING 0x01
+#define STANDARD_SPIFLASH_SUSPENDED 0x02
+#define STANDARD_SPIFLASH_RESUMED 0x04
+#define STANDARD_SPIFLASH_READING 0x08
+#define STANDARD_SPIFLASH_SUSPEND_ENABLED 0x10
+
 namespace codal
 {
 class StandardSPIFlash : public SPIFlash
@@ -36,20 +52,49 @@ protected:
     uint32_t _numPages;
     SPI &spi;
     Pin &ssel;
-    uint8_t cmdBuf[4];
+    uint8_t cmdBuf[5];
     uint8_t status;
+    volatile uint8_t flags;
+    PVoidCallback readHandler;
+    void *readHandlerArg;
 
     void setCommand(uint8_t command, int addr);
     int sendCommand(uint8_t command, int addr = -1, void *resp = 0, int respSize = 0);
     int eraseCore(uint8_t cmd, uint32_t addr);
     int waitBusy(int waitMS);
+    void waitIdle(bool forRead);
+    int suspendErase();
+    int resumeErase();
     void writeEnable();
+    static void readDone(void *flash);
 
 public:
     StandardSPIFlash(SPI &spi, Pin &ssel, int numPages);
     virtual int numPages();
     virtual int readBytes(uint32_t addr, void *buffer, uint32_t len);
+
+    /**
+     * Starts reading from the flash, using DMA where the SPI driver supports it.
+     * Other operations wait until the read has completed.
+     *
+     * @param addr The address to read from.
+     * @param buffer The buffer to receive the data, which must remain valid until the read completes.
+     * @param len The number of bytes to read.
+     * @param doneHandler Called (possibly in IRQ context) once the data is in the buffer.
+     * @param arg Passed to doneHandler.
+     * @return DEVICE_OK, or DEVICE_SPI_ERROR.
+     */
+    int readBytesAsync(uint32_t addr, void *buffer, uint32_t len, PVoidCallback doneHandler,
+                       void *arg);
+
     virtual int writeBytes(uint32_t addr, const void *buffer, uint32_t len);
+
+    /**
+     * Allows reads to suspend an erase in progress (commands 0x75 and 0x7A), rather than
+     * waiting for it to complete. Supported by most current parts, but check the datasheet.
+     */
+    void setEraseSuspend(bool enable);
+
     virtual int eraseSmallRow(uint32_t addr);
     virtual int eraseBigRow(uint32_t addr);
     virtual int eraseChip();
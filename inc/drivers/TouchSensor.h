@@ -36,8 +36,25 @@ DEALINGS IN THE SOFTWARE.
 #define TOUCH_SENSOR_SAMPLE_PERIOD      50
 #define TOUCH_SENSE_SAMPLE_MAX          1000
 
+// Time allowed for the receiver pins to drain before an asynchronous sample begins, in microseconds.
+#ifndef TOUCH_SENSOR_DRAIN_TIME_US
+#define TOUCH_SENSOR_DRAIN_TIME_US      1000
+#endif
+
+// The longest time an asynchronous sample waits for the receiver pins to charge, in microseconds.
+#ifndef TOUCH_SENSOR_ASYNC_TIMEOUT_US
+#define TOUCH_SENSOR_ASYNC_TIMEOUT_US   2000
+#endif
+
 // Event codes associate with this touch sensor.
 #define TOUCH_SENSOR_UPDATE_NEEDED      1
+#define TOUCH_SENSOR_SAMPLE_DRAINED     2
+#define TOUCH_SENSOR_SAMPLE_TIMEOUT     3
+
+// Status flags associated with this touch sensor.
+#define TOUCH_SENSOR_STATUS_ASYNCHRONOUS    0x02
+#define TOUCH_SENSOR_STATUS_DRIVE_PIN       0x04
+#define TOUCH_SENSOR_STATUS_QUEUED          0x08
 
 namespace codal
 {
@@ -55,6 +72,11 @@ namespace codal
         TouchButton*    buttons[TOUCH_SENSOR_MAX_BUTTONS];
         Pin             &drivePin;
         int             numberOfButtons;
+        CODAL_TIMESTAMP sampleStart;            // The time at which the drive pin was raised, in microseconds.
+        volatile int    pending;                // The number of buttons still charging in the current asynchronous sample.
+        uint32_t        cpuTime;                // CPU time spent on the current sample so far, in microseconds.
+        uint32_t        sampleCpuTime;          // CPU time spent on the most recent complete sample, in microseconds.
+        TouchSensor     *nextQueued;            // The next sensor waiting to start an asynchronous sample, after this one.
 
         public:
 
@@ -93,10 +115,69 @@ namespace codal
          */
         virtual void onSampleEvent(Event);
 
+        /**
+         * Selects how the sensors are sampled.
+         *
+         * In synchronous mode (the default), each sample drains the receiver pins and then polls them until they charge,
+         * blocking the caller for the duration. Readings are measured in loop iterations.
+         *
+         * In asynchronous mode, the drain and charge phases are timed by the system timer, and the charge time of every
+         * pin is captured in a single pass by pin change interrupts. The CPU is only used briefly at each edge.
+         * Readings are measured in microseconds, so TouchButtons should be calibrated (rather than given fixed thresholds)
+         * after changing mode. The pins used must support DEVICE_PIN_INTERRUPT_ON_EDGE.
+         *
+         * @param enable true to select asynchronous sampling, false for synchronous sampling.
+         * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if this sensor has no drive pin.
+         */
+        int setAsynchronous(bool enable);
+
+        /**
+         * Determines the CPU time consumed by the most recent sample.
+         *
+         * @return The time spent, in microseconds.
+         */
+        uint32_t getSampleCpuTime();
+
+        /**
+         * Records that the receiver pin of the given button has charged.
+         * Called from interrupt context during asynchronous sampling.
+         *
+         * @param index The index of the button.
+         */
+        void onChargeComplete(int index);
+
         /**
           * Destructor.
           */
         ~TouchSensor();
+
+        protected:
+
+        /**
+         * Starts an asynchronous sample by draining any residual charge on the receiver pins.
+         * The sample continues in onDrained(), once they have had time to settle.
+         */
+        void beginSample();
+
+        /**
+         * Removes this sensor from the queue of those waiting to sample, if it is there.
+         */
+        void dequeueSample();
+
+        /**
+         * Raises the drive pin, once the receiver pins have drained, and starts timing their charge.
+         */
+        void onDrained(Event);
+
+        /**
+         * Completes an asynchronous sample, giving the maximum reading to any button that has not yet charged.
+         */
+        void onTimeout(Event);
+
+        /**
+         * Ends an asynchronous sample, releases the receiver pins, and starts the next queued sensor, if any.
+         */
+        void completeSample();
     };
 }
 
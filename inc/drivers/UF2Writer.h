@@ -0,0 +1,187 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef CODAL_UF2_WRITER_H
+#define CODAL_UF2_WRITER_H
+
+#include "CodalConfig.h"
+#include "NVMController.h"
+#include "SPIFlash.h"
+#include "uf2format.h"
+
+#define UF2_BLOCK_SIZE 512
+
+// the largest file accepted, in blocks
+#ifndef UF2_WRITER_MAX_BLOCKS
+#define UF2_WRITER_MAX_BLOCKS 65536
+#endif
+
+// dirty regions of the buffered flash page are tracked in this many parts
+#define UF2_WRITER_GRANULES 32
+
+namespace codal
+{
+
+struct UF2WriterStats
+{
+    uint32_t blocks;       // blocks accepted
+    uint32_t duplicates;   // blocks received more than once
+    uint32_t erases;       // flash pages erased
+    uint32_t programs;     // contiguous regions programmed
+    uint32_t verifyErrors; // programmed regions that did not read back correctly
+};
+
+/**
+ * Writes the contents of a UF2 file into a region of internal flash (through an NVMController)
+ * or an SPI flash chip, e.g. to update a data partition over USB mass storage or serial.
+ *
+ * Blocks may arrive in any order, and more than once. Payloads are gathered into a RAM copy of the
+ * flash page (the erase unit) they belong to, which is only written back once blocks move on to
+ * another page, so a file written in order costs one read, at most one erase and one program per
+ * page. Pages are only erased when the new data needs bits set; otherwise just the changed parts
+ * are programmed. Data in the page not covered by the file is preserved. Everything programmed is
+ * read back and checked against a CRC-32 of the intended contents.
+ *
+ * Received block numbers are tracked in a bitmap, so isComplete() reports when the whole file has
+ * arrived.
+ */
+class UF2Writer
+{
+    NVMController *nvm;
+    SPIFlash *flash;
+    uint32_t start;
+    uint32_t end;
+    uint32_t pageSize;
+    uint32_t *page;
+    uint32_t pageAddr;
+    uint32_t dirty;
+    bool needsErase;
+    uint8_t *received;
+    uint32_t numBlocks;
+    uint32_t blocksReceived;
+    uint8_t *partial;
+    uint16_t partialLength;
+    UF2WriterStats stats;
+
+    void init(uint32_t start, uint32_t size, uint32_t pageSize);
+    int readFlash(uint32_t addr, void *dest, uint32_t len);
+    int program(uint32_t offset, uint32_t len);
+    int verify(uint32_t offset, uint32_t len);
+    int loadPage(uint32_t addr);
+
+public:
+    /**
+     * Creates a writer for a region of internal flash.
+     *
+     * @param nvm The flash controller.
+     * @param start The first address blocks may be written to.
+     * @param size The size of the region, in bytes.
+     */
+    UF2Writer(NVMController &nvm, uint32_t start, uint32_t size);
+
+    /**
+     * Creates a writer for a region of an SPI flash chip.
+     *
+     * @param flash The flash chip.
+     * @param start The first address blocks may be written to.
+     * @param size The size of the region, in bytes.
+     */
+    UF2Writer(SPIFlash &flash, uint32_t start, uint32_t size);
+
+    ~UF2Writer();
+
+    /**
+     * Accepts a single UF2 block. Blocks flagged UF2_FLAG_NOFLASH are counted, but not written.
+     * The page being gathered is written back when a block for another page arrives, or by flush().
+     *
+     * @param block UF2_BLOCK_SIZE bytes, holding a UF2_Block.
+     * @return DEVICE_OK, DEVICE_INVALID_PARAMETER if the block is malformed or targets an address
+     * outside the region, DEVICE_NO_RESOURCES, DEVICE_INVALID_STATE if the flash failed to verify,
+     * or the error returned by the flash.
+     */
+    int writeBlock(const void *block);
+
+    /**
+     * Accepts a UF2 file as a stream of bytes (e.g. from a serial port), in pieces of any length.
+     *
+     * @param data The next part of the file.
+     * @param len The number of bytes.
+     * @return DEVICE_OK, or the first error returned by writeBlock().
+     */
+    int write(const void *data, int len);
+
+    /**
+     * Writes back the page being gathered, if any.
+     *
+     * @return DEVICE_OK, DEVICE_INVALID_STATE if the flash failed to verify, or the error returned by the flash.
+     */
+    int flush();
+
+    /**
+     * Forgets the blocks received so far, and starts a new file. Any gathered data is discarded.
+     */
+    void reset();
+
+    /**
+     * Determines if every block of the file has been received.
+     */
+    bool isComplete() { return numBlocks > 0 && blocksReceived == numBlocks; }
+
+    /**
+     * Returns the number of distinct blocks received.
+     */
+    uint32_t getBlocksReceived() { return blocksReceived; }
+
+    /**
+     * Returns the number of blocks in the file, or 0 if no block has been received.
+     */
+    uint32_t getBlocksTotal() { return numBlocks; }
+
+    /**
+     * Returns the counts of blocks, erases, programs and verify errors.
+     */
+    UF2WriterStats getStats() { return stats; }
+
+    /**
+     * Computes the CRC-32 of a region of the flash, e.g. to compare an update with the file it came from.
+     * Call flush() first to include the page being gathered.
+     *
+     * @param addr The start of the region.
+     * @param len The length of the region, in bytes.
+     */
+    uint32_t computeCRC(uint32_t addr, uint32_t len);
+
+    /**
+     * Computes the CRC-32 (as used by zip and PNG) of a buffer.
+     *
+     * @param data The data.
+     * @param len The length of the data, in bytes.
+     * @param crc The CRC of any preceding data, to continue a calculation.
+     */
+    static uint32_t crc32(const void *data, uint32_t len, uint32_t crc = 0);
+};
+}
+
+#endif
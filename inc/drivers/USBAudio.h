@@ -0,0 +1,227 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef DEVICE_USBAUDIO_H
+#define DEVICE_USBAUDIO_H
+
+#include "CodalUSB.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+#if CONFIG_ENABLED(DEVICE_USB)
+
+// sample rate of both directions; one 16 bit mono packet per 1ms frame must fit into USB_MAX_PKT_SIZE
+#ifndef USB_AUDIO_SAMPLE_RATE
+#define USB_AUDIO_SAMPLE_RATE 16000
+#endif
+
+// samples buffered in each direction (power of 2); streams aim to keep these half full
+#ifndef USB_AUDIO_BUFFER_SAMPLES
+#define USB_AUDIO_BUFFER_SAMPLES 1024
+#endif
+
+// largest buffer handed to the downstream component by pull()
+#ifndef USB_AUDIO_PULL_SAMPLES
+#define USB_AUDIO_PULL_SAMPLES 128
+#endif
+
+// the host reads the feedback endpoint every 2^USB_AUDIO_FEEDBACK_REFRESH ms (1..9)
+#ifndef USB_AUDIO_FEEDBACK_REFRESH
+#define USB_AUDIO_FEEDBACK_REFRESH 4
+#endif
+
+// events
+#define USB_AUDIO_EVT_DATA 1         // samples from the host are ready for the downstream component
+#define USB_AUDIO_EVT_PLAY_START 2   // the host has started sending audio
+#define USB_AUDIO_EVT_PLAY_STOP 3    // the host has stopped sending audio
+#define USB_AUDIO_EVT_RECORD_START 4 // the host has started reading audio
+#define USB_AUDIO_EVT_RECORD_STOP 5  // the host has stopped reading audio
+
+namespace codal
+{
+
+struct USBAudioRing
+{
+    int16_t *data;
+    uint16_t head;
+    uint16_t count;
+    int32_t average; // moving average of count, in 1/16 samples
+};
+
+struct USBAudioBufferStats
+{
+    uint32_t packets;   // isochronous packets transferred
+    uint32_t underruns; // packets (or pulls) that could not be filled from the buffer
+    uint32_t overruns;  // times samples were dropped as the buffer was full
+    uint16_t level;     // samples currently buffered
+    uint16_t minLevel;  // fewest samples buffered since resetStats()
+    uint16_t maxLevel;  // most samples buffered since resetStats()
+};
+
+struct USBAudioStats
+{
+    USBAudioBufferStats toHost;   // samples from the upstream component, waiting for the host
+    USBAudioBufferStats fromHost; // samples from the host, waiting for the downstream component
+    uint32_t feedback;            // last rate requested from the host, in samples per frame (10.14)
+};
+
+/**
+ * A USB Audio Class 1 device, with a 16 bit mono speaker and microphone.
+ *
+ * As a DataSink, samples pulled from the upstream component are sent to the host through an
+ * asynchronous isochronous IN endpoint. The number of samples in each packet is adjusted from the
+ * buffer level, so the host follows the rate of the upstream component.
+ *
+ * As a DataSource, samples sent by the host through an asynchronous isochronous OUT endpoint are
+ * passed to the downstream component. An explicit feedback endpoint asks the host for more or
+ * fewer samples per frame, to keep the buffer half full at whatever rate the downstream consumes.
+ *
+ * The interface uses three consecutive interface numbers (audio control, speaker and microphone
+ * streaming). The IN and OUT endpoints are allocated like those of any other interface (sharing a
+ * number where DEVICE_USB_ENDPOINT_SHARING is defined), and the feedback endpoint takes an
+ * additional endpoint number of its own.
+ */
+class USBAudio : public CodalUSBInterface, public CodalComponent, public DataSink, public DataSource
+{
+    DataSource *upstream;
+    DataSink *downstream;
+    UsbEndpointIn *feedback;
+    USBAudioRing toHost;
+    USBAudioRing fromHost;
+    USBAudioStats stats;
+    int sampleRate;
+    uint32_t nominalFeedback;
+    uint16_t rateRemainder;
+    volatile bool playing;
+    volatile bool recording;
+    bool primed;
+    bool dataPending;
+    bool sending;
+    bool sendingFeedback;
+
+    void init(int sampleRate);
+    int fillPacket(int16_t *packet);
+    uint32_t computeFeedback();
+    void receivePacket();
+#ifdef USB_EP_FLAG_ASYNC
+    void sendPackets();
+#endif
+    void onStreamEvent(Event evt);
+    void onData(Event evt);
+    static void sendLoop(void *audio);
+    static void feedbackLoop(void *audio);
+
+public:
+    /**
+     * Creates a USB audio device, which sends silence to the host.
+     *
+     * @param sampleRate The sample rate of both directions, in Hz.
+     * @param id The id to use for the message bus when transmitting events.
+     */
+    USBAudio(int sampleRate = USB_AUDIO_SAMPLE_RATE, uint16_t id = CodalComponent::generateDynamicID());
+
+    /**
+     * Creates a USB audio device, which sends the samples of the given component to the host.
+     *
+     * @param source The component providing data for the host.
+     * @param sampleRate The sample rate of both directions, in Hz.
+     * @param id The id to use for the message bus when transmitting events.
+     */
+    USBAudio(DataSource &source, int sampleRate = USB_AUDIO_SAMPLE_RATE, uint16_t id = CodalComponent::generateDynamicID());
+
+    ~USBAudio();
+
+    virtual int endpointRequest();
+    virtual int classRequest(UsbEndpointIn &ctrl, USBSetup &setup);
+    virtual int stdRequest(UsbEndpointIn &ctrl, USBSetup &setup);
+    virtual const InterfaceInfo *getInterfaceInfo();
+    virtual int getInterfaceCount() { return 3; }
+    virtual int fillDescriptors(uint8_t *buf);
+    // the explicit feedback endpoint
+    virtual int getExtraEndpointCount() { return 1; }
+
+    /**
+     * Callback provided when data is ready from the upstream component.
+     */
+    virtual int pullRequest();
+
+    /**
+     * Provides up to USB_AUDIO_PULL_SAMPLES samples received from the host.
+     */
+    virtual ManagedBuffer pull();
+
+    /**
+     * Define a downstream component for samples received from the host.
+     *
+     * @sink The component that data will be delivered to, when it is available
+     */
+    virtual void connect(DataSink &sink);
+
+    /**
+     * Determines if this source is connected to a downstream component
+     */
+    virtual bool isConnected();
+
+    /**
+     * Disconnects the downstream component.
+     */
+    virtual void disconnect();
+
+    /**
+     * Samples from the host are always DATASTREAM_FORMAT_16BIT_SIGNED.
+     */
+    virtual int getFormat();
+
+    /**
+     * Determines the sample rate of the streams, in Hz.
+     */
+    virtual float getSampleRate();
+
+    /**
+     * Determines if the host is currently sending audio.
+     */
+    bool isPlaying() { return playing; }
+
+    /**
+     * Determines if the host is currently reading audio.
+     */
+    bool isRecording() { return recording; }
+
+    /**
+     * Returns the packet counts, underruns, overruns and buffer levels of both directions.
+     */
+    USBAudioStats getStats();
+
+    /**
+     * Clears the counters, and restarts the buffer level range from the current levels.
+     */
+    void resetStats();
+};
+
+} // namespace codal
+
+#endif
+
+#endif
@@ -26,15 +26,32 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_USBMSC_H
 
 #include "CodalUSB.h"
+#include "CodalFiber.h"
 #include "Event.h"
 
 #if CONFIG_ENABLED(DEVICE_USB)
 
+// number of 512 byte blocks queued between readBlocks()/writeBlocks() and the bulk endpoints;
+// 0 or 1 transfers each block directly
+#ifndef USBMSC_PIPELINE_DEPTH
+#define USBMSC_PIPELINE_DEPTH 2
+#endif
+
+#define USBMSC_MAX_PIPELINE_DEPTH 16
+
 namespace codal
 {
 
 struct MSCState;
 
+struct USBMSCStats
+{
+    uint32_t blocksRead;    // blocks sent to the host
+    uint32_t blocksWritten; // blocks received from the host
+    uint32_t readTime;      // time spent in READ(10) commands, in milliseconds
+    uint32_t writeTime;     // time spent in WRITE(10) commands, in milliseconds
+};
+
 class USBMSC : public CodalUSBInterface
 {
     struct MSCState *state;
@@ -44,10 +61,34 @@ class USBMSC : public CodalUSBInterface
     bool listen;
     bool disableIRQ;
 
+    // queue of blocks between the block device and a fiber running the bulk endpoint
+    uint8_t *pipeBuf;
+    uint16_t *pipeLen;
+    FiberLock *pipeFree;
+    FiberLock *pipeFull;
+    FiberLock *pipeDone;
+    uint8_t pipelineDepth;
+    uint8_t pipeHead;
+    uint8_t pipeTail;
+    bool pipeActive;
+    bool pipeRead;
+    uint16_t pipeOffset;
+    uint32_t pipeRemaining;
+    uint32_t pipeAvailable;
+    USBMSCStats stats;
+
     bool writePadded(const void *ptr, int dataSize, int allocSize = -1);
     void writeHandler(Event);
     void readHandler(Event);
 
+    void transferIn(const void *ptr, int dataSize);
+    void transferOut(void *ptr, int dataSize);
+    void startPipeline(bool isRead);
+    void finishPipeline();
+    void commitSlot();
+    static void sendPump(void *msc);
+    static void receivePump(void *msc);
+
     int handeSCSICommand();
     int sendResponse(bool ok);
     void fail();
@@ -60,6 +101,10 @@ class USBMSC : public CodalUSBInterface
     bool cmdModeSense(bool is10);
     bool cmdReadFormatCapacity();
 
+protected:
+    // set to false by devices that take over the OUT endpoint during writeBlocks()
+    bool pipelineWrites;
+
 public:
     USBMSC();
     virtual int endpointRequest();
@@ -74,6 +119,26 @@ public:
     void writeBulk(const void *ptr, int dataSize);
     void readBulk(void *ptr, int dataSize);
     void finishReadWrite();
+
+    /**
+     * Sets the number of blocks queued between the block device and the USB bulk endpoints.
+     * With two or more, the next block is produced (or the last one stored) by readBlocks()
+     * or writeBlocks() while the current one is on the bus.
+     *
+     * @param depth The number of 512 byte buffers, up to USBMSC_MAX_PIPELINE_DEPTH. 0 or 1 disables the queue.
+     * @return DEVICE_OK, DEVICE_INVALID_PARAMETER, or DEVICE_BUSY if a transfer is in progress.
+     */
+    int setPipelineDepth(int depth);
+
+    /**
+     * Returns the number of blocks transferred, and the time taken.
+     */
+    USBMSCStats getStats() { return stats; }
+
+    /**
+     * Clears the transfer counters.
+     */
+    void resetStats();
     int currLUN();
     uint32_t cbwTag();
 
@@ -0,0 +1,152 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "AudioCodec.h"
+
+#ifndef ADPCM_CODEC_H
+#define ADPCM_CODEC_H
+
+// The size of each encoded frame, in bytes. Encoder and decoder must agree on this value.
+#ifndef ADPCM_FRAME_SIZE
+#define ADPCM_FRAME_SIZE        256
+#endif
+
+// Each frame starts with a header: the predicted sample (int16_t), step index (uint8_t) and a reserved byte (zero).
+#define ADPCM_HEADER_SIZE       4
+
+// The number of samples held in each frame.
+#define ADPCM_FRAME_SAMPLES     ((ADPCM_FRAME_SIZE - ADPCM_HEADER_SIZE) * 2)
+
+namespace codal
+{
+    /**
+     * Encoder state of an IMA ADPCM stream.
+     */
+    struct ADPCMState
+    {
+        int16_t     predictor;      // The previous decoded sample.
+        uint8_t     index;          // Index into the step size table, 0..88.
+    };
+
+    /**
+     * Compresses a stream of samples with IMA ADPCM, into four bits per sample (4:1 for 16 bit audio).
+     *
+     * The output is a sequence of ADPCM_FRAME_SIZE byte frames. Each holds an ADPCM_HEADER_SIZE byte header with the
+     * coder state at its start, followed by ADPCM_FRAME_SAMPLES samples packed two per byte (first sample in the low
+     * nibble). Each output buffer holds as many whole frames as the samples received so far complete; samples left over
+     * are held until the next buffer arrives.
+     *
+     * As frames have a fixed size, the encoded stream may be split into buffers of any size on its way to the decoder
+     * (e.g. by FlashStreamRecording, or a serial link). Whole frames may be lost without affecting those that follow,
+     * but any other loss or insertion of bytes misaligns the decoder until it is reset.
+     */
+    class ADPCMEncoder : public AudioCodec
+    {
+        ADPCMState state;
+        uint8_t frame[ADPCM_FRAME_SIZE];    // The frame being encoded.
+        int frameSamples;                   // The number of samples encoded into the frame so far.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The upstream component providing samples, in any format.
+         */
+        ADPCMEncoder(DataSource &source);
+
+        /**
+         * Encoded data is reported as DATASTREAM_FORMAT_8BIT_UNSIGNED.
+         */
+        virtual int getFormat();
+
+        /**
+         * Restarts the coder from silence, discarding any samples not yet output.
+         */
+        void reset();
+
+        /**
+         * Encodes a block of samples, as held in the body of a frame.
+         *
+         * @param state The coder state, updated on return.
+         * @param samples The samples to encode.
+         * @param count The number of samples.
+         * @param out Buffer of (count + 1) / 2 bytes for the result.
+         */
+        static void encode(ADPCMState &state, const int16_t *samples, int count, uint8_t *out);
+
+        protected:
+
+        virtual ManagedBuffer process(ManagedBuffer input);
+    };
+
+    /**
+     * Expands a stream of IMA ADPCM frames, as produced by an ADPCMEncoder, into DATASTREAM_FORMAT_16BIT_SIGNED samples.
+     *
+     * Incoming data is gathered into whole frames, so it may arrive in buffers of any size.
+     */
+    class ADPCMDecoder : public AudioCodec
+    {
+        uint8_t frame[ADPCM_FRAME_SIZE];    // The frame being received.
+        int frameFill;                      // The number of bytes of the frame received so far.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The upstream component providing ADPCM data.
+         */
+        ADPCMDecoder(DataSource &source);
+
+        /**
+         * Decoded samples are DATASTREAM_FORMAT_16BIT_SIGNED.
+         */
+        virtual int getFormat();
+
+        /**
+         * Discards any partially received frame, so that decoding starts afresh from the next byte received.
+         * Use this when starting to decode a new stream.
+         */
+        void reset();
+
+        /**
+         * Decodes a block of samples, as held in the body of a frame.
+         *
+         * @param state The coder state, updated on return.
+         * @param in The encoded data, (count + 1) / 2 bytes.
+         * @param count The number of samples.
+         * @param samples Buffer for the decoded samples.
+         */
+        static void decode(ADPCMState &state, const uint8_t *in, int count, int16_t *samples);
+
+        protected:
+
+        virtual ManagedBuffer process(ManagedBuffer input);
+        virtual int getMaxInputLength();
+    };
+}
+
+#endif
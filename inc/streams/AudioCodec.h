@@ -0,0 +1,140 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ManagedBuffer.h"
+#include "DataStream.h"
+
+#ifndef AUDIO_CODEC_H
+#define AUDIO_CODEC_H
+
+namespace codal
+{
+    /**
+     * Base class for stream components that encode or decode audio, changing the size of each buffer.
+     *
+     * Encoders accept PCM of any format, and produce compressed data, reported as DATASTREAM_FORMAT_8BIT_UNSIGNED
+     * bytes. The sample rate reported is that of the audio, so it survives the round trip. Compressed data may be held
+     * or moved by components that treat buffers as opaque bytes (StreamRecording, FIFOStream, a serial port or radio)
+     * before reaching the matching decoder, which produces DATASTREAM_FORMAT_16BIT_SIGNED samples.
+     *
+     * Coded data may be split or merged into buffers of different sizes on its way to the decoder. See each codec
+     * for the effect of lost data.
+     */
+    class AudioCodec : public DataSource, public DataSink
+    {
+        protected:
+
+        DataSink        *downStream;
+        DataSource      &upStream;
+        ManagedBuffer   remainder;      // Input held back by the last pull, as its coded form would not fit in one buffer.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The upstream component providing data.
+         */
+        AudioCodec(DataSource &source);
+
+        /**
+         * Destructor.
+         */
+        virtual ~AudioCodec();
+
+        /**
+         * Provides the next buffer of upstream data, once it has been coded.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Define a downstream component for the coded data.
+         *
+         * @sink The component that data will be delivered to, when it is available
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Determines if this source is connected to a downstream component
+         */
+        virtual bool isConnected();
+
+        /**
+         * Disconnects the downstream component.
+         */
+        virtual void disconnect();
+
+        /**
+         * The format of coded data is fixed.
+         */
+        virtual int setFormat(int format);
+
+        /**
+         * Determines the sample rate of the audio, from the upstream component.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Asks the upstream component to use the given sample rate.
+         */
+        virtual float requestSampleRate(float sampleRate);
+
+        protected:
+
+        /**
+         * Codes a single buffer of data.
+         *
+         * @param input A buffer of data from the upstream component.
+         * @return The coded buffer.
+         */
+        virtual ManagedBuffer process(ManagedBuffer input) = 0;
+
+        /**
+         * Determines the largest input that process() can code into a single ManagedBuffer.
+         * Longer input is coded over several pulls.
+         *
+         * By default, this allows for 8 bit samples being expanded to 16 bits by toSigned16().
+         *
+         * @return The maximum number of bytes of input to pass to process().
+         */
+        virtual int getMaxInputLength();
+
+        /**
+         * Converts a buffer of samples in the given format into signed 16 bit samples.
+         *
+         * @param input The buffer to convert.
+         * @param format The format of the samples held in the buffer.
+         * @return The input buffer itself if it already holds DATASTREAM_FORMAT_16BIT_SIGNED samples, otherwise a new buffer.
+         */
+        static ManagedBuffer toSigned16(ManagedBuffer input, int format);
+    };
+}
+
+#endif
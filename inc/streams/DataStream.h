@@ -71,6 +71,7 @@ namespace codal
             virtual void disconnect();
             virtual int getFormat();
             virtual int setFormat(int format);
+            virtual int getSampleBits();
             virtual float getSampleRate();
             virtual float requestSampleRate(float sampleRate);
     };
@@ -161,6 +162,14 @@ namespace codal
              */
             virtual int getFormat() override;
 
+            /**
+             * Determine the number of significant bits in each sample streamed out of this component.
+             * Unsigned samples are centred on 2^(bits-1).
+             *
+             * @return The number of significant bits, or 0 if samples use the full width of their format.
+             */
+            virtual int getSampleBits() override;
+
             /**
              * Determines if this stream acts in a synchronous, blocking mode or asynchronous mode. In blocking mode, writes to a full buffer
              * will result int he calling fiber being blocked until space is available. Downstream DataSinks will also attempt to process data
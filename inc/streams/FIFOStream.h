@@ -35,6 +35,7 @@ namespace codal {
         virtual void disconnect();
         virtual int getFormat();
         virtual int setFormat( int format );
+        virtual int getSampleBits();
         int length();
         void dumpState();
 
@@ -0,0 +1,154 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ManagedBuffer.h"
+#include "DataStream.h"
+#include "EffectFilter.h"
+
+#ifndef FILTER_BANK_H
+#define FILTER_BANK_H
+
+// Biquad coefficients are signed Q2.14 values.
+#define FILTER_BANK_BIQUAD_SHIFT            14
+
+// FIR taps are signed Q1.15 values.
+#define FILTER_BANK_FIR_SHIFT               15
+
+// The maximum number of taps permitted in a single FIR stage.
+#ifndef FILTER_BANK_MAX_FIR_TAPS
+#define FILTER_BANK_MAX_FIR_TAPS            128
+#endif
+
+// Helpers to convert coefficients designed on the host into fixed point, at compile time.
+#define FILTER_BANK_BIQUAD_COEFFICIENT(x)   ((int16_t)((x) * (1 << FILTER_BANK_BIQUAD_SHIFT) + ((x) < 0 ? -0.5f : 0.5f)))
+#define FILTER_BANK_FIR_TAP(x)              ((int16_t)((x) * (1 << FILTER_BANK_FIR_SHIFT) + ((x) < 0 ? -0.5f : 0.5f)))
+
+namespace codal
+{
+    /**
+     * A single stage of a FilterBank.
+     */
+    struct FilterBankStage
+    {
+        FilterBankStage *next;
+        const int16_t   *coefficients;      // The FIR taps, or the biquad coefficients {b0, b1, b2, a1, a2}.
+        int16_t         *state;             // The previous (taps - 1) inputs of a FIR stage, or {x1, x2, y1, y2} of a biquad.
+        uint16_t        taps;               // The number of FIR taps, or zero for a biquad stage.
+        int16_t         biquad[5];          // Local copy of the biquad coefficients.
+    };
+
+    /**
+     * A fixed point filter bank, applying a cascade of biquad (IIR) and FIR filter stages to a stream.
+     *
+     * Samples of any format are converted to signed 16 bit values for processing (unsigned formats
+     * are centred on the midpoint of their range) and converted back to the original format afterwards.
+     * Each stage processes a whole buffer at a time, using 32 bit accumulators. As with other fast fixed point
+     * filters, stages with a large gain can overflow on full scale input, so headroom should be allowed
+     * for when designing the coefficients.
+     */
+    class FilterBank : public EffectFilter
+    {
+        private:
+
+        FilterBankStage *stages;            // The stages of this filter, in the order they are applied.
+        ManagedBuffer   work;               // Working buffer of 16 bit samples, reused for each buffer processed.
+        int             maxTaps;            // The largest number of taps of any FIR stage.
+
+        public:
+
+        /**
+         * Constructor.
+         * Creates an empty filter bank, which initially passes data through unmodified.
+         *
+         * @param source The upstream component providing data.
+         * @param deepCopy Set to true to copy incoming data into a freshly allocated buffer, or false to change data in place.
+         */
+        FilterBank(DataSource &source, bool deepCopy = true);
+
+        /**
+         * Destructor.
+         * Removes all resources held by the instance.
+         */
+        ~FilterBank();
+
+        /**
+         * Appends a biquad stage to the filter, computing
+         * y(n) = b0*x(n) + b1*x(n-1) + b2*x(n-2) - a1*y(n-1) - a2*y(n-2)
+         *
+         * @param coefficients The five coefficients {b0, b1, b2, a1, a2} in Q2.14 format (see FILTER_BANK_BIQUAD_COEFFICIENT).
+         * The coefficients are copied.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+         */
+        int addBiquad(const int16_t *coefficients);
+
+        /**
+         * Appends a FIR stage to the filter, computing y(n) = sum of h(k)*x(n-k).
+         *
+         * @param taps The filter taps in Q1.15 format (see FILTER_BANK_FIR_TAP). The taps are not copied,
+         * and must remain valid for the lifetime of this filter (e.g. a const table held in flash).
+         * @param length The number of taps, in the range 1..FILTER_BANK_MAX_FIR_TAPS.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+         */
+        int addFIR(const int16_t *taps, int length);
+
+        /**
+         * Removes all stages from the filter.
+         */
+        void clear();
+
+        /**
+         * Clears the history of every stage, as if the filter had just been created.
+         */
+        void reset();
+
+        /**
+         * Apply the filter stages in turn to the given buffer of data.
+         *
+         * @param inputBuffer the buffer containing data to process.
+         * @param outputBuffer the buffer in which to store the filtered data. n.b. MAY be the same memory as the input buffer.
+         * @param format the format of the data (word size and signed/unsigned representation)
+         */
+        virtual void applyEffect(ManagedBuffer inputBuffer, ManagedBuffer outputBuffer, int format) override;
+
+        private:
+
+        /**
+         * Appends the given stage to the end of the cascade.
+         */
+        void addStage(FilterBankStage *stage);
+
+        /**
+         * Applies a biquad stage to a block of samples, in place.
+         */
+        static void processBiquad(FilterBankStage *stage, int16_t *samples, int count);
+
+        /**
+         * Applies a FIR stage to a block of samples held at the end of the given buffer, in place.
+         * The (taps - 1) samples preceding the block are used to hold the history of the stage.
+         */
+        static void processFIR(FilterBankStage *stage, int16_t *buffer, int count);
+    };
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef FLASH_STREAM_RECORDING_H
+#define FLASH_STREAM_RECORDING_H
+
+#include "ManagedBuffer.h"
+#include "DataStream.h"
+#include "CodalFiber.h"
+#include "SPIFlash.h"
+#include "NVMController.h"
+#include "StreamRecording.h"
+
+// Size of each of the two RAM buffers used to gather data for flash, and of the buffers played back.
+// While one buffer is being programmed (including any erase), the other must be able to hold the incoming data.
+// Must be a multiple of 4, so that internal flash can be written in whole words, and should be no smaller than the
+// buffers produced upstream.
+#ifndef FLASH_RECORDING_BUFFER_SIZE
+#define FLASH_RECORDING_BUFFER_SIZE     1024
+#endif
+
+namespace codal
+{
+    /**
+     * A StreamRecording that keeps its data in a region of flash memory rather than RAM, so recordings can last for
+     * minutes rather than seconds.
+     *
+     * Incoming buffers are gathered into one of two RAM buffers. Once full, a buffer is programmed into flash by a
+     * fiber of its own while capture continues into the other, so the upstream component is never held up by the flash.
+     * Erase units are erased just ahead of the data being written. If an incoming buffer does not fit in the space left,
+     * the whole buffer is dropped and counted (see getDroppedBytes()), so framed data such as ADPCM stays aligned.
+     * If programming the flash fails, the recording stops, ending at the last byte written successfully.
+     *
+     * The recording is described by its length, format and sample rate, so the RAM used does not grow with its duration.
+     * Playback reads the flash back in FLASH_RECORDING_BUFFER_SIZE buffers, so the boundaries of the recorded buffers are
+     * not kept; data that depends on them must be framed, as that of an ADPCMEncoder is.
+     */
+    class FlashStreamRecording : public DataSource, public DataSink
+    {
+        private:
+
+        SPIFlash        *flash;
+        NVMController   *nvm;
+        uint32_t        start;              // Address of the first byte of the region.
+        uint32_t        capacity;           // Size of the region, in bytes.
+        uint32_t        eraseSize;          // Size of an erase unit.
+        uint32_t        recorded;           // Bytes accepted from the upstream component.
+        uint32_t        written;            // Bytes programmed into flash.
+        uint32_t        erased;             // Bytes of the region erased for this recording.
+        uint32_t        readOffset;         // Position of playback.
+        uint32_t        dropped;            // Bytes lost because both buffers were full, or the flash failed.
+        uint8_t         *buffers[2];
+        uint16_t        bufferLength[2];    // Bytes held in each buffer.
+        bool            bufferQueued[2];    // Set while a buffer is waiting to be (or being) written to flash.
+        uint8_t         active;             // The buffer being filled.
+        uint8_t         writing;            // The next buffer to be written to flash.
+        bool            writerRunning;      // Set while the writer fiber exists.
+        bool            writerExit;         // Asks the writer fiber to exit.
+        bool            writeFailed;        // Set once programming the flash fails. Nothing more is written until the recording is erased.
+        int             state;
+        float           lastUpstreamRate;
+        FiberLock       queued;
+
+        DataSink        *downStream;
+        DataSource      &upStream;
+
+        void init(uint32_t start, uint32_t size, uint32_t eraseSize);
+        void queueActive();
+        void waitForWrites();
+        int writeFlash(uint32_t offset, const uint8_t *data, uint32_t len);
+        static void writer(void *recording);
+
+        public:
+
+        /**
+         * Creates a recording held in a region of an SPI flash chip.
+         *
+         * @param source An upstream DataSource to connect to.
+         * @param flash The flash chip.
+         * @param start The start of the region, rounded up to a whole erase unit.
+         * @param size The size of the region in bytes.
+         */
+        FlashStreamRecording(DataSource &source, SPIFlash &flash, uint32_t start, uint32_t size);
+
+        /**
+         * Creates a recording held in a region of internal flash.
+         *
+         * @param source An upstream DataSource to connect to.
+         * @param nvm The flash controller.
+         * @param start The start of the region, rounded up to a whole page.
+         * @param size The size of the region in bytes.
+         */
+        FlashStreamRecording(DataSource &source, NVMController &nvm, uint32_t start, uint32_t size);
+
+        ~FlashStreamRecording();
+
+        virtual ManagedBuffer pull();
+        virtual int pullRequest();
+        virtual void connect(DataSink &sink);
+        bool isConnected();
+        virtual void disconnect();
+        virtual int getFormat();
+        virtual int setFormat(int format);
+        virtual int getSampleBits();
+        virtual float getSampleRate();
+
+        /**
+         * Determines the length of the recording, in bytes.
+         */
+        int length();
+
+        /**
+         * Calculate the recorded duration, based on the supplied sample rate, in seconds.
+         */
+        float duration(unsigned int sampleRate);
+
+        /**
+         * Determines the number of bytes that may be recorded.
+         */
+        int getCapacity() { return capacity; }
+
+        /**
+         * Determines the number of bytes lost while recording, because the flash could not keep up or could not be programmed.
+         */
+        uint32_t getDroppedBytes() { return dropped; }
+
+        /**
+         * Checks if this object can store any further data.
+         */
+        bool isFull();
+
+        /**
+         * Begin recording data from the connected upstream, replacing the previous recording. Non-blocking.
+         *
+         * @return true if the state actually changed (ie. we weren't already recording)
+         */
+        bool recordAsync();
+
+        /**
+         * Begin recording data from the connected upstream, blocking until the recording completes.
+         */
+        void record();
+
+        /**
+         * Begin playing the recording, once any data still in RAM has been written to flash. Non-blocking.
+         *
+         * @return true if the state actually changed (ie. we weren't already playing)
+         */
+        bool playAsync();
+
+        /**
+         * Begin playing the recording, blocking until playback completes.
+         */
+        void play();
+
+        /**
+         * Stop recording or playing. Data still in RAM continues to be written to flash in the background.
+         *
+         * @return true if the state actually changed.
+         */
+        bool stop();
+
+        /**
+         * Discards the recording. The flash is erased as the next recording is made.
+         */
+        void erase();
+
+        bool isPlaying();
+        bool isRecording();
+        bool isStopped();
+    };
+}
+
+#endif
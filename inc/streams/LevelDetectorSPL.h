@@ -41,7 +41,10 @@ DEALINGS IN THE SOFTWARE.
 /**
  * Default configuration values
  */
-#define LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE              128
+// The number of samples that make up a level detection window, unless set with setWindowSize().
+// 8 bit streams use a longer window, to keep the window duration used by earlier releases.
+#define LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE              64
+#define LEVEL_DETECTOR_SPL_DEFAULT_8BIT_WINDOW_SIZE         256
 
 #ifndef LEVEL_DETECTOR_SPL_NORMALIZE
 #define LEVEL_DETECTOR_SPL_NORMALIZE    1
@@ -92,7 +95,7 @@ namespace codal{
         DataSource      &upstream;          // The component producing data to process
         float           highThreshold;      // threshold at which a HIGH event is generated
         float           lowThreshold;       // threshold at which a LOW event is generated
-        int             windowSize;         // The number of samples the make up a level detection window.
+        int             windowSize;         // The number of samples the make up a level detection window, or 0 to use the default for the stream's format.
         float           level;              // The current, instantaneous level.
         int             sigma;              // Running total of the samples in the current window.
         float           gain;
@@ -109,6 +112,16 @@ namespace codal{
         uint64_t        timeout;            // The timestamp at which this component will cease actively sampling the data stream
         uint8_t         bufferCount;        // Used to track that enough buffers have been seen since activation to output a valid value/event
         FiberLock       resourceLock;
+
+        int             windowCount;        // The number of samples accumulated into the current window so far.
+        int32_t         windowMin;          // The smallest sample seen in the current window.
+        int32_t         windowMax;          // The largest sample seen in the current window.
+        int64_t         windowSum;          // Running total of the samples in the current window.
+        uint64_t        windowSumSquares;   // Running total of the squares of the samples in the current window.
+
+        float           splOffset;          // dB correction applied to the peak amplitude, derived from the gain and sample format.
+        float           splOffsetGain;      // The gain splOffset was calculated for.
+        int             splOffsetFormat;    // The sample format splOffset was calculated for.
         public:
 
         /**
@@ -221,6 +234,16 @@ namespace codal{
         ~LevelDetectorSPL();
 
         private:
+        /**
+         * Accumulates a block of samples into the current window, in a single pass.
+         */
+        void updateWindow(uint8_t *data, int count, int format);
+
+        /**
+         * Calculates the level and RMS amplitude of the completed window, and emits any resulting events.
+         */
+        void processWindow(int format);
+
         float splToUnit(float f, int queryUnit = -1);
         float unitToSpl(float f, int queryUnit = -1);
     };
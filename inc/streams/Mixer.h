@@ -27,6 +27,15 @@ DEALINGS IN THE SOFTWARE.
 
 #include "DataStream.h"
 
+// The default number of significant bits in the mixed output, and in the samples of channels that do not report a format.
+// This matches the 10 bit range produced by Synthesizer.
+#ifndef MIXER_DEFAULT_SAMPLE_BITS
+#define MIXER_DEFAULT_SAMPLE_BITS       10
+#endif
+
+// The largest output bit depth supported by a Mixer.
+#define MIXER_MAXIMUM_OUTPUT_BITS       24
+
 namespace codal
 {
 
@@ -38,14 +47,33 @@ private:
     friend class Mixer;
 
 public:
-    uint16_t volume;
-    bool isSigned;
+    uint16_t volume;                // Channel volume, in the range 0..1024.
+    bool isSigned;                  // Used for channels that do not report a format: if true, samples are int16_t, otherwise uint16_t.
+    uint8_t bits;                   // The number of significant bits in each sample, or 0 to use the value reported by the stream. Unsigned samples are centred on 2^(bits-1).
+};
+
+/**
+ * Performance counters maintained by a Mixer.
+ */
+struct MixerStatistics
+{
+    uint32_t pulls;                 // Number of buffers produced.
+    uint32_t samples;               // Number of samples produced.
+    uint32_t clipped;               // Number of output samples that were saturated.
+    uint32_t lastPullUs;            // Time taken to produce the most recent buffer, in microseconds.
+    uint32_t maxPullUs;             // Longest time taken to produce a buffer, in microseconds.
+    uint32_t totalPullUs;           // Total time spent producing buffers, in microseconds.
 };
 
 class Mixer : public DataSource, public DataSink
 {
     MixerChannel *channels;
     DataSink *downStream;
+    int outputFormat;               // The format of the buffers produced by this Mixer.
+    int outputBits;                 // The number of significant bits in each output sample.
+    int requestedBits;              // The output bit depth last requested through setOutputBits().
+    ManagedBuffer accumulator;      // 32 bit mix buffer, grown as needed and reused on each pull.
+    MixerStatistics stats;
 
 public:
     /**
@@ -86,6 +114,51 @@ public:
      * @return false If a downstream is not connected
      */
     bool isConnected();
+
+    /**
+     *  Determine the data format of the buffers streamed out of this component.
+     */
+    virtual int getFormat();
+
+    /**
+     * Defines the data format of the buffers streamed out of this component.
+     * Defaults to DATASTREAM_FORMAT_16BIT_UNSIGNED.
+     *
+     * @param format The new output format. Any of the DATASTREAM_FORMAT_ constants, other than DATASTREAM_FORMAT_UNKNOWN.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    virtual int setFormat(int format);
+
+    /**
+     * Determine the number of significant bits in each sample streamed out of this component.
+     */
+    virtual int getSampleBits();
+
+    /**
+     * Defines the range of the samples produced by this Mixer. Mixed samples are saturated to
+     * -2^(bits-1)..2^(bits-1)-1 and, for unsigned formats, offset by 2^(bits-1).
+     * Defaults to MIXER_DEFAULT_SAMPLE_BITS. If the output format is narrower than the requested
+     * depth, the full width of the format is used until a wider format is selected.
+     *
+     * @param bits The number of significant bits in each output sample, in the range 2..MIXER_MAXIMUM_OUTPUT_BITS.
+     * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+     */
+    int setOutputBits(int bits);
+
+    /**
+     * Determines the number of significant bits in each output sample, given the current output format.
+     */
+    int getOutputBits();
+
+    /**
+     * Provides the performance counters maintained by this Mixer.
+     */
+    const MixerStatistics &getStatistics();
+
+    /**
+     * Resets the performance counters maintained by this Mixer.
+     */
+    void resetStatistics();
 };
 
 } // namespace codal
@@ -0,0 +1,170 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+#include "Accelerometer.h"
+#include "Gyroscope.h"
+
+#ifndef MOTION_STREAM_H
+#define MOTION_STREAM_H
+
+// The default number of samples (XYZ readings) packed into each buffer.
+#ifndef MOTION_STREAM_DEFAULT_BLOCK_SIZE
+#define MOTION_STREAM_DEFAULT_BLOCK_SIZE        32
+#endif
+
+//
+// Axes that may be included in the stream.
+//
+#define MOTION_STREAM_AXIS_X                    0x01
+#define MOTION_STREAM_AXIS_Y                    0x02
+#define MOTION_STREAM_AXIS_Z                    0x04
+#define MOTION_STREAM_AXIS_ALL                  0x07
+
+namespace codal
+{
+    /**
+     * Presents the readings of an Accelerometer or Gyroscope as a DataSource.
+     *
+     * Consecutive readings are packed into buffers of DATASTREAM_FORMAT_16BIT_SIGNED values, in the coordinate system
+     * of the sensor, with the selected axes interleaved (e.g. x0, y0, z0, x1, y1, z1...). Downstream components are
+     * notified once per buffer, rather than once per reading. When the accelerometer is operating in batched mode,
+     * each block read from its FIFO is consumed in one go.
+     */
+    class MotionStream : public DataSource
+    {
+        Accelerometer   *accelerometer;     // The accelerometer providing data, or NULL.
+        Gyroscope       *gyroscope;         // The gyroscope providing data, or NULL.
+        DataSink        *downstream;        // Pointer to our downstream component.
+        ManagedBuffer   block;              // The buffer being filled.
+        ManagedBuffer   ready;              // The most recently completed buffer, waiting to be pulled.
+        int             blockSize;          // The number of readings in each buffer.
+        int             fill;               // The number of readings held in the buffer being filled.
+        uint8_t         axes;               // The axes included in the stream.
+        uint8_t         channels;           // The number of axes included in the stream.
+        uint32_t        overruns;           // The number of completed buffers dropped as they were not pulled in time.
+
+        public:
+
+        /**
+         * Constructor.
+         * Creates a stream of readings from the given accelerometer, and ensures it is being sampled.
+         *
+         * @param accelerometer The accelerometer to read.
+         * @param blockSize The number of readings in each buffer.
+         * @param axes The axes to include. A combination of MOTION_STREAM_AXIS_X, MOTION_STREAM_AXIS_Y and MOTION_STREAM_AXIS_Z.
+         */
+        MotionStream(Accelerometer &accelerometer, int blockSize = MOTION_STREAM_DEFAULT_BLOCK_SIZE, int axes = MOTION_STREAM_AXIS_ALL);
+
+        /**
+         * Constructor.
+         * Creates a stream of readings from the given gyroscope, and ensures it is being sampled.
+         *
+         * @param gyroscope The gyroscope to read.
+         * @param blockSize The number of readings in each buffer.
+         * @param axes The axes to include. A combination of MOTION_STREAM_AXIS_X, MOTION_STREAM_AXIS_Y and MOTION_STREAM_AXIS_Z.
+         */
+        MotionStream(Gyroscope &gyroscope, int blockSize = MOTION_STREAM_DEFAULT_BLOCK_SIZE, int axes = MOTION_STREAM_AXIS_ALL);
+
+        /**
+         * Destructor.
+         */
+        ~MotionStream();
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Allow our downstream component to register itself with us
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Determines if this source is connected to a downstream component
+         *
+         * @return true If a downstream is connected
+         * @return false If a downstream is not connected
+         */
+        virtual bool isConnected();
+
+        /**
+         * Disconnects the downstream component.
+         */
+        virtual void disconnect();
+
+        /**
+         *  Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Determines the rate of the stream, in values per second. This is the sample rate of the sensor multiplied by the number of axes included.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Requests a new sample rate for the sensor.
+         *
+         * @param sampleRate The requested rate, in values per second (as returned by getSampleRate()).
+         * @return The actual rate the stream will now run at.
+         */
+        virtual float requestSampleRate(float sampleRate);
+
+        /**
+         * Defines the number of readings packed into each buffer. Any partially filled buffer is discarded.
+         *
+         * @param samples The number of readings in each buffer.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setBlockSize(int samples);
+
+        /**
+         * Determines the number of completed buffers that were dropped because they were not pulled before the next was completed.
+         */
+        uint32_t getOverruns();
+
+        private:
+
+        /**
+         * Common initialisation for all constructors.
+         */
+        void init(uint16_t id, int value, int blockSize, int axes);
+
+        /**
+         * Handles new data from the sensor.
+         */
+        void onData(Event);
+
+        /**
+         * Appends a single reading to the buffer being filled, passing the buffer downstream when full.
+         */
+        void append(const Sample3D &s);
+    };
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "AudioCodec.h"
+
+#ifndef MULAW_CODEC_H
+#define MULAW_CODEC_H
+
+namespace codal
+{
+    /**
+     * Compresses a stream of samples with G.711 mu-law, into one byte per sample (2:1 for 16 bit audio).
+     * Quantisation is logarithmic, giving about 38dB signal to noise ratio over a wide range of levels.
+     * Each byte holds a whole sample, so lost data only affects the samples it held.
+     */
+    class MuLawEncoder : public AudioCodec
+    {
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The upstream component providing samples, in any format.
+         */
+        MuLawEncoder(DataSource &source);
+
+        /**
+         * Encoded data is reported as DATASTREAM_FORMAT_8BIT_UNSIGNED.
+         */
+        virtual int getFormat();
+
+        /**
+         * Encodes a single signed 16 bit sample.
+         */
+        static uint8_t encode(int16_t sample);
+
+        protected:
+
+        virtual ManagedBuffer process(ManagedBuffer input);
+    };
+
+    /**
+     * Expands a stream of G.711 mu-law bytes, as produced by a MuLawEncoder, into DATASTREAM_FORMAT_16BIT_SIGNED samples.
+     */
+    class MuLawDecoder : public AudioCodec
+    {
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The upstream component providing mu-law data.
+         */
+        MuLawDecoder(DataSource &source);
+
+        /**
+         * Decoded samples are DATASTREAM_FORMAT_16BIT_SIGNED.
+         */
+        virtual int getFormat();
+
+        /**
+         * Decodes a single mu-law byte.
+         */
+        static int16_t decode(uint8_t code);
+
+        protected:
+
+        virtual ManagedBuffer process(ManagedBuffer input);
+        virtual int getMaxInputLength();
+    };
+}
+
+#endif
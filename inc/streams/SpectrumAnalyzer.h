@@ -0,0 +1,251 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+#ifndef SPECTRUM_ANALYZER_H
+#define SPECTRUM_ANALYZER_H
+
+/**
+  * Spectrum analyzer events
+  */
+#define SPECTRUM_ANALYZER_EVT_PEAK                  1       // The peak bin has changed, and is above the peak threshold.
+#define SPECTRUM_ANALYZER_EVT_BAND_HIGH             0x10    // The energy of a band has risen above its threshold. The band number is added to this value.
+#define SPECTRUM_ANALYZER_EVT_BAND_LOW              0x20    // The energy of a band has fallen below its threshold. The band number is added to this value.
+
+/**
+  * Window functions
+  */
+#define SPECTRUM_ANALYZER_WINDOW_NONE               0
+#define SPECTRUM_ANALYZER_WINDOW_HANN               1
+
+/**
+ * Default configuration values
+ */
+#define SPECTRUM_ANALYZER_MIN_SIZE                  16
+#define SPECTRUM_ANALYZER_MAX_SIZE                  1024
+
+#ifndef SPECTRUM_ANALYZER_DEFAULT_SIZE
+#define SPECTRUM_ANALYZER_DEFAULT_SIZE              256
+#endif
+
+#ifndef SPECTRUM_ANALYZER_MAX_BANDS
+#define SPECTRUM_ANALYZER_MAX_BANDS                 8
+#endif
+
+namespace codal{
+
+    /**
+     * A range of frequencies monitored by a SpectrumAnalyzer.
+     */
+    struct SpectrumBand
+    {
+        float       lowFrequency;       // Lowest frequency in the band, in Hz.
+        float       highFrequency;      // Highest frequency in the band, in Hz.
+        uint32_t    threshold;          // Energy at which band events are raised.
+        uint32_t    energy;             // Mean squared magnitude of the bins in the band, for the most recent frame.
+        bool        high;               // Set while the energy is above the threshold.
+    };
+
+    /**
+     * A stream component that measures the frequency content of its input.
+     *
+     * Incoming samples are collected into overlapping frames. Each frame is windowed and transformed with an
+     * in place, fixed point radix-2 FFT. The resulting magnitude spectrum is available to downstream components
+     * as a DATASTREAM_FORMAT_16BIT_UNSIGNED buffer of (size / 2) bins, and peak and band energy events are
+     * raised on the message bus.
+     */
+    class SpectrumAnalyzer : public CodalComponent, public DataSink, public DataSource
+    {
+    public:
+        DataSource      &upstream;          // The component producing data to process.
+
+    private:
+        DataSink        *downstream;        // The component consuming our magnitude spectra, if any.
+        int             size;               // The number of samples in each frame.
+        int             hop;                // The number of new samples between the start of consecutive frames.
+        int             window;             // The window function applied to each frame.
+        int             frameFill;          // The number of samples currently held in the frame.
+        int16_t         *frame;             // Samples of the frame being collected.
+        int16_t         *real;              // FFT working buffer, real components.
+        int16_t         *imaginary;         // FFT working buffer, imaginary components.
+        uint16_t        *magnitudes;        // Magnitude of each bin of the most recent frame.
+        int             peakBin;            // The bin with the largest magnitude (excluding DC) in the most recent frame.
+        uint16_t        peakThreshold;      // The magnitude at which peak events are raised.
+        bool            peakHigh;           // Set while the peak bin is above the peak threshold.
+        int             bandCount;          // The number of bands being monitored.
+        SpectrumBand    bands[SPECTRUM_ANALYZER_MAX_BANDS];
+
+    public:
+
+        /**
+          * Creates a component that analyses the frequency content of a stream.
+          *
+          * @param source a DataSource to receive data from.
+          * @param size The number of samples in each frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_SIZE and SPECTRUM_ANALYZER_MAX_SIZE.
+          * @param hop The number of new samples between consecutive frames, in the range 1..size. Defaults to size / 2 (50% overlap).
+          * @param id The id to use for the message bus when transmitting events.
+          */
+        SpectrumAnalyzer(DataSource &source, int size = SPECTRUM_ANALYZER_DEFAULT_SIZE, int hop = 0, uint16_t id = CodalComponent::generateDynamicID());
+
+        /**
+         * Destructor.
+         */
+        ~SpectrumAnalyzer();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Provides the magnitude spectrum of the most recent frame, as (size / 2) 16 bit unsigned bins.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Define a downstream component for the magnitude spectra.
+         *
+         * @sink The component that data will be delivered to, when it is available
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Determines if this source is connected to a downstream component
+         *
+         * @return true If a downstream is connected
+         * @return false If a downstream is not connected
+         */
+        virtual bool isConnected();
+
+        /**
+         * Disconnects the downstream component.
+         */
+        virtual void disconnect();
+
+        /**
+         *  Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Determines the rate at which magnitude spectra are produced, in frames per second.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Changes the frame size and overlap of the analysis. Any partially collected frame is discarded.
+         *
+         * @param size The number of samples in each frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_SIZE and SPECTRUM_ANALYZER_MAX_SIZE.
+         * @param hop The number of new samples between consecutive frames, in the range 1..size. Defaults to size / 2.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+         */
+        int setSize(int size, int hop = 0);
+
+        /**
+         * Selects the window function applied to each frame.
+         *
+         * @param window SPECTRUM_ANALYZER_WINDOW_NONE or SPECTRUM_ANALYZER_WINDOW_HANN (the default).
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setWindow(int window);
+
+        /**
+         * Defines the magnitude at which SPECTRUM_ANALYZER_EVT_PEAK events are raised.
+         * Set to zero (the default) to disable peak events.
+         */
+        void setPeakThreshold(uint16_t threshold);
+
+        /**
+         * Starts monitoring the energy in a range of frequencies.
+         * SPECTRUM_ANALYZER_EVT_BAND_HIGH + band and SPECTRUM_ANALYZER_EVT_BAND_LOW + band events are raised as the energy
+         * crosses the given threshold.
+         *
+         * @param lowFrequency The lowest frequency in the band, in Hz.
+         * @param highFrequency The highest frequency in the band, in Hz.
+         * @param threshold The mean squared bin magnitude at which events are raised.
+         * @return The number of the band, or DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+         */
+        int addBand(float lowFrequency, float highFrequency, uint32_t threshold);
+
+        /**
+         * Determines the energy of a band in the most recent frame.
+         *
+         * @param band The band number, as returned by addBand().
+         * @return The mean squared magnitude of the bins in the band, or zero if the band is not valid.
+         */
+        uint32_t getBandEnergy(int band);
+
+        /**
+         * Determines the magnitude of a bin in the most recent frame.
+         *
+         * @param bin The bin, in the range 0..(size / 2 - 1).
+         * @return The magnitude of the bin, or zero if the bin is not valid.
+         */
+        uint16_t getMagnitude(int bin);
+
+        /**
+         * Determines the bin with the greatest magnitude (excluding DC) in the most recent frame.
+         */
+        int getPeakBin();
+
+        /**
+         * Determines the centre frequency of the bin with the greatest magnitude in the most recent frame.
+         *
+         * @return The frequency in Hz, or 0 if the sample rate of the stream is not known.
+         */
+        float getPeakFrequency();
+
+        /**
+         * Performs an in place, forward radix-2 FFT on Q15 data.
+         * Each stage is scaled by 1/2, so the result is the discrete fourier transform divided by size.
+         *
+         * @param real The real components of the data.
+         * @param imaginary The imaginary components of the data.
+         * @param size The number of points. Must be a power of two, no greater than SPECTRUM_ANALYZER_MAX_SIZE.
+         */
+        static void fft(int16_t *real, int16_t *imaginary, int size);
+
+    private:
+
+        /**
+         * Adds samples to the frame being collected, converting them into signed 16 bit values.
+         */
+        int collect(uint8_t *data, int count, int format);
+
+        /**
+         * Analyses a complete frame, and raises any resulting events.
+         */
+        void processFrame();
+
+        /**
+         * Releases the buffers used for analysis.
+         */
+        void release();
+    };
+}
+
+#endif
@@ -67,6 +67,7 @@ namespace codal
         virtual void disconnect();
         virtual int getFormat();
         virtual int setFormat( int format );
+        virtual int getSampleBits();
 
         void printChain();
 
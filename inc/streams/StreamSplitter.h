@@ -88,6 +88,7 @@ namespace codal{
             virtual void disconnect();
             virtual int getFormat();
             virtual int setFormat(int format);
+            virtual int getSampleBits();
             virtual float getSampleRate();
             virtual float requestSampleRate(float sampleRate);
     };
@@ -0,0 +1,294 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_WAVETABLE_SYNTHESIZER_H
+#define CODAL_WAVETABLE_SYNTHESIZER_H
+
+#include "DataStream.h"
+#include "Synthesizer.h"
+
+//
+// Compile Time Configuration Options
+//
+
+// The maximum number of voices that may be requested for a single WavetableSynthesizer.
+#ifndef WAVETABLE_SYNTHESIZER_MAX_VOICES
+#define WAVETABLE_SYNTHESIZER_MAX_VOICES        8
+#endif
+
+// The default number of voices allocated by a WavetableSynthesizer.
+#ifndef WAVETABLE_SYNTHESIZER_DEFAULT_VOICES
+#define WAVETABLE_SYNTHESIZER_DEFAULT_VOICES    4
+#endif
+
+// The default number of samples rendered on each pull().
+#ifndef WAVETABLE_SYNTHESIZER_BUFFER_SIZE
+#define WAVETABLE_SYNTHESIZER_BUFFER_SIZE       256
+#endif
+
+//
+// Waveforms supported by each voice.
+//
+#define SYNTHESIZER_WAVEFORM_SINE               0
+#define SYNTHESIZER_WAVEFORM_SQUARE             1
+#define SYNTHESIZER_WAVEFORM_TRIANGLE           2
+#define SYNTHESIZER_WAVEFORM_SAWTOOTH           3
+#define SYNTHESIZER_WAVEFORM_NOISE              4
+#define SYNTHESIZER_WAVEFORM_CUSTOM             5
+
+//
+// Envelope stages of a voice.
+//
+#define SYNTHESIZER_VOICE_IDLE                  0
+#define SYNTHESIZER_VOICE_ATTACK                1
+#define SYNTHESIZER_VOICE_DECAY                 2
+#define SYNTHESIZER_VOICE_SUSTAIN               3
+#define SYNTHESIZER_VOICE_RELEASE               4
+
+// Fixed point representation of a full scale envelope (1.0), in Q24.
+#define SYNTHESIZER_ENVELOPE_FULL_SCALE         (1 << 24)
+
+namespace codal
+{
+    /**
+     * State of a single voice within a WavetableSynthesizer.
+     */
+    struct SynthesizerVoice
+    {
+        uint32_t        phase;              // 32 bit phase accumulator. One complete waveform cycle is 2^32.
+        uint32_t        phaseDelta;         // Amount added to the phase accumulator for each output sample.
+        const int16_t   *table;             // Wavetable in use (SINE and CUSTOM waveforms).
+        uint8_t         tableShift;         // Right shift applied to the phase accumulator to index the wavetable.
+        uint8_t         waveform;           // One of the SYNTHESIZER_WAVEFORM_ constants.
+        uint8_t         stage;              // One of the SYNTHESIZER_VOICE_ constants.
+        int16_t         noise;              // Current noise value (NOISE waveform only).
+        int32_t         level;              // Current envelope level, in Q24.
+        int32_t         levelDelta;         // Change in envelope level per sample for the current stage.
+        int32_t         peakLevel;          // Envelope level reached at the end of the attack stage.
+        int32_t         stageSamples;       // Samples remaining in the current envelope stage.
+        int32_t         gateSamples;        // Samples remaining until the note is released automatically, or -1.
+        uint32_t        age;                // Sequence number of the note, used for voice stealing.
+        uint16_t        attack;             // Attack time, in milliseconds.
+        uint16_t        decay;              // Decay time, in milliseconds.
+        uint16_t        sustain;            // Sustain level, in the range 0..1024.
+        uint16_t        release;            // Release time, in milliseconds.
+    };
+
+    /**
+     * Class definition for a WavetableSynthesizer.
+     *
+     * A polyphonic synthesizer that renders a number of independent voices into a single buffer each time
+     * it is pulled. Each voice is driven by a 32 bit phase accumulator indexing a shared wavetable, and shaped
+     * by its own ADSR envelope. Rendering takes place block by block in the context of the downstream
+     * component, so no fiber is required.
+     */
+    class WavetableSynthesizer : public DataSource, public CodalComponent
+    {
+        SynthesizerVoice    voices[WAVETABLE_SYNTHESIZER_MAX_VOICES];
+        int                 voiceCount;         // Number of voices in use.
+        int                 sampleRate;         // Sample rate of the output, in Hz.
+        int                 bufferSize;         // Number of samples rendered on each pull().
+        int                 volume;             // Master volume, in the range 0..1024.
+        bool                isSigned;           // If true, samples use int16_t otherwise uint16_t.
+        bool                playing;            // Set when the downstream component has been notified of data.
+        uint32_t            noteCount;          // Sequence number of the most recently started note.
+        uint32_t            seed;               // State of the noise generator.
+        ManagedBuffer       mix;                // 32 bit accumulation buffer, reused on every pull().
+
+        public:
+
+        DataStream output;
+
+        /**
+         * A full cycle sine wave, 256 signed 16 bit samples.
+         */
+        static const int16_t SineTable[256];
+
+        /**
+          * Default Constructor.
+          *
+          * @param sampleRate The sample rate at which this synthesizer will produce data.
+          * @param voices The number of simultaneous voices to support, up to WAVETABLE_SYNTHESIZER_MAX_VOICES.
+          * @param isSigned If true, samples are generated as DATASTREAM_FORMAT_16BIT_SIGNED, otherwise DATASTREAM_FORMAT_16BIT_UNSIGNED.
+          */
+        WavetableSynthesizer(int sampleRate = SYNTHESIZER_SAMPLE_RATE, int voices = WAVETABLE_SYNTHESIZER_DEFAULT_VOICES, bool isSigned = false);
+
+        /**
+          * Destructor.
+          * Removes all resources held by the instance.
+          */
+        ~WavetableSynthesizer();
+
+        /**
+         * Starts a new note on the next available voice.
+         * If all voices are busy, the voice closest to completion is reused.
+         *
+         * @param frequency The frequency of the note, in Hz.
+         * @param volume The peak amplitude of the note, in the range 0..1024.
+         * @param duration If greater than zero, the note is released automatically after the given number of milliseconds.
+         * @return The voice used to play the note, or DEVICE_INVALID_PARAMETER.
+         */
+        int noteOn(float frequency, int volume = 1024, int duration = 0);
+
+        /**
+         * Starts a new note on the given voice, restarting its envelope.
+         *
+         * @param voice The voice to use.
+         * @param frequency The frequency of the note, in Hz.
+         * @param volume The peak amplitude of the note, in the range 0..1024.
+         * @param duration If greater than zero, the note is released automatically after the given number of milliseconds.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int noteOnVoice(int voice, float frequency, int volume, int duration = 0);
+
+        /**
+         * Moves the given voice into the release stage of its envelope.
+         *
+         * @param voice The voice to release.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int noteOff(int voice);
+
+        /**
+         * Releases all voices.
+         */
+        void allNotesOff();
+
+        /**
+         * Changes the frequency of a voice, without affecting its phase or envelope.
+         * Useful for glides and vibrato effects.
+         *
+         * @param voice The voice to update.
+         * @param frequency The new frequency, in Hz.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setFrequency(int voice, float frequency);
+
+        /**
+         * Selects one of the built in waveforms for a voice.
+         *
+         * @param voice The voice to update.
+         * @param waveform One of SYNTHESIZER_WAVEFORM_SINE, SYNTHESIZER_WAVEFORM_SQUARE, SYNTHESIZER_WAVEFORM_TRIANGLE,
+         * SYNTHESIZER_WAVEFORM_SAWTOOTH or SYNTHESIZER_WAVEFORM_NOISE.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setWaveform(int voice, int waveform);
+
+        /**
+         * Selects a custom wavetable for a voice. The table is not copied, and must remain valid while in use.
+         *
+         * @param voice The voice to update.
+         * @param table A single waveform cycle of signed 16 bit samples.
+         * @param length The number of samples in the table. Must be a power of two, between 2 and 65536.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setWavetable(int voice, const int16_t *table, int length);
+
+        /**
+         * Defines the ADSR envelope of a voice. Takes effect from the next note played on that voice.
+         *
+         * @param voice The voice to update.
+         * @param attack The time taken to reach the peak amplitude, in milliseconds.
+         * @param decay The time taken to fall from the peak to the sustain level, in milliseconds.
+         * @param sustain The level held until the note is released, in the range 0..1024 (relative to the peak).
+         * @param release The time taken to fall to silence once released, in milliseconds.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setEnvelope(int voice, int attack, int decay, int sustain, int release);
+
+        /**
+         * Determines if the given voice is currently producing sound.
+         *
+         * @param voice The voice to test.
+         * @return true if the voice is active, false otherwise.
+         */
+        bool isPlaying(int voice);
+
+        /**
+         * Defines the master volume of the synthesizer.
+         *
+         * @param volume The new output volume, in the range 0..1024
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+         */
+        int setVolume(int volume);
+
+        /**
+         * Defines the number of samples rendered on each pull. The larger the buffer, the lower the CPU overhead, but the longer the delay.
+         *
+         * @param size The new buffer size, in samples.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+         */
+        int setBufferSize(int size);
+
+        /**
+         * Determine the sample rate currently in use by this WavetableSynthesizer.
+         * @return the current sample rate, in Hz.
+         */
+        virtual float getSampleRate();
+
+        /**
+         * Change the sample rate used by this WavetableSynthesizer.
+         * Notes already playing retain their current phase increment and envelope timing.
+         *
+         * @param sampleRate The new sample rate, in Hz.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setSampleRate(int sampleRate);
+
+        /**
+         *  Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        private:
+
+        /**
+         * Advances a voice into the given envelope stage, calculating the length and gradient of that stage.
+         */
+        void enterStage(SynthesizerVoice &v, int stage);
+
+        /**
+         * Renders the given number of samples of a voice into the accumulation buffer,
+         * ramping its envelope linearly. The envelope stage does not change during the call.
+         */
+        void renderVoice(SynthesizerVoice &v, int32_t *out, int samples);
+
+        /**
+         * Converts a period in milliseconds into a number of samples at the current sample rate.
+         */
+        int32_t msToSamples(int ms);
+
+        /**
+         * Converts a frequency into a phase increment at the current sample rate.
+         */
+        uint32_t frequencyToDelta(float frequency);
+    };
+}
+
+#endif
@@ -0,0 +1,455 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef CODAL_MATRIX_H
+#define CODAL_MATRIX_H
+
+#include "CodalConfig.h"
+#include "ErrorNo.h"
+
+namespace codal
+{
+    /**
+     * A signed fixed point number, held in 32 bits with the given number of fractional bits.
+     * Products and quotients are calculated with 64 bit intermediates, so may be used with
+     * Matrix in place of float on devices without a floating point unit.
+     */
+    template <int F>
+    struct FixedPoint
+    {
+        static_assert(F > 0 && F < 31, "FixedPoint requires between 1 and 30 fractional bits");
+
+        int32_t raw;            // The value, scaled by 2^F.
+
+        FixedPoint() : raw(0) {}
+        FixedPoint(int v) : raw(v * (1 << F)) {}
+        FixedPoint(double v) : raw((int32_t) (v * (1 << F) + (v < 0 ? -0.5 : 0.5))) {}
+
+        /**
+         * Creates a value directly from its fixed point representation.
+         */
+        static FixedPoint fromRaw(int32_t raw) { FixedPoint r; r.raw = raw; return r; }
+
+        float toFloat() const { return (float) raw / (1 << F); }
+        int toInt() const { return raw >> F; }
+
+        FixedPoint operator+(const FixedPoint &b) const { return fromRaw(raw + b.raw); }
+        FixedPoint operator-(const FixedPoint &b) const { return fromRaw(raw - b.raw); }
+        FixedPoint operator-() const { return fromRaw(-raw); }
+        FixedPoint operator*(const FixedPoint &b) const { return fromRaw((int32_t) (((int64_t) raw * b.raw) >> F)); }
+        FixedPoint operator/(const FixedPoint &b) const { return fromRaw((int32_t) (((int64_t) raw << F) / b.raw)); }
+
+        FixedPoint& operator+=(const FixedPoint &b) { raw += b.raw; return *this; }
+        FixedPoint& operator-=(const FixedPoint &b) { raw -= b.raw; return *this; }
+        FixedPoint& operator*=(const FixedPoint &b) { return *this = *this * b; }
+
+        bool operator==(const FixedPoint &b) const { return raw == b.raw; }
+        bool operator!=(const FixedPoint &b) const { return raw != b.raw; }
+        bool operator<(const FixedPoint &b) const { return raw < b.raw; }
+        bool operator>(const FixedPoint &b) const { return raw > b.raw; }
+    };
+
+    template <int N, typename T> struct MatrixKernel;
+
+    /**
+     * Class definition for a matrix of fixed dimensions.
+     *
+     * Elements are held inline, so matrices may be placed on the stack or inside other objects, and no operation
+     * allocates memory. Dimensions are template parameters, so mismatched operations (such as multiplying a 3x4 matrix
+     * by a 3x3 matrix) are rejected at compile time. The element type may be float, or FixedPoint for devices without
+     * a floating point unit. Loops have constant bounds, allowing the compiler to unroll them.
+     */
+    template <int R, int C, typename T = float>
+    class Matrix
+    {
+        static_assert(R > 0 && C > 0, "Matrix dimensions must be positive");
+
+        template <int, int, typename> friend class Matrix;
+
+        T       data[R * C];    // Elements, in row major order.
+
+        public:
+
+        /**
+          * Constructor.
+          * Create a matrix with all elements set to zero.
+          */
+        Matrix()
+        {
+            for (int i = 0; i < R * C; i++)
+                data[i] = T();
+        }
+
+        /**
+          * Constructor.
+          * Create a matrix from the given elements.
+          *
+          * @param values R * C elements, in row major order.
+          */
+        explicit Matrix(const T *values)
+        {
+            for (int i = 0; i < R * C; i++)
+                data[i] = values[i];
+        }
+
+        /**
+          * Creates an identity matrix.
+          */
+        static Matrix identity()
+        {
+            static_assert(R == C, "Only square matrices have an identity");
+
+            Matrix result;
+            for (int i = 0; i < R; i++)
+                result.data[i * C + i] = T(1);
+
+            return result;
+        }
+
+        /**
+          * Determines the number of columns in this matrix.
+          */
+        static constexpr int width() { return C; }
+
+        /**
+          * Determines the number of rows in this matrix.
+          */
+        static constexpr int height() { return R; }
+
+        /**
+          * Reads the matrix element at the given position.
+          *
+          * @param row The row of the element to read.
+          * @param col The column of the element to read.
+          *
+          * @return The value of the matrix element at the given position. 0 is returned if the given index is out of range.
+          */
+        T get(int row, int col) const
+        {
+            if (row < 0 || col < 0 || row >= R || col >= C)
+                return T();
+
+            return data[row * C + col];
+        }
+
+        /**
+          * Writes the matrix element at the given position.
+          *
+          * @param row The row of the element to write.
+          * @param col The column of the element to write.
+          * @param v The new value of the element.
+          */
+        void set(int row, int col, T v)
+        {
+            if (row < 0 || col < 0 || row >= R || col >= C)
+                return;
+
+            data[row * C + col] = v;
+        }
+
+        /**
+          * Provides unchecked access to the element at the given position.
+          */
+        T& operator()(int row, int col) { return data[row * C + col]; }
+        const T& operator()(int row, int col) const { return data[row * C + col]; }
+
+        /**
+          * Provides the elements of this matrix, in row major order.
+          */
+        T* getData() { return data; }
+        const T* getData() const { return data; }
+
+        /**
+          * Transposes this matrix.
+          *
+          * @return the resultant matrix.
+          */
+        Matrix<C, R, T> transpose() const
+        {
+            Matrix<C, R, T> result;
+
+            for (int r = 0; r < R; r++)
+                for (int c = 0; c < C; c++)
+                    result.data[c * R + r] = data[r * C + c];
+
+            return result;
+        }
+
+        /**
+          * Multiplies this matrix with the given matrix.
+          *
+          * @param matrix the matrix to multiply this matrix's values against.
+          * @return the resultant matrix.
+          */
+        template <int K>
+        Matrix<R, K, T> multiply(const Matrix<C, K, T> &matrix) const
+        {
+            Matrix<R, K, T> result;
+
+            for (int r = 0; r < R; r++)
+            {
+                for (int k = 0; k < K; k++)
+                {
+                    T v = data[r * C] * matrix.data[k];
+
+                    for (int i = 1; i < C; i++)
+                        v += data[r * C + i] * matrix.data[i * K + k];
+
+                    result.data[r * K + k] = v;
+                }
+            }
+
+            return result;
+        }
+
+        /**
+          * Multiplies the transpose of this matrix with the given matrix, without forming the transpose.
+          *
+          * @param matrix the matrix to multiply this matrix's values against.
+          * @return the resultant matrix.
+          */
+        template <int K>
+        Matrix<C, K, T> multiplyT(const Matrix<R, K, T> &matrix) const
+        {
+            Matrix<C, K, T> result;
+
+            for (int c = 0; c < C; c++)
+            {
+                for (int k = 0; k < K; k++)
+                {
+                    T v = data[c] * matrix.data[k];
+
+                    for (int i = 1; i < R; i++)
+                        v += data[i * C + c] * matrix.data[i * K + k];
+
+                    result.data[c * K + k] = v;
+                }
+            }
+
+            return result;
+        }
+
+        template <int K>
+        Matrix<R, K, T> operator*(const Matrix<C, K, T> &matrix) const { return multiply(matrix); }
+
+        Matrix operator+(const Matrix &matrix) const
+        {
+            Matrix result;
+            for (int i = 0; i < R * C; i++)
+                result.data[i] = data[i] + matrix.data[i];
+
+            return result;
+        }
+
+        Matrix operator-(const Matrix &matrix) const
+        {
+            Matrix result;
+            for (int i = 0; i < R * C; i++)
+                result.data[i] = data[i] - matrix.data[i];
+
+            return result;
+        }
+
+        Matrix operator*(T scale) const
+        {
+            Matrix result;
+            for (int i = 0; i < R * C; i++)
+                result.data[i] = data[i] * scale;
+
+            return result;
+        }
+
+        /**
+          * Calculates the determinant of this matrix.
+          * Only square matrices of up to 4x4 are supported by this operation.
+          */
+        T determinant() const
+        {
+            static_assert(R == C && R <= 4, "determinant() is only supported for square matrices of up to 4x4");
+            return MatrixKernel<R, T>::determinant(data);
+        }
+
+        /**
+          * Inverts this matrix.
+          * Only square matrices of up to 4x4 are supported by this operation.
+          *
+          * @param result The matrix in which to store the inverse. May be this matrix.
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the matrix is singular (in which case result is unchanged).
+          */
+        int invert(Matrix &result) const
+        {
+            static_assert(R == C && R <= 4, "invert() is only supported for square matrices of up to 4x4");
+            return MatrixKernel<R, T>::invert(data, result.data);
+        }
+    };
+
+    /**
+     * Unrolled determinant and inversion kernels for small square matrices, in row major order.
+     * The inverse is formed from the adjugate, and is written only if the matrix is not singular.
+     */
+    template <typename T>
+    struct MatrixKernel<1, T>
+    {
+        static T determinant(const T *m) { return m[0]; }
+
+        static int invert(const T *m, T *out)
+        {
+            if (m[0] == T())
+                return DEVICE_INVALID_PARAMETER;
+
+            out[0] = T(1) / m[0];
+            return DEVICE_OK;
+        }
+    };
+
+    template <typename T>
+    struct MatrixKernel<2, T>
+    {
+        static T determinant(const T *m) { return m[0] * m[3] - m[1] * m[2]; }
+
+        static int invert(const T *m, T *out)
+        {
+            T det = determinant(m);
+
+            if (det == T())
+                return DEVICE_INVALID_PARAMETER;
+
+            T a = m[0], b = m[1], c = m[2], d = m[3];
+
+            out[0] = d / det;
+            out[1] = -b / det;
+            out[2] = -c / det;
+            out[3] = a / det;
+
+            return DEVICE_OK;
+        }
+    };
+
+    template <typename T>
+    struct MatrixKernel<3, T>
+    {
+        static T determinant(const T *m)
+        {
+            return m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) + m[2] * (m[3] * m[7] - m[4] * m[6]);
+        }
+
+        static int invert(const T *m, T *out)
+        {
+            T a[9];
+
+            a[0] = m[4] * m[8] - m[5] * m[7];
+            a[1] = m[2] * m[7] - m[1] * m[8];
+            a[2] = m[1] * m[5] - m[2] * m[4];
+            a[3] = m[5] * m[6] - m[3] * m[8];
+            a[4] = m[0] * m[8] - m[2] * m[6];
+            a[5] = m[2] * m[3] - m[0] * m[5];
+            a[6] = m[3] * m[7] - m[4] * m[6];
+            a[7] = m[1] * m[6] - m[0] * m[7];
+            a[8] = m[0] * m[4] - m[1] * m[3];
+
+            T det = m[0] * a[0] + m[1] * a[3] + m[2] * a[6];
+
+            if (det == T())
+                return DEVICE_INVALID_PARAMETER;
+
+            for (int i = 0; i < 9; i++)
+                out[i] = a[i] / det;
+
+            return DEVICE_OK;
+        }
+    };
+
+    template <typename T>
+    struct MatrixKernel<4, T>
+    {
+        /**
+         * Calculates the adjugate of m, using the 2x2 sub-determinants of the upper and lower pairs of rows.
+         *
+         * @return The determinant of m.
+         */
+        static T adjugate(const T *m, T *a)
+        {
+            T s0 = m[0] * m[5] - m[4] * m[1];
+            T s1 = m[0] * m[6] - m[4] * m[2];
+            T s2 = m[0] * m[7] - m[4] * m[3];
+            T s3 = m[1] * m[6] - m[5] * m[2];
+            T s4 = m[1] * m[7] - m[5] * m[3];
+            T s5 = m[2] * m[7] - m[6] * m[3];
+
+            T c5 = m[10] * m[15] - m[14] * m[11];
+            T c4 = m[9] * m[15] - m[13] * m[11];
+            T c3 = m[9] * m[14] - m[13] * m[10];
+            T c2 = m[8] * m[15] - m[12] * m[11];
+            T c1 = m[8] * m[14] - m[12] * m[10];
+            T c0 = m[8] * m[13] - m[12] * m[9];
+
+            if (a)
+            {
+                a[0] = m[5] * c5 - m[6] * c4 + m[7] * c3;
+                a[1] = -m[1] * c5 + m[2] * c4 - m[3] * c3;
+                a[2] = m[13] * s5 - m[14] * s4 + m[15] * s3;
+                a[3] = -m[9] * s5 + m[10] * s4 - m[11] * s3;
+
+                a[4] = -m[4] * c5 + m[6] * c2 - m[7] * c1;
+                a[5] = m[0] * c5 - m[2] * c2 + m[3] * c1;
+                a[6] = -m[12] * s5 + m[14] * s2 - m[15] * s1;
+                a[7] = m[8] * s5 - m[10] * s2 + m[11] * s1;
+
+                a[8] = m[4] * c4 - m[5] * c2 + m[7] * c0;
+                a[9] = -m[0] * c4 + m[1] * c2 - m[3] * c0;
+                a[10] = m[12] * s4 - m[13] * s2 + m[15] * s0;
+                a[11] = -m[8] * s4 + m[9] * s2 - m[11] * s0;
+
+                a[12] = -m[4] * c3 + m[5] * c1 - m[6] * c0;
+                a[13] = m[0] * c3 - m[1] * c1 + m[2] * c0;
+                a[14] = -m[12] * s3 + m[13] * s1 - m[14] * s0;
+                a[15] = m[8] * s3 - m[9] * s1 + m[10] * s0;
+            }
+
+            return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        }
+
+        static T determinant(const T *m) { return adjugate(m, NULL); }
+
+        static int invert(const T *m, T *out)
+        {
+            T a[16];
+            T det = adjugate(m, a);
+
+            if (det == T())
+                return DEVICE_INVALID_PARAMETER;
+
+            for (int i = 0; i < 16; i++)
+                out[i] = a[i] / det;
+
+            return DEVICE_OK;
+        }
+    };
+
+    typedef Matrix<3, 3, float> Matrix3f;
+    typedef Matrix<4, 4, float> Matrix4f;
+}
+
+#endif
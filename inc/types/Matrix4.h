@@ -26,6 +26,12 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_MATRIX4_H
 
 #include "CodalConfig.h"
+#include "Matrix.h"
+
+// Matrices with up to this many elements are held inline, rather than on the heap.
+#ifndef MATRIX4_INLINE_SIZE
+#define MATRIX4_INLINE_SIZE     16
+#endif
 
 /**
 * Class definition for a simple matrix, that is optimised for nx4 or 4xn matrices.
@@ -33,6 +39,12 @@ DEALINGS IN THE SOFTWARE.
 * This class is heavily optimised for these commonly used matrices as used in 3D geometry.
 * Whilst this class does support basic operations on matrices of any dimension, it is not intended as a
 * general purpose matrix class as inversion operations are only provided for 4x4 matrices.
+*
+* Matrix4 is retained for compatibility. Where dimensions are known at compile time, the codal::Matrix
+* template should be preferred, as it never allocates memory and checks dimensions at compile time.
+* Matrix4 instances of up to MATRIX4_INLINE_SIZE elements (such as 4x4) are also held inline, and
+* share the inversion kernel of codal::Matrix.
+*
 * For programmers needing more flexible Matrix support, the Matrix and MatrixMath classes from
 * Ernsesto Palacios provide a good basis:
 *
@@ -41,9 +53,20 @@ DEALINGS IN THE SOFTWARE.
 */
 class Matrix4
 {
-	float   *data;         // Linear buffer representing the matrix.
+	float   *data;          // Linear buffer representing the matrix.
 	int     rows;           // The number of rows in the matrix.
 	int     cols;           // The number of columns in the matrix.
+	float   storage[MATRIX4_INLINE_SIZE];   // Inline storage, used for small matrices.
+
+	/**
+	  * Sets the dimensions of the matrix, allocating storage as necessary.
+	  */
+	void allocate(int rows, int cols);
+
+	/**
+	  * Releases any storage allocated on the heap.
+	  */
+	void release();
 
 public:
 
@@ -73,6 +96,28 @@ public:
 	  */
 	Matrix4(const Matrix4 &matrix);
 
+	/**
+	  * Constructor.
+	  * Create a matrix from a fixed size matrix.
+	  *
+	  * @param matrix The matrix to copy.
+	  */
+	template <int R, int C>
+	Matrix4(const codal::Matrix<R, C, float> &matrix)
+	{
+		allocate(R, C);
+
+		for (int i = 0; i < R * C; i++)
+			data[i] = matrix.getData()[i];
+	}
+
+	/**
+	  * Copy assignment operator.
+	  *
+	  * @param matrix The matrix to copy.
+	  */
+	Matrix4& operator=(const Matrix4 &matrix);
+
 	/**
 	  * Determines the number of columns in this matrix.
 	  *
@@ -0,0 +1,337 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef DEVICE_PACKED_IMAGE_H
+#define DEVICE_PACKED_IMAGE_H
+
+#include "CodalConfig.h"
+#include "RefCounted.h"
+#include "Image.h"
+
+namespace codal
+{
+    struct PackedImageData : RefCounted
+    {
+        uint16_t width;         // Width in pixels
+        uint16_t height;        // Height in pixels
+        uint16_t stride;        // Number of bytes used to hold each column
+        uint8_t bitsPerPixel;   // 1, 2 or 4
+        uint8_t reserved;
+        uint8_t data[0];        // Packed, column-major bitmap
+    };
+
+    /**
+      * Class definition for a PackedImage.
+      *
+      * A PackedImage is a bitmap holding 1, 2 or 4 bits per pixel, rather than the byte per pixel used by Image.
+      * The bitmap is stored column by column, left to right. Each column holds its pixels from top to bottom, starting
+      * at the least significant bits of its first byte, and is padded to a whole number of bytes. This is the same
+      * layout used by ST7735::sendIndexedImage(), so 4 bit images can be sent to a colour screen with no conversion,
+      * and 1 and 2 bit images can be expanded directly into the screen driver's work buffer.
+      *
+      * Operations work on many pixels at a time: horizontal shifts move whole columns, and pastes, vertical shifts
+      * and glyph rendering move up to 24 bits of a column at once.
+      *
+      * n.b. This is a mutable, managed type.
+      */
+    class PackedImage
+    {
+        PackedImageData *ptr;   // Pointer to payload data
+
+        /**
+          * Internal constructor which provides sanity checking and initialises class properties.
+          *
+          * @param x the width of the image
+          *
+          * @param y the height of the image
+          *
+          * @param bitsPerPixel the number of bits used to represent each pixel.
+          */
+        void init(const int16_t x, const int16_t y, int bitsPerPixel);
+
+        /**
+          * Internal constructor which defaults to the Empty PackedImage instance variable
+          */
+        void init_empty();
+
+        public:
+        static PackedImage EmptyImage;  // Shared representation of a null image.
+
+        /**
+          * Return the packed bitmap held by this image.
+          */
+        uint8_t *getBitmap()
+        {
+            return ptr->data;
+        }
+
+        /**
+          * Constructor.
+          * Create an image from a specially prepared constant array, with no copying. Will call ptr->incr().
+          *
+          * @param ptr The literal - first two bytes should be 0xff, then width, height and stride as 16 bit values,
+          * the number of bits per pixel, a zero byte and the bitmap. The literal has to be 4-byte aligned.
+          */
+        PackedImage(PackedImageData *ptr);
+
+        /**
+          * Default Constructor.
+          * Creates a new reference to the empty PackedImage bitmap
+          */
+        PackedImage();
+
+        /**
+          * Copy Constructor.
+          * Add ourselves as a reference to an existing PackedImage.
+          *
+          * @param image The PackedImage to reference.
+          */
+        PackedImage(const PackedImage &image);
+
+        /**
+          * Constructor.
+          * Create a blank bitmap representation of a given size.
+          *
+          * @param x the width of the image.
+          *
+          * @param y the height of the image.
+          *
+          * @param bitsPerPixel the number of bits used to represent each pixel: 1, 2 or 4. Defaults to 1.
+          *
+          * @code
+          * PackedImage i(160, 128, 4); // a 4 bit image the size of a 1.8" ST7735 screen, in 10240 bytes
+          * @endcode
+          */
+        PackedImage(const int16_t x, const int16_t y, int bitsPerPixel = 1);
+
+        /**
+          * Constructor.
+          * Create a packed copy of the given Image. Pixel values are scaled from the range 0..255 into the range
+          * of the chosen format, rounding up so that no lit pixel is lost.
+          *
+          * @param image the Image to convert.
+          *
+          * @param bitsPerPixel the number of bits used to represent each pixel: 1, 2 or 4. Defaults to 1.
+          */
+        PackedImage(Image &image, int bitsPerPixel = 1);
+
+        /**
+          * Destructor.
+          *
+          * Removes buffer resources held by the instance.
+          */
+        ~PackedImage();
+
+        /**
+          * Copy assign operation.
+          *
+          * @param i The PackedImage to reference.
+          */
+        PackedImage& operator = (const PackedImage& i);
+
+        /**
+          * Equality operation.
+          *
+          * @param i The PackedImage to test ourselves against.
+          *
+          * @return true if this PackedImage is identical to the one supplied, false otherwise.
+          */
+        bool operator== (const PackedImage& i);
+
+        /**
+          * Resets all pixels in this image to 0.
+          */
+        void clear();
+
+        /**
+          * Sets every pixel in this image to the given value.
+          *
+          * @param value the pixel value, which is truncated to the range of this image.
+          */
+        void fill(int value);
+
+        /**
+          * Sets the pixel at the given co-ordinates to a given value.
+          *
+          * @param x The co-ordinate of the pixel to change.
+          *
+          * @param y The co-ordinate of the pixel to change.
+          *
+          * @param value The new value of the pixel, which is truncated to the range of this image.
+          *
+          * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER.
+          */
+        int setPixelValue(int16_t x , int16_t y, uint8_t value);
+
+        /**
+          * Retrieves the value of a given pixel.
+          *
+          * @param x The x co-ordinate of the pixel to read. Must be within the dimensions of the image.
+          *
+          * @param y The y co-ordinate of the pixel to read. Must be within the dimensions of the image.
+          *
+          * @return The value assigned to the given pixel location, or DEVICE_INVALID_PARAMETER.
+          */
+        int getPixelValue(int16_t x , int16_t y);
+
+        /**
+          * Pastes a given image at the given co-ordinates.
+          *
+          * Any pixels in the relevant area of this image are replaced. Both images must use the same number of bits per pixel.
+          *
+          * @param image The PackedImage to paste.
+          *
+          * @param x The leftmost X co-ordinate in this image where the given image should be pasted. Defaults to 0.
+          *
+          * @param y The uppermost Y co-ordinate in this image where the given image should be pasted. Defaults to 0.
+          *
+          * @param alpha set to 1 if transparency clear pixels in given image should be treated as transparent. Set to 0 otherwise.  Defaults to 0.
+          *
+          * @return The number of pixels in the area written, or DEVICE_INVALID_PARAMETER.
+          */
+        int paste(const PackedImage &image, int16_t x = 0, int16_t y = 0, uint8_t alpha = 0);
+
+        /**
+          * Prints a character to the image at the given location, using the system font.
+          *
+          * @param c The character to display.
+          *
+          * @param x The x co-ordinate of on the image to place the top left of the character. Defaults to 0.
+          *
+          * @param y The y co-ordinate of on the image to place the top left of the character. Defaults to 0.
+          *
+          * @param value The value given to lit pixels of the character. Defaults to the maximum value of this image.
+          *
+          * @param alpha set to 1 if unlit pixels of the character should leave the image unchanged, or 0 to clear them. Defaults to 0.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int print(char c, int16_t x = 0, int16_t y = 0, int value = -1, uint8_t alpha = 0);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels to the left.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftLeft(int16_t n);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels to the right.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftRight(int16_t n);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels upward.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftUp(int16_t n);
+
+        /**
+          * Shifts the pixels in this image a given number of pixels downward.
+          *
+          * @param n The number of pixels to shift.
+          *
+          * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+          */
+        int shiftDown(int16_t n);
+
+        /**
+          * Creates an unpacked copy of this image. Pixel values are scaled into the range 0..255.
+          *
+          * @return an Image holding one byte per pixel.
+          */
+        Image toImage();
+
+        /**
+          * Gets the width of this image.
+          *
+          * @return The width of this image.
+          */
+        int getWidth() const
+        {
+            return ptr->width;
+        }
+
+        /**
+          * Gets the height of this image.
+          *
+          * @return The height of this image.
+          */
+        int getHeight() const
+        {
+            return ptr->height;
+        }
+
+        /**
+          * Gets the number of bits used to represent each pixel.
+          *
+          * @return 1, 2 or 4.
+          */
+        int getBitsPerPixel() const
+        {
+            return ptr->bitsPerPixel;
+        }
+
+        /**
+          * Gets the number of bytes used to hold each column of this image.
+          */
+        int getStride() const
+        {
+            return ptr->stride;
+        }
+
+        /**
+          * Gets the size of the bitmap held by this image, in bytes.
+          */
+        int getSize() const
+        {
+            return ptr->width * ptr->stride;
+        }
+
+        /**
+          * Determines if this image points to a static bitmap held in flash.
+          *
+          * @return true if the image is read only, false otherwise.
+          */
+        bool isReadOnly();
+
+        /**
+          * Create a copy of the image bitmap. Used particularly, when isReadOnly() is true.
+          *
+          * @return an instance of PackedImage which can be modified independently of the current instance
+          */
+        PackedImage clone();
+    };
+}
+
+#endif
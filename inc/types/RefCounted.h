@@ -84,6 +84,7 @@ namespace codal
     #define REF_TAG_STRING 1
     #define REF_TAG_BUFFER 2
     #define REF_TAG_IMAGE 3
+    #define REF_TAG_PACKED_IMAGE 4
     #define REF_TAG_USER 32
 
     #define REF_COUNTED_DEF_EMPTY(...)                                                                 \
@@ -49,6 +49,7 @@ Accelerometer::Accelerometer(CoordinateSpace &cspace, uint16_t id) : sample(), s
     // Set a default rate of 50Hz and a +/-2g range.
     this->samplePeriod = 20;
     this->sampleRange = 2;
+    this->batchSize = 1;
 
     // Initialise gesture history
     this->sigma = 0;
@@ -95,6 +96,47 @@ int Accelerometer::update()
     return DEVICE_OK;
 };
 
+/**
+ * Stores a block of samples read from the hardware FIFO, and performs gesture tracking on each in turn.
+ * The last sample of the block becomes the current sample, and a single ACCELEROMETER_EVT_DATA_UPDATE event is raised.
+ *
+ * @param samples The samples read, oldest first, in raw ENU format (milli-g).
+ * @param count The number of samples.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES.
+ */
+int Accelerometer::updateBatch(const Sample3D *samples, int count)
+{
+    if (count <= 0)
+        return DEVICE_OK;
+
+    // Allocate a fresh buffer, so that any block still held by application code is left intact.
+    ManagedBuffer b(count * sizeof(Sample3D), BufferInitialize::None);
+    Sample3D *out = (Sample3D *) b.getBytes();
+
+    if (out == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    for (int i = 0; i < count; i++)
+    {
+        sampleENU = samples[i];
+        sample = coordinateSpace.transform(sampleENU);
+        out[i] = sample;
+
+        updateGesture();
+    }
+
+    batch = b;
+
+    // Indicate that pitch and roll data is now stale, and needs to be recalculated if needed.
+    status &= ~ACCELEROMETER_IMU_DATA_VALID;
+
+    // Indicate that a new block of samples is available
+    Event e(id, ACCELEROMETER_EVT_DATA_UPDATE);
+
+    return DEVICE_OK;
+}
+
 /**
   * A service function.
   * It calculates the current scalar acceleration of the device (x^2 + y^2 + z^2).
@@ -357,6 +399,47 @@ int Accelerometer::getRange()
     return (int)sampleRange;
 }
 
+/**
+  * Attempts to enable batched operation, where samples are collected in the hardware FIFO of the
+  * accelerometer and read in a single burst once the given number are available.
+  *
+  * @param samples The number of samples in each batch, or 1 to read every sample as it becomes available.
+  *
+  * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_I2C_ERROR if the request fails.
+  *
+  * @note The requested batch size may not be possible on the hardware. In this case, the
+  * nearest lower size is chosen (1 if the hardware has no FIFO).
+  */
+int Accelerometer::setBatchSize(int samples)
+{
+    if (samples < 1 || samples > ACCELEROMETER_MAX_BATCH_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    // The driver reduces batchSize to what the hardware supports.
+    batchSize = samples;
+    return configure();
+}
+
+/**
+  * Reads the currently configured batch size of the accelerometer.
+  *
+  * @return The number of samples read in each batch.
+  */
+int Accelerometer::getBatchSize()
+{
+    return (int)batchSize;
+}
+
+/**
+  * Provides the samples read in the most recent batch, in the coordinate system defined in the constructor.
+  *
+  * @return A buffer of Sample3D values, in milli-g, oldest first. Empty if batched operation has not been used.
+  */
+ManagedBuffer Accelerometer::getBatch()
+{
+    return batch;
+}
+
 /**
  * Reads the last accelerometer value stored, and provides it in the coordinate system requested.
  *
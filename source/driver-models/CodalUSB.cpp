@@ -226,6 +226,14 @@ int CodalUSB::sendConfig()
     // calculate the total size of our interfaces.
     for (CodalUSBInterface *iface = interfaces; iface; iface = iface->next)
     {
+        int len = iface->fillDescriptors(NULL);
+        if (len > 0)
+        {
+            clen += len;
+            numInterfaces += iface->getInterfaceCount();
+            continue;
+        }
+
         info = iface->getInterfaceInfo();
         clen += sizeof(InterfaceDescriptor) +
                 info->iface.numEndpoints * sizeof(EndpointDescriptor) +
@@ -247,6 +255,13 @@ int CodalUSB::sendConfig()
     // send our descriptors
     for (CodalUSBInterface *iface = interfaces; iface; iface = iface->next)
     {
+        int len = iface->fillDescriptors(buf + clen);
+        if (len > 0)
+        {
+            clen += len;
+            continue;
+        }
+
         info = iface->getInterfaceInfo();
         InterfaceDescriptor desc;
         iface->fillInterfaceInfo(&desc);
@@ -376,7 +391,8 @@ int CodalUSB::add(CodalUSBInterface &interface)
 {
     usb_assert(!usb_configured);
 
-    uint8_t epsConsumed = NUM_ENDPOINTS(interface.getInterfaceInfo()->allocateEndpoints);
+    uint8_t epsConsumed = NUM_ENDPOINTS(interface.getInterfaceInfo()->allocateEndpoints) +
+                          interface.getExtraEndpointCount();
 
     if (endpointsUsed + epsConsumed > DEVICE_USB_ENDPOINTS)
         return DEVICE_NO_RESOURCES;
@@ -429,8 +445,11 @@ int CodalUSB::interfaceRequest(USBSetup &setup, bool isClass)
 
     for (CodalUSBInterface *iface = interfaces; iface; iface = iface->next)
     {
-        if (iface->interfaceIdx == ifaceIdx ||
-            ((iface->in && iface->in->ep == epIdx) || (iface->out && iface->out->ep == epIdx)))
+        if ((iface->interfaceIdx <= ifaceIdx &&
+             ifaceIdx < iface->interfaceIdx + iface->getInterfaceCount()) ||
+            ((iface->in && iface->in->ep == epIdx) || (iface->out && iface->out->ep == epIdx)) ||
+            (iface->extraEndpointIdx <= epIdx &&
+             epIdx < iface->extraEndpointIdx + iface->getExtraEndpointCount()))
         {
             int res =
                 isClass ? iface->classRequest(*ctrlIn, setup) : iface->stdRequest(*ctrlIn, setup);
@@ -519,6 +538,26 @@ void CodalUSB::setupRequest(USBSetup &setup)
             send(&wStatus, 1);
             break;
 
+        case USB_REQ_GET_INTERFACE:
+        case USB_REQ_SET_INTERFACE:
+            LOG("GET/SET IFACE");
+            transactionStatus = interfaceRequest(setup, false);
+            if (transactionStatus == DEVICE_NOT_SUPPORTED)
+            {
+                // interfaces without alternate settings only have setting 0
+                if (setup.bRequest == USB_REQ_GET_INTERFACE)
+                {
+                    send(&wStatus, 1);
+                    transactionStatus = DEVICE_OK;
+                }
+                else if (wValue == 0)
+                {
+                    sendzlp();
+                    transactionStatus = DEVICE_OK;
+                }
+            }
+            break;
+
         case USB_REQ_SET_CONFIGURATION:
             LOG("SET CONF");
             if (USB_REQ_DEVICE == (request_type & USB_REQ_DESTINATION))
@@ -611,7 +650,8 @@ void CodalUSB::initEndpoints()
 
     for (CodalUSBInterface *iface = interfaces; iface; iface = iface->next)
     {
-        iface->interfaceIdx = ifaceCount++;
+        iface->interfaceIdx = ifaceCount;
+        ifaceCount += iface->getInterfaceCount();
 
 #if CONFIG_ENABLED(DEVICE_WEBUSB)
         if (iface->enableWebUSB())
@@ -648,6 +688,9 @@ void CodalUSB::initEndpoints()
         }
 
         endpointCount += numep;
+
+        iface->extraEndpointIdx = endpointCount;
+        endpointCount += iface->getExtraEndpointCount();
     }
 
     usb_assert(endpointsUsed == endpointCount);
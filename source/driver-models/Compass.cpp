@@ -27,6 +27,7 @@ DEALINGS IN THE SOFTWARE.
 #include "Event.h"
 #include "CodalCompat.h"
 #include "CodalFiber.h"
+#include "KeyValueStorage.h"
 
 #define CALIBRATED_SAMPLE(sample, axis) (((sample.axis - calibration.centre.axis) * calibration.scale.axis) >> 10)
 
@@ -75,6 +76,9 @@ void Compass::init(uint16_t id)
     // Set a default rate of 50Hz.
     this->samplePeriod = 20;
 
+    // Online calibration is disabled until requested.
+    this->calibrator = NULL;
+
     // Assume that we have no calibration information.
     status &= ~COMPASS_STATUS_CALIBRATED;
 
@@ -103,7 +107,7 @@ int Compass::heading()
     if(status & COMPASS_STATUS_CALIBRATING)
         return DEVICE_CALIBRATION_IN_PROGRESS;
 
-    if(!(status & COMPASS_STATUS_CALIBRATED))
+    if(!(status & (COMPASS_STATUS_CALIBRATED | COMPASS_STATUS_ONLINE_CALIBRATION)))
         calibrate();
 
     if(accelerometer != NULL)
@@ -223,6 +227,79 @@ void Compass::clearCalibration()
 {
     calibration = CompassCalibration();
     status &= ~COMPASS_STATUS_CALIBRATED;
+
+    if (calibrator)
+        calibrator->reset();
+}
+
+/**
+ * Enables or disables online calibration.
+ *
+ * When enabled, the calibration is continuously refined from the normal stream of samples, without blocking.
+ * Once enough of the sphere of possible orientations has been seen, the calibration is applied and a
+ * COMPASS_EVT_CALIBRATION_UPDATED event is raised. Further events are raised as the calibration changes significantly
+ * (for instance, if the device is moved into a different magnetic environment), which an application may use to persist it.
+ * While online calibration is enabled, heading() does not block waiting for the user to calibrate the compass.
+ *
+ * @param enable true to enable online calibration, false to disable it.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES.
+ */
+int Compass::setOnlineCalibration(bool enable)
+{
+    if (enable && calibrator == NULL)
+    {
+        calibrator = new CompassCalibrator();
+
+        if (calibrator == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        status |= COMPASS_STATUS_ONLINE_CALIBRATION;
+    }
+
+    if (!enable && calibrator != NULL)
+    {
+        delete calibrator;
+        calibrator = NULL;
+
+        status &= ~COMPASS_STATUS_ONLINE_CALIBRATION;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stores the current calibration in the given storage, so that it may be restored after a reset.
+ *
+ * @param storage The storage to use.
+ * @return DEVICE_OK on success, DEVICE_CALIBRATION_REQUIRED if the compass is not calibrated, or DEVICE_NO_RESOURCES.
+ */
+int Compass::saveCalibration(KeyValueStorage &storage)
+{
+    if (!(status & COMPASS_STATUS_CALIBRATED))
+        return DEVICE_CALIBRATION_REQUIRED;
+
+    return storage.put(COMPASS_CALIBRATION_KEY, (uint8_t *) &calibration, sizeof(CompassCalibration));
+}
+
+/**
+ * Restores a calibration previously stored with saveCalibration().
+ *
+ * @param storage The storage to use.
+ * @return DEVICE_OK on success, or DEVICE_NO_DATA if no calibration has been stored.
+ */
+int Compass::loadCalibration(KeyValueStorage &storage)
+{
+    KeyValuePair *pair = storage.get(COMPASS_CALIBRATION_KEY);
+
+    if (pair == NULL)
+        return DEVICE_NO_DATA;
+
+    CompassCalibration c;
+    memcpy(&c, pair->value, sizeof(CompassCalibration));
+    delete pair;
+
+    setCalibration(c);
+    return DEVICE_OK;
 }
 
 /**
@@ -283,6 +360,18 @@ int Compass::getPeriod()
  */
 int Compass::update()
 {
+    // Refine the online calibration (if enabled) using the raw data, and adopt any new estimate.
+    if (calibrator)
+    {
+        CompassCalibration c;
+
+        if (calibrator->addSample(sampleENU, c))
+        {
+            setCalibration(c);
+            Event(id, COMPASS_EVT_CALIBRATION_UPDATED);
+        }
+    }
+
     // Store the raw data, and apply any calibration data we have.
     sampleENU.x = CALIBRATED_SAMPLE(sampleENU, x);
     sampleENU.y = CALIBRATED_SAMPLE(sampleENU, y);
@@ -412,6 +501,217 @@ int Compass::basicBearing()
   */
 Compass::~Compass()
 {
+    delete calibrator;
 }
 
+/**
+ * Rounds the given value to the nearest integer.
+ */
+static int roundToInt(float v)
+{
+    return (int) (v + (v < 0 ? -0.5f : 0.5f));
+}
+
+/**
+ * Constructor.
+ */
+CompassCalibrator::CompassCalibrator()
+{
+    reset();
+}
+
+/**
+ * Discards all collected samples.
+ */
+void CompassCalibrator::reset()
+{
+    memclr(normal, sizeof(normal));
+    memclr(target, sizeof(target));
+
+    normalisation = 0.0f;
+    samples = 0;
+    published = CompassCalibration();
+}
 
+/**
+ * Considers a raw sample for inclusion in the fit.
+ *
+ * @param sample The uncalibrated sample.
+ * @param result Receives a new calibration, when one is available.
+ * @return true if a new calibration has been written to result, false otherwise.
+ */
+bool CompassCalibrator::addSample(const Sample3D &sample, CompassCalibration &result)
+{
+    float x = (float) sample.x;
+    float y = (float) sample.y;
+    float z = (float) sample.z;
+
+    // Scale all samples by the strength of the first, so that the terms of the fit are close to unity.
+    if (normalisation == 0.0f)
+    {
+        normalisation = sqrtf(x*x + y*y + z*z);
+
+        if (normalisation == 0.0f)
+            return false;
+    }
+
+    float p[3] = { x / normalisation, y / normalisation, z / normalisation };
+
+    if (samples > 0)
+    {
+        float dx = p[0] - last[0];
+        float dy = p[1] - last[1];
+        float dz = p[2] - last[2];
+
+        // Ignore samples too close to the last one collected.
+        if (dx*dx + dy*dy + dz*dz < COMPASS_CALIBRATION_MIN_DISTANCE * COMPASS_CALIBRATION_MIN_DISTANCE)
+            return false;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        last[i] = p[i];
+
+        if (samples == 0 || p[i] < low[i])
+            low[i] = p[i];
+
+        if (samples == 0 || p[i] > high[i])
+            high[i] = p[i];
+    }
+
+    // Accumulate the (lower half of the) normal equations, forgetting older samples.
+    const float decay = 1.0f - 1.0f / COMPASS_CALIBRATION_WINDOW;
+    float terms[6] = { p[0]*p[0], p[1]*p[1], p[2]*p[2], p[0], p[1], p[2] };
+
+    for (int i = 0; i < 6; i++)
+    {
+        target[i] = target[i] * decay + terms[i];
+
+        for (int j = 0; j <= i; j++)
+            normal[i][j] = normal[i][j] * decay + terms[i] * terms[j];
+    }
+
+    samples++;
+
+    if (samples >= COMPASS_CALIBRATION_MIN_SAMPLES && samples % COMPASS_CALIBRATION_SOLVE_INTERVAL == 0)
+        return solve(result);
+
+    return false;
+}
+
+/**
+ * Solves the normal equations, and checks that the resulting ellipsoid is plausible.
+ */
+bool CompassCalibrator::solve(CompassCalibration &result)
+{
+    float a[6][7];
+    float p[6];
+
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = 0; j < 6; j++)
+            a[i][j] = j <= i ? normal[i][j] : normal[j][i];
+
+        a[i][6] = target[i];
+    }
+
+    // Gaussian elimination, with partial pivoting.
+    for (int c = 0; c < 6; c++)
+    {
+        int pivot = c;
+
+        for (int r = c + 1; r < 6; r++)
+            if (fabsf(a[r][c]) > fabsf(a[pivot][c]))
+                pivot = r;
+
+        if (fabsf(a[pivot][c]) < 1e-9f)
+            return false;
+
+        if (pivot != c)
+        {
+            for (int j = c; j < 7; j++)
+            {
+                float t = a[c][j];
+                a[c][j] = a[pivot][j];
+                a[pivot][j] = t;
+            }
+        }
+
+        for (int r = c + 1; r < 6; r++)
+        {
+            float f = a[r][c] / a[c][c];
+
+            for (int j = c; j < 7; j++)
+                a[r][j] -= f * a[c][j];
+        }
+    }
+
+    for (int r = 5; r >= 0; r--)
+    {
+        float v = a[r][6];
+
+        for (int j = r + 1; j < 6; j++)
+            v -= a[r][j] * p[j];
+
+        p[r] = v / a[r][r];
+    }
+
+    // Convert a x^2 + b y^2 + c z^2 + d x + e y + f z = 1 into a centre and radius in each axis.
+    float g = 1.0f;
+    float centre[3];
+    float radius[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (p[i] <= 0.0f)
+            return false;
+
+        centre[i] = -p[i+3] / (2.0f * p[i]);
+        g += p[i] * centre[i] * centre[i];
+    }
+
+    float smallest = 0.0f;
+    float largest = 0.0f;
+    float mean = 0.0f;
+
+    for (int i = 0; i < 3; i++)
+    {
+        radius[i] = sqrtf(g / p[i]);
+
+        // Only trust the fit once the samples span a reasonable part of each axis.
+        if (high[i] - low[i] < COMPASS_CALIBRATION_MIN_COVERAGE * 2.0f * radius[i])
+            return false;
+
+        if (i == 0 || radius[i] < smallest)
+            smallest = radius[i];
+
+        if (i == 0 || radius[i] > largest)
+            largest = radius[i];
+
+        mean += radius[i] / 3.0f;
+    }
+
+    if (largest > smallest * COMPASS_CALIBRATION_MAX_ELLIPTICITY)
+        return false;
+
+    CompassCalibration c;
+
+    c.centre = Sample3D(roundToInt(centre[0] * normalisation), roundToInt(centre[1] * normalisation), roundToInt(centre[2] * normalisation));
+    c.scale = Sample3D(roundToInt(1024.0f * mean / radius[0]), roundToInt(1024.0f * mean / radius[1]), roundToInt(1024.0f * mean / radius[2]));
+    c.radius = roundToInt(mean * normalisation);
+
+    // Only publish calibrations that differ significantly from the last one, to avoid needless updates (and flash writes).
+    if (published.radius != 0)
+    {
+        int tolerance = published.radius / 32;
+
+        if (abs(c.centre.x - published.centre.x) <= tolerance && abs(c.centre.y - published.centre.y) <= tolerance && abs(c.centre.z - published.centre.z) <= tolerance &&
+            abs(c.scale.x - published.scale.x) <= 16 && abs(c.scale.y - published.scale.y) <= 16 && abs(c.scale.z - published.scale.z) <= 16)
+            return false;
+    }
+
+    published = c;
+    result = c;
+
+    return true;
+}
@@ -24,14 +24,73 @@ DEALINGS IN THE SOFTWARE.
 
 #include "I2C.h"
 #include "ErrorNo.h"
+#include "codal_target_hal.h"
 
 namespace codal
 {
+    /**
+     * Constructor. Creates an empty transaction with the given device.
+     *
+     * @param address The 8bit I2C address of the device.
+     */
+    I2CTransaction::I2CTransaction(uint16_t address)
+    {
+        this->next = NULL;
+        this->address = address;
+        this->segmentCount = 0;
+        this->status = DEVICE_OK;
+        this->callback = NULL;
+        this->context = NULL;
+        this->lock = NULL;
+    }
+
+    /**
+     * Appends a write segment to this transaction.
+     *
+     * @param data The bytes to write. These are not copied.
+     * @param length The number of bytes to write.
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the transaction is full.
+     */
+    int I2CTransaction::write(uint8_t *data, int length)
+    {
+        if (data == NULL || length <= 0 || length > 0xFFFF)
+            return DEVICE_INVALID_PARAMETER;
+
+        if (segmentCount >= I2C_TRANSACTION_MAX_SEGMENTS)
+            return DEVICE_NO_RESOURCES;
+
+        I2CSegment &s = segments[segmentCount++];
+        s.data = data;
+        s.length = length;
+        s.flags = I2C_SEGMENT_WRITE;
+
+        return DEVICE_OK;
+    }
+
+    /**
+     * Appends a read segment to this transaction.
+     *
+     * @param data The buffer to read into.
+     * @param length The number of bytes to read.
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the transaction is full.
+     */
+    int I2CTransaction::read(uint8_t *data, int length)
+    {
+        int result = write(data, length);
+
+        if (result == DEVICE_OK)
+            segments[segmentCount - 1].flags = I2C_SEGMENT_READ;
+
+        return result;
+    }
+
     /**
      * Constructor.
      */
     I2C::I2C(Pin &sda, Pin &scl)
     {
+        transactions = NULL;
+        synchronous = false;
     }
 
     /**
@@ -291,5 +350,182 @@ namespace codal
     {
         return read((uint16_t)address, (uint8_t *)data, len, repeated);
     }
-}
 
+    /**
+     * Begins the given transaction using asynchronous (interrupt or DMA driven) hardware.
+     * The default implementation does not support asynchronous operation.
+     *
+     * @param t The transaction to perform.
+     * @return DEVICE_OK if the transaction was started, or DEVICE_NOT_SUPPORTED.
+     */
+    int I2C::startTransaction(I2CTransaction *t)
+    {
+        return DEVICE_NOT_SUPPORTED;
+    }
+
+    /**
+     * Performs a transaction synchronously, with the blocking read() and write() operations.
+     * Each segment after the first is preceded by a repeated START, and a STOP is sent after the last.
+     *
+     * @param t The transaction to perform.
+     * @return DEVICE_OK on success, or DEVICE_I2C_ERROR.
+     */
+    int I2C::performTransaction(I2CTransaction *t)
+    {
+        int result = DEVICE_OK;
+
+        for (int i = 0; i < t->segmentCount && result == DEVICE_OK; i++)
+        {
+            I2CSegment &s = t->segments[i];
+            bool repeated = i < t->segmentCount - 1;
+
+            if (s.flags & I2C_SEGMENT_READ)
+                result = read(t->address, s.data, s.length, repeated);
+            else
+                result = write(t->address, s.data, s.length, repeated);
+        }
+
+        // Release the bus if a segment failed part way through the transaction.
+        if (result != DEVICE_OK)
+            stop();
+
+        return result;
+    }
+
+    /**
+     * Removes the transaction in progress from the queue, records its status and notifies its owner.
+     */
+    void I2C::completeTransaction(int status)
+    {
+        target_disable_irq();
+        I2CTransaction *t = transactions;
+        if (t)
+            transactions = t->next;
+        target_enable_irq();
+
+        if (t == NULL)
+            return;
+
+        t->next = NULL;
+        t->status = status;
+
+        if (t->callback)
+            t->callback(t);
+
+        if (t->lock)
+            t->lock->notify();
+    }
+
+    /**
+     * Records the result of the transaction in progress, notifies its owner, and starts the next queued transaction.
+     *
+     * @param status DEVICE_OK on success, or DEVICE_I2C_ERROR.
+     */
+    void I2C::transactionComplete(int status)
+    {
+        completeTransaction(status);
+        processQueue();
+    }
+
+    /**
+     * Starts the transaction at the head of the queue, running queued transactions back to back
+     * until the queue is empty or an asynchronous transfer is in progress.
+     */
+    void I2C::processQueue()
+    {
+        while (transactions)
+        {
+            I2CTransaction *t = transactions;
+
+            if (startTransaction(t) == DEVICE_OK)
+                return;
+
+            // Transactions submitted by completion callbacks are picked up by this loop, rather than recursively.
+            synchronous = true;
+            completeTransaction(performTransaction(t));
+            synchronous = false;
+        }
+    }
+
+    /**
+     * Queues a transaction to be performed as soon as the bus is free, and returns immediately.
+     *
+     * @param t The transaction to queue. This must remain valid until the transaction completes.
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_BUSY if the transaction is already queued.
+     */
+    int I2C::submit(I2CTransaction *t)
+    {
+        if (t == NULL || t->segmentCount == 0)
+            return DEVICE_INVALID_PARAMETER;
+
+        if (t->status == DEVICE_BUSY)
+            return DEVICE_BUSY;
+
+        t->next = NULL;
+        t->status = DEVICE_BUSY;
+
+        target_disable_irq();
+        I2CTransaction **p = &transactions;
+        while (*p)
+            p = &(*p)->next;
+        *p = t;
+        bool idle = (transactions == t) && !synchronous;
+        target_enable_irq();
+
+        if (idle)
+            processQueue();
+
+        return DEVICE_OK;
+    }
+
+    /**
+     * Queues a transaction, and blocks the calling fiber (but not the scheduler) until it completes.
+     *
+     * @param t The transaction to perform.
+     * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, DEVICE_BUSY or DEVICE_I2C_ERROR.
+     */
+    int I2C::transfer(I2CTransaction *t)
+    {
+        FiberLock done(0);
+        FiberLock *previous = t ? t->lock : NULL;
+
+        if (t)
+            t->lock = &done;
+
+        int result = submit(t);
+
+        if (result == DEVICE_OK)
+        {
+            // If the scheduler is not running, wait() returns immediately, so fall back to polling.
+            done.wait();
+            while (t->status == DEVICE_BUSY);
+            result = t->status;
+        }
+
+        if (t)
+            t->lock = previous;
+
+        return result;
+    }
+
+    /**
+     * Performs a typical register read operation as a single queued transaction, using a repeated START.
+     * Only the calling fiber is blocked while the transfer takes place.
+     *
+     * @param address 8bit I2C address of the device to read from
+     * @param reg The 8bit register address of the to read.
+     * @param data A pointer to a memory location to store the result of the read operation
+     * @param length The number of bytes to read
+     *
+     * @return DEVICE_OK, DEVICE_INVALID_PARAMETER or DEVICE_I2C_ERROR if the the read request failed.
+     */
+    int I2C::readRegisterAsync(uint16_t address, uint8_t reg, uint8_t *data, int length)
+    {
+        I2CTransaction t(address);
+
+        if (t.write(&reg, 1) != DEVICE_OK || t.read(data, length) != DEVICE_OK)
+            return DEVICE_INVALID_PARAMETER;
+
+        return transfer(&t);
+    }
+}
@@ -0,0 +1,50 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SPIFlash.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+int SPIFlash::writeBuffer(uint32_t addr, const void *buffer, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)buffer;
+
+    while (len)
+    {
+        uint32_t n = SPIFLASH_PAGE_SIZE - (addr & (SPIFLASH_PAGE_SIZE - 1));
+        if (n > len)
+            n = len;
+
+        int r = writeBytes(addr, p, n);
+        if (r < 0)
+            return r;
+
+        addr += n;
+        p += n;
+        len -= n;
+    }
+
+    return DEVICE_OK;
+}
@@ -47,7 +47,7 @@ using namespace codal;
   * @param id The id the display should use when sending events on the MessageBus. Defaults to DEVICE_ID_DISPLAY.
   *
   */
-AnimatedDisplay::AnimatedDisplay(Display& _display, uint16_t id) : display(_display), font(), printingText(), scrollingImage()
+AnimatedDisplay::AnimatedDisplay(Display& _display, uint16_t id) : display(_display), font(), scrollingStrip(), scrollingBackground(), printingText(), scrollingImage()
 {
     this->id = id;
     this->status = 0;
@@ -58,8 +58,8 @@ AnimatedDisplay::AnimatedDisplay(Display& _display, uint16_t id) : display(_disp
     animationMode = AnimationMode::ANIMATION_MODE_NONE;
     animationDelay = 0;
     animationTick = 0;
-    scrollingChar = 0;
     scrollingPosition = 0;
+    scrollingLength = 0;
     printingChar = 0;
     scrollingImagePosition = 0;
     scrollingImageStride = 0;
@@ -115,64 +115,107 @@ void AnimatedDisplay::sendAnimationCompleteEvent()
 }
 
 /**
-  * Internal scrollText update method.
-  * Shift the screen image by one pixel to the left. If necessary, paste in the next char.
+  * Renders the given string into scrollingStrip, ready to be scrolled across the display.
+  *
+  * Only the glyph columns of each character are stored; the gaps between characters are added as the
+  * text is scrolled, so that any frame can be drawn directly from the strip without looking up the font again.
+  *
+  * @param s The string to render.
+  *
+  * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER if the string is too long to be rendered.
   */
-void AnimatedDisplay::updateScrollText()
+int AnimatedDisplay::renderScrollText(ManagedString s)
 {
-    /**
-    display.image.shiftLeft(1);
-    scrollingPosition++;
+    int pitch = display.getWidth() + DISPLAY_SPACING;
+    int columns = min(pitch, BITMAP_FONT_WIDTH);
+    int width = s.length() * columns;
 
-    if (scrollingPosition == display.getWidth() + DISPLAY_SPACING)
-    {
-        scrollingPosition = 0;
-
-        display.image.print(scrollingChar < scrollingText.length() ? scrollingText.charAt(scrollingChar) : ' ', display.getWidth(), 0);
+    if (width > 0x7FFF)
+        return DEVICE_INVALID_PARAMETER;
 
-        if (scrollingChar > scrollingText.length())
-        {
-            animationMode = ANIMATION_MODE_NONE;
-            this->sendAnimationCompleteEvent();
-            return;
-        }
-        scrollingChar++;
-   }
-   **/
+    scrollingStrip = PackedImage(width, BITMAP_FONT_HEIGHT, 1);
 
-    display.image.shiftLeft(1);
+    uint8_t *column = scrollingStrip.getBitmap();
+    int stride = scrollingStrip.getStride();
 
-    if (scrollingPosition < BITMAP_FONT_WIDTH && scrollingChar < scrollingText.length())
+    for (int i = 0; i < s.length(); i++)
     {
-        const uint8_t *v = font.get(scrollingText.charAt(scrollingChar));
-        if (v == NULL) {
+        const uint8_t *v = font.get(s.charAt(i));
+        if (v == NULL)
             v = font.get(' ');
-        }
-        uint8_t mask = 1 << (BITMAP_FONT_WIDTH - scrollingPosition - 1);
-        uint8_t x = display.getWidth()-1;
 
-        for (int y=0; y<BITMAP_FONT_HEIGHT; y++)
+        uint8_t *p = column + i * columns * stride;
+
+        for (int x = 0; x < columns; x++)
         {
-            if (*v & mask)
-                display.image.setPixelValue(x, y, 255);
+            uint8_t mask = 1 << (BITMAP_FONT_WIDTH - x - 1);
+
+            for (int y = 0; y < BITMAP_FONT_HEIGHT; y++)
+                if (v[y] & mask)
+                    p[y >> 3] |= 1 << (y & 7);
 
-            v++;
+            p += stride;
         }
     }
 
+    return DEVICE_OK;
+}
+
+/**
+  * Internal scrollText update method.
+  * Shift the screen image by one pixel to the left, by drawing the next window of the pre-rendered text.
+  */
+void AnimatedDisplay::updateScrollText()
+{
+    int width = display.getWidth();
+    int height = display.getHeight();
+    int rows = min(height, BITMAP_FONT_HEIGHT);
+    int pitch = width + DISPLAY_SPACING;
+    int columns = min(pitch, BITMAP_FONT_WIDTH);
+    int stride = scrollingStrip.getStride();
+
     scrollingPosition++;
 
-    if (scrollingPosition == display.getWidth() + DISPLAY_SPACING)
+    // The display shows the window of (width) columns ending at scrollingPosition, where the columns before the
+    // text are those that were on the display when the scroll began.
+    int first = scrollingPosition - width;
+    uint8_t *out = display.image.getBitmap();
+
+    for (int x = 0; x < width; x++)
     {
-        scrollingPosition = 0;
+        int column = first + x;
+        uint8_t *p = out + x;
 
-        if (scrollingChar >= scrollingText.length())
+        if (column < 0)
         {
-            animationMode = ANIMATION_MODE_NONE;
-            this->sendAnimationCompleteEvent();
-            return;
+            const uint8_t *in = scrollingBackground.getBitmap() + width + column;
+
+            for (int y = 0; y < height; y++)
+                p[y * width] = in[y * width];
         }
-        scrollingChar++;
+        else
+        {
+            // Each character spans (pitch) columns of the scroll, but only its first (columns) are held in the strip.
+            int glyph = (column / pitch) * columns + column % pitch;
+            const uint8_t *in = (column % pitch < columns && glyph < scrollingStrip.getWidth()) ? scrollingStrip.getBitmap() + glyph * stride : NULL;
+
+            for (int y = 0; y < rows; y++)
+                p[y * width] = (in && (in[y >> 3] & (1 << (y & 7)))) ? 255 : 0;
+
+            for (int y = rows; y < height; y++)
+                p[y * width] = 0;
+        }
+    }
+
+    // Once the original contents have scrolled off, we no longer need them.
+    if (first == 0)
+        scrollingBackground = Image();
+
+    if (scrollingPosition >= scrollingLength)
+    {
+        scrollingStrip = PackedImage();
+        animationMode = ANIMATION_MODE_NONE;
+        this->sendAnimationCompleteEvent();
     }
 }
 
@@ -574,9 +617,12 @@ int AnimatedDisplay::scrollAsync(ManagedString s, int delay)
     // If the display is free, it's our turn to display.
     if (animationMode == ANIMATION_MODE_NONE || animationMode == ANIMATION_MODE_STOPPED)
     {
+        if (renderScrollText(s) != DEVICE_OK)
+            return DEVICE_INVALID_PARAMETER;
+
+        scrollingBackground = display.image.clone();
         scrollingPosition = 0;
-        scrollingChar = 0;
-        scrollingText = s;
+        scrollingLength = (s.length() + 1) * (display.getWidth() + DISPLAY_SPACING);
 
         animationDelay = delay;
         animationTick = 0;
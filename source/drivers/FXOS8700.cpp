@@ -83,6 +83,7 @@ int FXOS8700::configure()
     Accelerometer::samplePeriod = accelerometerPeriod.getKey(Accelerometer::samplePeriod * 2000) / 1000;
     Accelerometer::sampleRange = accelerometerRange.getKey(Accelerometer::sampleRange);
     Compass::samplePeriod = Accelerometer::samplePeriod;
+    batchSize = min(batchSize, FXOS8700_FIFO_DEPTH);
 
     // Now configure the accelerometer accordingly.
 
@@ -109,7 +110,9 @@ int FXOS8700::configure()
     // Select the auto incremement mode, which allows a contiguous I2C block
     // read of both acceleromter and magnetometer data despite them being non-contguous
     // in memory... funky!
-    value = 0x20;
+    // In batched mode the accelerometer FIFO is drained with a burst read that must wrap from OUT_Z_LSB back to
+    // OUT_X_MSB, so the hybrid auto increment is disabled and the magnetometer is read separately.
+    value = batchSize > 1 ? 0x00 : 0x20;
     result = i2c.writeRegister(address, FXOS8700_M_CTRL_REG2, value);
     if (result != 0)
     {
@@ -131,8 +134,17 @@ int FXOS8700::configure()
         return DEVICE_I2C_ERROR;
     }
 
-    // Enable a data ready interrupt.
-    value = 0x01;
+    // Configure the FIFO: circular buffer mode with a watermark of batchSize samples, or disabled.
+    value = batchSize > 1 ? FXOS8700_F_MODE_CIRCULAR | batchSize : 0x00;
+    result = i2c.writeRegister(address, FXOS8700_F_SETUP, value);
+    if (result != 0)
+    {
+        DMESG("I2C ERROR: FXOS8700_F_SETUP");
+        return DEVICE_I2C_ERROR;
+    }
+
+    // Enable a data ready interrupt, or a FIFO interrupt in batched mode.
+    value = batchSize > 1 ? 0x40 : 0x01;
     result = i2c.writeRegister(address, FXOS8700_CTRL_REG4, value);
     if (result != 0)
     {
@@ -140,8 +152,8 @@ int FXOS8700::configure()
         return DEVICE_I2C_ERROR;
     }
 
-    // Route the data ready interrupt to INT1 pin.
-    value = 0x01;
+    // Route the interrupt to INT1 pin.
+    value = batchSize > 1 ? 0x40 : 0x01;
     result = i2c.writeRegister(address, FXOS8700_CTRL_REG5, value);
     if (result != 0)
     {
@@ -219,6 +231,10 @@ int FXOS8700::requestUpdate()
     // Poll interrupt line from device (ACTIVE LOW)
     if(int1.isActive())
     {
+        // In batched mode, drain the FIFO instead.
+        if (batchSize > 1)
+            return requestBatch();
+
         uint8_t data[12];
         FXOSRawSample sample;
         uint8_t *lsb = (uint8_t *) &sample;
@@ -264,6 +280,65 @@ int FXOS8700::requestUpdate()
     return DEVICE_OK;
 }
 
+/**
+  * Drains the accelerometer samples held in the FIFO with a single burst read, and reads the latest magnetometer sample.
+  *
+  * @return DEVICE_OK on success, DEVICE_I2C_ERROR if the read request fails.
+  */
+int FXOS8700::requestBatch()
+{
+    uint8_t data[6 * FXOS8700_FIFO_DEPTH];
+    Sample3D samples[FXOS8700_FIFO_DEPTH];
+    uint8_t status_reg;
+    int count;
+    int result;
+
+    // Determine how many samples are held in the FIFO. Reading F_STATUS also clears the FIFO interrupt.
+    result = i2c.readRegister(address, FXOS8700_STATUS_REG, &status_reg, 1);
+    if (result != 0)
+        return DEVICE_I2C_ERROR;
+
+    count = min(status_reg & FXOS8700_F_STATUS_COUNT, FXOS8700_FIFO_DEPTH);
+    if (count == 0)
+        return DEVICE_OK;
+
+    result = i2c.readRegister(address, FXOS8700_OUT_X_MSB, data, 6 * count);
+    if (result != 0)
+        return DEVICE_I2C_ERROR;
+
+    // scale the 14 bit accelerometer data (packed into 16 bits, big endian) into SI units (milli-g), and translate to ENU coordinate system
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t *d = &data[6 * i];
+        int16_t ax = (d[0] << 8) | d[1];
+        int16_t ay = (d[2] << 8) | d[3];
+        int16_t az = (d[4] << 8) | d[5];
+
+        samples[i].x = (-ay * Accelerometer::sampleRange) / 32;
+        samples[i].y = (ax * Accelerometer::sampleRange) / 32;
+        samples[i].z = (az * Accelerometer::sampleRange) / 32;
+    }
+
+    // The magnetometer is not buffered, so take its most recent sample.
+    result = i2c.readRegister(address, FXOS8700_M_OUT_X_MSB, data, 6);
+    if (result != 0)
+        return DEVICE_I2C_ERROR;
+
+    int16_t cx = (data[0] << 8) | data[1];
+    int16_t cy = (data[2] << 8) | data[3];
+    int16_t cz = (data[4] << 8) | data[5];
+
+    // translate magnetometer data into ENU coordinate system and normalise into nano-teslas
+    Compass::sampleENU.x = FXOS8700_NORMALIZE_SAMPLE(-cy);
+    Compass::sampleENU.y = FXOS8700_NORMALIZE_SAMPLE(cx);
+    Compass::sampleENU.z = FXOS8700_NORMALIZE_SAMPLE(cz);
+
+    Accelerometer::updateBatch(samples, count);
+    Compass::update();
+
+    return DEVICE_OK;
+}
+
 /**
   * A periodic callback invoked by the fiber scheduler idle thread.
   *
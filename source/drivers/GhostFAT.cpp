@@ -211,15 +211,54 @@ void GhostFAT::readDirData(uint8_t *dest, int blkno, uint8_t dirid)
     }
 }
 
-#define WRITE_ENT(v)                                                                               \
-    do                                                                                             \
-    {                                                                                              \
-        if (skip++ >= 0)                                                                           \
-            *dest++ = v;                                                                           \
-        if (skip >= 256)                                                                           \
-            return;                                                                                \
-        cl++;                                                                                      \
-    } while (0)
+// returns the position in index[] of the entry holding the given data cluster, or -1
+int GhostFAT::findEntry(uint32_t cluster)
+{
+    int lo = 0, hi = numEntries - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) >> 1;
+        GFATEntry *p = index[mid];
+
+        if (cluster < p->startCluster)
+            hi = mid - 1;
+        else if (cluster >= (uint32_t)(p->startCluster + numClusters(p)))
+            lo = mid + 1;
+        else
+            return mid;
+    }
+
+    return -1;
+}
+
+// entries are allocated contiguously, so each cluster just links to the next one, except the last of each file
+void GhostFAT::buildFATBlock(uint32_t sectionIdx, uint16_t *dest)
+{
+    uint32_t first = sectionIdx * 256;
+    int i = 0;
+
+    if (first == 0)
+    {
+        dest[i++] = 0xfff0;
+        dest[i++] = 0xffff;
+    }
+
+    // FAT entries 0 and 1 are reserved, so entry n describes data cluster n - 2
+    for (int e = findEntry(first + i - 2); e >= 0 && e < numEntries && i < 256; e++)
+    {
+        GFATEntry *p = index[e];
+        uint32_t last = p->startCluster + numClusters(p) - 1 + 2;
+
+        while (i < 256)
+        {
+            uint32_t cl = first + i;
+            dest[i++] = cl == last ? 0xffff : cl + 1;
+            if (cl == last)
+                break;
+        }
+    }
+}
 
 void GhostFAT::buildBlock(uint32_t block_no, uint8_t *data)
 {
@@ -241,19 +280,7 @@ void GhostFAT::buildBlock(uint32_t block_no, uint8_t *data)
         if (sectionIdx >= SECTORS_PER_FAT)
             sectionIdx -= SECTORS_PER_FAT;
 
-        int cl = 0;
-        int skip = -(sectionIdx * 256);
-        uint16_t *dest = (uint16_t *)data;
-
-        WRITE_ENT(0xfff0);
-        WRITE_ENT(0xffff);
-        for (GFATEntry *p = files; p; p = p->next)
-        {
-            int n = numClusters(p) - 1;
-            for (int i = 0; i < n; i++)
-                WRITE_ENT(cl + 1);
-            WRITE_ENT(0xffff);
-        }
+        buildFATBlock(sectionIdx, (uint16_t *)data);
     }
     else if (block_no < START_CLUSTERS)
     {
@@ -263,17 +290,15 @@ void GhostFAT::buildBlock(uint32_t block_no, uint8_t *data)
     else
     {
         sectionIdx -= START_CLUSTERS;
-        for (GFATEntry *p = files; p; p = p->next)
+        int e = findEntry(sectionIdx);
+        if (e >= 0)
         {
-            if (p->startCluster <= sectionIdx && (int)sectionIdx < p->startCluster + numClusters(p))
-            {
-                sectionIdx -= p->startCluster;
-                if (p->attrs & 0x10)
-                    readDirData(data, sectionIdx, (uint32_t)p->userdata);
-                else
-                    p->read(p, sectionIdx, (char *)data);
-                break;
-            }
+            GFATEntry *p = index[e];
+            sectionIdx -= p->startCluster;
+            if (p->attrs & 0x10)
+                readDirData(data, sectionIdx, (uint32_t)p->userdata);
+            else
+                p->read(p, sectionIdx, (char *)data);
         }
     }
 }
@@ -282,17 +307,16 @@ void GhostFAT::readBlocks(int blockAddr, int numBlocks)
 {
     finalizeFiles();
 
-    uint8_t *buf = new uint8_t[512];
+    if (blockBuf == NULL)
+        blockBuf = new uint8_t[512];
 
     while (numBlocks--)
     {
-        buildBlock(blockAddr, buf);
-        writeBulk(buf, 512);
+        buildBlock(blockAddr, blockBuf);
+        writeBulk(blockBuf, 512);
         blockAddr++;
     }
 
-    delete buf;
-
     finishReadWrite();
 }
 
@@ -336,6 +360,13 @@ void GhostFAT::writeBlocks(int blockAddr, int numBlocks)
 GhostFAT::GhostFAT()
 {
     files = NULL;
+    index = NULL;
+    numEntries = 0;
+    blockBuf = NULL;
+#ifdef BOOTLOADER_START_ADDR
+    // UF2 handover passes the OUT endpoint to the bootloader part way through a write
+    pipelineWrites = false;
+#endif
 }
 
 bool GhostFAT::filesFinalized()
@@ -390,6 +421,17 @@ void GhostFAT::finalizeFiles()
             dirs = NULL;
         }
     }
+
+    // the list is now in cluster order
+    numEntries = 0;
+    for (GFATEntry *p = files; p; p = p->next)
+        numEntries++;
+
+    index = new GFATEntry *[numEntries];
+
+    int i = 0;
+    for (GFATEntry *p = files; p; p = p->next)
+        index[i++] = p;
 }
 
 GFATEntry *GhostFAT::addFile(GFATReadCallback read, void *userdata, const char *filename,
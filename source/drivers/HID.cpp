@@ -23,6 +23,7 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "HID.h"
+#include "CodalFiber.h"
 
 #if CONFIG_ENABLED(DEVICE_USB)
 
@@ -75,6 +76,100 @@ static const InterfaceInfo ifaceInfo = {
 
 USBHID::USBHID() : CodalUSBInterface()
 {
+    reportHead = 0;
+    reportCount = 0;
+    reportSending = false;
+}
+
+int USBHID::queueReport(const void *report, int len)
+{
+    if (!in)
+        return DEVICE_INVALID_STATE;
+
+    if (len <= 0 || len > HID_REPORT_MAX_SIZE)
+        return DEVICE_INVALID_PARAMETER;
+
+    // the report at the head of the queue may already be on its way to the host
+    for (;;)
+    {
+        target_disable_irq();
+
+        int unsent = reportCount - (reportSending ? 1 : 0);
+        HIDQueuedReport *last = &reportQueue[(reportHead + reportCount - 1) % HID_REPORT_QUEUE_SIZE];
+
+        if (unsent > 0 && last->len == len && mergeReport(last->data, (const uint8_t *)report, len))
+        {
+            target_enable_irq();
+            return DEVICE_OK;
+        }
+
+        if (reportCount < HID_REPORT_QUEUE_SIZE)
+        {
+            HIDQueuedReport *r = &reportQueue[(reportHead + reportCount) % HID_REPORT_QUEUE_SIZE];
+            r->len = len;
+            memcpy(r->data, report, len);
+            reportCount++;
+            target_enable_irq();
+            break;
+        }
+
+        target_enable_irq();
+        fiber_sleep(1);
+    }
+
+    sendReports();
+
+    return DEVICE_OK;
+}
+
+void USBHID::sendReports()
+{
+#ifdef USB_EP_FLAG_ASYNC
+    // the endpoint takes a copy of each report, and endpointRequest() is called as each completes
+    target_disable_irq();
+    while (reportCount && in->canWrite())
+    {
+        HIDQueuedReport *r = &reportQueue[reportHead];
+        in->write(r->data, r->len);
+        reportHead = (reportHead + 1) % HID_REPORT_QUEUE_SIZE;
+        reportCount--;
+    }
+    target_enable_irq();
+#else
+    // writes block until the host collects the report, so send them from a fiber of our own
+    if (!reportSending)
+    {
+        reportSending = true;
+        create_fiber(drainReports, this);
+    }
+#endif
+}
+
+void USBHID::drainReports(void *hid)
+{
+    USBHID *h = (USBHID *)hid;
+
+    while (h->reportCount)
+    {
+        HIDQueuedReport *r = &h->reportQueue[h->reportHead];
+        h->in->write(r->data, r->len);
+
+        target_disable_irq();
+        h->reportHead = (h->reportHead + 1) % HID_REPORT_QUEUE_SIZE;
+        h->reportCount--;
+        target_enable_irq();
+    }
+
+    h->reportSending = false;
+}
+
+int USBHID::endpointRequest()
+{
+#ifdef USB_EP_FLAG_ASYNC
+    if (in)
+        sendReports();
+#endif
+    return DEVICE_OK;
 }
 
 int USBHID::stdRequest(UsbEndpointIn &ctrl, USBSetup &setup)
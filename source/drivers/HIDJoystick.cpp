@@ -195,7 +195,20 @@ int USBHIDJoystick::sendReport()
 	uint8_t report[sizeof(HIDJoystickState)];
 	memcpy(report, &joystickState, sizeof(HIDJoystickState));
 
-	return in->write(report, sizeof(report));
+	return queueReport(report, sizeof(report));
+}
+
+/**
+ * Axes and throttles are absolute, so while the buttons don't change, only the latest position needs to be sent.
+ */
+bool USBHIDJoystick::mergeReport(uint8_t *queued, const uint8_t *report, int len)
+{
+	if (((HIDJoystickState *)queued)->buttons != ((HIDJoystickState *)report)->buttons)
+		return false;
+
+	memcpy(queued, report, len);
+
+	return true;
 }
 
 #endif
@@ -194,7 +194,7 @@ int USBHIDKeyboard::setKeyMap(KeyMap& m)
 }
 
 /**
-  * Writes the given report out over USB.
+  * Queues the given report to be sent over USB.
   *
   * @param report A pointer to the report to copy to USB
   */
@@ -203,13 +203,18 @@ int USBHIDKeyboard::updateReport(HIDKeyboardReport* report)
     if(report == NULL)
         return DEVICE_INVALID_PARAMETER;
 
-    if (!in)
-        return DEVICE_INVALID_STATE;
-
     uint8_t reportBuf[report->reportSize + 1] = {report->reportID};
     memcpy(reportBuf + 1, report->keyState, report->reportSize);
 
-    return in->write(reportBuf, sizeof(reportBuf));
+    return queueReport(reportBuf, sizeof(reportBuf));
+}
+
+/**
+  * Drops a report that repeats the one queued before it, as the host would see no change.
+  */
+bool USBHIDKeyboard::mergeReport(uint8_t *queued, const uint8_t *report, int len)
+{
+    return memcmp(queued, report, len) == 0;
 }
 
 
@@ -358,8 +363,6 @@ int USBHIDKeyboard::keyUp(Key k)
     else
         status = standardKeyPress(k, ReleaseKey);
 
-    fiber_sleep(HID_KEYBOARD_DELAY_DEFAULT);
-
     return status;
 }
 
@@ -381,8 +384,6 @@ int USBHIDKeyboard::keyDown(Key k)
     else
         status = standardKeyPress(k, PressKey);
 
-    fiber_sleep(HID_KEYBOARD_DELAY_DEFAULT);
-
     return status;
 }
 
@@ -553,21 +554,27 @@ int USBHIDKeyboard::flush()
 {
     int status = DEVICE_OK;
 
-    HIDKeyboardReport *report = &reports[HID_KEYBOARD_REPORT_GENERIC];
-    memset(report->keyState, 0, report->reportSize);
-    status = updateReport(report);
+    // a report is queued whenever a key changes, so there is nothing to send for a report that is already clear
+    for(int id = HID_KEYBOARD_REPORT_GENERIC; id < HID_KEYBOARD_NUM_REPORTS; id++)
+    {
+        HIDKeyboardReport *report = &reports[id];
+        bool pressed = false;
 
-    report->keyPressedCount = 0;
+        for(int i = 0; i < report->reportSize; i++)
+            if(report->keyState[i])
+                pressed = true;
 
-    if(status != DEVICE_OK)
-        return status;
+        report->keyPressedCount = 0;
 
-    report = &reports[HID_KEYBOARD_REPORT_CONSUMER];
-    memset(report->keyState, 0, report->reportSize);
-    status = updateReport(report);
+        if(!pressed)
+            continue;
 
-    report->keyPressedCount = 0;
+        memset(report->keyState, 0, report->reportSize);
+        status = updateReport(report);
 
+        if(status != DEVICE_OK)
+            return status;
+    }
 
     return status;
 }
@@ -600,7 +607,6 @@ int USBHIDKeyboard::type(const KeySequence *seq)
 
     //all keys up is implicit at the end of each sequence
     flush();
-    fiber_sleep(HID_KEYBOARD_DELAY_DEFAULT);
 
     return DEVICE_OK;
 }
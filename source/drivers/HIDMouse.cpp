@@ -164,7 +164,32 @@ int USBHIDMouse::sendReport()
 	mouseState.yMovement = 0;
 	mouseState.wheelMovement = 0;
 
-	return in->write(report, sizeof(report));
+	return queueReport(report, sizeof(report));
+}
+
+/**
+ * Movements are relative, so while the buttons don't change, queued movements can be added together.
+ */
+bool USBHIDMouse::mergeReport(uint8_t *queued, const uint8_t *report, int len)
+{
+	HIDMouseState *q = (HIDMouseState *)queued;
+	HIDMouseState *r = (HIDMouseState *)report;
+
+	if (q->buttons.reg != r->buttons.reg)
+		return false;
+
+	int x = q->xMovement + r->xMovement;
+	int y = q->yMovement + r->yMovement;
+	int w = q->wheelMovement + r->wheelMovement;
+
+	if (x < -127 || x > 127 || y < -127 || y > 127 || w < -127 || w > 127)
+		return false;
+
+	q->xMovement = x;
+	q->yMovement = y;
+	q->wheelMovement = w;
+
+	return true;
 }
 
 #endif
@@ -106,6 +106,7 @@ int LIS3DH::configure()
     // First find the nearest sample rate to that specified.
     samplePeriod = accelerometerPeriod.getKey(samplePeriod * 1000) / 1000;
     sampleRange = accelerometerRange.getKey(sampleRange);
+    batchSize = min(batchSize, LIS3DH_FIFO_DEPTH);
 
     // Now configure the accelerometer accordingly.
     // Firstly, Configure for normal precision operation at the sample rate requested.
@@ -114,8 +115,8 @@ int LIS3DH::configure()
     if (result != 0)
         return DEVICE_I2C_ERROR;
 
-    // Enable the INT1 interrupt pin when XYZ data is available.
-    value = 0x10;
+    // Enable the INT1 interrupt pin when XYZ data is available, or when the FIFO reaches its watermark in batched mode.
+    value = batchSize > 1 ? 0x04 : 0x10;
     result = i2c.writeRegister(address, LIS3DH_CTRL_REG3, value);
     if (result != 0)
         return DEVICE_I2C_ERROR;
@@ -126,12 +127,18 @@ int LIS3DH::configure()
     if (result != 0)
         return DEVICE_I2C_ERROR;
 
-    // Configure for a latched interrupt request.
-    value = 0x08;
+    // Configure for a latched interrupt request, and enable the FIFO in batched mode.
+    value = batchSize > 1 ? 0x48 : 0x08;
     result = i2c.writeRegister(address, LIS3DH_CTRL_REG5, value);
     if (result != 0)
         return DEVICE_I2C_ERROR;
 
+    // Select stream mode, with a watermark of batchSize samples, or bypass the FIFO.
+    value = batchSize > 1 ? 0x80 | (batchSize - 1) : 0x00;
+    result = i2c.writeRegister(address, LIS3DH_FIFO_CTRL_REG, value);
+    if (result != 0)
+        return DEVICE_I2C_ERROR;
+
     return DEVICE_OK;
 }
 
@@ -179,52 +186,95 @@ int LIS3DH::requestUpdate()
     // Poll interrupt line from accelerometer.
     if(int1.getDigitalValue() == 1)
     {
-        int8_t data[6];
-        uint8_t src;
         int result;
 
-        // read the XYZ data (16 bit)
-        // n.b. we need to set the MSB bit to enable multibyte transfers from this device (WHY? Who Knows!)
-        result = i2c.readRegister(address, 0x80 | LIS3DH_OUT_X_L, (uint8_t *)data, 6);
+        if (batchSize > 1)
+        {
+            int8_t data[6 * LIS3DH_FIFO_DEPTH];
+            Sample3D samples[LIS3DH_FIFO_DEPTH];
+            uint8_t src;
+            int count;
 
-        if (result !=0)
-            return DEVICE_I2C_ERROR;
+            // Determine how many samples are held in the FIFO.
+            result = i2c.readRegister(address, LIS3DH_FIFO_SRC_REG, &src, 1);
+            if (result != 0)
+                return DEVICE_I2C_ERROR;
 
-        target_wait_us(3);
+            count = (src & LIS3DH_FIFO_OVERRUN) ? LIS3DH_FIFO_DEPTH : (src & LIS3DH_FIFO_EMPTY) ? 0 : (src & LIS3DH_FIFO_COUNT_MASK);
+            if (count == 0)
+                return DEVICE_OK;
 
-        // Acknowledge the interrupt.
-        i2c.readRegister(address, LIS3DH_INT1_SRC, &src, 1);
+            // Drain the FIFO in a single burst. The register address wraps from OUT_Z_H back to OUT_X_L while the FIFO is enabled.
+            result = i2c.readRegister(address, 0x80 | LIS3DH_OUT_X_L, (uint8_t *)data, 6 * count);
+            if (result != 0)
+                return DEVICE_I2C_ERROR;
 
-        // read MSB values...
-        sampleENU.x = data[1];
-        sampleENU.y = data[3];
-        sampleENU.z = data[5];
+            for (int i = 0; i < count; i++)
+                samples[i] = convertSample(&data[6 * i]);
 
-        // Normalize the data in the 0..1024 range.
-        sampleENU.x *= 8;
-        sampleENU.y *= 8;
-        sampleENU.z *= 8;
+            // Indicate that a new block of samples is available
+            updateBatch(samples, count);
+        }
+        else
+        {
+            int8_t data[6];
+            uint8_t src;
 
-#if CONFIG_ENABLED(USE_ACCEL_LSB)
-        // Add in LSB values.
-        sampleENU.x += (data[0] / 64);
-        sampleENU.y += (data[2] / 64);
-        sampleENU.z += (data[4] / 64);
-#endif
+            // read the XYZ data (16 bit)
+            // n.b. we need to set the MSB bit to enable multibyte transfers from this device (WHY? Who Knows!)
+            result = i2c.readRegister(address, 0x80 | LIS3DH_OUT_X_L, (uint8_t *)data, 6);
+
+            if (result !=0)
+                return DEVICE_I2C_ERROR;
 
-        // Scale into millig (approx!). (LIS3DH is ENU aligned)
-        sampleENU.x *= this->sampleRange;
-        sampleENU.y *= this->sampleRange;
-        sampleENU.z *= this->sampleRange;
- 
-        // Indicate that a new sample is available
-        update();
+            target_wait_us(3);
+
+            // Acknowledge the interrupt.
+            i2c.readRegister(address, LIS3DH_INT1_SRC, &src, 1);
+
+            sampleENU = convertSample(data);
+
+            // Indicate that a new sample is available
+            update();
+        }
     }
 
     return DEVICE_OK;
 };
 
 
+/**
+  * Converts a single raw XYZ sample read from the device into milli-g, in ENU format.
+  */
+Sample3D LIS3DH::convertSample(int8_t *data)
+{
+    Sample3D s;
+
+    // read MSB values...
+    s.x = data[1];
+    s.y = data[3];
+    s.z = data[5];
+
+    // Normalize the data in the 0..1024 range.
+    s.x *= 8;
+    s.y *= 8;
+    s.z *= 8;
+
+#if CONFIG_ENABLED(USE_ACCEL_LSB)
+    // Add in LSB values.
+    s.x += (data[0] / 64);
+    s.y += (data[2] / 64);
+    s.z += (data[4] / 64);
+#endif
+
+    // Scale into millig (approx!). (LIS3DH is ENU aligned)
+    s.x *= this->sampleRange;
+    s.y *= this->sampleRange;
+    s.z *= this->sampleRange;
+
+    return s;
+}
+
 /**
   * A periodic callback invoked by the fiber scheduler idle thread.
   *
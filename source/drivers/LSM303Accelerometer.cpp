@@ -104,6 +104,7 @@ int LSM303Accelerometer::configure()
     // First find the nearest sample rate to that specified.
     samplePeriod = accelerometerPeriod.getKey(samplePeriod * 1000) / 1000;
     sampleRange = accelerometerRange.getKey(sampleRange);
+    batchSize = min(batchSize, LSM303_A_FIFO_DEPTH);
 
     // Now configure the accelerometer accordingly.
 
@@ -115,8 +116,8 @@ int LSM303Accelerometer::configure()
         return DEVICE_I2C_ERROR;
     }
 
-    // Enable the DRDY1 interrupt on INT1 pin.
-    result = i2c.writeRegister(address, LSM303_CTRL_REG3_A, 0x10);
+    // Enable the DRDY1 interrupt on INT1 pin, or the FIFO watermark interrupt in batched mode.
+    result = i2c.writeRegister(address, LSM303_CTRL_REG3_A, batchSize > 1 ? 0x04 : 0x10);
     if (result != 0)
     {
         DMESG("LSM303 INIT: ERROR WRITING LSM303_CTRL_REG3_A");
@@ -131,6 +132,22 @@ int LSM303Accelerometer::configure()
         return DEVICE_I2C_ERROR;
     }
 
+    // Enable the FIFO in batched mode.
+    result = i2c.writeRegister(address, LSM303_CTRL_REG5_A, batchSize > 1 ? 0x40 : 0x00);
+    if (result != 0)
+    {
+        DMESG("LSM303 INIT: ERROR WRITING LSM303_CTRL_REG5_A");
+        return DEVICE_I2C_ERROR;
+    }
+
+    // Select stream mode, with a watermark of batchSize samples, or bypass the FIFO.
+    result = i2c.writeRegister(address, LSM303_FIFO_CTRL_REG_A, batchSize > 1 ? 0x80 | (batchSize - 1) : 0x00);
+    if (result != 0)
+    {
+        DMESG("LSM303 INIT: ERROR WRITING LSM303_FIFO_CTRL_REG_A");
+        return DEVICE_I2C_ERROR;
+    }
+
     return DEVICE_OK;
 }
 
@@ -166,6 +183,10 @@ int LSM303Accelerometer::requestUpdate()
     {
         if(int1.isActive())
         {
+            // In batched mode, drain the FIFO instead.
+            if (batchSize > 1)
+                return requestBatch();
+
             uint8_t data[6];
             int result;
             int16_t *x;
@@ -213,6 +234,52 @@ int LSM303Accelerometer::requestUpdate()
     return DEVICE_OK;
 }
 
+/**
+ * Drains the samples held in the FIFO with a single burst read.
+ *
+ * @return DEVICE_OK on success, DEVICE_I2C_ERROR if the read request fails.
+ */
+int LSM303Accelerometer::requestBatch()
+{
+    int16_t data[3 * LSM303_A_FIFO_DEPTH];
+    Sample3D samples[LSM303_A_FIFO_DEPTH];
+    uint8_t src;
+    int count;
+    int result;
+
+    // Determine how many samples are held in the FIFO.
+    result = i2c.readRegister(address, LSM303_FIFO_SRC_REG_A, &src, 1);
+    if (result != 0)
+        return DEVICE_I2C_ERROR;
+
+    count = (src & LSM303_A_FIFO_OVERRUN) ? LSM303_A_FIFO_DEPTH : (src & LSM303_A_FIFO_EMPTY) ? 0 : (src & LSM303_A_FIFO_COUNT_MASK);
+    if (count == 0)
+        return DEVICE_OK;
+
+    // Drain the FIFO in a single burst. The register address wraps from OUT_Z_H_A back to OUT_X_L_A while the FIFO is enabled.
+    result = i2c.readRegister(address, LSM303_OUT_X_L_A | 0x80, (uint8_t *)data, 6 * count);
+    if (result != 0)
+        return DEVICE_I2C_ERROR;
+
+    for (int i = 0; i < count; i++)
+    {
+        // Read in each reading as a 16 bit little endian value, and scale to 10 bits.
+        int x = data[3 * i] / 32;
+        int y = data[3 * i + 1] / 32;
+        int z = data[3 * i + 2] / 32;
+
+        // Scale into millig (approx) and align to ENU coordinate system
+        samples[i].x = -y * sampleRange;
+        samples[i].y = -x * sampleRange;
+        samples[i].z = z * sampleRange;
+    }
+
+    // indicate that a new block of samples is available.
+    updateBatch(samples, count);
+
+    return DEVICE_OK;
+}
+
 /**
   * A periodic callback invoked by the fiber scheduler idle thread.
   *
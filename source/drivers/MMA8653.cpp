@@ -73,6 +73,9 @@ int MMA8653::configure()
     this->samplePeriod = actualSampleRate->sample_period / 1000;
     this->sampleRange = actualSampleRange->sample_range;
 
+    // The MMA8653 has no hardware FIFO, so samples are always read individually.
+    this->batchSize = 1;
+
     // Now configure the accelerometer accordingly.
     // First place the device into standby mode, so it can be configured.
     result = i2c.writeRegister(this->address, MMA8653_CTRL_REG1, 0x00);
@@ -26,6 +26,9 @@ MPU6050::MPU6050(I2C& _i2c, Pin &_int1, CoordinateSpace &coordinateSpace, uint16
 
 int MPU6050::configure()
 {
+    // Batched reads from the FIFO are not supported by this driver.
+    batchSize = 1;
+
     i2c.writeRegister(address, 0x6B, 0x80);
     fiber_sleep(20);
     i2c.writeRegister(address, 0x6B, 0x00);  /* PWR_MGMT_1    -- SLEEP 0; CYCLE 0; TEMP_DIS 0; CLKSEL 3 (PLL with Z Gyro reference) */
@@ -25,11 +25,32 @@ DEALINGS IN THE SOFTWARE.
 #include "PulseIn.h"
 #include "Timer.h"
 #include "CodalDmesg.h"
+#include "ErrorNo.h"
+#include "codal_target_hal.h"
 
 using namespace codal;
 
 bool PulseIn::timeoutGeneratorStarted = false;
 
+// The PulseIn instance using each capture slot, if any.
+static PulseIn *captures[PULSE_IN_MAX_CAPTURES];
+
+/**
+ * Pin change handlers for each capture slot. Pin interrupts carry no context, so each slot has its own handler.
+ */
+template <int N>
+static void onCaptureEdge(int state)
+{
+    if (N < PULSE_IN_MAX_CAPTURES && captures[N])
+        captures[N]->onEdge(state);
+}
+
+static void (*const captureEdgeHandlers[])(int) = {
+    onCaptureEdge<0>, onCaptureEdge<1>, onCaptureEdge<2>, onCaptureEdge<3>
+};
+
+static_assert(sizeof(captureEdgeHandlers) / sizeof(captureEdgeHandlers[0]) >= PULSE_IN_MAX_CAPTURES, "a pin change handler is required for each capture slot");
+
 /**
  * Creates a new instance of a synchronous pulse detector ont he given pin.
  * 
@@ -42,6 +63,17 @@ PulseIn::PulseIn(Pin &p) : pin(p)
     lastEdge = 0;
     enabled = false;
 
+    ring = NULL;
+    ringSize = 0;
+    head = 0;
+    tail = 0;
+    slot = -1;
+    watermark = 0;
+    lastEdgeTime = 0;
+    overflows = 0;
+    downstream = NULL;
+    pullRequested = false;
+
     lock.wait();
 }
 
@@ -54,6 +86,9 @@ PulseIn::PulseIn(Pin &p) : pin(p)
 int 
 PulseIn::awaitPulse(int timeout)
 {
+    if (slot >= 0)
+        return DEVICE_BUSY;
+
     // perform lazy initialisation of our dependencies
     if (!enabled)
     {
@@ -129,6 +164,7 @@ int PulseIn::releasePin(Pin &pin)
 {
     // We've been asked to disconnect from the given pin.
     // As we do nothing else, simply disable ourselves.
+    stopCapture();
     disable();
 
     if (deleteOnRelease)
@@ -156,5 +192,234 @@ void PulseIn::disable()
  */
 PulseIn::~PulseIn()
 {
+    stopCapture();
+    disable();
+}
+
+/**
+ * Starts recording the time between every edge on the pin into a ring buffer, without raising an event per pulse.
+ * While capturing, awaitPulse() is unavailable.
+ *
+ * Each captured duration is a number of microseconds, ORed with PULSE_IN_LEVEL_HIGH if the pin was high during that period.
+ *
+ * @param size The number of durations the ring can hold.
+ * @param watermark The number of unread durations at which a connected DataSink is notified. Defaults to half the ring.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER, DEVICE_NO_RESOURCES, or DEVICE_NOT_SUPPORTED if the pin cannot interrupt on edges.
+ */
+int PulseIn::startCapture(int size, int watermark)
+{
+    // Each pull must fit within the 16 bit length of a ManagedBuffer.
+    if (size < 1 || size > 0xFFFF / (int)sizeof(uint32_t) || watermark < 0 || watermark > size)
+        return DEVICE_INVALID_PARAMETER;
+
+    stopCapture();
+
+    // Pulse events and edge interrupts cannot be used together.
     disable();
+
+    int s;
+    for (s = 0; s < PULSE_IN_MAX_CAPTURES; s++)
+        if (captures[s] == NULL)
+            break;
+
+    if (s == PULSE_IN_MAX_CAPTURES)
+        return DEVICE_NO_RESOURCES;
+
+    // One entry is left unused, to distinguish a full ring from an empty one.
+    ring = new uint32_t[size + 1];
+    if (ring == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    ringSize = size + 1;
+    head = 0;
+    tail = 0;
+    lastEdgeTime = 0;
+    overflows = 0;
+    pullRequested = false;
+    this->watermark = watermark ? watermark : max(size / 2, 1);
+
+    slot = s;
+    captures[slot] = this;
+
+    pin.setIRQ(captureEdgeHandlers[slot]);
+
+    if (pin.eventOn(DEVICE_PIN_INTERRUPT_ON_EDGE) != DEVICE_OK)
+    {
+        stopCapture();
+        return DEVICE_NOT_SUPPORTED;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops recording edges, and releases the ring buffer. Unread durations are discarded.
+ */
+void PulseIn::stopCapture()
+{
+    if (slot < 0)
+        return;
+
+    pin.eventOn(DEVICE_PIN_EVENT_NONE);
+    pin.setIRQ(NULL);
+
+    target_disable_irq();
+    captures[slot] = NULL;
+    slot = -1;
+    target_enable_irq();
+
+    delete[] ring;
+    ring = NULL;
+    ringSize = 0;
+    head = tail = 0;
+}
+
+/**
+ * Determines if edges are being captured.
+ */
+bool PulseIn::isCapturing()
+{
+    return slot >= 0;
+}
+
+/**
+ * Determines the number of captured durations waiting to be read.
+ */
+int PulseIn::available()
+{
+    int n = head - tail;
+
+    return n < 0 ? n + ringSize : n;
+}
+
+/**
+ * Reads captured durations, oldest first.
+ *
+ * @param durations The buffer to fill.
+ * @param count The maximum number of durations to read.
+ * @return The number of durations read.
+ */
+int PulseIn::read(uint32_t *durations, int count)
+{
+    int n = min(count, available());
+    int t = tail;
+
+    for (int i = 0; i < n; i++)
+    {
+        durations[i] = ring[t];
+
+        if (++t == ringSize)
+            t = 0;
+    }
+
+    // Only the consumer moves the tail, so no locking is required.
+    tail = t;
+
+    if (available() < watermark)
+        pullRequested = false;
+
+    return n;
+}
+
+/**
+ * Determines the number of durations dropped since capture started, because the ring was full.
+ */
+uint32_t PulseIn::getOverflowCount()
+{
+    return overflows;
+}
+
+/**
+ * Records an edge. Called from interrupt context while capturing.
+ *
+ * @param state The new state of the pin.
+ */
+void PulseIn::onEdge(int state)
+{
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+    // The first edge only marks the start of the first period.
+    if (lastEdgeTime != 0)
+    {
+        int next = head + 1;
+        if (next == ringSize)
+            next = 0;
+
+        if (next == tail)
+        {
+            overflows++;
+        }
+        else
+        {
+            // The period that has just ended was at the opposite level to the new state.
+            ring[head] = ((uint32_t) (now - lastEdgeTime) & PULSE_IN_DURATION_MASK) | (state ? 0 : PULSE_IN_LEVEL_HIGH);
+            head = next;
+        }
+
+        if (downstream && !pullRequested && available() >= watermark)
+        {
+            pullRequested = true;
+            downstream->pullRequest();
+        }
+    }
+
+    lastEdgeTime = now;
+    lastEdge = (uint32_t) now;
+}
+
+/**
+ * Provides all unread durations, as DATASTREAM_FORMAT_32BIT_UNSIGNED values.
+ */
+ManagedBuffer PulseIn::pull()
+{
+    int n = available();
+
+    if (n == 0)
+    {
+        pullRequested = false;
+        return ManagedBuffer();
+    }
+
+    ManagedBuffer b(n * sizeof(uint32_t), BufferInitialize::None);
+    read((uint32_t *) b.getBytes(), n);
+    pullRequested = false;
+
+    return b;
+}
+
+/**
+ * Define a downstream component for captured durations.
+ *
+ * @sink The component that data will be delivered to, when it is available
+ */
+void PulseIn::connect(DataSink &sink)
+{
+    downstream = &sink;
+}
+
+/**
+ * Determines if this source is connected to a downstream component
+ *
+ * @return true If a downstream is connected
+ * @return false If a downstream is not connected
+ */
+bool PulseIn::isConnected()
+{
+    return downstream != NULL;
+}
+
+/**
+ * Disconnects the downstream component.
+ */
+void PulseIn::disconnect()
+{
+    downstream = NULL;
+}
+
+/**
+ *  Determine the data format of the buffers streamed out of this component.
+ */
+int PulseIn::getFormat()
+{
+    return DATASTREAM_FORMAT_32BIT_UNSIGNED;
 }
\ No newline at end of file
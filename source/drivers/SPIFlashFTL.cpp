@@ -0,0 +1,581 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SPIFlashFTL.h"
+#include "CodalDmesg.h"
+#include "EventModel.h"
+#include "ErrorNo.h"
+
+#define LOG DMESG
+
+#define FTL_MAGIC 0x314c5446 // "FTL1"
+#define FTL_UNMAPPED 0xffff
+
+// layout of the header page of each row
+#define FTL_ENTRIES_OFFSET 16
+#define FTL_HEADER_SIZE (FTL_ENTRIES_OFFSET + SPIFLASH_FTL_SECTORS_PER_ROW * sizeof(FTLEntry))
+
+#define ROW_FREE 0x01   // the row holds no data, and can be used for new writes
+#define ROW_ERASED 0x02 // a free row that has been erased, and has a valid header
+
+namespace codal
+{
+
+struct FTLHeader
+{
+    uint32_t magic;
+    uint32_t erases; // the number of times the row has been erased
+    uint32_t check;  // ~erases, to detect an interrupted header write
+};
+
+struct FTLEntry
+{
+    uint32_t seq;    // sequence number of the write; the highest copy of a sector wins
+    uint16_t sector; // the logical sector held in the corresponding slot
+    uint16_t check;
+};
+
+static uint16_t entryCheck(uint32_t seq, uint16_t sector)
+{
+    return sector ^ (seq & 0xffff) ^ (seq >> 16) ^ 0xa5a5;
+}
+
+static bool isBlank(const uint8_t *p, int len)
+{
+    while (len--)
+        if (*p++ != 0xff)
+            return false;
+    return true;
+}
+
+SPIFlashFTL::SPIFlashFTL(SPIFlash &flash, uint32_t offset, uint32_t size, uint16_t id)
+    : flash(flash)
+{
+    uint32_t flashSize = flash.numPages() * SPIFLASH_PAGE_SIZE;
+
+    offset = (offset + SPIFLASH_FTL_ROW_SIZE - 1) & ~(SPIFLASH_FTL_ROW_SIZE - 1);
+    if (offset > flashSize)
+        offset = flashSize;
+    if (size == 0 || size > flashSize - offset)
+        size = flashSize - offset;
+
+    this->id = id;
+    this->offset = offset;
+    this->rows = min(size / SPIFLASH_FTL_ROW_SIZE, SPIFLASH_FTL_MAX_ROWS);
+    this->sectors = rows > SPIFLASH_FTL_RESERVED_ROWS
+                        ? (rows - SPIFLASH_FTL_RESERVED_ROWS) * SPIFLASH_FTL_SECTORS_PER_ROW
+                        : 0;
+
+    map = NULL;
+    rowValid = NULL;
+    rowFlags = NULL;
+    rowErases = NULL;
+    buffer = NULL;
+    freeRows = 0;
+    activeRow = -1;
+    activeNext = 0;
+    sequence = 0;
+    eraseCount = 0;
+    programCount = 0;
+    collecting = false;
+    wearPending = false;
+}
+
+SPIFlashFTL::~SPIFlashFTL()
+{
+    if (status & DEVICE_COMPONENT_RUNNING)
+        EventModel::defaultEventBus->ignore(id, SPIFLASH_FTL_EVT_GC, this, &SPIFlashFTL::onCollect);
+
+    delete[] map;
+    delete[] rowValid;
+    delete[] rowFlags;
+    delete[] rowErases;
+    delete[] buffer;
+}
+
+static inline uint32_t rowAddress(uint32_t offset, int row)
+{
+    return offset + row * SPIFLASH_FTL_ROW_SIZE;
+}
+
+static inline uint32_t slotAddress(uint32_t offset, int slot)
+{
+    return rowAddress(offset, slot / SPIFLASH_FTL_SECTORS_PER_ROW) +
+           (slot % SPIFLASH_FTL_SECTORS_PER_ROW + 1) * SPIFLASH_FTL_SECTOR_SIZE;
+}
+
+static inline uint32_t entryAddress(uint32_t offset, int slot)
+{
+    return rowAddress(offset, slot / SPIFLASH_FTL_SECTORS_PER_ROW) + FTL_ENTRIES_OFFSET +
+           (slot % SPIFLASH_FTL_SECTORS_PER_ROW) * sizeof(FTLEntry);
+}
+
+int SPIFlashFTL::readEntry(int slot, uint32_t *seq, uint16_t *sector)
+{
+    FTLEntry e;
+
+    int r = flash.readBytes(entryAddress(offset, slot), &e, sizeof(e));
+    if (r < 0)
+        return r;
+
+    if (e.check != entryCheck(e.seq, e.sector) || e.sector >= sectors)
+        return DEVICE_NO_DATA;
+
+    *seq = e.seq;
+    *sector = e.sector;
+    return DEVICE_OK;
+}
+
+int SPIFlashFTL::init()
+{
+    if (status & DEVICE_COMPONENT_RUNNING)
+        return DEVICE_OK;
+
+    if (sectors == 0)
+        return DEVICE_NO_RESOURCES;
+
+    if (map == NULL)
+    {
+        map = new uint16_t[sectors];
+        rowValid = new uint8_t[rows];
+        rowFlags = new uint8_t[rows];
+        rowErases = new uint32_t[rows];
+        buffer = new uint8_t[SPIFLASH_FTL_SECTOR_SIZE];
+    }
+
+    memset(map, 0xff, sectors * sizeof(uint16_t));
+    memclr(rowValid, rows);
+
+    uint32_t known = 0;
+    uint32_t knownErases = 0;
+
+    freeRows = 0;
+    activeRow = -1;
+    sequence = 0;
+
+    for (int row = 0; row < rows; ++row)
+    {
+        int r = flash.readBytes(rowAddress(offset, row), buffer, FTL_HEADER_SIZE);
+        if (r < 0)
+            return r;
+
+        FTLHeader *h = (FTLHeader *)buffer;
+        rowFlags[row] = 0;
+        rowErases[row] = 0xffffffff;
+
+        // never used, or the power failed during an erase; it will be erased again before use
+        if (h->magic != FTL_MAGIC || h->check != ~h->erases)
+        {
+            rowFlags[row] = ROW_FREE;
+            freeRows++;
+            continue;
+        }
+
+        rowErases[row] = h->erases;
+        known++;
+        knownErases += h->erases;
+
+        // replay the journal entries of the row
+        int used = 0;
+        for (int i = 0; i < SPIFLASH_FTL_SECTORS_PER_ROW; ++i)
+        {
+            FTLEntry *e = (FTLEntry *)(buffer + FTL_ENTRIES_OFFSET + i * sizeof(FTLEntry));
+
+            if (isBlank((uint8_t *)e, sizeof(FTLEntry)))
+                break;
+
+            used = i + 1;
+
+            // an entry that was only partly written
+            if (e->check != entryCheck(e->seq, e->sector) || e->sector >= sectors)
+                continue;
+
+            if (e->seq >= sequence)
+                sequence = e->seq + 1;
+
+            int slot = row * SPIFLASH_FTL_SECTORS_PER_ROW + i;
+            uint16_t current = map[e->sector];
+            uint32_t currentSeq;
+            uint16_t currentSector;
+
+            if (current == FTL_UNMAPPED ||
+                readEntry(current, &currentSeq, &currentSector) != DEVICE_OK ||
+                currentSeq < e->seq)
+                map[e->sector] = slot;
+        }
+
+        // skip any slots where the power failed after writing data, but before writing its entry
+        while (used < SPIFLASH_FTL_SECTORS_PER_ROW)
+        {
+            r = flash.readBytes(slotAddress(offset, row * SPIFLASH_FTL_SECTORS_PER_ROW + used),
+                                buffer, SPIFLASH_FTL_SECTOR_SIZE);
+            if (r < 0)
+                return r;
+
+            if (isBlank(buffer, SPIFLASH_FTL_SECTOR_SIZE))
+                break;
+
+            used++;
+        }
+
+        if (used == 0)
+        {
+            rowFlags[row] = ROW_FREE | ROW_ERASED;
+            freeRows++;
+        }
+        else if (used < SPIFLASH_FTL_SECTORS_PER_ROW && activeRow < 0)
+        {
+            activeRow = row;
+            activeNext = used;
+        }
+    }
+
+    // rows whose wear was lost in a power failure are assumed to be average
+    for (int row = 0; row < rows; ++row)
+        if (rowErases[row] == 0xffffffff)
+            rowErases[row] = known ? knownErases / known : 0;
+
+    for (int i = 0; i < sectors; ++i)
+        if (map[i] != FTL_UNMAPPED)
+            rowValid[map[i] / SPIFLASH_FTL_SECTORS_PER_ROW]++;
+
+    EventModel::defaultEventBus->listen(id, SPIFLASH_FTL_EVT_GC, this, &SPIFlashFTL::onCollect);
+    status |= DEVICE_COMPONENT_RUNNING;
+
+    requestCollection();
+
+    return DEVICE_OK;
+}
+
+int SPIFlashFTL::format()
+{
+    int r = init();
+    if (r < 0)
+        return r;
+
+    lock.wait();
+
+    for (int row = 0; row < rows; ++row)
+    {
+        r = eraseRow(row);
+        if (r < 0)
+            break;
+        rowFlags[row] = ROW_FREE | ROW_ERASED;
+        rowValid[row] = 0;
+    }
+
+    memset(map, 0xff, sectors * sizeof(uint16_t));
+    freeRows = rows;
+    activeRow = -1;
+
+    lock.notify();
+
+    return r;
+}
+
+int SPIFlashFTL::eraseRow(int row)
+{
+    uint32_t addr = rowAddress(offset, row);
+
+    int r = flash.eraseSmallRow(addr);
+    if (r < 0)
+        return r;
+
+    eraseCount++;
+    rowErases[row]++;
+
+    FTLHeader h;
+    h.magic = FTL_MAGIC;
+    h.erases = rowErases[row];
+    h.check = ~h.erases;
+
+    r = flash.writeBytes(addr, &h, sizeof(h));
+    if (r < 0)
+        return r;
+
+    // see if the rows holding static data have fallen too far behind
+    for (int i = 0; i < rows; ++i)
+        if (!(rowFlags[i] & ROW_FREE) && i != row &&
+            rowErases[i] + SPIFLASH_FTL_WEAR_THRESHOLD < rowErases[row])
+        {
+            wearPending = true;
+            break;
+        }
+
+    return DEVICE_OK;
+}
+
+// returns the next pre-erased slot, opening a new row (and reclaiming space) as needed
+int SPIFlashFTL::allocateSlot(bool forGC)
+{
+    // keep one free row in hand, so that garbage collection always has somewhere to move data to
+    if (!forGC)
+        while ((activeRow < 0 || activeNext == SPIFLASH_FTL_SECTORS_PER_ROW) && freeRows < 2)
+        {
+            int r = collectRow(false);
+            if (r < 0)
+                return r;
+            if (r == 0)
+                break;
+        }
+
+    if (activeRow < 0 || activeNext == SPIFLASH_FTL_SECTORS_PER_ROW)
+    {
+        int row = -1;
+
+        for (int i = 0; i < rows; ++i)
+            if ((rowFlags[i] & ROW_FREE) && (row < 0 || rowErases[i] < rowErases[row]))
+                row = i;
+
+        if (row < 0)
+            return DEVICE_NO_RESOURCES;
+
+        if (!(rowFlags[row] & ROW_ERASED))
+        {
+            int r = eraseRow(row);
+            if (r < 0)
+                return r;
+        }
+
+        rowFlags[row] = 0;
+        freeRows--;
+        activeRow = row;
+        activeNext = 0;
+    }
+
+    return activeRow * SPIFLASH_FTL_SECTORS_PER_ROW + activeNext++;
+}
+
+// programs the data, then the journal entry that makes it live
+int SPIFlashFTL::writeSlot(int slot, uint16_t sector, const void *data)
+{
+    int r = flash.writeBytes(slotAddress(offset, slot), data, SPIFLASH_FTL_SECTOR_SIZE);
+    if (r < 0)
+        return r;
+
+    programCount++;
+
+    FTLEntry e;
+    e.seq = sequence++;
+    e.sector = sector;
+    e.check = entryCheck(e.seq, e.sector);
+
+    r = flash.writeBytes(entryAddress(offset, slot), &e, sizeof(e));
+    if (r < 0)
+        return r;
+
+    if (map[sector] != FTL_UNMAPPED)
+        rowValid[map[sector] / SPIFLASH_FTL_SECTORS_PER_ROW]--;
+
+    map[sector] = slot;
+    rowValid[slot / SPIFLASH_FTL_SECTORS_PER_ROW]++;
+
+    return DEVICE_OK;
+}
+
+// the row with the least live data, or when wear levelling, the least worn row holding data
+int SPIFlashFTL::pickVictim(bool wear)
+{
+    int best = -1;
+    int coldest = -1;
+    uint32_t maxErases = 0;
+
+    for (int row = 0; row < rows; ++row)
+    {
+        if (rowErases[row] > maxErases)
+            maxErases = rowErases[row];
+
+        if ((rowFlags[row] & ROW_FREE) || row == activeRow)
+            continue;
+
+        if (best < 0 || rowValid[row] < rowValid[best])
+            best = row;
+
+        if (coldest < 0 || rowErases[row] < rowErases[coldest])
+            coldest = row;
+    }
+
+    if (wear)
+        return (coldest >= 0 && rowErases[coldest] + SPIFLASH_FTL_WEAR_THRESHOLD < maxErases) ? coldest : -1;
+
+    return (best >= 0 && rowValid[best] < SPIFLASH_FTL_SECTORS_PER_ROW) ? best : -1;
+}
+
+// moves the live sectors out of a row and erases it; returns 1 if a row was reclaimed, 0 if there was none to reclaim
+int SPIFlashFTL::collectRow(bool wear)
+{
+    int victim = pickVictim(wear);
+    if (victim < 0)
+        return 0;
+
+    for (int i = 0; i < SPIFLASH_FTL_SECTORS_PER_ROW && rowValid[victim]; ++i)
+    {
+        int slot = victim * SPIFLASH_FTL_SECTORS_PER_ROW + i;
+        uint32_t seq;
+        uint16_t sector;
+
+        if (readEntry(slot, &seq, &sector) != DEVICE_OK || map[sector] != slot)
+            continue;
+
+        int r = flash.readBytes(slotAddress(offset, slot), buffer, SPIFLASH_FTL_SECTOR_SIZE);
+        if (r < 0)
+            return r;
+
+        int dest = allocateSlot(true);
+        if (dest < 0)
+            return dest;
+
+        r = writeSlot(dest, sector, buffer);
+        if (r < 0)
+            return r;
+    }
+
+    int r = eraseRow(victim);
+    if (r < 0)
+        return r;
+
+    rowFlags[victim] = ROW_FREE | ROW_ERASED;
+    rowValid[victim] = 0;
+    freeRows++;
+
+    return 1;
+}
+
+void SPIFlashFTL::requestCollection()
+{
+    if (!collecting && (freeRows < SPIFLASH_FTL_GC_FREE_ROWS || wearPending))
+    {
+        collecting = true;
+        Event(id, SPIFLASH_FTL_EVT_GC);
+    }
+}
+
+void SPIFlashFTL::onCollect(Event)
+{
+    collect();
+    collecting = false;
+}
+
+int SPIFlashFTL::collect()
+{
+    int r = init();
+
+    // one row at a time, so that foreground reads and writes are only briefly held up
+    for (int i = 0; r >= 0 && i < rows; ++i)
+    {
+        lock.wait();
+
+        if (freeRows < SPIFLASH_FTL_GC_FREE_ROWS)
+        {
+            r = collectRow(false);
+        }
+        else if (wearPending)
+        {
+            r = collectRow(true);
+            if (r == 0)
+                wearPending = false;
+        }
+        else
+        {
+            r = 0;
+        }
+
+        lock.notify();
+
+        if (r == 0)
+            break;
+    }
+
+    if (r < 0)
+        LOG("FTL collect failed: %d", r);
+
+    return r < 0 ? r : DEVICE_OK;
+}
+
+int SPIFlashFTL::getSectorCount()
+{
+    return sectors;
+}
+
+int SPIFlashFTL::read(int sector, void *data)
+{
+    int r = init();
+    if (r < 0)
+        return r;
+
+    if (sector < 0 || sector >= sectors || data == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    lock.wait();
+
+    if (map[sector] == FTL_UNMAPPED)
+        memset(data, 0xff, SPIFLASH_FTL_SECTOR_SIZE);
+    else
+        r = flash.readBytes(slotAddress(offset, map[sector]), data, SPIFLASH_FTL_SECTOR_SIZE);
+
+    lock.notify();
+
+    return r < 0 ? r : DEVICE_OK;
+}
+
+int SPIFlashFTL::write(int sector, const void *data)
+{
+    int r = init();
+    if (r < 0)
+        return r;
+
+    if (sector < 0 || sector >= sectors || data == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    lock.wait();
+
+    int slot = allocateSlot(false);
+    r = slot < 0 ? slot : writeSlot(slot, sector, data);
+
+    lock.notify();
+
+    requestCollection();
+
+    return r;
+}
+
+uint32_t SPIFlashFTL::getWearSpread()
+{
+    if (!(status & DEVICE_COMPONENT_RUNNING))
+        return 0;
+
+    uint32_t lo = 0xffffffff, hi = 0;
+
+    for (int row = 0; row < rows; ++row)
+    {
+        if (rowErases[row] < lo)
+            lo = rowErases[row];
+        if (rowErases[row] > hi)
+            hi = rowErases[row];
+    }
+
+    return hi - lo;
+}
+
+} // namespace codal
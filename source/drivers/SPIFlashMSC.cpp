@@ -0,0 +1,337 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SPIFlashMSC.h"
+
+#if CONFIG_ENABLED(DEVICE_USB)
+
+#include "CodalDmesg.h"
+#include "EventModel.h"
+#include "Timer.h"
+
+#define LOG DMESG
+
+#define NO_ROW 0xffffffff
+#define ALL_BLOCKS ((1 << SPIFLASH_MSC_BLOCKS_PER_ROW) - 1)
+
+// size of the chunks used to compare the cache with the flash
+#define COMPARE_SIZE 64
+
+namespace codal
+{
+
+SPIFlashMSC::SPIFlashMSC(SPIFlash &flash, uint32_t offset, uint32_t size) : flash(flash)
+{
+    uint32_t flashSize = flash.numPages() * SPIFLASH_PAGE_SIZE;
+
+    offset = (offset + SPIFLASH_MSC_ROW_SIZE - 1) & ~(SPIFLASH_MSC_ROW_SIZE - 1);
+    if (offset > flashSize)
+        offset = flashSize;
+    if (size == 0 || size > flashSize - offset)
+        size = flashSize - offset;
+
+    this->offset = offset;
+    this->size = size & ~(SPIFLASH_MSC_ROW_SIZE - 1);
+
+    for (int i = 0; i < SPIFLASH_MSC_CACHE_ROWS; ++i)
+    {
+        cache[i].addr = NO_ROW;
+        cache[i].lastUsed = 0;
+        cache[i].valid = 0;
+        cache[i].dirty = 0;
+        cache[i].data = NULL;
+    }
+
+    useCount = 0;
+    eraseCount = 0;
+    lastWrite = 0;
+    flushPending = false;
+    listening = false;
+}
+
+SPIFlashMSC::~SPIFlashMSC()
+{
+    flush();
+
+    if (listening)
+        EventModel::defaultEventBus->ignore(DEVICE_ID_MSC, SPIFLASH_MSC_EVT_FLUSH, this,
+                                           &SPIFlashMSC::onFlushTimer);
+
+    for (int i = 0; i < SPIFLASH_MSC_CACHE_ROWS; ++i)
+        delete[] cache[i].data;
+}
+
+uint32_t SPIFlashMSC::getCapacity()
+{
+    return size / SPIFLASH_MSC_BLOCK_SIZE;
+}
+
+SPIFlashMSCRow *SPIFlashMSC::findRow(uint32_t addr)
+{
+    for (int i = 0; i < SPIFLASH_MSC_CACHE_ROWS; ++i)
+        if (cache[i].addr == addr)
+            return &cache[i];
+    return NULL;
+}
+
+// find the row in the cache, or make room for it by writing back the least recently used row
+SPIFlashMSCRow *SPIFlashMSC::getRow(uint32_t addr)
+{
+    SPIFlashMSCRow *row = findRow(addr);
+
+    if (!row)
+    {
+        row = &cache[0];
+        for (int i = 1; i < SPIFLASH_MSC_CACHE_ROWS; ++i)
+            if (cache[i].lastUsed < row->lastUsed)
+                row = &cache[i];
+
+        int r = flushRow(row);
+        if (r < 0)
+            LOG("MSC write back failed: %d", r);
+
+        if (!row->data)
+            row->data = new uint8_t[SPIFLASH_MSC_ROW_SIZE];
+
+        row->addr = addr;
+        row->valid = 0;
+        row->dirty = 0;
+    }
+
+    row->lastUsed = ++useCount;
+    return row;
+}
+
+int SPIFlashMSC::flushRow(SPIFlashMSCRow *row)
+{
+    if (!row->dirty)
+        return DEVICE_OK;
+
+    uint8_t *data = row->data;
+    int r;
+
+    // bring in the blocks the host hasn't written, in case we need to rewrite the whole row
+    for (int i = 0; i < SPIFLASH_MSC_BLOCKS_PER_ROW; ++i)
+        if (!(row->valid & (1 << i)))
+        {
+            r = flash.readBytes(row->addr + i * SPIFLASH_MSC_BLOCK_SIZE,
+                                data + i * SPIFLASH_MSC_BLOCK_SIZE, SPIFLASH_MSC_BLOCK_SIZE);
+            if (r < 0)
+                return r;
+        }
+    row->valid = ALL_BLOCKS;
+
+    // see if the new data differs, and if so whether it can be programmed without an erase
+    // (programming can only clear bits)
+    bool changed = false;
+    bool needsErase = false;
+    uint8_t tmp[COMPARE_SIZE];
+
+    for (int off = 0; off < SPIFLASH_MSC_ROW_SIZE && !needsErase; off += COMPARE_SIZE)
+    {
+        if (!(row->dirty & (1 << (off / SPIFLASH_MSC_BLOCK_SIZE))))
+            continue;
+
+        r = flash.readBytes(row->addr + off, tmp, COMPARE_SIZE);
+        if (r < 0)
+            return r;
+
+        for (int i = 0; i < COMPARE_SIZE; ++i)
+        {
+            uint8_t n = data[off + i];
+            if (n != tmp[i])
+            {
+                changed = true;
+                if (n & ~tmp[i])
+                {
+                    needsErase = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (changed)
+    {
+        if (needsErase)
+        {
+            r = flash.eraseSmallRow(row->addr);
+            if (r < 0)
+                return r;
+            eraseCount++;
+        }
+
+        for (int off = 0; off < SPIFLASH_MSC_ROW_SIZE; off += SPIFLASH_PAGE_SIZE)
+        {
+            // after an erase, every page has to be written back, except the blank ones;
+            // otherwise only the pages the host wrote
+            if (needsErase)
+            {
+                int i = 0;
+                while (i < SPIFLASH_PAGE_SIZE && data[off + i] == 0xff)
+                    i++;
+                if (i == SPIFLASH_PAGE_SIZE)
+                    continue;
+            }
+            else if (!(row->dirty & (1 << (off / SPIFLASH_MSC_BLOCK_SIZE))))
+            {
+                continue;
+            }
+
+            r = flash.writeBytes(row->addr + off, data + off, SPIFLASH_PAGE_SIZE);
+            if (r < 0)
+                return r;
+        }
+    }
+
+    row->dirty = 0;
+    return DEVICE_OK;
+}
+
+int SPIFlashMSC::flush()
+{
+    int res = DEVICE_OK;
+
+    lock.wait();
+    for (int i = 0; i < SPIFLASH_MSC_CACHE_ROWS; ++i)
+    {
+        int r = flushRow(&cache[i]);
+        if (r < 0)
+        {
+            LOG("MSC flush failed: %d", r);
+            res = r;
+        }
+    }
+    lock.notify();
+
+    return res;
+}
+
+void SPIFlashMSC::onFlushTimer(Event)
+{
+    CODAL_TIMESTAMP idle = system_timer_current_time() - lastWrite;
+
+    // the host is still writing; check again once it could have gone quiet
+    if (idle < SPIFLASH_MSC_FLUSH_DELAY)
+    {
+        system_timer_event_after(SPIFLASH_MSC_FLUSH_DELAY - idle, DEVICE_ID_MSC,
+                                 SPIFLASH_MSC_EVT_FLUSH);
+        return;
+    }
+
+    flushPending = false;
+    flush();
+}
+
+void SPIFlashMSC::readBlocks(int blockAddr, int numBlocks)
+{
+    uint8_t *buf = NULL;
+
+    lock.wait();
+
+    while (numBlocks--)
+    {
+        uint32_t addr = offset + blockAddr * SPIFLASH_MSC_BLOCK_SIZE;
+        uint32_t rowAddr = addr & ~(SPIFLASH_MSC_ROW_SIZE - 1);
+        int block = (addr - rowAddr) / SPIFLASH_MSC_BLOCK_SIZE;
+        SPIFlashMSCRow *row = findRow(rowAddr);
+
+        if (row && (row->valid & (1 << block)))
+        {
+            writeBulk(row->data + block * SPIFLASH_MSC_BLOCK_SIZE, SPIFLASH_MSC_BLOCK_SIZE);
+        }
+        else
+        {
+            if (!buf)
+                buf = new uint8_t[SPIFLASH_MSC_BLOCK_SIZE];
+
+            if ((uint32_t)blockAddr < getCapacity())
+                flash.readBytes(addr, buf, SPIFLASH_MSC_BLOCK_SIZE);
+            else
+                memset(buf, 0, SPIFLASH_MSC_BLOCK_SIZE);
+
+            writeBulk(buf, SPIFLASH_MSC_BLOCK_SIZE);
+        }
+
+        blockAddr++;
+    }
+
+    lock.notify();
+
+    delete[] buf;
+
+    finishReadWrite();
+}
+
+void SPIFlashMSC::writeBlocks(int blockAddr, int numBlocks)
+{
+    lock.wait();
+
+    while (numBlocks--)
+    {
+        uint32_t addr = offset + blockAddr * SPIFLASH_MSC_BLOCK_SIZE;
+        uint32_t rowAddr = addr & ~(SPIFLASH_MSC_ROW_SIZE - 1);
+        int block = (addr - rowAddr) / SPIFLASH_MSC_BLOCK_SIZE;
+
+        if ((uint32_t)blockAddr < getCapacity())
+        {
+            SPIFlashMSCRow *row = getRow(rowAddr);
+            readBulk(row->data + block * SPIFLASH_MSC_BLOCK_SIZE, SPIFLASH_MSC_BLOCK_SIZE);
+            row->valid |= 1 << block;
+            row->dirty |= 1 << block;
+        }
+        else
+        {
+            // past the end of the disk; discard the data
+            uint8_t tmp[64];
+            for (int i = 0; i < SPIFLASH_MSC_BLOCK_SIZE; i += sizeof(tmp))
+                readBulk(tmp, sizeof(tmp));
+        }
+
+        blockAddr++;
+    }
+
+    lastWrite = system_timer_current_time();
+
+    if (!listening)
+    {
+        listening = true;
+        EventModel::defaultEventBus->listen(DEVICE_ID_MSC, SPIFLASH_MSC_EVT_FLUSH, this,
+                                            &SPIFlashMSC::onFlushTimer);
+    }
+
+    if (!flushPending)
+    {
+        flushPending = true;
+        system_timer_event_after(SPIFLASH_MSC_FLUSH_DELAY, DEVICE_ID_MSC, SPIFLASH_MSC_EVT_FLUSH);
+    }
+
+    lock.notify();
+
+    finishReadWrite();
+}
+
+} // namespace codal
+
+#endif
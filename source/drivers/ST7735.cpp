@@ -146,6 +146,10 @@ struct ST7735WorkBuffer
     uint32_t *paletteTable;
     unsigned srcLeft;
     bool inProgress;
+    uint8_t bitsPerPixel;
+    unsigned stride;
+    unsigned y;
+    int pending;
     uint32_t expPalette[256];
 };
 
@@ -222,6 +226,67 @@ void ST7735::sendWords(unsigned numBytes)
     startTransfer((uint8_t *)dst - work->dataBuf);
 }
 
+// expands 1 and 2 bit pixels into the data buffer, skipping the padding at the end of each column
+void ST7735::sendPacked(unsigned numBytes)
+{
+    if (numBytes > work->srcLeft)
+        numBytes = work->srcLeft;
+    work->srcLeft -= numBytes;
+
+    unsigned bpp = work->bitsPerPixel;
+    unsigned mask = (1 << bpp) - 1;
+    unsigned columnPixels = work->stride * (8 / bpp);
+    uint32_t *tbl = work->expPalette;
+    uint8_t *dst = work->dataBuf;
+
+    while (numBytes--)
+    {
+        uint32_t v = *work->srcPtr++;
+
+        for (unsigned i = 0; i < 8; i += bpp)
+        {
+            if (work->y < work->height)
+            {
+                uint32_t p = v & mask;
+
+                if (double16)
+                {
+                    *(uint32_t *)dst = tbl[p];
+                    dst += 4;
+                }
+                else if (work->pending < 0)
+                {
+                    work->pending = p;
+                }
+                else
+                {
+                    uint32_t c = tbl[work->pending | (p << 4)];
+                    *dst++ = c;
+                    *dst++ = c >> 8;
+                    *dst++ = c >> 16;
+                    work->pending = -1;
+                }
+            }
+
+            v >>= bpp;
+            if (++work->y == columnPixels)
+                work->y = 0;
+        }
+    }
+
+    // an odd number of pixels in total; pad the last pair
+    if (!double16 && work->srcLeft == 0 && work->pending >= 0)
+    {
+        uint32_t c = tbl[work->pending];
+        *dst++ = c;
+        *dst++ = c >> 8;
+        *dst++ = c >> 16;
+        work->pending = -1;
+    }
+
+    startTransfer(dst - work->dataBuf);
+}
+
 void ST7735::sendColorsStep(ST7735 *st)
 {
     ST7735WorkBuffer *work = st->work;
@@ -251,13 +316,32 @@ void ST7735::sendColorsStep(ST7735 *st)
 
     if (st->double16 && work->srcLeft == 0 && work->x++ < (work->width << 1))
     {
-        work->srcLeft = (work->height + 1) >> 1;
+        work->srcLeft = work->stride;
         if ((work->x & 1) == 0)
         {
             work->srcPtr -= work->srcLeft;
         }
     }
 
+    if (work->bitsPerPixel < 4)
+    {
+        if (work->srcLeft == 0)
+        {
+            st->endCS();
+            Event(DEVICE_ID_DISPLAY, 100);
+        }
+        else
+        {
+            // each source byte expands to (8 / bpp) pixels of 4 (double16) or 1.5 bytes
+            unsigned pixelsPerByte = 8 / work->bitsPerPixel;
+            if (st->double16)
+                st->sendPacked(sizeof(work->dataBuf) / (4 * pixelsPerByte));
+            else
+                st->sendPacked((sizeof(work->dataBuf) * 2 / 3 - 2) / pixelsPerByte);
+        }
+        return;
+    }
+
     // with the current image format in PXT the sendBytes cases never happen
     unsigned align = (unsigned)work->srcPtr & 3;
     if (work->srcLeft && align)
@@ -342,6 +426,15 @@ int ST7735::setSleep(bool sleepMode)
 
 int ST7735::sendIndexedImage(const uint8_t *src, unsigned width, unsigned height, uint32_t *palette)
 {
+    return sendPackedImage(src, width, height, 4, palette);
+}
+
+int ST7735::sendPackedImage(const uint8_t *src, unsigned width, unsigned height, int bitsPerPixel,
+                            uint32_t *palette)
+{
+    if (bitsPerPixel != 1 && bitsPerPixel != 2 && bitsPerPixel != 4)
+        return DEVICE_INVALID_PARAMETER;
+
     if (!work)
     {
         work = new ST7735WorkBuffer;
@@ -367,7 +460,11 @@ int ST7735::sendIndexedImage(const uint8_t *src, unsigned width, unsigned height
     work->srcPtr = src;
     work->width = width;
     work->height = height;
-    work->srcLeft = (height + 1) >> 1;
+    work->bitsPerPixel = bitsPerPixel;
+    work->stride = (height * bitsPerPixel + 7) >> 3;
+    work->y = 0;
+    work->pending = -1;
+    work->srcLeft = work->stride;
     // when not scaling up, we don't care about where lines end
     if (!double16)
         work->srcLeft *= width;
@@ -0,0 +1,523 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+/**
+  * Class definition for SensorFusion.
+  *
+  * Estimates the orientation of the device using a fixed point Mahony complementary filter.
+  */
+#include "SensorFusion.h"
+#include "EventModel.h"
+#include "Timer.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+// The largest time step integrated in a single update, in microseconds. Longer gaps (e.g. when sampling has been paused)
+// are clamped, as the gyroscope reading says little about the rotation that took place meanwhile.
+#define SENSOR_FUSION_MAX_PERIOD        100000
+
+#define FIXED_ONE                       ((int64_t) SENSOR_FUSION_ONE)
+#define FIXED_HALF                      (SENSOR_FUSION_ONE >> 1)
+
+// pi / 180, in Q4.28.
+#define DPS_TO_RAD                      4685083
+
+// Reciprocal of the CORDIC gain, in Q16.
+#define CORDIC_GAIN_RECIPROCAL          39797
+
+// atan(2^-i) in degrees, in Q16.
+static const int32_t cordicAngles[] = {
+    2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335,
+    14668, 7334, 3667, 1833, 917, 458, 229, 115
+};
+
+/**
+  * Multiplies two Q4.28 values.
+  */
+static inline int32_t fmul(int32_t a, int32_t b)
+{
+    return (int32_t) (((int64_t) a * b) >> SENSOR_FUSION_FIXED_POINT_SHIFT);
+}
+
+/**
+  * Calculates the integer square root of the given value.
+  */
+static uint32_t isqrt(uint64_t v)
+{
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > v)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (v >= result + bit)
+        {
+            v -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return (uint32_t) result;
+}
+
+/**
+  * Scales the given vector to unit length, in Q4.28.
+  *
+  * @return false if the vector has no length, true otherwise.
+  */
+static bool normalise(int32_t *v, int n)
+{
+    uint64_t sum = 0;
+
+    for (int i = 0; i < n; i++)
+        sum += (int64_t) v[i] * v[i];
+
+    int64_t length = isqrt(sum);
+
+    if (length == 0)
+        return false;
+
+    for (int i = 0; i < n; i++)
+        v[i] = (int32_t) (((int64_t) v[i] << SENSOR_FUSION_FIXED_POINT_SHIFT) / length);
+
+    return true;
+}
+
+/**
+  * Scales the given quaternion to unit length, in Q4.28.
+  *
+  * @return false if the quaternion has no length, true otherwise.
+  */
+static bool normalise(FusionQuaternion &q)
+{
+    int32_t v[4] = { q.w, q.x, q.y, q.z };
+
+    if (!normalise(v, 4))
+        return false;
+
+    q.w = v[0];
+    q.x = v[1];
+    q.y = v[2];
+    q.z = v[3];
+
+    return true;
+}
+
+/**
+  * Calculates atan2(y, x) using CORDIC vectoring.
+  *
+  * @param magnitude If not NULL, receives sqrt(x^2 + y^2), with the same scale as the inputs.
+  * @return The angle, in Q16 degrees (-180..180).
+  */
+static int32_t cordicAtan2(int32_t y, int32_t x, int32_t *magnitude)
+{
+    int32_t angle = 0;
+
+    // Leave headroom for the growth of the vector.
+    x >>= 2;
+    y >>= 2;
+
+    if (x < 0)
+    {
+        angle = y >= 0 ? 180 << 16 : -(180 << 16);
+        x = -x;
+        y = -y;
+    }
+
+    for (int i = 0; i < (int) (sizeof(cordicAngles) / sizeof(cordicAngles[0])); i++)
+    {
+        int32_t dx = x >> i;
+        int32_t dy = y >> i;
+
+        if (y > 0)
+        {
+            x += dy;
+            y -= dx;
+            angle += cordicAngles[i];
+        }
+        else
+        {
+            x -= dy;
+            y += dx;
+            angle -= cordicAngles[i];
+        }
+    }
+
+    if (magnitude)
+        *magnitude = (int32_t) (((int64_t) x * CORDIC_GAIN_RECIPROCAL) >> 14);
+
+    return angle;
+}
+
+/**
+  * Constructor.
+  * Create a fusion filter combining the given gyroscope, accelerometer and compass.
+  *
+  * @param accelerometer The accelerometer to use.
+  * @param gyroscope The gyroscope to use.
+  * @param compass The compass to use.
+  * @param id the unique EventModel id of this component.
+  */
+SensorFusion::SensorFusion(Accelerometer &accelerometer, Gyroscope &gyroscope, Compass &compass, uint16_t id) : accelerometer(accelerometer), gyroscope(gyroscope)
+{
+    this->id = id;
+    this->compass = &compass;
+    initialiseFilter();
+}
+
+/**
+  * Constructor.
+  * Create a fusion filter combining the given gyroscope and accelerometer only. Without a compass,
+  * the heading is relative to the orientation at startup, and drifts over time.
+  *
+  * @param accelerometer The accelerometer to use.
+  * @param gyroscope The gyroscope to use.
+  * @param id the unique EventModel id of this component.
+  */
+SensorFusion::SensorFusion(Accelerometer &accelerometer, Gyroscope &gyroscope, uint16_t id) : accelerometer(accelerometer), gyroscope(gyroscope)
+{
+    this->id = id;
+    this->compass = NULL;
+    initialiseFilter();
+}
+
+/**
+  * Common initialisation for all constructors.
+  */
+void SensorFusion::initialiseFilter()
+{
+    this->updating = false;
+
+    setGains(SENSOR_FUSION_DEFAULT_KP, SENSOR_FUSION_DEFAULT_KI);
+    reset();
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(gyroscope.id, GYROSCOPE_EVT_DATA_UPDATE, this, &SensorFusion::onGyroscopeUpdate, MESSAGE_BUS_LISTENER_IMMEDIATE);
+}
+
+/**
+  * Destructor.
+  */
+SensorFusion::~SensorFusion()
+{
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->ignore(gyroscope.id, GYROSCOPE_EVT_DATA_UPDATE, this, &SensorFusion::onGyroscopeUpdate);
+}
+
+/**
+  * Defines the gains of the filter.
+  *
+  * @param kp The proportional gain. Larger values follow the accelerometer and compass more closely, but admit more noise.
+  * @param ki The integral gain, used to learn and remove gyroscope bias. Zero to disable.
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int SensorFusion::setGains(float kp, float ki)
+{
+    if (kp < 0.0f || kp >= 4.0f || ki < 0.0f || ki >= 4.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->kp = (int32_t) (kp * SENSOR_FUSION_ONE);
+    this->ki = (int32_t) (ki * SENSOR_FUSION_ONE);
+
+    if (this->ki == 0)
+        integral[0] = integral[1] = integral[2] = 0;
+
+    return DEVICE_OK;
+}
+
+/**
+  * Resets the orientation estimate. The next update initialises it directly from the accelerometer and compass.
+  */
+void SensorFusion::reset()
+{
+    q.w = SENSOR_FUSION_ONE;
+    q.x = q.y = q.z = 0;
+    integral[0] = integral[1] = integral[2] = 0;
+    heading = pitch = roll = 0;
+    lastUpdate = 0;
+
+    status &= ~(SENSOR_FUSION_INITIALISED | SENSOR_FUSION_ANGLES_VALID);
+}
+
+/**
+  * Runs the filter when new gyroscope data is available.
+  */
+void SensorFusion::onGyroscopeUpdate(Event)
+{
+    // Reading the sensors may itself lead to further updates.
+    if (updating)
+        return;
+
+    updating = true;
+
+    uint64_t now = system_timer_current_time_us();
+    uint32_t period = (uint32_t) (now - lastUpdate);
+
+    Sample3D rotation = gyroscope.getSample(NORTH_EAST_DOWN);
+    Sample3D acceleration = accelerometer.getSample(NORTH_EAST_DOWN);
+
+    if (compass)
+    {
+        Sample3D field = compass->getSample(NORTH_EAST_DOWN);
+        update(acceleration, rotation, &field, period);
+    }
+    else
+    {
+        update(acceleration, rotation, NULL, period);
+    }
+
+    lastUpdate = now;
+    updating = false;
+
+    Event(id, SENSOR_FUSION_EVT_DATA_UPDATE);
+}
+
+/**
+  * Sets the orientation estimate directly from the given readings, ignoring history.
+  * Both vectors must be normalised. The field may be NULL.
+  */
+void SensorFusion::initialiseOrientation(int32_t *a, int32_t *m)
+{
+    // Tilt: the shortest rotation taking the earth's vertical onto the measured direction of gravity.
+    int32_t t[4] = { SENSOR_FUSION_ONE + a[2], a[1], -a[0], 0 };
+
+    if (!normalise(t, 4))
+    {
+        // Upside down.
+        t[0] = 0;
+        t[1] = SENSOR_FUSION_ONE;
+    }
+
+    q.w = t[0];
+    q.x = t[1];
+    q.y = t[2];
+    q.z = t[3];
+
+    if (m == NULL)
+        return;
+
+    // Heading: rotate about the earth's vertical, until the horizontal component of the field points north.
+    int32_t q0q1 = fmul(q.w, q.x), q0q2 = fmul(q.w, q.y), q0q3 = fmul(q.w, q.z);
+    int32_t q1q1 = fmul(q.x, q.x), q1q2 = fmul(q.x, q.y), q1q3 = fmul(q.x, q.z);
+    int32_t q2q2 = fmul(q.y, q.y), q2q3 = fmul(q.y, q.z), q3q3 = fmul(q.z, q.z);
+
+    int32_t h[2];
+    h[0] = fmul(m[0], FIXED_HALF - q2q2 - q3q3) + fmul(m[1], q1q2 - q0q3) + fmul(m[2], q1q3 + q0q2);
+    h[1] = fmul(m[0], q1q2 + q0q3) + fmul(m[1], FIXED_HALF - q1q1 - q3q3) + fmul(m[2], q2q3 - q0q1);
+
+    if (!normalise(h, 2))
+        return;
+
+    int32_t r[2] = { SENSOR_FUSION_ONE + h[0], -h[1] };
+
+    if (!normalise(r, 2))
+    {
+        r[0] = 0;
+        r[1] = SENSOR_FUSION_ONE;
+    }
+
+    q.w = fmul(r[0], t[0]) - fmul(r[1], t[3]);
+    q.x = fmul(r[0], t[1]) - fmul(r[1], t[2]);
+    q.y = fmul(r[0], t[2]) + fmul(r[1], t[1]);
+    q.z = fmul(r[0], t[3]) + fmul(r[1], t[0]);
+}
+
+/**
+  * Advances the filter by one step, using the given readings. This is called automatically as the gyroscope is
+  * sampled, but may also be used to process recorded data.
+  *
+  * @param acceleration The acceleration of the device, in milli-g, in the NORTH_EAST_DOWN coordinate system.
+  * @param rotation The angular velocity of the device, in degrees per second, in the NORTH_EAST_DOWN coordinate system.
+  * @param field The magnetic field, in the NORTH_EAST_DOWN coordinate system. Any unit may be used. NULL if not available.
+  * @param period The time since the previous readings, in microseconds.
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int SensorFusion::update(const Sample3D &acceleration, const Sample3D &rotation, const Sample3D *field, uint32_t period)
+{
+    // The accelerometer measures the reaction to gravity, so reverse it to find which way is down.
+    int32_t a[3] = { -acceleration.x, -acceleration.y, -acceleration.z };
+    int32_t m[3];
+    bool accelerationValid = normalise(a, 3);
+    bool fieldValid = false;
+
+    if (field)
+    {
+        m[0] = field->x;
+        m[1] = field->y;
+        m[2] = field->z;
+        fieldValid = normalise(m, 3);
+    }
+
+    status &= ~SENSOR_FUSION_ANGLES_VALID;
+
+    if (!(status & SENSOR_FUSION_INITIALISED))
+    {
+        if (!accelerationValid)
+            return DEVICE_INVALID_PARAMETER;
+
+        initialiseOrientation(a, fieldValid ? m : NULL);
+        status |= SENSOR_FUSION_INITIALISED;
+        return DEVICE_OK;
+    }
+
+    if (period > SENSOR_FUSION_MAX_PERIOD)
+        period = SENSOR_FUSION_MAX_PERIOD;
+
+    int32_t q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+    int32_t q0q0 = fmul(q0, q0), q0q1 = fmul(q0, q1), q0q2 = fmul(q0, q2), q0q3 = fmul(q0, q3);
+    int32_t q1q1 = fmul(q1, q1), q1q2 = fmul(q1, q2), q1q3 = fmul(q1, q3);
+    int32_t q2q2 = fmul(q2, q2), q2q3 = fmul(q2, q3), q3q3 = fmul(q3, q3);
+
+    // Half of the error between the measured and estimated directions of gravity and magnetic north (as a rotation vector).
+    int32_t e[3] = { 0, 0, 0 };
+
+    if (accelerationValid)
+    {
+        int32_t vx = q1q3 - q0q2;
+        int32_t vy = q0q1 + q2q3;
+        int32_t vz = q0q0 - FIXED_HALF + q3q3;
+
+        e[0] = fmul(a[1], vz) - fmul(a[2], vy);
+        e[1] = fmul(a[2], vx) - fmul(a[0], vz);
+        e[2] = fmul(a[0], vy) - fmul(a[1], vx);
+    }
+
+    if (fieldValid)
+    {
+        // The field in the earth frame, and its reference direction (horizontal component pointing north).
+        int32_t hx = 2 * (fmul(m[0], FIXED_HALF - q2q2 - q3q3) + fmul(m[1], q1q2 - q0q3) + fmul(m[2], q1q3 + q0q2));
+        int32_t hy = 2 * (fmul(m[0], q1q2 + q0q3) + fmul(m[1], FIXED_HALF - q1q1 - q3q3) + fmul(m[2], q2q3 - q0q1));
+        int32_t bz = 2 * (fmul(m[0], q1q3 - q0q2) + fmul(m[1], q2q3 + q0q1) + fmul(m[2], FIXED_HALF - q1q1 - q2q2));
+        int32_t bx = isqrt((int64_t) hx * hx + (int64_t) hy * hy);
+
+        int32_t wx = fmul(bx, FIXED_HALF - q2q2 - q3q3) + fmul(bz, q1q3 - q0q2);
+        int32_t wy = fmul(bx, q1q2 - q0q3) + fmul(bz, q0q1 + q2q3);
+        int32_t wz = fmul(bx, q0q2 + q1q3) + fmul(bz, FIXED_HALF - q1q1 - q2q2);
+
+        e[0] += fmul(m[1], wz) - fmul(m[2], wy);
+        e[1] += fmul(m[2], wx) - fmul(m[0], wz);
+        e[2] += fmul(m[0], wy) - fmul(m[1], wx);
+    }
+
+    int32_t r[3] = { rotation.x, rotation.y, rotation.z };
+    int32_t g[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (ki)
+            integral[i] += (int32_t) (2 * (int64_t) fmul(ki, e[i]) * period / 1000000);
+
+        // Angular rate in Q4.28 radians per second, corrected by the feedback terms.
+        int64_t rate = (int64_t) r[i] * DPS_TO_RAD + integral[i] + 2 * (int64_t) fmul(kp, e[i]);
+
+        // Half of the rotation during this period.
+        g[i] = (int32_t) (rate * period / 2000000);
+    }
+
+    // Integrate the rate of change of the quaternion.
+    q.w += -fmul(q1, g[0]) - fmul(q2, g[1]) - fmul(q3, g[2]);
+    q.x += fmul(q0, g[0]) + fmul(q2, g[2]) - fmul(q3, g[1]);
+    q.y += fmul(q0, g[1]) - fmul(q1, g[2]) + fmul(q3, g[0]);
+    q.z += fmul(q0, g[2]) + fmul(q1, g[1]) - fmul(q2, g[0]);
+
+    normalise(q);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Recalculates the heading, pitch and roll of the current orientation estimate.
+  */
+void SensorFusion::recalculateAngles()
+{
+    int32_t cosPitch;
+
+    roll = cordicAtan2(2 * (fmul(q.w, q.x) + fmul(q.y, q.z)), SENSOR_FUSION_ONE - 2 * (fmul(q.x, q.x) + fmul(q.y, q.y)), &cosPitch);
+    pitch = cordicAtan2(2 * (fmul(q.w, q.y) - fmul(q.x, q.z)), cosPitch, NULL);
+    heading = cordicAtan2(2 * (fmul(q.x, q.y) + fmul(q.w, q.z)), SENSOR_FUSION_ONE - 2 * (fmul(q.y, q.y) + fmul(q.z, q.z)), NULL);
+
+    if (heading < 0)
+        heading += 360 << 16;
+
+    status |= SENSOR_FUSION_ANGLES_VALID;
+}
+
+/**
+  * Provides the current orientation estimate.
+  *
+  * @return The rotation from the earth (NORTH_EAST_DOWN) frame to the frame of the device, in Q4.28 format.
+  */
+FusionQuaternion SensorFusion::getQuaternion()
+{
+    return q;
+}
+
+/**
+  * Provides the tilt compensated heading of the device.
+  *
+  * @return The heading, in degrees clockwise from magnetic north (0..359).
+  */
+int SensorFusion::getHeading()
+{
+    if (!(status & SENSOR_FUSION_ANGLES_VALID))
+        recalculateAngles();
+
+    return ((heading + 0x8000) >> 16) % 360;
+}
+
+/**
+  * Provides the pitch of the device.
+  *
+  * @return The pitch, in degrees (-90..90). Positive when the nose (the x axis) points upwards.
+  */
+int SensorFusion::getPitch()
+{
+    if (!(status & SENSOR_FUSION_ANGLES_VALID))
+        recalculateAngles();
+
+    return (pitch + 0x8000) >> 16;
+}
+
+/**
+  * Provides the roll of the device.
+  *
+  * @return The roll, in degrees (-180..180). Positive when the right side (the y axis) points downwards.
+  */
+int SensorFusion::getRoll()
+{
+    if (!(status & SENSOR_FUSION_ANGLES_VALID))
+        recalculateAngles();
+
+    return (roll + 0x8000) >> 16;
+}
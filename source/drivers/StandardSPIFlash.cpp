@@ -23,6 +23,8 @@ DEALINGS IN THE SOFTWARE.
 */
 
 #include "StandardSPIFlash.h"
+#include "CodalFiber.h"
+#include "codal_target_hal.h"
 
 using namespace codal;
 
@@ -34,6 +36,9 @@ using namespace codal;
 StandardSPIFlash::StandardSPIFlash(SPI &spi, Pin &ssel, int numPages)
     : _numPages(numPages), spi(spi), ssel(ssel)
 {
+    flags = 0;
+    readHandler = NULL;
+    readHandlerArg = NULL;
     ssel.setDigitalValue(1);
 }
 
@@ -43,6 +48,7 @@ void StandardSPIFlash::setCommand(uint8_t command, int addr)
     cmdBuf[1] = addr >> 16;
     cmdBuf[2] = addr >> 8;
     cmdBuf[3] = addr >> 0;
+    cmdBuf[4] = 0; // dummy byte for fast read
 }
 
 int StandardSPIFlash::sendCommand(uint8_t command, int addr, void *resp, int respSize)
@@ -50,7 +56,7 @@ int StandardSPIFlash::sendCommand(uint8_t command, int addr, void *resp, int res
     setCommand(command, addr);
 
     ssel.setDigitalValue(0);
-    int r = spi.transfer(cmdBuf, addr == -1 ? 1 : 4, NULL, 0);
+    int r = spi.transfer(cmdBuf, addr == -1 ? 1 : command == 0x0B ? 5 : 4, NULL, 0);
     if (r == DEVICE_OK)
         r = spi.transfer(NULL, 0, (uint8_t *)resp, respSize);
     ssel.setDigitalValue(1);
@@ -65,16 +71,86 @@ void StandardSPIFlash::writeEnable()
 
 int StandardSPIFlash::waitBusy(int waitMS)
 {
-    do
+    if (waitMS == 0)
     {
+        // the status register is clocked out repeatedly for as long as the chip is selected,
+        // so short operations are polled without reissuing the command
+        setCommand(0x05, -1);
+
+        ssel.setDigitalValue(0);
+        int r = spi.transfer(cmdBuf, 1, NULL, 0);
+        while (r >= 0)
+        {
+            r = spi.write(0);
+            status = r;
+            if (r >= 0 && !(status & 0x01))
+                break;
+        }
+        ssel.setDigitalValue(1);
+
+        return r < 0 ? DEVICE_SPI_ERROR : DEVICE_OK;
+    }
+
+    // release the bus between polls, so that reads can suspend the operation
+    for (;;)
+    {
+        fiber_sleep(waitMS);
+
+        if (flags & STANDARD_SPIFLASH_SUSPENDED)
+            continue;
+
         int r = sendCommand(0x05, -1, &status, 1);
         if (r < 0)
             return r;
-        if (waitMS)
-            fiber_sleep(waitMS);
-    } while (status & 0x01);
+        if (!(status & 0x01))
+            return DEVICE_OK;
+    }
+}
+
+void StandardSPIFlash::waitIdle(bool forRead)
+{
+    for (;;)
+    {
+        uint8_t f = flags;
+
+        if (f & (STANDARD_SPIFLASH_READING | STANDARD_SPIFLASH_SUSPENDED))
+            schedule();
+        else if ((f & STANDARD_SPIFLASH_ERASING) &&
+                 !(forRead && (f & STANDARD_SPIFLASH_SUSPEND_ENABLED)))
+            fiber_sleep(STANDARD_SPIFLASH_ERASE_POLL_MS);
+        else
+            return;
+    }
+}
+
+int StandardSPIFlash::suspendErase()
+{
+    if (flags & STANDARD_SPIFLASH_RESUMED)
+        target_wait_us(STANDARD_SPIFLASH_RESUME_US);
+
+    flags |= STANDARD_SPIFLASH_SUSPENDED;
 
-    return DEVICE_OK;
+    int r = sendCommand(0x75);
+    if (r < 0)
+        return r;
+
+    // typically 20-30us
+    return waitBusy(0);
+}
+
+int StandardSPIFlash::resumeErase()
+{
+    int r = sendCommand(0x7A);
+    flags = (flags & ~STANDARD_SPIFLASH_SUSPENDED) | STANDARD_SPIFLASH_RESUMED;
+    return r;
+}
+
+void StandardSPIFlash::setEraseSuspend(bool enable)
+{
+    if (enable)
+        flags |= STANDARD_SPIFLASH_SUSPEND_ENABLED;
+    else
+        flags &= ~STANDARD_SPIFLASH_SUSPEND_ENABLED;
 }
 
 int StandardSPIFlash::numPages()
@@ -86,7 +162,64 @@ int StandardSPIFlash::readBytes(uint32_t addr, void *buffer, uint32_t len)
 {
     check(addr + len <= _numPages * SPIFLASH_PAGE_SIZE);
     check(addr <= _numPages * SPIFLASH_PAGE_SIZE);
-    return sendCommand(0x03, addr, buffer, len);
+
+    waitIdle(true);
+
+    // only still set if the erase can be suspended
+    bool suspend = flags & STANDARD_SPIFLASH_ERASING;
+    int r = DEVICE_OK;
+
+    if (suspend)
+        r = suspendErase();
+
+    if (r == DEVICE_OK)
+        r = sendCommand(0x0B, addr, buffer, len);
+
+    if (suspend)
+    {
+        int rr = resumeErase();
+        if (r == DEVICE_OK)
+            r = rr;
+    }
+
+    return r;
+}
+
+void StandardSPIFlash::readDone(void *p)
+{
+    StandardSPIFlash *flash = (StandardSPIFlash *)p;
+
+    flash->ssel.setDigitalValue(1);
+    flash->flags &= ~STANDARD_SPIFLASH_READING;
+
+    if (flash->readHandler)
+        flash->readHandler(flash->readHandlerArg);
+}
+
+int StandardSPIFlash::readBytesAsync(uint32_t addr, void *buffer, uint32_t len,
+                                     PVoidCallback doneHandler, void *arg)
+{
+    check(addr + len <= _numPages * SPIFLASH_PAGE_SIZE);
+    check(addr <= _numPages * SPIFLASH_PAGE_SIZE);
+
+    waitIdle(false);
+
+    flags |= STANDARD_SPIFLASH_READING;
+    readHandler = doneHandler;
+    readHandlerArg = arg;
+
+    setCommand(0x0B, addr);
+
+    ssel.setDigitalValue(0);
+    if (spi.transfer(cmdBuf, 5, NULL, 0) < 0)
+    {
+        ssel.setDigitalValue(1);
+        flags &= ~STANDARD_SPIFLASH_READING;
+        return DEVICE_SPI_ERROR;
+    }
+
+    // the chip is deselected by readDone()
+    return spi.startTransfer(NULL, 0, (uint8_t *)buffer, len, &StandardSPIFlash::readDone, this);
 }
 
 int StandardSPIFlash::writeBytes(uint32_t addr, const void *buffer, uint32_t len)
@@ -95,34 +228,37 @@ int StandardSPIFlash::writeBytes(uint32_t addr, const void *buffer, uint32_t len
     check(addr / SPIFLASH_PAGE_SIZE == (addr + len - 1) / SPIFLASH_PAGE_SIZE);
     check(addr + len <= _numPages * SPIFLASH_PAGE_SIZE);
 
+    waitIdle(false);
     writeEnable();
 
     setCommand(0x02, addr);
 
     ssel.setDigitalValue(0);
-    for (uint32_t i = 0; i < 4; ++i)
-        if (spi.write(cmdBuf[i]) < 0)
-            goto fail;
-    for (uint32_t i = 0; i < len; ++i)
-        if (spi.write(((const uint8_t *)buffer)[i]) < 0)
-            goto fail;
+    int r = spi.transfer(cmdBuf, 4, NULL, 0);
+    if (r == DEVICE_OK)
+        r = spi.transfer((const uint8_t *)buffer, len, NULL, 0);
     ssel.setDigitalValue(1);
 
+    if (r < 0)
+        return DEVICE_SPI_ERROR;
+
     // the typical write time is under 1ms, so we don't bother with fiber_sleep()
     return waitBusy(0);
-
-fail:
-    ssel.setDigitalValue(1);
-    return DEVICE_SPI_ERROR;
 }
 
 int StandardSPIFlash::eraseCore(uint8_t cmd, uint32_t addr)
 {
+    waitIdle(false);
     writeEnable();
     int r = sendCommand(cmd, addr);
     if (r < 0)
         return r;
-    return waitBusy(10);
+
+    flags = (flags & ~STANDARD_SPIFLASH_RESUMED) | STANDARD_SPIFLASH_ERASING;
+    r = waitBusy(STANDARD_SPIFLASH_ERASE_POLL_MS);
+    flags &= ~STANDARD_SPIFLASH_ERASING;
+
+    return r;
 }
 
 int StandardSPIFlash::eraseSmallRow(uint32_t addr)
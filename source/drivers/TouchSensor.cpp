@@ -30,6 +30,27 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+// The sensor currently performing an asynchronous sample, if any.
+// Pin change interrupts carry no context, so only one sensor samples at a time, and any others that become due are queued.
+static TouchSensor *sampling = NULL;
+static TouchSensor *sampleQueue = NULL;
+
+/**
+ * Pin change handlers for each button slot. Pin interrupts carry no context, so each slot has its own handler.
+ */
+template <int N>
+static void onTouchEdge(int state)
+{
+    if (state && sampling)
+        sampling->onChargeComplete(N);
+}
+
+static void (*const touchEdgeHandlers[])(int) = {
+    onTouchEdge<0>, onTouchEdge<1>, onTouchEdge<2>, onTouchEdge<3>, onTouchEdge<4>,
+    onTouchEdge<5>, onTouchEdge<6>, onTouchEdge<7>, onTouchEdge<8>, onTouchEdge<9>
+};
+
+static_assert(sizeof(touchEdgeHandlers) / sizeof(touchEdgeHandlers[0]) >= TOUCH_SENSOR_MAX_BUTTONS, "a pin change handler is required for each button");
 
 /**
  * Default Constructor.
@@ -43,6 +64,10 @@ TouchSensor::TouchSensor(uint16_t id) : drivePin(*(Pin*)NULL)
 {
     this->id = id;
     this->numberOfButtons = 0;
+    this->pending = 0;
+    this->cpuTime = 0;
+    this->sampleCpuTime = 0;
+    this->nextQueued = NULL;
 }
 
 /**
@@ -57,6 +82,11 @@ TouchSensor::TouchSensor(Pin &pin, uint16_t id) : drivePin(pin)
 {
     this->id = id;
     this->numberOfButtons = 0;
+    this->pending = 0;
+    this->cpuTime = 0;
+    this->sampleCpuTime = 0;
+    this->nextQueued = NULL;
+    this->status |= TOUCH_SENSOR_STATUS_DRIVE_PIN;
 
     // Initialise output drive low (to drain any residual charge before sampling begins).
     drivePin.setDigitalValue(0);
@@ -67,7 +97,11 @@ TouchSensor::TouchSensor(Pin &pin, uint16_t id) : drivePin(pin)
 
     // Configure a periodic callback event.
     if(EventModel::defaultEventBus)
+    {
         EventModel::defaultEventBus->listen(id, TOUCH_SENSOR_UPDATE_NEEDED, this, &TouchSensor::onSampleEvent, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(id, TOUCH_SENSOR_SAMPLE_DRAINED, this, &TouchSensor::onDrained, MESSAGE_BUS_LISTENER_IMMEDIATE);
+        EventModel::defaultEventBus->listen(id, TOUCH_SENSOR_SAMPLE_TIMEOUT, this, &TouchSensor::onTimeout, MESSAGE_BUS_LISTENER_IMMEDIATE);
+    }
 
     // Generate an event every TOUCH_SENSOR_SAMPLE_PERIOD milliseconds.
     system_timer_event_every_us(TOUCH_SENSOR_SAMPLE_PERIOD * 1000, id, TOUCH_SENSOR_UPDATE_NEEDED);
@@ -102,13 +136,21 @@ int TouchSensor::addTouchButton(TouchButton *button)
  */
 int TouchSensor::removeTouchButton(TouchButton *button)
 {
+    // Button indices change below, so end any sample in progress.
+    target_disable_irq();
+
+    if (sampling == this)
+        completeSample();
+
+    target_enable_irq();
+
     // First, find the button, if we have it.
     for (int i=0; i<numberOfButtons; i++)
     {
         if (buttons[i] == button)
         {
             // replace this entry with the last in the list, to ensure the list remains contiguous.
-            buttons[i] = buttons[numberOfButtons];
+            buttons[i] = buttons[numberOfButtons - 1];
             numberOfButtons--;
 
             return DEVICE_OK;
@@ -125,6 +167,41 @@ void TouchSensor::onSampleEvent(Event)
 {
     int cycles = 0;
     int activeSensors = 0;
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    if (status & TOUCH_SENSOR_STATUS_ASYNCHRONOUS)
+    {
+        if (numberOfButtons == 0)
+            return;
+
+        bool begin = false;
+
+        target_disable_irq();
+
+        // Only one asynchronous sample may be in progress at a time. If another sensor is sampling, wait our turn.
+        if (sampling == NULL)
+        {
+            sampling = this;
+            begin = true;
+        }
+        else if (sampling != this && !(status & TOUCH_SENSOR_STATUS_QUEUED))
+        {
+            TouchSensor **p = &sampleQueue;
+            while (*p)
+                p = &(*p)->nextQueued;
+
+            *p = this;
+            nextQueued = NULL;
+            status |= TOUCH_SENSOR_STATUS_QUEUED;
+        }
+
+        target_enable_irq();
+
+        if (begin)
+            beginSample();
+
+        return;
+    }
 
     // Drain any residual charge on the receiver pins.
     // TODO: Move this to a platform specific library function (DevicePin).
@@ -165,6 +242,207 @@ void TouchSensor::onSampleEvent(Event)
     }
 
     drivePin.setDigitalValue(0);
+
+    sampleCpuTime = system_timer_current_time_us() - start;
+}
+
+/**
+ * Starts an asynchronous sample by draining any residual charge on the receiver pins.
+ * The sample continues in onDrained(), once they have had time to settle.
+ */
+void TouchSensor::beginSample()
+{
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    pending = numberOfButtons;
+
+    for (int i=0; i<numberOfButtons; i++)
+    {
+        buttons[i]->_pin.drainPin();
+        buttons[i]->active = true;
+    }
+
+    system_timer_event_after_us(TOUCH_SENSOR_DRAIN_TIME_US, id, TOUCH_SENSOR_SAMPLE_DRAINED);
+
+    cpuTime = system_timer_current_time_us() - start;
+}
+
+/**
+ * Removes this sensor from the queue of those waiting to sample, if it is there.
+ */
+void TouchSensor::dequeueSample()
+{
+    for (TouchSensor **p = &sampleQueue; *p; p = &(*p)->nextQueued)
+    {
+        if (*p == this)
+        {
+            *p = nextQueued;
+            break;
+        }
+    }
+
+    nextQueued = NULL;
+    status &= ~TOUCH_SENSOR_STATUS_QUEUED;
+}
+
+/**
+ * Raises the drive pin, once the receiver pins have drained, and starts timing their charge.
+ */
+void TouchSensor::onDrained(Event)
+{
+    if (sampling != this)
+        return;
+
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
+    for (int i=0; i<numberOfButtons; i++)
+    {
+        buttons[i]->_pin.setIRQ(touchEdgeHandlers[i]);
+
+        // Fall back to synchronous sampling if the pins cannot interrupt on change.
+        if (buttons[i]->_pin.eventOn(DEVICE_PIN_INTERRUPT_ON_EDGE) != DEVICE_OK)
+        {
+            status &= ~TOUCH_SENSOR_STATUS_ASYNCHRONOUS;
+            completeSample();
+            return;
+        }
+    }
+
+    system_timer_event_after_us(TOUCH_SENSOR_ASYNC_TIMEOUT_US, id, TOUCH_SENSOR_SAMPLE_TIMEOUT);
+
+    sampleStart = system_timer_current_time_us();
+    drivePin.setDigitalValue(1);
+
+    cpuTime += sampleStart - start;
+}
+
+/**
+ * Records that the receiver pin of the given button has charged.
+ * Called from interrupt context during asynchronous sampling.
+ *
+ * @param index The index of the button.
+ */
+void TouchSensor::onChargeComplete(int index)
+{
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+
+    if (index >= numberOfButtons || !buttons[index]->active)
+        return;
+
+    buttons[index]->active = false;
+    buttons[index]->setValue(now - sampleStart);
+
+    cpuTime += system_timer_current_time_us() - now;
+
+    if (--pending == 0)
+        completeSample();
+}
+
+/**
+ * Completes an asynchronous sample, giving the maximum reading to any button that has not yet charged.
+ */
+void TouchSensor::onTimeout(Event)
+{
+    if (sampling != this)
+        return;
+
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+    int elapsed = now - sampleStart;
+
+    target_disable_irq();
+
+    for (int i=0; i<numberOfButtons; i++)
+    {
+        if (buttons[i]->active)
+        {
+            buttons[i]->active = false;
+            buttons[i]->setValue(max(elapsed, buttons[i]->threshold));
+        }
+    }
+
+    cpuTime += system_timer_current_time_us() - now;
+    completeSample();
+
+    target_enable_irq();
+}
+
+/**
+ * Ends an asynchronous sample, releases the receiver pins, and starts the next queued sensor, if any.
+ */
+void TouchSensor::completeSample()
+{
+    drivePin.setDigitalValue(0);
+
+    for (int i=0; i<numberOfButtons; i++)
+    {
+        buttons[i]->active = false;
+        buttons[i]->_pin.eventOn(DEVICE_PIN_EVENT_NONE);
+        buttons[i]->_pin.setIRQ(NULL);
+    }
+
+    pending = 0;
+    sampleCpuTime = cpuTime;
+    sampling = NULL;
+
+    // Hand over to the next sensor that became due while we were sampling.
+    TouchSensor *next = sampleQueue;
+
+    if (next)
+    {
+        next->dequeueSample();
+
+        if (next->numberOfButtons > 0 && (next->status & TOUCH_SENSOR_STATUS_ASYNCHRONOUS))
+        {
+            sampling = next;
+            next->beginSample();
+        }
+    }
+}
+
+/**
+ * Selects how the sensors are sampled.
+ *
+ * In synchronous mode (the default), each sample drains the receiver pins and then polls them until they charge,
+ * blocking the caller for the duration. Readings are measured in loop iterations.
+ *
+ * In asynchronous mode, the drain and charge phases are timed by the system timer, and the charge time of every
+ * pin is captured in a single pass by pin change interrupts. The CPU is only used briefly at each edge.
+ * Readings are measured in microseconds, so TouchButtons should be calibrated (rather than given fixed thresholds)
+ * after changing mode. The pins used must support DEVICE_PIN_INTERRUPT_ON_EDGE.
+ *
+ * @param enable true to select asynchronous sampling, false for synchronous sampling.
+ * @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if this sensor has no drive pin.
+ */
+int TouchSensor::setAsynchronous(bool enable)
+{
+    if (!(status & TOUCH_SENSOR_STATUS_DRIVE_PIN))
+        return DEVICE_NOT_SUPPORTED;
+
+    target_disable_irq();
+
+    if (sampling == this)
+        completeSample();
+
+    dequeueSample();
+
+    if (enable)
+        status |= TOUCH_SENSOR_STATUS_ASYNCHRONOUS;
+    else
+        status &= ~TOUCH_SENSOR_STATUS_ASYNCHRONOUS;
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the CPU time consumed by the most recent sample.
+ *
+ * @return The time spent, in microseconds.
+ */
+uint32_t TouchSensor::getSampleCpuTime()
+{
+    return sampleCpuTime;
 }
 
 /**
@@ -172,6 +450,19 @@ void TouchSensor::onSampleEvent(Event)
  */
 TouchSensor::~TouchSensor()
 {
+    target_disable_irq();
+
+    if (sampling == this)
+        completeSample();
+
+    dequeueSample();
+
+    target_enable_irq();
+
     if(EventModel::defaultEventBus)
+    {
         EventModel::defaultEventBus->ignore(id, TOUCH_SENSOR_UPDATE_NEEDED, this, &TouchSensor::onSampleEvent);
+        EventModel::defaultEventBus->ignore(id, TOUCH_SENSOR_SAMPLE_DRAINED, this, &TouchSensor::onDrained);
+        EventModel::defaultEventBus->ignore(id, TOUCH_SENSOR_SAMPLE_TIMEOUT, this, &TouchSensor::onTimeout);
+    }
 }
@@ -0,0 +1,353 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "UF2Writer.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+#define NO_PAGE 0xffffffff
+
+static const uint32_t crcTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t UF2Writer::crc32(const void *data, uint32_t len, uint32_t crc)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ crcTable[crc & 0xf];
+        crc = (crc >> 4) ^ crcTable[crc & 0xf];
+    }
+
+    return ~crc;
+}
+
+UF2Writer::UF2Writer(NVMController &nvm, uint32_t start, uint32_t size)
+{
+    this->nvm = &nvm;
+    this->flash = NULL;
+    init(start, size, nvm.getPageSize());
+}
+
+UF2Writer::UF2Writer(SPIFlash &flash, uint32_t start, uint32_t size)
+{
+    this->nvm = NULL;
+    this->flash = &flash;
+    init(start, size, SPIFLASH_SMALL_ROW_SIZE);
+}
+
+void UF2Writer::init(uint32_t start, uint32_t size, uint32_t pageSize)
+{
+    this->start = start;
+    this->end = start + size;
+    this->pageSize = pageSize;
+    this->page = NULL;
+    this->received = NULL;
+    this->partial = NULL;
+
+    memclr(&stats, sizeof(stats));
+    reset();
+}
+
+UF2Writer::~UF2Writer()
+{
+    delete[] page;
+    delete[] received;
+    delete[] partial;
+}
+
+void UF2Writer::reset()
+{
+    delete[] received;
+    received = NULL;
+    numBlocks = 0;
+    blocksReceived = 0;
+    partialLength = 0;
+    pageAddr = NO_PAGE;
+    dirty = 0;
+    needsErase = false;
+}
+
+int UF2Writer::readFlash(uint32_t addr, void *dest, uint32_t len)
+{
+    if (flash)
+        return flash->readBytes(addr, dest, len);
+
+    return nvm->read((uint32_t *)dest, addr, (len + 3) / 4);
+}
+
+uint32_t UF2Writer::computeCRC(uint32_t addr, uint32_t len)
+{
+    uint32_t buf[16];
+    uint32_t crc = 0;
+
+    while (len)
+    {
+        uint32_t n = min(len, sizeof(buf));
+        readFlash(addr, buf, n);
+        crc = crc32(buf, n, crc);
+        addr += n;
+        len -= n;
+    }
+
+    return crc;
+}
+
+/**
+ * Checks part of the buffered page against the flash, after it has been programmed.
+ */
+int UF2Writer::verify(uint32_t offset, uint32_t len)
+{
+    if (computeCRC(pageAddr + offset, len) != crc32((uint8_t *)page + offset, len))
+    {
+        stats.verifyErrors++;
+        return DEVICE_INVALID_STATE;
+    }
+
+    return DEVICE_OK;
+}
+
+int UF2Writer::program(uint32_t offset, uint32_t len)
+{
+    uint8_t *data = (uint8_t *)page + offset;
+    int r;
+
+    if (flash)
+        r = flash->writeBuffer(pageAddr + offset, data, len);
+    else
+        r = nvm->write(pageAddr + offset, (uint32_t *)data, len / 4);
+
+    stats.programs++;
+
+    if (r < 0)
+        return r;
+
+    return verify(offset, len);
+}
+
+int UF2Writer::flush()
+{
+    if (pageAddr == NO_PAGE || dirty == 0)
+        return DEVICE_OK;
+
+    uint32_t granule = max(pageSize / UF2_WRITER_GRANULES, 4);
+    uint32_t granules = pageSize / granule;
+    int r = DEVICE_OK;
+
+    if (!needsErase)
+    {
+        // only bits being cleared; program each run of changed granules in one go
+        for (uint32_t i = 0; i < granules && r == DEVICE_OK;)
+        {
+            if (!(dirty & (1UL << i)))
+            {
+                i++;
+                continue;
+            }
+
+            uint32_t j = i;
+            while (j < granules && (dirty & (1UL << j)))
+                j++;
+
+            r = program(i * granule, (j - i) * granule);
+            i = j;
+        }
+
+        // the flash did not hold what was expected; start again from an erased page
+        if (r == DEVICE_INVALID_STATE)
+            needsErase = true;
+    }
+
+    for (int attempt = 0; needsErase && attempt < 2; attempt++)
+    {
+        r = flash ? flash->eraseSmallRow(pageAddr) : nvm->erase(pageAddr);
+        stats.erases++;
+
+        if (r >= 0)
+            r = program(0, pageSize);
+
+        if (r != DEVICE_INVALID_STATE)
+            break;
+    }
+
+    dirty = 0;
+    needsErase = false;
+
+    return r < 0 ? r : DEVICE_OK;
+}
+
+/**
+ * Writes back the page being gathered, and reads in the page holding the given address.
+ */
+int UF2Writer::loadPage(uint32_t addr)
+{
+    int r = flush();
+    if (r != DEVICE_OK)
+        return r;
+
+    if (page == NULL)
+    {
+        page = new uint32_t[pageSize / 4];
+        if (page == NULL)
+            return DEVICE_NO_RESOURCES;
+    }
+
+    pageAddr = NO_PAGE;
+
+    r = readFlash(addr, page, pageSize);
+    if (r < 0)
+        return r;
+
+    pageAddr = addr;
+    return DEVICE_OK;
+}
+
+int UF2Writer::writeBlock(const void *block)
+{
+    const UF2_Block *b = (const UF2_Block *)block;
+
+    if (!is_uf2_block((void *)block) || b->payloadSize > sizeof(b->data) || b->numBlocks == 0 ||
+        b->numBlocks > UF2_WRITER_MAX_BLOCKS || b->blockNo >= b->numBlocks)
+        return DEVICE_INVALID_PARAMETER;
+
+    bool noFlash = b->flags & UF2_FLAG_NOFLASH;
+
+    // written so that a targetAddr near the top of the address space can't wrap around
+    if (!noFlash && (b->targetAddr < start || b->targetAddr > end ||
+                     b->payloadSize > end - b->targetAddr))
+        return DEVICE_INVALID_PARAMETER;
+
+    // a different block count means a different file
+    if (b->numBlocks != numBlocks)
+    {
+        delete[] received;
+        numBlocks = 0;
+        blocksReceived = 0;
+
+        received = new uint8_t[(b->numBlocks + 7) / 8];
+        if (received == NULL)
+            return DEVICE_NO_RESOURCES;
+
+        memclr(received, (b->numBlocks + 7) / 8);
+        numBlocks = b->numBlocks;
+    }
+
+    if (!noFlash)
+    {
+        uint32_t addr = b->targetAddr;
+        const uint8_t *src = b->data;
+        uint32_t remaining = b->payloadSize;
+        uint32_t granule = max(pageSize / UF2_WRITER_GRANULES, 4);
+
+        while (remaining)
+        {
+            uint32_t base = addr - addr % pageSize;
+
+            if (base != pageAddr)
+            {
+                int r = loadPage(base);
+                if (r != DEVICE_OK)
+                    return r;
+            }
+
+            uint32_t offset = addr - base;
+            uint32_t n = min(remaining, pageSize - offset);
+            uint8_t *p = (uint8_t *)page + offset;
+
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (p[i] != src[i])
+                {
+                    // programming can only clear bits
+                    if ((p[i] & src[i]) != src[i])
+                        needsErase = true;
+
+                    p[i] = src[i];
+                    dirty |= 1UL << ((offset + i) / granule);
+                }
+            }
+
+            addr += n;
+            src += n;
+            remaining -= n;
+        }
+    }
+
+    uint8_t mask = 1 << (b->blockNo & 7);
+
+    if (received[b->blockNo >> 3] & mask)
+    {
+        stats.duplicates++;
+    }
+    else
+    {
+        received[b->blockNo >> 3] |= mask;
+        blocksReceived++;
+    }
+
+    stats.blocks++;
+    return DEVICE_OK;
+}
+
+int UF2Writer::write(const void *data, int len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    int result = DEVICE_OK;
+
+    if (partial == NULL)
+    {
+        partial = new uint8_t[UF2_BLOCK_SIZE];
+        if (partial == NULL)
+            return DEVICE_NO_RESOURCES;
+    }
+
+    while (len > 0)
+    {
+        int n = min(len, UF2_BLOCK_SIZE - partialLength);
+
+        memcpy(partial + partialLength, p, n);
+        partialLength += n;
+        p += n;
+        len -= n;
+
+        if (partialLength == UF2_BLOCK_SIZE)
+        {
+            partialLength = 0;
+
+            int r = writeBlock(partial);
+            if (r != DEVICE_OK && result == DEVICE_OK)
+                result = r;
+        }
+    }
+
+    return result;
+}
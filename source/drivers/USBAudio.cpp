@@ -0,0 +1,676 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "USBAudio.h"
+#include "CodalFiber.h"
+#include "CodalDmesg.h"
+#include "EventModel.h"
+#include "ErrorNo.h"
+
+#if CONFIG_ENABLED(DEVICE_USB)
+
+using namespace codal;
+
+#define AUDIO_CLASS 0x01
+#define AUDIO_SUBCLASS_CONTROL 0x01
+#define AUDIO_SUBCLASS_STREAMING 0x02
+
+#define AUDIO_CS_INTERFACE 0x24
+#define AUDIO_CS_ENDPOINT 0x25
+#define AUDIO_AC_HEADER 0x01
+#define AUDIO_AC_INPUT_TERMINAL 0x02
+#define AUDIO_AC_OUTPUT_TERMINAL 0x03
+#define AUDIO_AS_GENERAL 0x01
+#define AUDIO_AS_FORMAT_TYPE 0x02
+#define AUDIO_EP_GENERAL 0x01
+
+#define AUDIO_REQ_SET_CUR 0x01
+#define AUDIO_REQ_GET_CUR 0x81
+#define AUDIO_SAMPLING_FREQ_CONTROL 0x01
+
+// terminals of the audio function: USB -> speaker, microphone -> USB
+#define AUDIO_TERMINAL_PLAY_IN 1
+#define AUDIO_TERMINAL_PLAY_OUT 2
+#define AUDIO_TERMINAL_RECORD_IN 3
+#define AUDIO_TERMINAL_RECORD_OUT 4
+#define AUDIO_AC_TOTAL_LENGTH (10 + 2 * (12 + 9))
+
+// offsets from interfaceIdx
+#define AUDIO_INTERFACE_PLAY 1
+#define AUDIO_INTERFACE_RECORD 2
+
+#define AUDIO_EP_ISO_ASYNC 0x05
+#define AUDIO_EP_ISO_FEEDBACK 0x11
+
+#define BUFFER_MASK (USB_AUDIO_BUFFER_SAMPLES - 1)
+#define BUFFER_TARGET (USB_AUDIO_BUFFER_SAMPLES / 2)
+
+static const InterfaceInfo ifaceInfo = {
+    NULL, // descriptors are built by fillDescriptors()
+    0,
+    2,
+    {
+        2,    // numEndpoints
+        AUDIO_CLASS,
+        AUDIO_SUBCLASS_CONTROL,
+        0x00, // protocol
+        0x00, //
+        0x00, //
+    },
+    {USB_EP_TYPE_ISOCHRONOUS, 1},
+    {USB_EP_TYPE_ISOCHRONOUS, 1},
+};
+
+static void ring_write(USBAudioRing &r, const int16_t *samples, int count)
+{
+    int tail = (r.head + r.count) & BUFFER_MASK;
+    int first = min(count, USB_AUDIO_BUFFER_SAMPLES - tail);
+
+    memcpy(r.data + tail, samples, first * sizeof(int16_t));
+    memcpy(r.data, samples + first, (count - first) * sizeof(int16_t));
+    r.count += count;
+}
+
+static void ring_read(USBAudioRing &r, int16_t *samples, int count)
+{
+    int first = min(count, USB_AUDIO_BUFFER_SAMPLES - r.head);
+
+    memcpy(samples, r.data + r.head, first * sizeof(int16_t));
+    memcpy(samples + first, r.data, (count - first) * sizeof(int16_t));
+    r.head = (r.head + count) & BUFFER_MASK;
+    r.count -= count;
+}
+
+static void ring_reset(USBAudioRing &r)
+{
+    r.head = 0;
+    r.count = 0;
+    r.average = BUFFER_TARGET << 4;
+}
+
+// called once per frame, to track the level of a buffer
+static void ring_update(USBAudioRing &r, USBAudioBufferStats &s)
+{
+    r.average += (((int32_t)r.count << 4) - r.average) >> 5;
+
+    s.level = r.count;
+    if (r.count < s.minLevel)
+        s.minLevel = r.count;
+    if (r.count > s.maxLevel)
+        s.maxLevel = r.count;
+}
+
+static int16_t to_sample(const uint8_t *p, int format)
+{
+    switch (format)
+    {
+    case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+        return (*p - 128) << 8;
+    case DATASTREAM_FORMAT_8BIT_SIGNED:
+        return *(const int8_t *)p << 8;
+    case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+        return (p[0] | (p[1] << 8)) ^ 0x8000;
+    case DATASTREAM_FORMAT_16BIT_SIGNED:
+        return p[0] | (p[1] << 8);
+    case DATASTREAM_FORMAT_24BIT_UNSIGNED:
+        return (p[1] | (p[2] << 8)) ^ 0x8000;
+    case DATASTREAM_FORMAT_24BIT_SIGNED:
+        return p[1] | (p[2] << 8);
+    case DATASTREAM_FORMAT_32BIT_UNSIGNED:
+        return (p[2] | (p[3] << 8)) ^ 0x8000;
+    default:
+        return p[2] | (p[3] << 8);
+    }
+}
+
+USBAudio::USBAudio(int sampleRate, uint16_t id) : CodalUSBInterface(), CodalComponent(id, 0)
+{
+    upstream = NULL;
+    init(sampleRate);
+}
+
+USBAudio::USBAudio(DataSource &source, int sampleRate, uint16_t id)
+    : CodalUSBInterface(), CodalComponent(id, 0)
+{
+    upstream = &source;
+    init(sampleRate);
+
+    source.requestSampleRate(sampleRate);
+    source.connect(*this);
+}
+
+void USBAudio::init(int sampleRate)
+{
+    this->sampleRate = sampleRate;
+    nominalFeedback = ((uint32_t)sampleRate << 14) / 1000;
+    rateRemainder = 0;
+
+    downstream = NULL;
+    feedback = NULL;
+    toHost.data = NULL;
+    fromHost.data = NULL;
+    ring_reset(toHost);
+    ring_reset(fromHost);
+
+    playing = false;
+    recording = false;
+    primed = false;
+    dataPending = false;
+    sending = false;
+    sendingFeedback = false;
+
+    // the largest packet carries one sample more than the nominal rate
+    usb_assert(((sampleRate + 999) / 1000 + 1) * (int)sizeof(int16_t) <= USB_MAX_PKT_SIZE);
+
+    resetStats();
+    stats.feedback = nominalFeedback;
+
+    if (EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->listen(id, USB_AUDIO_EVT_DATA, this, &USBAudio::onData);
+        EventModel::defaultEventBus->listen(id, DEVICE_EVT_ANY, this, &USBAudio::onStreamEvent);
+    }
+}
+
+USBAudio::~USBAudio()
+{
+    if (EventModel::defaultEventBus)
+    {
+        EventModel::defaultEventBus->ignore(id, USB_AUDIO_EVT_DATA, this, &USBAudio::onData);
+        EventModel::defaultEventBus->ignore(id, DEVICE_EVT_ANY, this, &USBAudio::onStreamEvent);
+    }
+
+    delete feedback;
+    delete[] toHost.data;
+    delete[] fromHost.data;
+}
+
+const InterfaceInfo *USBAudio::getInterfaceInfo()
+{
+    return &ifaceInfo;
+}
+
+#define ADD_DESC(...)                                                                              \
+    do                                                                                             \
+    {                                                                                              \
+        const uint8_t desc[] = {__VA_ARGS__};                                                      \
+        if (buf)                                                                                   \
+            memcpy(buf + len, desc, sizeof(desc));                                                 \
+        len += sizeof(desc);                                                                       \
+    } while (0)
+
+int USBAudio::fillDescriptors(uint8_t *buf)
+{
+    uint8_t control = interfaceIdx;
+    uint8_t play = interfaceIdx + AUDIO_INTERFACE_PLAY;
+    uint8_t record = interfaceIdx + AUDIO_INTERFACE_RECORD;
+    uint8_t epIn = 0x80 | (in ? in->ep : 0);
+    uint8_t epOut = out ? out->ep : 0;
+    uint8_t epFeedback = 0x80 | extraEndpointIdx;
+    uint8_t rate0 = sampleRate, rate1 = sampleRate >> 8, rate2 = sampleRate >> 16;
+    uint16_t packetSize = ((sampleRate + 999) / 1000 + 1) * sizeof(int16_t);
+    int len = 0;
+
+    // audio control interface, with no controls of its own
+    ADD_DESC(9, USB_INTERFACE_DESCRIPTOR_TYPE, control, 0, 0, AUDIO_CLASS, AUDIO_SUBCLASS_CONTROL, 0, 0);
+    ADD_DESC(10, AUDIO_CS_INTERFACE, AUDIO_AC_HEADER, 0x00, 0x01, // bcdADC 1.00
+             AUDIO_AC_TOTAL_LENGTH, 0, 2, play, record);
+    ADD_DESC(12, AUDIO_CS_INTERFACE, AUDIO_AC_INPUT_TERMINAL, AUDIO_TERMINAL_PLAY_IN,
+             0x01, 0x01, // USB streaming
+             0, 1, 0, 0, 0, 0);
+    ADD_DESC(9, AUDIO_CS_INTERFACE, AUDIO_AC_OUTPUT_TERMINAL, AUDIO_TERMINAL_PLAY_OUT,
+             0x01, 0x03, // speaker
+             0, AUDIO_TERMINAL_PLAY_IN, 0);
+    ADD_DESC(12, AUDIO_CS_INTERFACE, AUDIO_AC_INPUT_TERMINAL, AUDIO_TERMINAL_RECORD_IN,
+             0x01, 0x02, // microphone
+             0, 1, 0, 0, 0, 0);
+    ADD_DESC(9, AUDIO_CS_INTERFACE, AUDIO_AC_OUTPUT_TERMINAL, AUDIO_TERMINAL_RECORD_OUT,
+             0x01, 0x01, // USB streaming
+             0, AUDIO_TERMINAL_RECORD_IN, 0);
+
+    // host -> device; alternate setting 1 streams PCM, with a feedback endpoint for the rate
+    ADD_DESC(9, USB_INTERFACE_DESCRIPTOR_TYPE, play, 0, 0, AUDIO_CLASS, AUDIO_SUBCLASS_STREAMING, 0, 0);
+    ADD_DESC(9, USB_INTERFACE_DESCRIPTOR_TYPE, play, 1, 2, AUDIO_CLASS, AUDIO_SUBCLASS_STREAMING, 0, 0);
+    ADD_DESC(7, AUDIO_CS_INTERFACE, AUDIO_AS_GENERAL, AUDIO_TERMINAL_PLAY_IN, 1, 0x01, 0x00);
+    ADD_DESC(11, AUDIO_CS_INTERFACE, AUDIO_AS_FORMAT_TYPE, 1, 1, 2, 16, 1, rate0, rate1, rate2);
+    ADD_DESC(9, USB_ENDPOINT_DESCRIPTOR_TYPE, epOut, AUDIO_EP_ISO_ASYNC, (uint8_t)packetSize,
+             (uint8_t)(packetSize >> 8), 1, 0, epFeedback);
+    ADD_DESC(7, AUDIO_CS_ENDPOINT, AUDIO_EP_GENERAL, 0x01, 0, 0, 0); // sampling frequency control
+    ADD_DESC(9, USB_ENDPOINT_DESCRIPTOR_TYPE, epFeedback, AUDIO_EP_ISO_FEEDBACK, 3, 0, 1,
+             USB_AUDIO_FEEDBACK_REFRESH, 0);
+
+    // device -> host
+    ADD_DESC(9, USB_INTERFACE_DESCRIPTOR_TYPE, record, 0, 0, AUDIO_CLASS, AUDIO_SUBCLASS_STREAMING, 0, 0);
+    ADD_DESC(9, USB_INTERFACE_DESCRIPTOR_TYPE, record, 1, 1, AUDIO_CLASS, AUDIO_SUBCLASS_STREAMING, 0, 0);
+    ADD_DESC(7, AUDIO_CS_INTERFACE, AUDIO_AS_GENERAL, AUDIO_TERMINAL_RECORD_OUT, 1, 0x01, 0x00);
+    ADD_DESC(11, AUDIO_CS_INTERFACE, AUDIO_AS_FORMAT_TYPE, 1, 1, 2, 16, 1, rate0, rate1, rate2);
+    ADD_DESC(9, USB_ENDPOINT_DESCRIPTOR_TYPE, epIn, AUDIO_EP_ISO_ASYNC, (uint8_t)packetSize,
+             (uint8_t)(packetSize >> 8), 1, 0, 0);
+    ADD_DESC(7, AUDIO_CS_ENDPOINT, AUDIO_EP_GENERAL, 0x01, 0, 0, 0);
+
+    return len;
+}
+
+int USBAudio::stdRequest(UsbEndpointIn &ctrl, USBSetup &setup)
+{
+    if ((setup.bmRequestType & USB_REQ_DESTINATION) != USB_REQ_INTERFACE)
+        return DEVICE_NOT_SUPPORTED;
+
+    int iface = (setup.wIndex & 0xff) - interfaceIdx;
+    if (iface != AUDIO_INTERFACE_PLAY && iface != AUDIO_INTERFACE_RECORD)
+        return DEVICE_NOT_SUPPORTED;
+
+    volatile bool &active = iface == AUDIO_INTERFACE_PLAY ? playing : recording;
+
+    if (setup.bRequest == USB_REQ_GET_INTERFACE)
+    {
+        uint8_t alternate = active ? 1 : 0;
+        return ctrl.write(&alternate, 1);
+    }
+
+    if (setup.bRequest == USB_REQ_SET_INTERFACE && setup.wValueL <= 1)
+    {
+        bool enable = setup.wValueL == 1;
+
+        if (active != enable)
+        {
+            active = enable;
+
+            if (iface == AUDIO_INTERFACE_PLAY)
+                Event(id, enable ? USB_AUDIO_EVT_PLAY_START : USB_AUDIO_EVT_PLAY_STOP);
+            else
+                Event(id, enable ? USB_AUDIO_EVT_RECORD_START : USB_AUDIO_EVT_RECORD_STOP);
+        }
+
+        uint8_t tmp;
+        return ctrl.write(&tmp, 0);
+    }
+
+    return DEVICE_NOT_SUPPORTED;
+}
+
+int USBAudio::classRequest(UsbEndpointIn &ctrl, USBSetup &setup)
+{
+    if ((setup.bmRequestType & USB_REQ_DESTINATION) == USB_REQ_ENDPOINT &&
+        setup.wValueH == AUDIO_SAMPLING_FREQ_CONTROL)
+    {
+        uint8_t rate[3] = {(uint8_t)sampleRate, (uint8_t)(sampleRate >> 8),
+                           (uint8_t)(sampleRate >> 16)};
+
+        // only one rate is offered, so the value set by the host is not needed
+        if (setup.bRequest == AUDIO_REQ_SET_CUR)
+            return ctrl.write(rate, 0);
+
+        if (setup.bRequest == AUDIO_REQ_GET_CUR)
+            return ctrl.write(rate, sizeof(rate));
+    }
+
+    return DEVICE_NOT_SUPPORTED;
+}
+
+/**
+ * Fills the next packet for the host, with IRQs disabled.
+ * Returns the size of the packet in bytes.
+ */
+int USBAudio::fillPacket(int16_t *packet)
+{
+    int count = sampleRate / 1000;
+
+    rateRemainder += sampleRate % 1000;
+    if (rateRemainder >= 1000)
+    {
+        rateRemainder -= 1000;
+        count++;
+    }
+
+    ring_update(toHost, stats.toHost);
+
+    if (!primed && toHost.count >= BUFFER_TARGET)
+    {
+        primed = true;
+        toHost.average = toHost.count << 4;
+    }
+
+    if (primed)
+    {
+        // follow the rate of the upstream component, by keeping the buffer half full
+        int level = toHost.average >> 4;
+
+        if (level > BUFFER_TARGET + count)
+            count++;
+        else if (level < BUFFER_TARGET - count)
+            count--;
+
+        int available = min(count, toHost.count);
+        ring_read(toHost, packet, available);
+
+        if (available < count)
+        {
+            memclr(packet + available, (count - available) * sizeof(int16_t));
+            stats.toHost.underruns++;
+            primed = false;
+        }
+    }
+    else
+    {
+        memclr(packet, count * sizeof(int16_t));
+    }
+
+    stats.toHost.packets++;
+    return count * sizeof(int16_t);
+}
+
+/**
+ * Determines the number of samples per frame to ask of the host, as a 10.14 value,
+ * so that the buffer of samples from the host stays half full.
+ */
+uint32_t USBAudio::computeFeedback()
+{
+    // an error of 256 samples asks for one sample more (or less) in every frame
+    int32_t adjust = ((BUFFER_TARGET << 4) - fromHost.average) << 2;
+
+    if (adjust > (1 << 13))
+        adjust = 1 << 13;
+    if (adjust < -(1 << 13))
+        adjust = -(1 << 13);
+
+    stats.feedback = nominalFeedback + adjust;
+    return stats.feedback;
+}
+
+void USBAudio::receivePacket()
+{
+    int16_t packet[USB_MAX_PKT_SIZE / sizeof(int16_t)];
+    int len = out->read(packet, sizeof(packet));
+
+    if (len <= 0 || !playing || fromHost.data == NULL)
+        return;
+
+    int count = len / sizeof(int16_t);
+    int space = USB_AUDIO_BUFFER_SAMPLES - fromHost.count;
+
+    if (count > space)
+    {
+        count = space;
+        stats.fromHost.overruns++;
+    }
+
+    ring_write(fromHost, packet, count);
+    ring_update(fromHost, stats.fromHost);
+    stats.fromHost.packets++;
+
+    if (!dataPending && downstream && fromHost.count >= BUFFER_TARGET)
+    {
+        dataPending = true;
+        Event(id, USB_AUDIO_EVT_DATA);
+    }
+}
+
+int USBAudio::endpointRequest()
+{
+    if (out)
+        receivePacket();
+
+#ifdef USB_EP_FLAG_ASYNC
+    sendPackets();
+#endif
+
+    return DEVICE_OK;
+}
+
+#ifdef USB_EP_FLAG_ASYNC
+void USBAudio::sendPackets()
+{
+    // each endpoint takes a copy of the packet, and endpointRequest() is called as each completes
+    target_disable_irq();
+    if (recording && toHost.data && in->canWrite())
+    {
+        int16_t packet[USB_MAX_PKT_SIZE / sizeof(int16_t)];
+        in->write(packet, fillPacket(packet));
+    }
+
+    if (playing && feedback && feedback->canWrite())
+    {
+        uint32_t value = computeFeedback();
+        feedback->write(&value, 3);
+    }
+    target_enable_irq();
+}
+#endif
+
+void USBAudio::sendLoop(void *audio)
+{
+    USBAudio *a = (USBAudio *)audio;
+    int16_t packet[USB_MAX_PKT_SIZE / sizeof(int16_t)];
+
+    // writes block until the host collects each packet, once per frame
+    while (a->recording)
+    {
+        target_disable_irq();
+        int len = a->fillPacket(packet);
+        target_enable_irq();
+
+        a->in->write(packet, len);
+    }
+
+    a->sending = false;
+}
+
+void USBAudio::feedbackLoop(void *audio)
+{
+    USBAudio *a = (USBAudio *)audio;
+
+    while (a->playing)
+    {
+        target_disable_irq();
+        uint32_t value = a->computeFeedback();
+        target_enable_irq();
+
+        a->feedback->write(&value, 3);
+    }
+
+    a->sendingFeedback = false;
+}
+
+void USBAudio::onStreamEvent(Event evt)
+{
+    if (evt.value == USB_AUDIO_EVT_PLAY_START)
+    {
+        int16_t *data = fromHost.data ? fromHost.data : new int16_t[USB_AUDIO_BUFFER_SAMPLES];
+
+        // the feedback endpoint has a number of its own, reserved by getExtraEndpointCount()
+        if (feedback == NULL || feedback->ep != extraEndpointIdx)
+        {
+            delete feedback;
+            feedback = new UsbEndpointIn(extraEndpointIdx, USB_EP_TYPE_ISOCHRONOUS, 3);
+        }
+
+        target_disable_irq();
+        fromHost.data = data;
+        ring_reset(fromHost);
+        dataPending = false;
+        target_enable_irq();
+
+#ifdef USB_EP_FLAG_ASYNC
+        sendPackets();
+#else
+        if (!sendingFeedback)
+        {
+            sendingFeedback = true;
+            create_fiber(feedbackLoop, this);
+        }
+#endif
+    }
+
+    if (evt.value == USB_AUDIO_EVT_RECORD_START)
+    {
+        int16_t *data = toHost.data ? toHost.data : new int16_t[USB_AUDIO_BUFFER_SAMPLES];
+
+        target_disable_irq();
+        toHost.data = data;
+        ring_reset(toHost);
+        rateRemainder = 0;
+        primed = false;
+        target_enable_irq();
+
+#ifdef USB_EP_FLAG_ASYNC
+        sendPackets();
+#else
+        if (!sending)
+        {
+            sending = true;
+            create_fiber(sendLoop, this);
+        }
+#endif
+    }
+}
+
+void USBAudio::onData(Event)
+{
+    if (downstream)
+        downstream->pullRequest();
+}
+
+int USBAudio::pullRequest()
+{
+    ManagedBuffer b = upstream->pull();
+    int format = upstream->getFormat();
+
+    // samples are discarded while the host isn't listening
+    if (!recording || toHost.data == NULL || format == DATASTREAM_FORMAT_UNKNOWN)
+        return DEVICE_OK;
+
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int count = b.length() / bytesPerSample;
+    const uint8_t *p = b.getBytes();
+    int16_t samples[32];
+    bool overrun = false;
+
+    while (count > 0)
+    {
+        int n = min(count, 32);
+
+        for (int i = 0; i < n; i++, p += bytesPerSample)
+            samples[i] = to_sample(p, format);
+
+        target_disable_irq();
+
+        // make room by dropping the oldest samples, to keep the latency down
+        int excess = toHost.count + n - USB_AUDIO_BUFFER_SAMPLES;
+        if (excess > 0)
+        {
+            toHost.head = (toHost.head + excess) & BUFFER_MASK;
+            toHost.count -= excess;
+            overrun = true;
+        }
+
+        ring_write(toHost, samples, n);
+        target_enable_irq();
+
+        count -= n;
+    }
+
+    if (overrun)
+        stats.toHost.overruns++;
+
+    return DEVICE_OK;
+}
+
+ManagedBuffer USBAudio::pull()
+{
+    int count = min(fromHost.count, USB_AUDIO_PULL_SAMPLES);
+
+    if (count < USB_AUDIO_PULL_SAMPLES && playing)
+        stats.fromHost.underruns++;
+
+    if (count == 0)
+    {
+        dataPending = false;
+        return ManagedBuffer();
+    }
+
+    ManagedBuffer b(count * sizeof(int16_t), BufferInitialize::None);
+
+    target_disable_irq();
+    ring_read(fromHost, (int16_t *)b.getBytes(), count);
+    bool more = fromHost.count >= BUFFER_TARGET;
+    dataPending = more;
+    target_enable_irq();
+
+    if (more && downstream)
+        Event(id, USB_AUDIO_EVT_DATA);
+
+    return b;
+}
+
+void USBAudio::connect(DataSink &sink)
+{
+    downstream = &sink;
+}
+
+bool USBAudio::isConnected()
+{
+    return downstream != NULL;
+}
+
+void USBAudio::disconnect()
+{
+    downstream = NULL;
+}
+
+int USBAudio::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+float USBAudio::getSampleRate()
+{
+    return sampleRate;
+}
+
+USBAudioStats USBAudio::getStats()
+{
+    target_disable_irq();
+    USBAudioStats s = stats;
+    s.toHost.level = toHost.count;
+    s.fromHost.level = fromHost.count;
+    target_enable_irq();
+
+    return s;
+}
+
+void USBAudio::resetStats()
+{
+    target_disable_irq();
+    uint32_t value = stats.feedback;
+    memclr(&stats, sizeof(stats));
+    stats.feedback = value;
+
+    stats.toHost.level = stats.toHost.minLevel = stats.toHost.maxLevel = toHost.count;
+    stats.fromHost.level = stats.fromHost.minLevel = stats.fromHost.maxLevel = fromHost.count;
+    target_enable_irq();
+}
+
+#endif
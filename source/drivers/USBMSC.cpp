@@ -66,8 +66,11 @@ DEALINGS IN THE SOFTWARE.
 #define DEVICE_MSC_EVT_START_READ 1
 #define DEVICE_MSC_EVT_START_WRITE 2
 
+#define MSC_BLOCK_SIZE 512
+
 #include "USBMassStorageClass.h"
 #include "EventModel.h"
+#include "Timer.h"
 
 #define CPU_TO_LE32(x) (x)
 #define le32_to_cpu(x) (x)
@@ -194,6 +197,16 @@ USBMSC::USBMSC() : CodalUSBInterface()
     failed = false;
     listen = false;
     disableIRQ = false;
+    pipelineWrites = true;
+
+    pipeBuf = NULL;
+    pipeLen = NULL;
+    pipeFree = NULL;
+    pipeFull = NULL;
+    pipeDone = NULL;
+    pipelineDepth = USBMSC_PIPELINE_DEPTH;
+    pipeActive = false;
+    resetStats();
 }
 
 int USBMSC::sendResponse(bool ok)
@@ -284,9 +297,8 @@ int USBMSC::handeSCSICommand()
     return sendResponse(ok);
 }
 
-void USBMSC::readBulk(void *ptr, int dataSize)
+void USBMSC::transferOut(void *ptr, int dataSize)
 {
-    usb_assert(dataSize % 64 == 0);
     if (failed)
     {
         memset(ptr, 0, dataSize);
@@ -305,6 +317,46 @@ void USBMSC::readBulk(void *ptr, int dataSize)
     }
 }
 
+void USBMSC::readBulk(void *ptr, int dataSize)
+{
+    usb_assert(dataSize % 64 == 0);
+
+    if (!pipeActive)
+    {
+        transferOut(ptr, dataSize);
+        return;
+    }
+
+    uint8_t *dst = (uint8_t *)ptr;
+
+    while (dataSize)
+    {
+        // the host sent less than was asked for
+        if (pipeAvailable == 0)
+        {
+            memset(dst, 0, dataSize);
+            return;
+        }
+
+        if (pipeOffset == 0)
+            pipeFull->wait();
+
+        int n = min(pipeLen[pipeTail] - pipeOffset, dataSize);
+        memcpy(dst, pipeBuf + pipeTail * MSC_BLOCK_SIZE + pipeOffset, n);
+        dst += n;
+        dataSize -= n;
+        pipeOffset += n;
+        pipeAvailable -= n;
+
+        if (pipeOffset == pipeLen[pipeTail])
+        {
+            pipeTail = (pipeTail + 1) % pipelineDepth;
+            pipeOffset = 0;
+            pipeFree->notify();
+        }
+    }
+}
+
 void USBMSC::fail()
 {
     failed = true;
@@ -312,15 +364,186 @@ void USBMSC::fail()
     out->enableIRQ();
 }
 
+void USBMSC::transferIn(const void *ptr, int dataSize)
+{
+    in->flags |= USB_EP_FLAG_NO_AUTO_ZLP; // disable AUTO-ZLP
+    if (in->write(ptr, dataSize) < 0)
+        fail();
+}
+
 void USBMSC::writeBulk(const void *ptr, int dataSize)
 {
     usb_assert(dataSize % 64 == 0);
     if (failed)
         return;
     state->CommandBlock.DataTransferLength -= dataSize;
-    in->flags |= USB_EP_FLAG_NO_AUTO_ZLP; // disable AUTO-ZLP
-    if (in->write(ptr, dataSize) < 0)
-        fail();
+
+    if (!pipeActive)
+    {
+        transferIn(ptr, dataSize);
+        return;
+    }
+
+    const uint8_t *src = (const uint8_t *)ptr;
+
+    while (dataSize)
+    {
+        if (pipeOffset == 0)
+            pipeFree->wait();
+
+        int n = min(MSC_BLOCK_SIZE - pipeOffset, dataSize);
+        memcpy(pipeBuf + pipeHead * MSC_BLOCK_SIZE + pipeOffset, src, n);
+        src += n;
+        dataSize -= n;
+        pipeOffset += n;
+
+        if (pipeOffset == MSC_BLOCK_SIZE)
+            commitSlot();
+    }
+}
+
+// hands the block being filled by writeBulk() to the sending fiber
+void USBMSC::commitSlot()
+{
+    pipeLen[pipeHead] = pipeOffset;
+    pipeHead = (pipeHead + 1) % pipelineDepth;
+    pipeOffset = 0;
+    pipeFull->notify();
+}
+
+void USBMSC::sendPump(void *msc)
+{
+    USBMSC *m = (USBMSC *)msc;
+
+    for (;;)
+    {
+        m->pipeFull->wait();
+
+        int slot = m->pipeTail;
+        int len = m->pipeLen[slot];
+        m->pipeTail = (slot + 1) % m->pipelineDepth;
+
+        // an empty block marks the end of the transfer
+        if (len && !m->failed)
+            m->transferIn(m->pipeBuf + slot * MSC_BLOCK_SIZE, len);
+
+        m->pipeFree->notify();
+
+        if (len == 0)
+            break;
+    }
+
+    m->pipeDone->notify();
+}
+
+void USBMSC::receivePump(void *msc)
+{
+    USBMSC *m = (USBMSC *)msc;
+
+    while (m->pipeRemaining)
+    {
+        m->pipeFree->wait();
+
+        int slot = m->pipeHead;
+        int len = min(MSC_BLOCK_SIZE, m->pipeRemaining);
+        m->transferOut(m->pipeBuf + slot * MSC_BLOCK_SIZE, len);
+        m->pipeLen[slot] = len;
+        m->pipeHead = (slot + 1) % m->pipelineDepth;
+        m->pipeRemaining -= len;
+
+        m->pipeFull->notify();
+    }
+
+    m->pipeDone->notify();
+}
+
+void USBMSC::startPipeline(bool isRead)
+{
+    pipeActive = false;
+
+    if (pipelineDepth < 2 || (!isRead && !pipelineWrites) || !fiber_scheduler_running())
+        return;
+
+    if (pipeBuf == NULL)
+    {
+        pipeBuf = new uint8_t[pipelineDepth * MSC_BLOCK_SIZE];
+        pipeLen = new uint16_t[pipelineDepth];
+        pipeFree = new FiberLock(pipelineDepth, FiberLockMode::SEMAPHORE);
+        pipeFull = new FiberLock(0, FiberLockMode::SEMAPHORE);
+        pipeDone = new FiberLock(0, FiberLockMode::SEMAPHORE);
+    }
+
+    pipeHead = 0;
+    pipeTail = 0;
+    pipeOffset = 0;
+    pipeRead = isRead;
+    pipeRemaining = isRead ? 0 : blockCount * MSC_BLOCK_SIZE;
+    pipeAvailable = pipeRemaining;
+    pipeActive = true;
+
+    create_fiber(isRead ? sendPump : receivePump, this);
+}
+
+// waits for the endpoint fiber to complete the transfer
+void USBMSC::finishPipeline()
+{
+    if (!pipeActive)
+        return;
+
+    if (pipeRead)
+    {
+        if (pipeOffset)
+            commitSlot();
+
+        pipeFree->wait();
+        commitSlot();
+    }
+    else
+    {
+        // discard anything the device didn't read
+        while (pipeAvailable)
+        {
+            if (pipeOffset == 0)
+                pipeFull->wait();
+
+            pipeAvailable -= pipeLen[pipeTail] - pipeOffset;
+            pipeTail = (pipeTail + 1) % pipelineDepth;
+            pipeOffset = 0;
+            pipeFree->notify();
+        }
+    }
+
+    pipeDone->wait();
+    pipeActive = false;
+}
+
+int USBMSC::setPipelineDepth(int depth)
+{
+    if (depth < 0 || depth > USBMSC_MAX_PIPELINE_DEPTH)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (pipeActive)
+        return DEVICE_BUSY;
+
+    delete[] pipeBuf;
+    delete[] pipeLen;
+    delete pipeFree;
+    delete pipeFull;
+    delete pipeDone;
+
+    pipeBuf = NULL;
+    pipeLen = NULL;
+    pipeFree = NULL;
+    pipeFull = NULL;
+    pipeDone = NULL;
+    pipelineDepth = depth;
+
+    return DEVICE_OK;
+}
+
+void USBMSC::resetStats()
+{
+    memset(&stats, 0, sizeof(stats));
 }
 
 bool USBMSC::writePadded(const void *ptr, int dataSize, int allocSize)
@@ -425,6 +648,8 @@ bool USBMSC::cmdSend_Diagnostic()
 
 void USBMSC::finishReadWrite()
 {
+    finishPipeline();
+
     bool ok = !failed;
     failed = false;
     disableIRQ = false;
@@ -476,12 +701,24 @@ void USBMSC::cmdReadWrite_10(bool isRead)
 
 void USBMSC::readHandler(Event)
 {
+    CODAL_TIMESTAMP start = system_timer_current_time();
+
+    startPipeline(true);
     readBlocks(blockAddr, blockCount);
+
+    stats.blocksRead += blockCount;
+    stats.readTime += system_timer_current_time() - start;
 }
 
 void USBMSC::writeHandler(Event)
 {
+    CODAL_TIMESTAMP start = system_timer_current_time();
+
+    startPipeline(false);
     writeBlocks(blockAddr, blockCount);
+
+    stats.blocksWritten += blockCount;
+    stats.writeTime += system_timer_current_time() - start;
 }
 
 bool USBMSC::cmdModeSense(bool is10)
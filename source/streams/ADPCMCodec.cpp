@@ -0,0 +1,294 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "ADPCMCodec.h"
+
+using namespace codal;
+
+static const int16_t stepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767
+};
+
+static const int8_t indexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static_assert(ADPCM_FRAME_SAMPLES * sizeof(int16_t) <= 0xFFFF, "the samples of a frame must fit in a single ManagedBuffer");
+
+/**
+ * Applies a 4 bit code to the coder state, returning the new predicted sample.
+ */
+static inline int32_t adpcm_step(int32_t &predictor, int &index, int code)
+{
+    int32_t step = stepTable[index];
+    int32_t delta = step >> 3;
+
+    if (code & 4)
+        delta += step;
+    if (code & 2)
+        delta += step >> 1;
+    if (code & 1)
+        delta += step >> 2;
+
+    predictor += (code & 8) ? -delta : delta;
+
+    if (predictor > 32767)
+        predictor = 32767;
+    if (predictor < -32768)
+        predictor = -32768;
+
+    index += indexTable[code & 7];
+
+    if (index < 0)
+        index = 0;
+    if (index > 88)
+        index = 88;
+
+    return predictor;
+}
+
+ADPCMEncoder::ADPCMEncoder(DataSource &source) : AudioCodec(source)
+{
+    reset();
+}
+
+int ADPCMEncoder::getFormat()
+{
+    return DATASTREAM_FORMAT_8BIT_UNSIGNED;
+}
+
+/**
+ * Restarts the coder from silence.
+ */
+void ADPCMEncoder::reset()
+{
+    state.predictor = 0;
+    state.index = 0;
+    frameSamples = 0;
+    remainder = ManagedBuffer();
+}
+
+/**
+ * Encodes a block of samples, as held in the body of a frame.
+ */
+void ADPCMEncoder::encode(ADPCMState &state, const int16_t *samples, int count, uint8_t *out)
+{
+    int32_t predictor = state.predictor;
+    int index = state.index;
+
+    for (int i = 0; i < count; i++)
+    {
+        int32_t diff = samples[i] - predictor;
+        int32_t step = stepTable[index];
+        int code = 0;
+
+        if (diff < 0)
+        {
+            code = 8;
+            diff = -diff;
+        }
+
+        // Successive approximation of diff / step, in 1/4 steps, matching the reconstruction in adpcm_step().
+        if (diff >= step)
+        {
+            code |= 4;
+            diff -= step;
+        }
+        step >>= 1;
+        if (diff >= step)
+        {
+            code |= 2;
+            diff -= step;
+        }
+        step >>= 1;
+        if (diff >= step)
+            code |= 1;
+
+        adpcm_step(predictor, index, code);
+
+        if (i & 1)
+            *out++ |= code << 4;
+        else
+            *out = code;
+    }
+
+    state.predictor = predictor;
+    state.index = index;
+}
+
+ManagedBuffer ADPCMEncoder::process(ManagedBuffer input)
+{
+    ManagedBuffer samples = toSigned16(input, upStream.getFormat());
+    int count = samples.length() / sizeof(int16_t);
+    int16_t *in = (int16_t *) samples.getBytes();
+    int frames = (frameSamples + count) / ADPCM_FRAME_SAMPLES;
+
+    ManagedBuffer output(frames * ADPCM_FRAME_SIZE, BufferInitialize::None);
+    uint8_t *out = output.getBytes();
+
+    while (count)
+    {
+        if (frameSamples == 0)
+        {
+            frame[0] = state.predictor;
+            frame[1] = state.predictor >> 8;
+            frame[2] = state.index;
+            frame[3] = 0;
+        }
+
+        int n = min(count, ADPCM_FRAME_SAMPLES - frameSamples);
+        uint8_t *body = frame + ADPCM_HEADER_SIZE + frameSamples / 2;
+        int i = 0;
+
+        // Complete a byte left half filled by the previous buffer.
+        if (frameSamples & 1)
+        {
+            uint8_t code;
+            encode(state, in, 1, &code);
+            *body++ |= code << 4;
+            i = 1;
+        }
+
+        encode(state, in + i, n - i, body);
+
+        in += n;
+        count -= n;
+        frameSamples += n;
+
+        if (frameSamples == ADPCM_FRAME_SAMPLES)
+        {
+            memcpy(out, frame, ADPCM_FRAME_SIZE);
+            out += ADPCM_FRAME_SIZE;
+            frameSamples = 0;
+        }
+    }
+
+    return output;
+}
+
+ADPCMDecoder::ADPCMDecoder(DataSource &source) : AudioCodec(source)
+{
+    reset();
+}
+
+int ADPCMDecoder::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+/**
+ * Discards any partially received frame.
+ */
+void ADPCMDecoder::reset()
+{
+    frameFill = 0;
+    remainder = ManagedBuffer();
+}
+
+/**
+ * Decodes a block of samples, as held in the body of a frame.
+ */
+void ADPCMDecoder::decode(ADPCMState &state, const uint8_t *in, int count, int16_t *samples)
+{
+    int32_t predictor = state.predictor;
+    int index = state.index;
+    int16_t *end = samples + count;
+
+    while (samples < end)
+    {
+        *samples++ = adpcm_step(predictor, index, *in & 0x0f);
+
+        if (samples < end)
+            *samples++ = adpcm_step(predictor, index, *in >> 4);
+
+        in++;
+    }
+
+    state.predictor = predictor;
+    state.index = index;
+}
+
+/**
+ * Decodes a whole frame into ADPCM_FRAME_SAMPLES samples.
+ */
+static void decode_frame(const uint8_t *frame, int16_t *samples)
+{
+    ADPCMState state;
+
+    state.predictor = frame[0] | (frame[1] << 8);
+    state.index = frame[2] > 88 ? 88 : frame[2];
+
+    ADPCMDecoder::decode(state, frame + ADPCM_HEADER_SIZE, ADPCM_FRAME_SAMPLES, samples);
+}
+
+/**
+ * Limits each pull to the whole frames whose samples fit in a single ManagedBuffer. A partial frame
+ * held from earlier input never completes an extra frame, as it is shorter than a frame.
+ */
+int ADPCMDecoder::getMaxInputLength()
+{
+    return (0xFFFF / (ADPCM_FRAME_SAMPLES * sizeof(int16_t))) * ADPCM_FRAME_SIZE;
+}
+
+ManagedBuffer ADPCMDecoder::process(ManagedBuffer input)
+{
+    uint8_t *in = input.getBytes();
+    int length = input.length();
+    int frames = (frameFill + length) / ADPCM_FRAME_SIZE;
+
+    ManagedBuffer output(frames * ADPCM_FRAME_SAMPLES * sizeof(int16_t), BufferInitialize::None);
+    int16_t *out = (int16_t *) output.getBytes();
+
+    while (length)
+    {
+        // Frames that arrive whole are decoded in place.
+        if (frameFill == 0 && length >= ADPCM_FRAME_SIZE)
+        {
+            decode_frame(in, out);
+            out += ADPCM_FRAME_SAMPLES;
+            in += ADPCM_FRAME_SIZE;
+            length -= ADPCM_FRAME_SIZE;
+            continue;
+        }
+
+        int n = min(length, ADPCM_FRAME_SIZE - frameFill);
+
+        memcpy(frame + frameFill, in, n);
+        frameFill += n;
+        in += n;
+        length -= n;
+
+        if (frameFill == ADPCM_FRAME_SIZE)
+        {
+            decode_frame(frame, out);
+            out += ADPCM_FRAME_SAMPLES;
+            frameFill = 0;
+        }
+    }
+
+    return output;
+}
@@ -0,0 +1,178 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "AudioCodec.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param source The upstream component providing data.
+ */
+AudioCodec::AudioCodec(DataSource &source) : upStream(source)
+{
+    this->downStream = NULL;
+    source.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+AudioCodec::~AudioCodec()
+{
+}
+
+/**
+ * Provides the next buffer of upstream data, once it has been coded.
+ */
+ManagedBuffer AudioCodec::pull()
+{
+    ManagedBuffer input = remainder.length() ? remainder : this->upStream.pull();
+    remainder = ManagedBuffer();
+
+    if (input.length() == 0)
+        return input;
+
+    // Code no more than fits in a single buffer, and let our downstream component know there is more to come.
+    int limit = getMaxInputLength();
+
+    if (input.length() > limit)
+    {
+        remainder = input.slice(limit);
+        input = input.slice(0, limit);
+    }
+
+    ManagedBuffer output = process(input);
+
+    if (remainder.length() && downStream != NULL)
+        downStream->pullRequest();
+
+    return output;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int AudioCodec::pullRequest()
+{
+    if (this->downStream != NULL)
+        return this->downStream->pullRequest();
+
+    return DEVICE_BUSY;
+}
+
+void AudioCodec::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+bool AudioCodec::isConnected()
+{
+    return this->downStream != NULL;
+}
+
+void AudioCodec::disconnect()
+{
+    this->downStream = NULL;
+}
+
+int AudioCodec::setFormat(int format)
+{
+    return format == getFormat() ? DEVICE_OK : DEVICE_NOT_SUPPORTED;
+}
+
+float AudioCodec::getSampleRate()
+{
+    return this->upStream.getSampleRate();
+}
+
+float AudioCodec::requestSampleRate(float sampleRate)
+{
+    return this->upStream.requestSampleRate(sampleRate);
+}
+
+/**
+ * Determines the largest input that process() can code into a single ManagedBuffer.
+ */
+int AudioCodec::getMaxInputLength()
+{
+    return DATASTREAM_FORMAT_BYTES_PER_SAMPLE(upStream.getFormat()) == 1 ? 0xFFFF / sizeof(int16_t) : 0xFFFF;
+}
+
+/**
+ * Converts a buffer of samples in the given format into signed 16 bit samples.
+ */
+ManagedBuffer AudioCodec::toSigned16(ManagedBuffer input, int format)
+{
+    if (format == DATASTREAM_FORMAT_16BIT_SIGNED || format == DATASTREAM_FORMAT_UNKNOWN)
+        return input;
+
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int count = input.length() / bytesPerSample;
+    ManagedBuffer output(count * sizeof(int16_t), BufferInitialize::None);
+
+    uint8_t *in = input.getBytes();
+    int16_t *out = (int16_t *) output.getBytes();
+    int16_t *end = out + count;
+
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            while (out < end)
+                *out++ = (*in++ - 128) << 8;
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            while (out < end)
+                *out++ = *(int8_t *) in++ << 8;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            for (uint16_t *p = (uint16_t *) in; out < end; p++)
+                *out++ = *p ^ 0x8000;
+            break;
+
+        case DATASTREAM_FORMAT_24BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_24BIT_SIGNED:
+        {
+            uint16_t mask = format == DATASTREAM_FORMAT_24BIT_UNSIGNED ? 0x8000 : 0;
+            for (; out < end; in += 3)
+                *out++ = (in[1] | (in[2] << 8)) ^ mask;
+            break;
+        }
+
+        default:
+        {
+            uint32_t mask = format == DATASTREAM_FORMAT_32BIT_UNSIGNED ? 0x8000 : 0;
+            for (uint32_t *p = (uint32_t *) in; out < end; p++)
+                *out++ = (*p >> 16) ^ mask;
+            break;
+        }
+    }
+
+    return output;
+}
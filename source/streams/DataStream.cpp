@@ -57,6 +57,11 @@ int DataSource::setFormat(int format)
     return DEVICE_NOT_SUPPORTED;
 }
 
+int DataSource::getSampleBits()
+{
+    return 0;
+}
+
 float DataSource::getSampleRate() {
     return DATASTREAM_SAMPLE_RATE_UNKNOWN;
 }
@@ -127,6 +132,11 @@ int DataStream::getFormat()
     return upStream->getFormat();
 }
 
+int DataStream::getSampleBits()
+{
+    return upStream->getSampleBits();
+}
+
 void DataStream::disconnect()
 {
 	this->downStream = NULL;
@@ -53,6 +53,11 @@ int EffectFilter::getFormat()
     return this->upStream.getFormat();
 }
 
+int EffectFilter::getSampleBits()
+{
+    return this->upStream.getSampleBits();
+}
+
 int EffectFilter::setFormat( int format )
 {
     return this->upStream.setFormat( format );
@@ -112,6 +112,11 @@ int FIFOStream::getFormat()
     return this->upStream.getFormat();
 }
 
+int FIFOStream::getSampleBits()
+{
+    return this->upStream.getSampleBits();
+}
+
 int FIFOStream::setFormat( int format )
 {
     return this->upStream.setFormat( format );
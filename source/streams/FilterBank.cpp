@@ -0,0 +1,378 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FilterBank.h"
+#include "ErrorNo.h"
+#include "CodalDmesg.h"
+
+using namespace codal;
+
+static inline int16_t saturate_16(int32_t v)
+{
+    if (v > 32767)
+        return 32767;
+
+    if (v < -32768)
+        return -32768;
+
+    return v;
+}
+
+/**
+ * Constructor.
+ * Creates an empty filter bank, which initially passes data through unmodified.
+ *
+ * @param source The upstream component providing data.
+ * @param deepCopy Set to true to copy incoming data into a freshly allocated buffer, or false to change data in place.
+ */
+FilterBank::FilterBank(DataSource &source, bool deepCopy) : EffectFilter(source, deepCopy)
+{
+    this->stages = NULL;
+    this->maxTaps = 1;
+}
+
+/**
+ * Destructor.
+ * Removes all resources held by the instance.
+ */
+FilterBank::~FilterBank()
+{
+    clear();
+}
+
+/**
+ * Appends the given stage to the end of the cascade.
+ */
+void FilterBank::addStage(FilterBankStage *stage)
+{
+    FilterBankStage **p = &stages;
+
+    while (*p)
+        p = &(*p)->next;
+
+    stage->next = NULL;
+    *p = stage;
+}
+
+/**
+ * Appends a biquad stage to the filter.
+ *
+ * @param coefficients The five coefficients {b0, b1, b2, a1, a2} in Q2.14 format.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+ */
+int FilterBank::addBiquad(const int16_t *coefficients)
+{
+    if (coefficients == NULL)
+        return DEVICE_INVALID_PARAMETER;
+
+    FilterBankStage *stage = new FilterBankStage();
+    if (stage == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    stage->state = new int16_t[4];
+    if (stage->state == NULL)
+    {
+        delete stage;
+        return DEVICE_NO_RESOURCES;
+    }
+
+    memcpy(stage->biquad, coefficients, sizeof(stage->biquad));
+    memclr(stage->state, 4 * sizeof(int16_t));
+    stage->coefficients = stage->biquad;
+    stage->taps = 0;
+
+    addStage(stage);
+    return DEVICE_OK;
+}
+
+/**
+ * Appends a FIR stage to the filter.
+ *
+ * @param taps The filter taps in Q1.15 format. The taps are not copied.
+ * @param length The number of taps, in the range 1..FILTER_BANK_MAX_FIR_TAPS.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+ */
+int FilterBank::addFIR(const int16_t *taps, int length)
+{
+    if (taps == NULL || length < 1 || length > FILTER_BANK_MAX_FIR_TAPS)
+        return DEVICE_INVALID_PARAMETER;
+
+    FilterBankStage *stage = new FilterBankStage();
+    if (stage == NULL)
+        return DEVICE_NO_RESOURCES;
+
+    stage->state = NULL;
+    if (length > 1)
+    {
+        stage->state = new int16_t[length - 1];
+        if (stage->state == NULL)
+        {
+            delete stage;
+            return DEVICE_NO_RESOURCES;
+        }
+
+        memclr(stage->state, (length - 1) * sizeof(int16_t));
+    }
+
+    stage->coefficients = taps;
+    stage->taps = length;
+    maxTaps = max(maxTaps, length);
+
+    addStage(stage);
+    return DEVICE_OK;
+}
+
+/**
+ * Removes all stages from the filter.
+ */
+void FilterBank::clear()
+{
+    while (stages)
+    {
+        FilterBankStage *s = stages;
+        stages = s->next;
+
+        delete[] s->state;
+        delete s;
+    }
+
+    maxTaps = 1;
+}
+
+/**
+ * Clears the history of every stage, as if the filter had just been created.
+ */
+void FilterBank::reset()
+{
+    for (FilterBankStage *s = stages; s; s = s->next)
+    {
+        int length = s->taps ? s->taps - 1 : 4;
+
+        if (s->state)
+            memclr(s->state, length * sizeof(int16_t));
+    }
+}
+
+/**
+ * Applies a biquad stage to a block of samples, in place (Direct Form I).
+ */
+void FilterBank::processBiquad(FilterBankStage *stage, int16_t *samples, int count)
+{
+    const int16_t *c = stage->coefficients;
+    int16_t *state = stage->state;
+
+    int32_t b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+    int32_t x1 = state[0], x2 = state[1], y1 = state[2], y2 = state[3];
+    int16_t *end = samples + count;
+
+    while (samples < end)
+    {
+        int32_t x0 = *samples;
+        int32_t acc = b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2 + (1 << (FILTER_BANK_BIQUAD_SHIFT - 1));
+        int32_t y0 = saturate_16(acc >> FILTER_BANK_BIQUAD_SHIFT);
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+
+        *samples++ = y0;
+    }
+
+    state[0] = x1;
+    state[1] = x2;
+    state[2] = y1;
+    state[3] = y2;
+}
+
+/**
+ * Applies a FIR stage to a block of samples, in place.
+ * The (taps - 1) samples preceding the block are used to hold the history of the stage.
+ */
+void FilterBank::processFIR(FilterBankStage *stage, int16_t *buffer, int count)
+{
+    const int16_t *h = stage->coefficients;
+    int taps = stage->taps;
+    int history = taps - 1;
+
+    if (history > 0)
+    {
+        // Place the previous inputs immediately before this block, and record the inputs to carry forward
+        // before they are overwritten.
+        memcpy(buffer - history, stage->state, history * sizeof(int16_t));
+        memcpy(stage->state, buffer + count - history, history * sizeof(int16_t));
+    }
+
+    // Work backwards through the block, so that each output only overwrites an input that is no longer needed.
+    for (int16_t *out = buffer + count - 1; out >= buffer; out--)
+    {
+        const int16_t *x = out;
+        const int16_t *t = h;
+        const int16_t *end = h + taps;
+        int32_t acc = 1 << (FILTER_BANK_FIR_SHIFT - 1);
+
+        while (t + 4 <= end)
+        {
+            acc += t[0] * x[0];
+            acc += t[1] * x[-1];
+            acc += t[2] * x[-2];
+            acc += t[3] * x[-3];
+            t += 4;
+            x -= 4;
+        }
+
+        while (t < end)
+            acc += *t++ * *x--;
+
+        *out = saturate_16(acc >> FILTER_BANK_FIR_SHIFT);
+    }
+}
+
+/**
+ * Apply the filter stages in turn to the given buffer of data.
+ *
+ * @param inputBuffer the buffer containing data to process.
+ * @param outputBuffer the buffer in which to store the filtered data. n.b. MAY be the same memory as the input buffer.
+ * @param format the format of the data (word size and signed/unsigned representation)
+ */
+void FilterBank::applyEffect(ManagedBuffer inputBuffer, ManagedBuffer outputBuffer, int format)
+{
+    if (stages == NULL || format == DATASTREAM_FORMAT_UNKNOWN)
+    {
+        EffectFilter::applyEffect(inputBuffer, outputBuffer, format);
+        return;
+    }
+
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int count = inputBuffer.length() / bytesPerSample;
+    int history = maxTaps - 1;
+    int size = (history + count) * sizeof(int16_t);
+
+    if (count == 0)
+        return;
+
+    if (work.length() < size)
+        work = ManagedBuffer(size, BufferInitialize::None);
+
+    int16_t *samples = (int16_t *) work.getBytes() + history;
+    int16_t *s = samples;
+    int16_t *end = samples + count;
+    uint8_t *in = inputBuffer.getBytes();
+    uint8_t *out = outputBuffer.getBytes();
+
+    // Convert to signed 16 bit samples.
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            while (s < end)
+                *s++ = (*in++ - 128) << 8;
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            while (s < end)
+                *s++ = *(int8_t *) in++ << 8;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            for (uint16_t *p = (uint16_t *) in; s < end; p++)
+                *s++ = *p ^ 0x8000;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            memcpy(s, in, count * sizeof(int16_t));
+            break;
+
+        case DATASTREAM_FORMAT_24BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_24BIT_SIGNED:
+        {
+            uint16_t mask = format == DATASTREAM_FORMAT_24BIT_UNSIGNED ? 0x8000 : 0;
+            for (; s < end; in += 3)
+                *s++ = (in[1] | (in[2] << 8)) ^ mask;
+            break;
+        }
+
+        default:
+        {
+            uint32_t mask = format == DATASTREAM_FORMAT_32BIT_UNSIGNED ? 0x8000 : 0;
+            for (uint32_t *p = (uint32_t *) in; s < end; p++)
+                *s++ = (*p >> 16) ^ mask;
+            break;
+        }
+    }
+
+    for (FilterBankStage *stage = stages; stage; stage = stage->next)
+    {
+        if (stage->taps)
+            processFIR(stage, samples, count);
+        else
+            processBiquad(stage, samples, count);
+    }
+
+    // Convert back into the original format.
+    s = samples;
+
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            while (s < end)
+                *out++ = (*s++ >> 8) + 128;
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            while (s < end)
+                *out++ = *s++ >> 8;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            for (uint16_t *p = (uint16_t *) out; s < end; p++)
+                *p = *s++ ^ 0x8000;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            memcpy(out, s, count * sizeof(int16_t));
+            break;
+
+        case DATASTREAM_FORMAT_24BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_24BIT_SIGNED:
+        {
+            uint16_t mask = format == DATASTREAM_FORMAT_24BIT_UNSIGNED ? 0x8000 : 0;
+            for (; s < end; out += 3)
+            {
+                uint16_t v = *s++ ^ mask;
+                out[0] = 0;
+                out[1] = v;
+                out[2] = v >> 8;
+            }
+            break;
+        }
+
+        default:
+        {
+            uint32_t mask = format == DATASTREAM_FORMAT_32BIT_UNSIGNED ? 0x80000000 : 0;
+            for (uint32_t *p = (uint32_t *) out; s < end; p++)
+                *p = ((uint32_t) (uint16_t) *s++ << 16) ^ mask;
+            break;
+        }
+    }
+}
@@ -0,0 +1,464 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "FlashStreamRecording.h"
+#include "ErrorNo.h"
+#include "CodalFiber.h"
+
+using namespace codal;
+
+FlashStreamRecording::FlashStreamRecording(DataSource &source, SPIFlash &flash, uint32_t start, uint32_t size) : queued(0, FiberLockMode::SEMAPHORE), upStream(source)
+{
+    this->flash = &flash;
+    this->nvm = NULL;
+    init(start, size, SPIFLASH_SMALL_ROW_SIZE);
+}
+
+FlashStreamRecording::FlashStreamRecording(DataSource &source, NVMController &nvm, uint32_t start, uint32_t size) : queued(0, FiberLockMode::SEMAPHORE), upStream(source)
+{
+    this->flash = NULL;
+    this->nvm = &nvm;
+    init(start, size, nvm.getPageSize());
+}
+
+/**
+ * Common initialisation: limits the region to whole erase units, and connects to the upstream component.
+ */
+void FlashStreamRecording::init(uint32_t start, uint32_t size, uint32_t eraseSize)
+{
+    uint32_t end = start + size;
+
+    this->eraseSize = eraseSize;
+    this->start = (start + eraseSize - 1) / eraseSize * eraseSize;
+    this->capacity = end > this->start ? (end - this->start) / eraseSize * eraseSize : 0;
+
+    this->recorded = 0;
+    this->written = 0;
+    this->erased = 0;
+    this->readOffset = 0;
+    this->dropped = 0;
+    this->buffers[0] = NULL;
+    this->buffers[1] = NULL;
+    this->bufferLength[0] = 0;
+    this->bufferLength[1] = 0;
+    this->bufferQueued[0] = false;
+    this->bufferQueued[1] = false;
+    this->active = 0;
+    this->writing = 0;
+    this->writerRunning = false;
+    this->writerExit = false;
+    this->writeFailed = false;
+    this->state = REC_STATE_STOPPED;
+    this->lastUpstreamRate = DATASTREAM_SAMPLE_RATE_UNKNOWN;
+    this->downStream = NULL;
+
+    upStream.connect( *this );
+}
+
+FlashStreamRecording::~FlashStreamRecording()
+{
+    upStream.disconnect();
+    stop();
+
+    // The writer fiber uses our buffers, so let it finish with them and exit before they are freed.
+    if( this->writerRunning )
+    {
+        waitForWrites();
+
+        this->writerExit = true;
+        this->queued.notify();
+
+        while( this->writerRunning )
+            fiber_sleep(5);
+    }
+
+    free(buffers[0]);
+    free(buffers[1]);
+}
+
+/**
+ * Hands the buffer being filled over to the writer fiber, and moves on to the other buffer.
+ */
+void FlashStreamRecording::queueActive()
+{
+    if( this->bufferQueued[active] || this->bufferLength[active] == 0 )
+        return;
+
+    this->bufferQueued[active] = true;
+    this->active ^= 1;
+    this->queued.notify();
+}
+
+/**
+ * Blocks the calling fiber until all recorded data has been written to flash.
+ */
+void FlashStreamRecording::waitForWrites()
+{
+    while( this->bufferQueued[0] || this->bufferQueued[1] )
+        fiber_sleep(5);
+}
+
+/**
+ * Programs data into the region, erasing the flash just ahead of it as required.
+ * Erasing lazily means that starting a recording never waits for the whole region to be erased.
+ */
+int FlashStreamRecording::writeFlash(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    int r;
+
+    while( this->erased < offset + len )
+    {
+        r = flash ? flash->eraseSmallRow(start + erased) : nvm->erase(start + erased);
+        if( r != DEVICE_OK )
+            return r;
+
+        this->erased += this->eraseSize;
+    }
+
+    if( flash )
+        return flash->writeBuffer(start + offset, data, len);
+
+    return nvm->write(start + offset, (uint32_t *)data, (len + 3) / 4);
+}
+
+/**
+ * Fiber that writes each buffer to flash as it is filled, so that flash programming overlaps capture.
+ */
+void FlashStreamRecording::writer(void *recording)
+{
+    FlashStreamRecording *r = (FlashStreamRecording *)recording;
+
+    while( true )
+    {
+        r->queued.wait();
+
+        if( r->writerExit )
+            break;
+
+        int b = r->writing;
+        if( !r->bufferQueued[b] )
+            continue;
+
+        uint32_t len = r->bufferLength[b];
+
+        if( !r->writeFailed && r->writeFlash(r->written, r->buffers[b], len) == DEVICE_OK )
+        {
+            r->written += len;
+        }
+        else
+        {
+            // Leave no gap in the flash; the data is simply lost.
+            target_disable_irq();
+            r->recorded -= len;
+            r->dropped += len;
+            target_enable_irq();
+
+            // The flash beyond the data written may now be partly programmed, and cannot be written again until
+            // it is erased. The recording ends at the last good byte, and later buffers are dropped.
+            if( !r->writeFailed )
+            {
+                r->writeFailed = true;
+
+                if( r->state == REC_STATE_RECORDING )
+                    r->stop();
+            }
+        }
+
+        r->bufferLength[b] = 0;
+        r->bufferQueued[b] = false;
+        r->writing ^= 1;
+    }
+
+    r->writerExit = false;
+    r->writerRunning = false;
+}
+
+ManagedBuffer FlashStreamRecording::pull()
+{
+    // Are we playing back?
+    if( this->state != REC_STATE_PLAYING )
+        return ManagedBuffer();
+
+    // Do we have data to send?
+    if( this->readOffset >= this->written ) {
+        stop();
+        return ManagedBuffer();
+    }
+
+    uint32_t len = min(this->written - this->readOffset, (uint32_t) FLASH_RECORDING_BUFFER_SIZE);
+    ManagedBuffer out;
+
+    if( flash )
+    {
+        out = ManagedBuffer(len, BufferInitialize::None);
+        flash->readBytes(start + readOffset, out.getBytes(), len);
+    }
+    else
+    {
+        // Internal flash is read in whole words.
+        out = ManagedBuffer((len + 3) & ~3, BufferInitialize::None);
+        nvm->read((uint32_t *)out.getBytes(), start + readOffset, (len + 3) / 4);
+        out.truncate(len);
+    }
+
+    this->readOffset += len;
+
+    // Prod the downstream that we're good to go
+    if( downStream != NULL )
+        downStream->pullRequest();
+
+    return out;
+}
+
+int FlashStreamRecording::length()
+{
+    return this->recorded;
+}
+
+float FlashStreamRecording::duration( unsigned int sampleRate )
+{
+    return ((float)this->length() / DATASTREAM_FORMAT_BYTES_PER_SAMPLE((float)this->getFormat()) ) / (float)sampleRate;
+}
+
+bool FlashStreamRecording::isFull()
+{
+    return this->recorded >= this->capacity;
+}
+
+int FlashStreamRecording::pullRequest()
+{
+    // Are we recording?
+    if( this->state != REC_STATE_RECORDING )
+        return DEVICE_BUSY;
+
+    ManagedBuffer data = this->upStream.pull();
+    this->lastUpstreamRate = this->upStream.getSampleRate();
+
+    // Are we getting empty buffers (probably because we're out of RAM!)
+    if( data == ManagedBuffer() || data.length() <= 1 )
+        return DEVICE_OK;
+
+    uint8_t *in = data.getBytes();
+    uint32_t remaining = data.length();
+
+    // Buffers are only recorded if they can be stored whole, so that any gap falls on a buffer boundary. This keeps
+    // framed data (such as that of an ADPCMEncoder) aligned. Buffers larger than FLASH_RECORDING_BUFFER_SIZE are stored
+    // as far as they fit.
+    uint32_t space = bufferQueued[active] ? 0 : FLASH_RECORDING_BUFFER_SIZE - bufferLength[active];
+
+    if( !bufferQueued[active ^ 1] )
+        space += FLASH_RECORDING_BUFFER_SIZE;
+
+    if( remaining > space && remaining <= FLASH_RECORDING_BUFFER_SIZE )
+    {
+        this->dropped += remaining;
+        return DEVICE_BUSY;
+    }
+
+    while( remaining )
+    {
+        // If the buffer we would fill is still waiting for the flash, there's nowhere to put the data.
+        if( this->bufferQueued[active] )
+        {
+            this->dropped += remaining;
+            return DEVICE_BUSY;
+        }
+
+        uint32_t len = min(remaining, (uint32_t) FLASH_RECORDING_BUFFER_SIZE - bufferLength[active]);
+        len = min(len, this->capacity - this->recorded);
+
+        memcpy(buffers[active] + bufferLength[active], in, len);
+        this->bufferLength[active] += len;
+        this->recorded += len;
+        in += len;
+        remaining -= len;
+
+        if( isFull() )
+        {
+            this->dropped += remaining;
+            this->stop();
+            return DEVICE_NO_RESOURCES;
+        }
+
+        if( this->bufferLength[active] == FLASH_RECORDING_BUFFER_SIZE )
+            queueActive();
+    }
+
+    return DEVICE_OK;
+}
+
+void FlashStreamRecording::connect( DataSink &sink )
+{
+    this->downStream = &sink;
+}
+
+bool FlashStreamRecording::isConnected()
+{
+    return this->downStream != NULL;
+}
+
+void FlashStreamRecording::disconnect()
+{
+    this->downStream = NULL;
+}
+
+int FlashStreamRecording::getFormat()
+{
+    return this->upStream.getFormat();
+}
+
+int FlashStreamRecording::getSampleBits()
+{
+    return this->upStream.getSampleBits();
+}
+
+int FlashStreamRecording::setFormat( int format )
+{
+    return this->upStream.setFormat( format );
+}
+
+bool FlashStreamRecording::recordAsync()
+{
+    if( this->capacity == 0 )
+        return false;
+
+    if( this->buffers[0] == NULL )
+    {
+        this->buffers[0] = (uint8_t *)malloc(FLASH_RECORDING_BUFFER_SIZE);
+        this->buffers[1] = (uint8_t *)malloc(FLASH_RECORDING_BUFFER_SIZE);
+
+        if( this->buffers[0] == NULL || this->buffers[1] == NULL )
+        {
+            free(this->buffers[0]);
+            free(this->buffers[1]);
+            this->buffers[0] = NULL;
+            this->buffers[1] = NULL;
+            return false;
+        }
+    }
+
+    if( !this->writerRunning )
+    {
+        this->writerRunning = true;
+        create_fiber(writer, this);
+    }
+
+    erase();
+
+    bool changed = this->state != REC_STATE_RECORDING;
+
+    this->state = REC_STATE_RECORDING;
+
+    return changed;
+}
+
+void FlashStreamRecording::record()
+{
+    recordAsync();
+    while( isRecording() )
+        fiber_sleep(5);
+}
+
+void FlashStreamRecording::erase()
+{
+    if( this->state != REC_STATE_STOPPED )
+        this->stop();
+
+    waitForWrites();
+
+    this->recorded = 0;
+    this->written = 0;
+    this->erased = 0;
+    this->readOffset = 0;
+    this->dropped = 0;
+    this->active = 0;
+    this->writing = 0;
+    this->writeFailed = false;
+    this->lastUpstreamRate = DATASTREAM_SAMPLE_RATE_UNKNOWN;
+}
+
+bool FlashStreamRecording::playAsync()
+{
+    if( this->state != REC_STATE_STOPPED )
+        this->stop();
+
+    // Anything recorded must reach the flash before it can be played back.
+    waitForWrites();
+
+    bool changed = this->state != REC_STATE_PLAYING;
+
+    this->state = REC_STATE_PLAYING;
+    if( this->downStream != NULL )
+        this->downStream->pullRequest();
+
+    return changed;
+}
+
+void FlashStreamRecording::play()
+{
+    playAsync();
+    while( isPlaying() )
+        fiber_sleep(5);
+}
+
+bool FlashStreamRecording::stop()
+{
+    bool changed = this->state != REC_STATE_STOPPED;
+
+    // Hand any partially filled buffer to the writer. This does not wait for the flash.
+    if( this->state == REC_STATE_RECORDING )
+        queueActive();
+
+    this->state = REC_STATE_STOPPED;
+    this->readOffset = 0; // Snap to the start
+
+    return changed;
+}
+
+bool FlashStreamRecording::isPlaying()
+{
+    fiber_sleep(0);
+    return this->state == REC_STATE_PLAYING;
+}
+
+bool FlashStreamRecording::isRecording()
+{
+    fiber_sleep(0);
+    return this->state == REC_STATE_RECORDING;
+}
+
+bool FlashStreamRecording::isStopped()
+{
+    fiber_sleep(0);
+    return this->state == REC_STATE_STOPPED;
+}
+
+float FlashStreamRecording::getSampleRate()
+{
+    if( this->lastUpstreamRate == DATASTREAM_SAMPLE_RATE_UNKNOWN )
+        return this->upStream.getSampleRate();
+
+    return this->lastUpstreamRate;
+}
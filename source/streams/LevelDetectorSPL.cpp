@@ -34,11 +34,65 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+// 20*log10(1 + (i + 0.5) / 64) in Q8 format, used to convert the mantissa of a normalised amplitude into dB.
+static const uint16_t dbMantissa[64] = {17, 52, 85, 118, 151, 183, 215, 246, 277, 308, 338, 367, 397, 426, 454, 482, 510, 537, 565, 591, 618, 644, 670, 695, 721, 746, 770, 795, 819, 843, 867, 890, 913, 936, 959, 981, 1003, 1025, 1047, 1069, 1090, 1111, 1132, 1153, 1174, 1194, 1214, 1234, 1254, 1274, 1293, 1313, 1332, 1351, 1370, 1388, 1407, 1425, 1444, 1462, 1480, 1497, 1515, 1533};
+
+// 20*log10(2) in Q8 format: the change in level for each doubling of amplitude.
+#define LEVEL_DETECTOR_SPL_DB_PER_OCTAVE_Q8     1541
+
+/*
+ * Converts a (non-zero) amplitude to 20*log10(amplitude), in Q8 format, using a lookup table.
+ */
+static int amplitude_to_db(uint32_t amplitude)
+{
+    int exponent = 31 - __builtin_clz(amplitude);
+    int mantissa = ((amplitude << (31 - exponent)) >> 25) & 0x3F;
+
+    return exponent * LEVEL_DETECTOR_SPL_DB_PER_OCTAVE_Q8 + dbMantissa[mantissa];
+}
+
+/*
+ * Integer square root.
+ */
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t result = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (value >= result + bit)
+        {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+        {
+            result >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return result;
+}
+
+static inline void accumulate(int32_t v, int32_t &lo, int32_t &hi, int64_t &sum, uint64_t &squares)
+{
+    if (v < lo) lo = v;
+    if (v > hi) hi = v;
+    sum += v;
+    squares += (uint32_t) v * (uint32_t) v;
+}
+
 LevelDetectorSPL::LevelDetectorSPL(DataSource &source, float highThreshold, float lowThreshold, float gain, float minValue, uint16_t id, bool activateImmediately) : upstream(source), resourceLock(0)
 {
     this->id = id;
     this->level = 0;
-    this->windowSize = LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE;
+    this->windowSize = 0;
     this->lowThreshold = lowThreshold;
     this->highThreshold = highThreshold;
     this->minValue = minValue;
@@ -61,6 +115,16 @@ LevelDetectorSPL::LevelDetectorSPL(DataSource &source, float highThreshold, floa
 
     this->bufferCount = 0;
     this->timeout = 0;
+
+    this->windowCount = 0;
+    this->windowMin = INT32_MAX;
+    this->windowMax = INT32_MIN;
+    this->windowSum = 0;
+    this->windowSumSquares = 0;
+
+    this->splOffset = 0;
+    this->splOffsetGain = 0;
+    this->splOffsetFormat = -1;
 }
 
 int LevelDetectorSPL::pullRequest()
@@ -73,146 +137,202 @@ int LevelDetectorSPL::pullRequest()
 
     ManagedBuffer b = upstream.pull();
     uint8_t *data = &b[0];
-    
+
     int format = upstream.getFormat();
-    int skip = 1;
-    float multiplier = 256;
-    windowSize = 256;
-
-    if (format == DATASTREAM_FORMAT_16BIT_SIGNED || format == DATASTREAM_FORMAT_UNKNOWN){
-        skip = 2;
-        multiplier = 1;
-        windowSize = 128;
-    }
-    else if (format == DATASTREAM_FORMAT_32BIT_SIGNED){
-        skip = 4;
-        windowSize = 64;
-        multiplier = (1/65536);
+    int skip = format == DATASTREAM_FORMAT_UNKNOWN ? 2 : DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int samples = b.length() / skip;
+    int window = windowSize;
+
+    if (window == 0)
+        window = skip == 1 ? LEVEL_DETECTOR_SPL_DEFAULT_8BIT_WINDOW_SIZE : LEVEL_DETECTOR_SPL_DEFAULT_WINDOW_SIZE;
+
+    // Windows span buffer boundaries, so every sample contributes to a window.
+    while (samples)
+    {
+        int count = max(0, min(samples, window - windowCount));
+
+        updateWindow(data, count, format);
+
+        samples -= count;
+        data += count * skip;
+
+        if (windowCount >= window)
+            processWindow(format);
     }
 
-    int samples = b.length() / skip;
+    if( this->bufferCount < LEVEL_DETECTOR_SPL_MIN_BUFFERS )
+        this->bufferCount++;
 
-    while(samples){
-        // ensure we use at least windowSize number of samples (128)
-        if(samples < windowSize)
+    return DEVICE_OK;
+}
+
+/**
+ * Accumulates a block of samples into the current window, in a single pass.
+ * Samples wider than 16 bits are reduced to their most significant 16 bits.
+ */
+void LevelDetectorSPL::updateWindow(uint8_t *data, int count, int format)
+{
+    int32_t lo = windowMin;
+    int32_t hi = windowMax;
+    int64_t sum = windowSum;
+    uint64_t squares = windowSumSquares;
+
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            for (uint8_t *p = data, *end = p + count; p < end; p++)
+                accumulate(*p, lo, hi, sum, squares);
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            for (int8_t *p = (int8_t *) data, *end = p + count; p < end; p++)
+                accumulate(*p, lo, hi, sum, squares);
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            for (uint16_t *p = (uint16_t *) data, *end = p + count; p < end; p++)
+                accumulate(*p, lo, hi, sum, squares);
+            break;
+
+        case DATASTREAM_FORMAT_24BIT_UNSIGNED:
+            for (uint8_t *p = data, *end = p + count * 3; p < end; p += 3)
+                accumulate(p[1] | (p[2] << 8), lo, hi, sum, squares);
             break;
 
-        uint8_t *ptr, *end;
+        case DATASTREAM_FORMAT_24BIT_SIGNED:
+            for (uint8_t *p = data, *end = p + count * 3; p < end; p += 3)
+                accumulate((int16_t) (p[1] | (p[2] << 8)), lo, hi, sum, squares);
+            break;
+
+        case DATASTREAM_FORMAT_32BIT_UNSIGNED:
+            for (uint32_t *p = (uint32_t *) data, *end = p + count; p < end; p++)
+                accumulate(*p >> 16, lo, hi, sum, squares);
+            break;
+
+        case DATASTREAM_FORMAT_32BIT_SIGNED:
+            for (int32_t *p = (int32_t *) data, *end = p + count; p < end; p++)
+                accumulate(*p >> 16, lo, hi, sum, squares);
+            break;
 
-        ptr = data;
-        end = data + windowSize;
+        default:
+            for (int16_t *p = (int16_t *) data, *end = p + count; p < end; p++)
+                accumulate(*p, lo, hi, sum, squares);
+            break;
+    }
 
+    windowMin = lo;
+    windowMax = hi;
+    windowSum = sum;
+    windowSumSquares = squares;
+    windowCount += count;
+}
+
+/**
+ * Calculates the level and RMS amplitude of the completed window, and emits any resulting events.
+ */
+void LevelDetectorSPL::processWindow(int format)
+{
+    int32_t maxVal = (windowMax - windowMin) / 2;
+
+    /*******************************
+    *   GET RMS AMPLITUDE FOR CLAP DETECTION
+    ******************************/
+    // RMS is measured relative to the smallest sample in the window, derived from the running sums:
+    // sum((v - min)^2) = sum(v^2) - 2 * min * sum(v) + n * min^2
+    int64_t n = windowCount;
+    int64_t m = windowMin;
+    int64_t deviation = (int64_t) windowSumSquares - 2 * m * windowSum + n * m * m;
+    float rms = isqrt((uint32_t) (deviation / n));
+
+    windowCount = 0;
+    windowMin = INT32_MAX;
+    windowMax = INT32_MIN;
+    windowSum = 0;
+    windowSumSquares = 0;
+
+    /*******************************
+    *   CALCULATE SPL
+    ******************************/
+    // 8 bit samples are scaled up to 16 bit equivalents. All other formats are measured as 16 bit values.
+    if (gain != splOffsetGain || format != splOffsetFormat)
+    {
+        float multiplier = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format) == 1 ? 256.0f : 1.0f;
         float pref = 0.00002;
 
-        /*******************************
-        *   GET MAX VALUE
-        ******************************/
-        int16_t maxVal = 0;
-        int16_t minVal = 32766;
-        int32_t v;
-        ptr = data;
-        while (ptr < end) {
-            v = (int32_t) StreamNormalizer::readSample[format](ptr);
-            if (v > maxVal) maxVal = v;
-            if (v < minVal) minVal = v;
-            ptr += skip;
-        }
-        maxVal = (maxVal - minVal) / 2;
-
-        /*******************************
-        *   GET RMS AMPLITUDE FOR CLAP DETECTION
-        ******************************/
-        int sumSquares = 0;
-        int count = 0;
-        ptr = data;
-        while (ptr < end) {
-            count++;
-            v = (int32_t) StreamNormalizer::readSample[format](ptr) - minVal;   // need to sub minVal to avoid overflow
-            sumSquares += v * v;
-            ptr += skip;
-        }
-        float rms = sqrt(sumSquares / count);
-
-        /*******************************
-        *   CALCULATE SPL
-        ******************************/
-        float conv = ((float) maxVal * multiplier) / ((1 << 15) - 1) * gain;
-        conv = 20 * log10(conv / pref);
-
-        if (conv < minValue)
-            level = minValue;
-        else if (isfinite(conv))
-            level = conv;
-        else
-            level = minValue;
+        splOffset = 20 * log10(multiplier * gain / (((1 << 15) - 1) * pref));
+        splOffsetGain = gain;
+        splOffsetFormat = format;
+    }
 
-        samples -= windowSize;
-        data += windowSize;
+    float conv = maxVal > 0 ? (float) amplitude_to_db(maxVal) / 256.0f + splOffset : minValue;
 
-        /*******************************
-        *   EMIT EVENTS
-        ******************************/
+    if (conv < minValue)
+        level = minValue;
+    else if (isfinite(conv))
+        level = conv;
+    else
+        level = minValue;
 
-        if( this->bufferCount < LEVEL_DETECTOR_SPL_MIN_BUFFERS ) {
-            this->bufferCount++; // Here to prevent this endlessly increasing
-            return DEVICE_OK;
-        }
-        if( this->resourceLock.getWaitCount() > 0 )
-            this->resourceLock.notifyAll();
+    /*******************************
+    *   EMIT EVENTS
+    ******************************/
 
-        // HIGH THRESHOLD
-        if ((!(status & LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED)) && level > highThreshold)
-        {
-            Event(id, LEVEL_THRESHOLD_HIGH);
-            status |=  LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
-            status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
-        }
+    if( this->bufferCount < LEVEL_DETECTOR_SPL_MIN_BUFFERS )
+        return;
 
-        // LOW THRESHOLD
-        else if ((!(status & LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED)) && level < lowThreshold)
-        {
-            Event(id, LEVEL_THRESHOLD_LOW);
-            status |=  LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
-            status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
-        }
+    if( this->resourceLock.getWaitCount() > 0 )
+        this->resourceLock.notifyAll();
 
-        // CLAP DETECTION HANDLING
-        if (this->inNoisyBlock && rms > this->maxRms) this->maxRms = rms;
-
-        if (
-            (       // if start of clap
-                    !this->inNoisyBlock &&
-                    rms > LEVEL_DETECTOR_SPL_BEGIN_POSS_CLAP_RMS &&
-                    this->quietBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_QUIET_BLOCKS
-            ) ||
-            (       // or if continuing a clap
-                    this->inNoisyBlock &&
-                    rms > LEVEL_DETECTOR_SPL_CLAP_OVER_RMS
-            )) {
-            // noisy block
-            if (!this->inNoisyBlock)
-                this->maxRms = rms;
-            this->quietBlockCount = 0;
-            this->noisyBlockCount += 1;
-            this->inNoisyBlock = true;
-
-        } else {
-            // quiet block
-            if (    // if not too long, not too short, and loud enough
-                    this->noisyBlockCount <= LEVEL_DETECTOR_SPL_CLAP_MAX_LOUD_BLOCKS &&
-                    this->noisyBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_LOUD_BLOCKS &&
-                    this->maxRms >= LEVEL_DETECTOR_SPL_MIN_IN_CLAP_RMS
-                    ) {
-                Event(id, LEVEL_DETECTOR_SPL_CLAP);
-            }
-            this->inNoisyBlock = false;
-            this->noisyBlockCount = 0;
-            this->quietBlockCount += 1;
-            this->maxRms = 0;
-        }
+    // HIGH THRESHOLD
+    if ((!(status & LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED)) && level > highThreshold)
+    {
+        Event(id, LEVEL_THRESHOLD_HIGH);
+        status |=  LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+        status &= ~LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
     }
 
-    return DEVICE_OK;
+    // LOW THRESHOLD
+    else if ((!(status & LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED)) && level < lowThreshold)
+    {
+        Event(id, LEVEL_THRESHOLD_LOW);
+        status |=  LEVEL_DETECTOR_SPL_LOW_THRESHOLD_PASSED;
+        status &= ~LEVEL_DETECTOR_SPL_HIGH_THRESHOLD_PASSED;
+    }
+
+    // CLAP DETECTION HANDLING
+    if (this->inNoisyBlock && rms > this->maxRms) this->maxRms = rms;
+
+    if (
+        (       // if start of clap
+                !this->inNoisyBlock &&
+                rms > LEVEL_DETECTOR_SPL_BEGIN_POSS_CLAP_RMS &&
+                this->quietBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_QUIET_BLOCKS
+        ) ||
+        (       // or if continuing a clap
+                this->inNoisyBlock &&
+                rms > LEVEL_DETECTOR_SPL_CLAP_OVER_RMS
+        )) {
+        // noisy block
+        if (!this->inNoisyBlock)
+            this->maxRms = rms;
+        this->quietBlockCount = 0;
+        this->noisyBlockCount += 1;
+        this->inNoisyBlock = true;
+
+    } else {
+        // quiet block
+        if (    // if not too long, not too short, and loud enough
+                this->noisyBlockCount <= LEVEL_DETECTOR_SPL_CLAP_MAX_LOUD_BLOCKS &&
+                this->noisyBlockCount >= LEVEL_DETECTOR_SPL_CLAP_MIN_LOUD_BLOCKS &&
+                this->maxRms >= LEVEL_DETECTOR_SPL_MIN_IN_CLAP_RMS
+                ) {
+            Event(id, LEVEL_DETECTOR_SPL_CLAP);
+        }
+        this->inNoisyBlock = false;
+        this->noisyBlockCount = 0;
+        this->quietBlockCount += 1;
+        this->maxRms = 0;
+    }
 }
 
 float LevelDetectorSPL::getValue( int scale )
@@ -25,13 +25,176 @@ DEALINGS IN THE SOFTWARE.
 #include "Mixer.h"
 #include "ErrorNo.h"
 #include "CodalDmesg.h"
+#include "Timer.h"
 
 using namespace codal;
 
+/*
+ * Accumulates a block of samples from a single channel into the mix buffer.
+ *
+ * Each sample is converted from the given format, centred on zero, reduced to at most 16 significant bits
+ * and multiplied by a gain that places a full scale sample at +/-2^25 for a channel volume of 1024.
+ * This leaves 6 bits of headroom in the accumulator, so up to 64 full scale channels can be summed without overflow,
+ * provided no sample exceeds the given number of bits.
+ * Loops are unrolled four samples at a time, and 16 bit data is read two samples per 32 bit word.
+ */
+static void mix_samples(int32_t *acc, uint8_t *data, int count, int format, int bits, int volume)
+{
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    bool isSigned = format == DATASTREAM_FORMAT_8BIT_SIGNED || format == DATASTREAM_FORMAT_16BIT_SIGNED || format == DATASTREAM_FORMAT_24BIT_SIGNED || format == DATASTREAM_FORMAT_32BIT_SIGNED;
+
+    bits = max(1, min(bits, bytesPerSample * 8));
+
+    int shift = bits > 16 ? bits - 16 : 0;
+    int32_t gain = volume << (16 - (bits - shift));
+    uint32_t offset = isSigned ? 0 : 1UL << (bits - 1);
+    int32_t *end = acc + count;
+
+    switch (bytesPerSample)
+    {
+        case 1:
+        {
+            if (isSigned)
+            {
+                int8_t *p = (int8_t *) data;
+
+                while (acc + 4 <= end)
+                {
+                    acc[0] += p[0] * gain;
+                    acc[1] += p[1] * gain;
+                    acc[2] += p[2] * gain;
+                    acc[3] += p[3] * gain;
+                    acc += 4;
+                    p += 4;
+                }
+
+                while (acc < end)
+                    *acc++ += *p++ * gain;
+            }
+            else
+            {
+                uint8_t *p = data;
+                int32_t o = offset;
+
+                while (acc + 4 <= end)
+                {
+                    acc[0] += (p[0] - o) * gain;
+                    acc[1] += (p[1] - o) * gain;
+                    acc[2] += (p[2] - o) * gain;
+                    acc[3] += (p[3] - o) * gain;
+                    acc += 4;
+                    p += 4;
+                }
+
+                while (acc < end)
+                    *acc++ += (*p++ - o) * gain;
+            }
+            break;
+        }
+
+        case 2:
+        {
+            int32_t o = offset;
+            uint16_t *p = (uint16_t *) data;
+
+            // Word aligned data is processed as pairs of 16 bit samples packed into each 32 bit load.
+            if (((uintptr_t) p & 3) == 0)
+            {
+                uint32_t *w = (uint32_t *) p;
+
+                if (isSigned)
+                {
+                    while (acc + 4 <= end)
+                    {
+                        uint32_t a = w[0];
+                        uint32_t b = w[1];
+
+                        acc[0] += (int16_t) a * gain;
+                        acc[1] += ((int32_t) a >> 16) * gain;
+                        acc[2] += (int16_t) b * gain;
+                        acc[3] += ((int32_t) b >> 16) * gain;
+                        acc += 4;
+                        w += 2;
+                    }
+                }
+                else
+                {
+                    while (acc + 4 <= end)
+                    {
+                        uint32_t a = w[0];
+                        uint32_t b = w[1];
+
+                        acc[0] += ((int32_t) (a & 0xFFFF) - o) * gain;
+                        acc[1] += ((int32_t) (a >> 16) - o) * gain;
+                        acc[2] += ((int32_t) (b & 0xFFFF) - o) * gain;
+                        acc[3] += ((int32_t) (b >> 16) - o) * gain;
+                        acc += 4;
+                        w += 2;
+                    }
+                }
+
+                p = (uint16_t *) w;
+            }
+
+            if (isSigned)
+            {
+                while (acc < end)
+                    *acc++ += *(int16_t *) p++ * gain;
+            }
+            else
+            {
+                while (acc < end)
+                    *acc++ += (*p++ - o) * gain;
+            }
+            break;
+        }
+
+        case 3:
+        {
+            uint8_t *p = data;
+
+            while (acc < end)
+            {
+                uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+
+                if (isSigned)
+                    v = (uint32_t) (((int32_t) (v << 8)) >> 8);
+
+                *acc++ += ((int32_t) (v - offset) >> shift) * gain;
+                p += 3;
+            }
+            break;
+        }
+
+        case 4:
+        {
+            uint32_t *p = (uint32_t *) data;
+
+            while (acc + 4 <= end)
+            {
+                acc[0] += ((int32_t) (p[0] - offset) >> shift) * gain;
+                acc[1] += ((int32_t) (p[1] - offset) >> shift) * gain;
+                acc[2] += ((int32_t) (p[2] - offset) >> shift) * gain;
+                acc[3] += ((int32_t) (p[3] - offset) >> shift) * gain;
+                acc += 4;
+                p += 4;
+            }
+
+            while (acc < end)
+                *acc++ += ((int32_t) (*p++ - offset) >> shift) * gain;
+            break;
+        }
+    }
+}
+
 Mixer::Mixer()
 {
     channels = NULL;
     downStream = NULL;
+    outputFormat = DATASTREAM_FORMAT_16BIT_UNSIGNED;
+    outputBits = MIXER_DEFAULT_SAMPLE_BITS;
+    requestedBits = MIXER_DEFAULT_SAMPLE_BITS;
+    resetStatistics();
 }
 
 Mixer::~Mixer()
@@ -52,6 +215,7 @@ MixerChannel *Mixer::addChannel(DataStream &stream)
     c->next = channels;
     c->volume = 1024;
     c->isSigned = true;
+    c->bits = 0;
     channels = c;
     stream.connect(*this);
     return c;
@@ -61,38 +225,117 @@ ManagedBuffer Mixer::pull() {
     if (!channels)
         return ManagedBuffer(512);
 
-    ManagedBuffer sum;
+    CODAL_TIMESTAMP start = system_timer_current_time_us();
+
     MixerChannel *next;
+    int samples = 0;
 
     for (auto ch = channels; ch; ch = next) {
         next = ch->next; // save next in case the current channel gets deleted
-        bool isSigned = ch->isSigned;
-        int vol = ch->volume;
         ManagedBuffer data = ch->stream->pull();
-        if (sum.length() < data.length()) {
-            ManagedBuffer newsum(data.length());
-            newsum.writeBuffer(0, sum);
-            sum = newsum;
+
+        // Channels that don't describe their data are assumed to hold MIXER_DEFAULT_SAMPLE_BITS samples in 16 bits, as determined by isSigned.
+        // Otherwise, samples have the depth set on the channel, or reported by the stream, or the full width of their format.
+        int format = ch->stream->getFormat();
+        int bits = ch->bits ? ch->bits : ch->stream->getSampleBits();
+
+        if (format == DATASTREAM_FORMAT_UNKNOWN) {
+            format = ch->isSigned ? DATASTREAM_FORMAT_16BIT_SIGNED : DATASTREAM_FORMAT_16BIT_UNSIGNED;
+            if (bits == 0)
+                bits = MIXER_DEFAULT_SAMPLE_BITS;
         }
-        auto d = (int16_t*)&data[0];
-        auto s = (int16_t*)&sum[0];
-        auto len = data.length() >> 1;
-        while (len--) {
-            int v = isSigned ? *d : *(uint16_t*)d - 512;
-            v = ((v * vol) + (*s << 10)) >> 10;
-            if (v < -512) v = -512;
-            if (v > 511) v = 511;
-            *s = v;
-            d++;
-            s++;
+
+        if (bits == 0)
+            bits = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format) * 8;
+
+        int count = data.length() / DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+        // Extend the mix with silence if this channel is longer than those before it.
+        if (count > samples) {
+            int size = count * sizeof(int32_t);
+
+            if (accumulator.length() < size) {
+                ManagedBuffer b(size, BufferInitialize::None);
+                b.writeBuffer(0, accumulator, 0, samples * sizeof(int32_t));
+                accumulator = b;
+            }
+
+            memclr(&accumulator[samples * sizeof(int32_t)], (count - samples) * sizeof(int32_t));
+            samples = count;
         }
+
+        mix_samples((int32_t *) accumulator.getBytes(), data.getBytes(), count, format, bits, ch->volume);
     }
 
-    auto s = (int16_t*)&sum[0];
-    auto len = sum.length() >> 1;
-    while (len--)
-        *s++ += 512;
-        
+    // Scale down to the output range, saturate, and apply the unsigned offset if required.
+    int32_t *acc = (int32_t *) accumulator.getBytes();
+    int32_t *end = acc + samples;
+    int shift = 26 - outputBits;
+    int32_t maxValue = (1 << (outputBits - 1)) - 1;
+    int32_t minValue = -maxValue - 1;
+    int32_t offset = (outputFormat & 1) ? maxValue + 1 : 0;
+    uint32_t clipped = 0;
+
+    while (acc < end) {
+        int32_t v = *acc >> shift;
+
+        if (v > maxValue) {
+            v = maxValue;
+            clipped++;
+        }
+        else if (v < minValue) {
+            v = minValue;
+            clipped++;
+        }
+
+        *acc++ = v + offset;
+    }
+
+    // Pack into the output container.
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat);
+    ManagedBuffer sum(samples * bytesPerSample, BufferInitialize::None);
+    uint8_t *out = sum.getBytes();
+
+    acc = (int32_t *) accumulator.getBytes();
+
+    switch (bytesPerSample) {
+        case 1:
+            while (acc < end)
+                *out++ = *acc++;
+            break;
+
+        case 2:
+        {
+            uint16_t *o = (uint16_t *) out;
+            while (acc < end)
+                *o++ = *acc++;
+            break;
+        }
+
+        case 3:
+            while (acc < end) {
+                int32_t v = *acc++;
+                *out++ = v;
+                *out++ = v >> 8;
+                *out++ = v >> 16;
+            }
+            break;
+
+        default:
+            memcpy(out, acc, samples * sizeof(int32_t));
+            break;
+    }
+
+    uint32_t elapsed = (uint32_t) (system_timer_current_time_us() - start);
+
+    stats.pulls++;
+    stats.samples += samples;
+    stats.clipped += clipped;
+    stats.lastPullUs = elapsed;
+    stats.totalPullUs += elapsed;
+    if (elapsed > stats.maxPullUs)
+        stats.maxPullUs = elapsed;
+
     return sum;
 }
 
@@ -114,4 +357,49 @@ void Mixer::connect(DataSink &sink)
 bool Mixer::isConnected()
 {
     return this->downStream != NULL;
-}
\ No newline at end of file
+}
+
+int Mixer::getFormat()
+{
+    return outputFormat;
+}
+
+int Mixer::setFormat(int format)
+{
+    if (format <= DATASTREAM_FORMAT_UNKNOWN || format > DATASTREAM_FORMAT_32BIT_SIGNED)
+        return DEVICE_INVALID_PARAMETER;
+
+    outputFormat = format;
+    outputBits = min(requestedBits, DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format) * 8);
+    return DEVICE_OK;
+}
+
+int Mixer::getSampleBits()
+{
+    return outputBits;
+}
+
+int Mixer::setOutputBits(int bits)
+{
+    if (bits < 2 || bits > MIXER_MAXIMUM_OUTPUT_BITS)
+        return DEVICE_INVALID_PARAMETER;
+
+    requestedBits = bits;
+    outputBits = min(requestedBits, DATASTREAM_FORMAT_BYTES_PER_SAMPLE(outputFormat) * 8);
+    return DEVICE_OK;
+}
+
+int Mixer::getOutputBits()
+{
+    return outputBits;
+}
+
+const MixerStatistics &Mixer::getStatistics()
+{
+    return stats;
+}
+
+void Mixer::resetStatistics()
+{
+    memclr(&stats, sizeof(stats));
+}
@@ -0,0 +1,285 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "CodalConfig.h"
+#include "MotionStream.h"
+#include "EventModel.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+static inline int16_t clamp_16(int v)
+{
+    if (v > 32767)
+        return 32767;
+
+    if (v < -32768)
+        return -32768;
+
+    return v;
+}
+
+/**
+ * Constructor.
+ * Creates a stream of readings from the given accelerometer, and ensures it is being sampled.
+ *
+ * @param accelerometer The accelerometer to read.
+ * @param blockSize The number of readings in each buffer.
+ * @param axes The axes to include. A combination of MOTION_STREAM_AXIS_X, MOTION_STREAM_AXIS_Y and MOTION_STREAM_AXIS_Z.
+ */
+MotionStream::MotionStream(Accelerometer &accelerometer, int blockSize, int axes)
+{
+    this->accelerometer = &accelerometer;
+    this->gyroscope = NULL;
+
+    init(accelerometer.id, ACCELEROMETER_EVT_DATA_UPDATE, blockSize, axes);
+
+    // Ensure the sensor is being sampled in the background.
+    accelerometer.requestUpdate();
+}
+
+/**
+ * Constructor.
+ * Creates a stream of readings from the given gyroscope, and ensures it is being sampled.
+ *
+ * @param gyroscope The gyroscope to read.
+ * @param blockSize The number of readings in each buffer.
+ * @param axes The axes to include. A combination of MOTION_STREAM_AXIS_X, MOTION_STREAM_AXIS_Y and MOTION_STREAM_AXIS_Z.
+ */
+MotionStream::MotionStream(Gyroscope &gyroscope, int blockSize, int axes)
+{
+    this->accelerometer = NULL;
+    this->gyroscope = &gyroscope;
+
+    init(gyroscope.id, GYROSCOPE_EVT_DATA_UPDATE, blockSize, axes);
+
+    // Ensure the sensor is being sampled in the background.
+    gyroscope.requestUpdate();
+}
+
+/**
+ * Common initialisation for all constructors.
+ */
+void MotionStream::init(uint16_t id, int value, int blockSize, int axes)
+{
+    this->downstream = NULL;
+    this->fill = 0;
+    this->overruns = 0;
+    this->axes = axes & MOTION_STREAM_AXIS_ALL;
+
+    if (this->axes == 0)
+        this->axes = MOTION_STREAM_AXIS_ALL;
+
+    this->channels = ((this->axes & MOTION_STREAM_AXIS_X) ? 1 : 0) + ((this->axes & MOTION_STREAM_AXIS_Y) ? 1 : 0) + ((this->axes & MOTION_STREAM_AXIS_Z) ? 1 : 0);
+    this->blockSize = 0;
+
+    if (setBlockSize(blockSize) != DEVICE_OK)
+        setBlockSize(MOTION_STREAM_DEFAULT_BLOCK_SIZE);
+
+    if (EventModel::defaultEventBus)
+        EventModel::defaultEventBus->listen(id, value, this, &MotionStream::onData, MESSAGE_BUS_LISTENER_IMMEDIATE);
+}
+
+/**
+ * Destructor.
+ */
+MotionStream::~MotionStream()
+{
+    if (EventModel::defaultEventBus)
+    {
+        if (accelerometer)
+            EventModel::defaultEventBus->ignore(accelerometer->id, ACCELEROMETER_EVT_DATA_UPDATE, this, &MotionStream::onData);
+
+        if (gyroscope)
+            EventModel::defaultEventBus->ignore(gyroscope->id, GYROSCOPE_EVT_DATA_UPDATE, this, &MotionStream::onData);
+    }
+}
+
+/**
+ * Defines the number of readings packed into each buffer. Any partially filled buffer is discarded.
+ *
+ * @param samples The number of readings in each buffer.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int MotionStream::setBlockSize(int samples)
+{
+    // Each buffer must fit within the 16 bit length of a ManagedBuffer.
+    if (samples < 1 || samples * channels * (int)sizeof(int16_t) > 0xFFFF)
+        return DEVICE_INVALID_PARAMETER;
+
+    blockSize = samples;
+    fill = 0;
+    block = ManagedBuffer();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of completed buffers that were dropped because they were not pulled before the next was completed.
+ */
+uint32_t MotionStream::getOverruns()
+{
+    return overruns;
+}
+
+/**
+ * Appends a single reading to the buffer being filled, passing the buffer downstream when full.
+ */
+void MotionStream::append(const Sample3D &s)
+{
+    if (fill == 0)
+        block = ManagedBuffer(blockSize * channels * sizeof(int16_t), BufferInitialize::None);
+
+    int16_t *out = (int16_t *) block.getBytes() + fill * channels;
+
+    if (axes & MOTION_STREAM_AXIS_X)
+        *out++ = clamp_16(s.x);
+
+    if (axes & MOTION_STREAM_AXIS_Y)
+        *out++ = clamp_16(s.y);
+
+    if (axes & MOTION_STREAM_AXIS_Z)
+        *out++ = clamp_16(s.z);
+
+    if (++fill < blockSize)
+        return;
+
+    // Hand the completed buffer on. If the previous one is still waiting, it is replaced, so the stream never lags behind the sensor.
+    if (ready.length() > 0)
+        overruns++;
+
+    ready = block;
+    block = ManagedBuffer();
+    fill = 0;
+
+    if (downstream)
+        downstream->pullRequest();
+}
+
+/**
+ * Handles new data from the sensor.
+ */
+void MotionStream::onData(Event)
+{
+    if (accelerometer)
+    {
+        if (accelerometer->getBatchSize() > 1)
+        {
+            ManagedBuffer b = accelerometer->getBatch();
+            Sample3D *s = (Sample3D *) b.getBytes();
+            int count = b.length() / sizeof(Sample3D);
+
+            for (int i = 0; i < count; i++)
+                append(s[i]);
+        }
+        else
+        {
+            append(accelerometer->getSample());
+        }
+    }
+
+    if (gyroscope)
+        append(gyroscope->getSample());
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer MotionStream::pull()
+{
+    ManagedBuffer b = ready;
+    ready = ManagedBuffer();
+
+    return b;
+}
+
+/**
+ * Allow our downstream component to register itself with us
+ */
+void MotionStream::connect(DataSink &sink)
+{
+    this->downstream = &sink;
+}
+
+/**
+ * Determines if this source is connected to a downstream component
+ *
+ * @return true If a downstream is connected
+ * @return false If a downstream is not connected
+ */
+bool MotionStream::isConnected()
+{
+    return this->downstream != NULL;
+}
+
+/**
+ * Disconnects the downstream component.
+ */
+void MotionStream::disconnect()
+{
+    this->downstream = NULL;
+}
+
+/**
+ *  Determine the data format of the buffers streamed out of this component.
+ */
+int MotionStream::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+/**
+ * Determines the rate of the stream, in values per second. This is the sample rate of the sensor multiplied by the number of axes included.
+ */
+float MotionStream::getSampleRate()
+{
+    int period = accelerometer ? accelerometer->getPeriod() : gyroscope->getPeriod();
+
+    if (period <= 0)
+        return DATASTREAM_SAMPLE_RATE_UNKNOWN;
+
+    return (1000.0f * channels) / period;
+}
+
+/**
+ * Requests a new sample rate for the sensor.
+ *
+ * @param sampleRate The requested rate, in values per second (as returned by getSampleRate()).
+ * @return The actual rate the stream will now run at.
+ */
+float MotionStream::requestSampleRate(float sampleRate)
+{
+    if (sampleRate > 0)
+    {
+        int period = max(1, (int)((1000.0f * channels) / sampleRate));
+
+        if (accelerometer)
+            accelerometer->setPeriod(period);
+        else
+            gyroscope->setPeriod(period);
+    }
+
+    return getSampleRate();
+}
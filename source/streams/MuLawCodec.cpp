@@ -0,0 +1,127 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "MuLawCodec.h"
+
+using namespace codal;
+
+#define MULAW_BIAS      0x84
+#define MULAW_CLIP      32635
+
+MuLawEncoder::MuLawEncoder(DataSource &source) : AudioCodec(source)
+{
+}
+
+int MuLawEncoder::getFormat()
+{
+    return DATASTREAM_FORMAT_8BIT_UNSIGNED;
+}
+
+/**
+ * Encodes a single signed 16 bit sample.
+ */
+uint8_t MuLawEncoder::encode(int16_t sample)
+{
+    int32_t x = sample;
+    uint8_t sign = 0;
+
+    if (x < 0)
+    {
+        x = -x;
+        sign = 0x80;
+    }
+
+    if (x > MULAW_CLIP)
+        x = MULAW_CLIP;
+
+    x += MULAW_BIAS;
+
+    // x is now in the range 0x84..0x7fff; the segment is given by its highest set bit (7..14).
+    int exponent = (31 - __builtin_clz(x)) - 7;
+    int mantissa = (x >> (exponent + 3)) & 0x0f;
+
+    return ~(sign | (exponent << 4) | mantissa);
+}
+
+ManagedBuffer MuLawEncoder::process(ManagedBuffer input)
+{
+    ManagedBuffer samples = toSigned16(input, upStream.getFormat());
+    int count = samples.length() / sizeof(int16_t);
+    ManagedBuffer output(count, BufferInitialize::None);
+
+    int16_t *in = (int16_t *) samples.getBytes();
+    uint8_t *out = output.getBytes();
+    uint8_t *end = out + count;
+
+    while (out < end)
+        *out++ = encode(*in++);
+
+    return output;
+}
+
+MuLawDecoder::MuLawDecoder(DataSource &source) : AudioCodec(source)
+{
+}
+
+int MuLawDecoder::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_SIGNED;
+}
+
+/**
+ * Decodes a single mu-law byte.
+ */
+int16_t MuLawDecoder::decode(uint8_t code)
+{
+    code = ~code;
+
+    int exponent = (code >> 4) & 0x07;
+    int32_t x = ((((code & 0x0f) << 3) + MULAW_BIAS) << exponent) - MULAW_BIAS;
+
+    return (code & 0x80) ? -x : x;
+}
+
+/**
+ * Each byte expands to a 16 bit sample, so limit each pull to what fits in a single ManagedBuffer.
+ */
+int MuLawDecoder::getMaxInputLength()
+{
+    return 0xFFFF / sizeof(int16_t);
+}
+
+ManagedBuffer MuLawDecoder::process(ManagedBuffer input)
+{
+    int count = input.length();
+    ManagedBuffer output(count * sizeof(int16_t), BufferInitialize::None);
+
+    uint8_t *in = input.getBytes();
+    int16_t *out = (int16_t *) output.getBytes();
+    int16_t *end = out + count;
+
+    while (out < end)
+        *out++ = decode(*in++);
+
+    return output;
+}
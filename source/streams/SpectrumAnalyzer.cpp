@@ -0,0 +1,558 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalConfig.h"
+#include "Event.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+#include "SpectrumAnalyzer.h"
+
+using namespace codal;
+
+// sin(i * pi / 512) in Q15 format, for i in 0..256: the first quadrant of a 1024 point circle.
+// This provides the twiddle factors for every supported FFT size, and the Hann window.
+static const int16_t quarterSine[257] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210, 2411, 2611, 2811, 3012,
+    3212, 3412, 3612, 3812, 4011, 4211, 4410, 4609, 4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195,
+    6393, 6590, 6787, 6983, 7180, 7376, 7571, 7767, 7962, 8157, 8351, 8546, 8740, 8933, 9127, 9319,
+    9512, 9704, 9896, 10088, 10279, 10469, 10660, 10850, 11039, 11228, 11417, 11605, 11793, 11980, 12167, 12354,
+    12540, 12725, 12910, 13095, 13279, 13463, 13646, 13828, 14010, 14192, 14373, 14553, 14733, 14912, 15091, 15269,
+    15447, 15624, 15800, 15976, 16151, 16326, 16500, 16673, 16846, 17018, 17190, 17361, 17531, 17700, 17869, 18037,
+    18205, 18372, 18538, 18703, 18868, 19032, 19195, 19358, 19520, 19681, 19841, 20001, 20160, 20318, 20475, 20632,
+    20788, 20943, 21097, 21251, 21403, 21555, 21706, 21856, 22006, 22154, 22302, 22449, 22595, 22740, 22884, 23028,
+    23170, 23312, 23453, 23593, 23732, 23870, 24008, 24144, 24279, 24414, 24548, 24680, 24812, 24943, 25073, 25202,
+    25330, 25457, 25583, 25708, 25833, 25956, 26078, 26199, 26320, 26439, 26557, 26674, 26791, 26906, 27020, 27133,
+    27246, 27357, 27467, 27576, 27684, 27791, 27897, 28002, 28106, 28209, 28311, 28411, 28511, 28610, 28707, 28803,
+    28899, 28993, 29086, 29178, 29269, 29359, 29448, 29535, 29622, 29707, 29792, 29875, 29957, 30038, 30118, 30196,
+    30274, 30350, 30425, 30499, 30572, 30644, 30715, 30784, 30853, 30920, 30986, 31050, 31114, 31177, 31238, 31298,
+    31357, 31415, 31471, 31527, 31581, 31634, 31686, 31737, 31786, 31834, 31881, 31927, 31972, 32015, 32058, 32099,
+    32138, 32177, 32214, 32251, 32286, 32319, 32352, 32383, 32413, 32442, 32470, 32496, 32522, 32546, 32568, 32590,
+    32610, 32629, 32647, 32664, 32679, 32693, 32706, 32718, 32729, 32738, 32746, 32753, 32758, 32762, 32766, 32767,
+    32767
+};
+
+/*
+ * sin(index * pi / 512) in Q15 format, for index in 0..512.
+ */
+static inline int32_t sine(int index)
+{
+    return index <= 256 ? quarterSine[index] : quarterSine[512 - index];
+}
+
+/*
+ * cos(index * pi / 512) in Q15 format, for index in 0..1023.
+ */
+static inline int32_t cosine(int index)
+{
+    if (index > 512)
+        index = 1024 - index;
+
+    return index <= 256 ? quarterSine[256 - index] : -quarterSine[index - 256];
+}
+
+static inline int32_t absolute(int32_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+/**
+  * Creates a component that analyses the frequency content of a stream.
+  *
+  * @param source a DataSource to receive data from.
+  * @param size The number of samples in each frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_SIZE and SPECTRUM_ANALYZER_MAX_SIZE.
+  * @param hop The number of new samples between consecutive frames, in the range 1..size. Defaults to size / 2 (50% overlap).
+  * @param id The id to use for the message bus when transmitting events.
+  */
+SpectrumAnalyzer::SpectrumAnalyzer(DataSource &source, int size, int hop, uint16_t id) : upstream(source)
+{
+    this->id = id;
+    this->downstream = NULL;
+    this->size = 0;
+    this->hop = 0;
+    this->window = SPECTRUM_ANALYZER_WINDOW_HANN;
+    this->frameFill = 0;
+    this->frame = NULL;
+    this->real = NULL;
+    this->imaginary = NULL;
+    this->magnitudes = NULL;
+    this->peakBin = 0;
+    this->peakThreshold = 0;
+    this->peakHigh = false;
+    this->bandCount = 0;
+
+    if (setSize(size, hop) != DEVICE_OK)
+        setSize(SPECTRUM_ANALYZER_DEFAULT_SIZE);
+
+    upstream.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    release();
+}
+
+/**
+ * Releases the buffers used for analysis.
+ */
+void SpectrumAnalyzer::release()
+{
+    delete[] frame;
+    delete[] real;
+    delete[] imaginary;
+    delete[] magnitudes;
+
+    frame = NULL;
+    real = NULL;
+    imaginary = NULL;
+    magnitudes = NULL;
+    size = 0;
+}
+
+/**
+ * Changes the frame size and overlap of the analysis. Any partially collected frame is discarded.
+ *
+ * @param size The number of samples in each frame. Must be a power of two between SPECTRUM_ANALYZER_MIN_SIZE and SPECTRUM_ANALYZER_MAX_SIZE.
+ * @param hop The number of new samples between consecutive frames, in the range 1..size. Defaults to size / 2.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+ */
+int SpectrumAnalyzer::setSize(int size, int hop)
+{
+    if (size < SPECTRUM_ANALYZER_MIN_SIZE || size > SPECTRUM_ANALYZER_MAX_SIZE || (size & (size - 1)))
+        return DEVICE_INVALID_PARAMETER;
+
+    if (hop == 0)
+        hop = size / 2;
+
+    if (hop < 1 || hop > size)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (size != this->size)
+    {
+        release();
+
+        frame = new int16_t[size];
+        real = new int16_t[size];
+        imaginary = new int16_t[size];
+        magnitudes = new uint16_t[size / 2];
+
+        if (frame == NULL || real == NULL || imaginary == NULL || magnitudes == NULL)
+        {
+            release();
+            return DEVICE_NO_RESOURCES;
+        }
+
+        memclr(magnitudes, (size / 2) * sizeof(uint16_t));
+        this->size = size;
+        this->peakBin = 0;
+    }
+
+    this->hop = hop;
+    this->frameFill = 0;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Selects the window function applied to each frame.
+ *
+ * @param window SPECTRUM_ANALYZER_WINDOW_NONE or SPECTRUM_ANALYZER_WINDOW_HANN (the default).
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SpectrumAnalyzer::setWindow(int window)
+{
+    if (window != SPECTRUM_ANALYZER_WINDOW_NONE && window != SPECTRUM_ANALYZER_WINDOW_HANN)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->window = window;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the magnitude at which SPECTRUM_ANALYZER_EVT_PEAK events are raised.
+ * Set to zero (the default) to disable peak events.
+ */
+void SpectrumAnalyzer::setPeakThreshold(uint16_t threshold)
+{
+    this->peakThreshold = threshold;
+}
+
+/**
+ * Starts monitoring the energy in a range of frequencies.
+ *
+ * @param lowFrequency The lowest frequency in the band, in Hz.
+ * @param highFrequency The highest frequency in the band, in Hz.
+ * @param threshold The mean squared bin magnitude at which events are raised.
+ * @return The number of the band, or DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES.
+ */
+int SpectrumAnalyzer::addBand(float lowFrequency, float highFrequency, uint32_t threshold)
+{
+    if (lowFrequency < 0 || highFrequency < lowFrequency)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (bandCount >= SPECTRUM_ANALYZER_MAX_BANDS)
+        return DEVICE_NO_RESOURCES;
+
+    SpectrumBand &b = bands[bandCount];
+    b.lowFrequency = lowFrequency;
+    b.highFrequency = highFrequency;
+    b.threshold = threshold;
+    b.energy = 0;
+    b.high = false;
+
+    return bandCount++;
+}
+
+/**
+ * Determines the energy of a band in the most recent frame.
+ *
+ * @param band The band number, as returned by addBand().
+ * @return The mean squared magnitude of the bins in the band, or zero if the band is not valid.
+ */
+uint32_t SpectrumAnalyzer::getBandEnergy(int band)
+{
+    if (band < 0 || band >= bandCount)
+        return 0;
+
+    return bands[band].energy;
+}
+
+/**
+ * Determines the magnitude of a bin in the most recent frame.
+ *
+ * @param bin The bin, in the range 0..(size / 2 - 1).
+ * @return The magnitude of the bin, or zero if the bin is not valid.
+ */
+uint16_t SpectrumAnalyzer::getMagnitude(int bin)
+{
+    if (bin < 0 || bin >= size / 2)
+        return 0;
+
+    return magnitudes[bin];
+}
+
+/**
+ * Determines the bin with the greatest magnitude (excluding DC) in the most recent frame.
+ */
+int SpectrumAnalyzer::getPeakBin()
+{
+    return peakBin;
+}
+
+/**
+ * Determines the centre frequency of the bin with the greatest magnitude in the most recent frame.
+ *
+ * @return The frequency in Hz, or 0 if the sample rate of the stream is not known.
+ */
+float SpectrumAnalyzer::getPeakFrequency()
+{
+    float sampleRate = upstream.getSampleRate();
+
+    if (sampleRate <= 0 || size == 0)
+        return 0;
+
+    return (peakBin * sampleRate) / size;
+}
+
+/**
+ * Performs an in place, forward radix-2 FFT on Q15 data.
+ * Each stage is scaled by 1/2, so the result is the discrete fourier transform divided by size.
+ *
+ * @param real The real components of the data.
+ * @param imaginary The imaginary components of the data.
+ * @param size The number of points. Must be a power of two, no greater than SPECTRUM_ANALYZER_MAX_SIZE.
+ */
+void SpectrumAnalyzer::fft(int16_t *real, int16_t *imaginary, int size)
+{
+    // Reorder the input into bit reversed order.
+    for (int i = 1, j = 0; i < size; i++)
+    {
+        int bit = size >> 1;
+
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+
+        j ^= bit;
+
+        if (i < j)
+        {
+            int16_t t = real[i]; real[i] = real[j]; real[j] = t;
+            t = imaginary[i]; imaginary[i] = imaginary[j]; imaginary[j] = t;
+        }
+    }
+
+    // Decimation in time butterflies. Twiddles are read directly from the quarter sine table,
+    // striding through it according to the length of the current stage.
+    for (int length = 2; length <= size; length <<= 1)
+    {
+        int half = length >> 1;
+        int step = 1024 / length;
+
+        for (int k = 0; k < half; k++)
+        {
+            int32_t wr = cosine(k * step);
+            int32_t wi = -sine(k * step);
+
+            for (int i = k; i < size; i += length)
+            {
+                int j = i + half;
+
+                int32_t tr = (wr * real[j] - wi * imaginary[j]) >> 15;
+                int32_t ti = (wr * imaginary[j] + wi * real[j]) >> 15;
+                int32_t ur = real[i];
+                int32_t ui = imaginary[i];
+
+                real[i] = (ur + tr) >> 1;
+                imaginary[i] = (ui + ti) >> 1;
+                real[j] = (ur - tr) >> 1;
+                imaginary[j] = (ui - ti) >> 1;
+            }
+        }
+    }
+}
+
+/**
+ * Adds samples to the frame being collected, converting them into signed 16 bit values.
+ *
+ * @return The number of samples consumed.
+ */
+int SpectrumAnalyzer::collect(uint8_t *data, int count, int format)
+{
+    int n = min(count, size - frameFill);
+    int16_t *s = frame + frameFill;
+    int16_t *end = s + n;
+
+    switch (format)
+    {
+        case DATASTREAM_FORMAT_8BIT_UNSIGNED:
+            while (s < end)
+                *s++ = (*data++ - 128) << 8;
+            break;
+
+        case DATASTREAM_FORMAT_8BIT_SIGNED:
+            while (s < end)
+                *s++ = *(int8_t *) data++ << 8;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_UNSIGNED:
+            for (uint16_t *p = (uint16_t *) data; s < end; p++)
+                *s++ = *p ^ 0x8000;
+            break;
+
+        case DATASTREAM_FORMAT_16BIT_SIGNED:
+            memcpy(s, data, n * sizeof(int16_t));
+            break;
+
+        case DATASTREAM_FORMAT_24BIT_UNSIGNED:
+        case DATASTREAM_FORMAT_24BIT_SIGNED:
+        {
+            uint16_t mask = format == DATASTREAM_FORMAT_24BIT_UNSIGNED ? 0x8000 : 0;
+            for (; s < end; data += 3)
+                *s++ = (data[1] | (data[2] << 8)) ^ mask;
+            break;
+        }
+
+        default:
+        {
+            uint32_t mask = format == DATASTREAM_FORMAT_32BIT_UNSIGNED ? 0x8000 : 0;
+            for (uint32_t *p = (uint32_t *) data; s < end; p++)
+                *s++ = (*p >> 16) ^ mask;
+            break;
+        }
+    }
+
+    frameFill += n;
+    return n;
+}
+
+/**
+ * Analyses a complete frame, and raises any resulting events.
+ */
+void SpectrumAnalyzer::processFrame()
+{
+    int bins = size / 2;
+    int step = 1024 / size;
+
+    // Apply the window function.
+    if (window == SPECTRUM_ANALYZER_WINDOW_HANN)
+    {
+        for (int i = 0; i < size; i++)
+            real[i] = (frame[i] * ((32767 - cosine(i * step)) >> 1)) >> 15;
+    }
+    else
+    {
+        memcpy(real, frame, size * sizeof(int16_t));
+    }
+
+    memclr(imaginary, size * sizeof(int16_t));
+
+    fft(real, imaginary, size);
+
+    // Estimate the magnitude of each bin as max + 3/8 min (alpha max plus beta min), avoiding a square root.
+    int peak = 1;
+
+    for (int i = 0; i < bins; i++)
+    {
+        int32_t a = absolute(real[i]);
+        int32_t b = absolute(imaginary[i]);
+
+        magnitudes[i] = a > b ? a + ((3 * b) >> 3) : b + ((3 * a) >> 3);
+
+        if (i > 0 && magnitudes[i] > magnitudes[peak])
+            peak = i;
+    }
+
+    // Raise peak events when a new dominant frequency appears.
+    bool above = peakThreshold && magnitudes[peak] >= peakThreshold;
+
+    if (above && (peak != peakBin || !peakHigh))
+    {
+        peakBin = peak;
+        Event(id, SPECTRUM_ANALYZER_EVT_PEAK);
+    }
+
+    peakBin = peak;
+    peakHigh = above;
+
+    // Update the energy of each band, and raise events as thresholds are crossed.
+    float sampleRate = upstream.getSampleRate();
+
+    for (int b = 0; b < bandCount && sampleRate > 0; b++)
+    {
+        SpectrumBand &band = bands[b];
+
+        int low = max(0, (int)(band.lowFrequency * size / sampleRate + 0.5f));
+        int high = min(bins - 1, (int)(band.highFrequency * size / sampleRate + 0.5f));
+        uint64_t sum = 0;
+
+        for (int i = low; i <= high; i++)
+            sum += (uint32_t)(real[i] * real[i]) + (uint32_t)(imaginary[i] * imaginary[i]);
+
+        band.energy = high >= low ? sum / (high - low + 1) : 0;
+
+        if (!band.high && band.energy >= band.threshold)
+        {
+            band.high = true;
+            Event(id, SPECTRUM_ANALYZER_EVT_BAND_HIGH + b);
+        }
+
+        if (band.high && band.energy < band.threshold)
+        {
+            band.high = false;
+            Event(id, SPECTRUM_ANALYZER_EVT_BAND_LOW + b);
+        }
+    }
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int SpectrumAnalyzer::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+    int format = upstream.getFormat();
+
+    if (size == 0 || format == DATASTREAM_FORMAT_UNKNOWN)
+        return DEVICE_OK;
+
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+    int count = b.length() / bytesPerSample;
+    uint8_t *data = b.getBytes();
+
+    while (count > 0)
+    {
+        int n = collect(data, count, format);
+        data += n * bytesPerSample;
+        count -= n;
+
+        if (frameFill == size)
+        {
+            processFrame();
+
+            // Retain the overlapping part of the frame for the next analysis.
+            memmove(frame, frame + hop, (size - hop) * sizeof(int16_t));
+            frameFill = size - hop;
+
+            if (downstream)
+                downstream->pullRequest();
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provides the magnitude spectrum of the most recent frame, as (size / 2) 16 bit unsigned bins.
+ */
+ManagedBuffer SpectrumAnalyzer::pull()
+{
+    return ManagedBuffer((uint8_t *) magnitudes, (size / 2) * sizeof(uint16_t));
+}
+
+/**
+ * Define a downstream component for the magnitude spectra.
+ *
+ * @sink The component that data will be delivered to, when it is available
+ */
+void SpectrumAnalyzer::connect(DataSink &sink)
+{
+    downstream = &sink;
+}
+
+/**
+ * Determines if this source is connected to a downstream component
+ *
+ * @return true If a downstream is connected
+ * @return false If a downstream is not connected
+ */
+bool SpectrumAnalyzer::isConnected()
+{
+    return downstream != NULL;
+}
+
+/**
+ * Disconnects the downstream component.
+ */
+void SpectrumAnalyzer::disconnect()
+{
+    downstream = NULL;
+}
+
+/**
+ *  Determine the data format of the buffers streamed out of this component.
+ */
+int SpectrumAnalyzer::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+}
+
+/**
+ * Determines the rate at which magnitude spectra are produced, in frames per second.
+ */
+float SpectrumAnalyzer::getSampleRate()
+{
+    return hop ? upstream.getSampleRate() / hop : 0;
+}
@@ -57,6 +57,11 @@ int StreamFlowTrigger::getFormat()
     return this->upStream.getFormat();
 }
 
+int StreamFlowTrigger::getSampleBits()
+{
+    return this->upStream.getSampleBits();
+}
+
 int StreamFlowTrigger::setFormat( int format )
 {
     return this->upStream.setFormat( format );
@@ -142,6 +142,11 @@ int StreamRecording::getFormat()
     return this->upStream.getFormat();
 }
 
+int StreamRecording::getSampleBits()
+{
+    return this->upStream.getSampleBits();
+}
+
 int StreamRecording::setFormat( int format )
 {
     return this->upStream.setFormat( format );
@@ -157,6 +157,11 @@ int SplitterChannel::getFormat()
     return parent->upstream.getFormat();
 }
 
+int SplitterChannel::getSampleBits()
+{
+    return parent->upstream.getSampleBits();
+}
+
 int SplitterChannel::setFormat(int format)
 {
     return parent->upstream.setFormat( format );
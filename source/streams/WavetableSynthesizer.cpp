@@ -0,0 +1,593 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "WavetableSynthesizer.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+const int16_t WavetableSynthesizer::SineTable[256] = {0,804,1608,2410,3212,4011,4808,5602,6393,7179,7962,8739,9512,10278,11039,11793,12539,13279,14010,14732,15446,16151,16846,17530,18204,18868,19519,20159,20787,21403,22005,22594,23170,23731,24279,24811,25329,25832,26319,26790,27245,27683,28105,28510,28898,29268,29621,29956,30273,30571,30852,31113,31356,31580,31785,31971,32137,32285,32412,32521,32609,32678,32728,32757,32767,32757,32728,32678,32609,32521,32412,32285,32137,31971,31785,31580,31356,31113,30852,30571,30273,29956,29621,29268,28898,28510,28105,27683,27245,26790,26319,25832,25329,24811,24279,23731,23170,22594,22005,21403,20787,20159,19519,18868,18204,17530,16846,16151,15446,14732,14010,13279,12539,11793,11039,10278,9512,8739,7962,7179,6393,5602,4808,4011,3212,2410,1608,804,0,-804,-1608,-2410,-3212,-4011,-4808,-5602,-6393,-7179,-7962,-8739,-9512,-10278,-11039,-11793,-12539,-13279,-14010,-14732,-15446,-16151,-16846,-17530,-18204,-18868,-19519,-20159,-20787,-21403,-22005,-22594,-23170,-23731,-24279,-24811,-25329,-25832,-26319,-26790,-27245,-27683,-28105,-28510,-28898,-29268,-29621,-29956,-30273,-30571,-30852,-31113,-31356,-31580,-31785,-31971,-32137,-32285,-32412,-32521,-32609,-32678,-32728,-32757,-32767,-32757,-32728,-32678,-32609,-32521,-32412,-32285,-32137,-31971,-31785,-31580,-31356,-31113,-30852,-30571,-30273,-29956,-29621,-29268,-28898,-28510,-28105,-27683,-27245,-26790,-26319,-25832,-25329,-24811,-24279,-23731,-23170,-22594,-22005,-21403,-20787,-20159,-19519,-18868,-18204,-17530,-16846,-16151,-15446,-14732,-14010,-13279,-12539,-11793,-11039,-10278,-9512,-8739,-7962,-7179,-6393,-5602,-4808,-4011,-3212,-2410,-1608,-804};
+
+/**
+ * Default Constructor.
+ *
+ * @param sampleRate The sample rate at which this synthesizer will produce data.
+ * @param voices The number of simultaneous voices to support, up to WAVETABLE_SYNTHESIZER_MAX_VOICES.
+ * @param isSigned If true, samples are generated as DATASTREAM_FORMAT_16BIT_SIGNED, otherwise DATASTREAM_FORMAT_16BIT_UNSIGNED.
+ */
+WavetableSynthesizer::WavetableSynthesizer(int sampleRate, int voices, bool isSigned) : output(*this)
+{
+    this->sampleRate = sampleRate;
+    this->voiceCount = max(1, min(voices, WAVETABLE_SYNTHESIZER_MAX_VOICES));
+    this->isSigned = isSigned;
+    this->volume = 1024;
+    this->playing = false;
+    this->noteCount = 0;
+    this->seed = 0x2545F491;
+    this->bufferSize = 0;
+
+    for (int i = 0; i < WAVETABLE_SYNTHESIZER_MAX_VOICES; i++)
+    {
+        SynthesizerVoice &v = this->voices[i];
+
+        memclr(&v, sizeof(SynthesizerVoice));
+        v.table = SineTable;
+        v.tableShift = 24;
+        v.waveform = SYNTHESIZER_WAVEFORM_SINE;
+        v.stage = SYNTHESIZER_VOICE_IDLE;
+        v.gateSamples = -1;
+        v.attack = 2;
+        v.decay = 0;
+        v.sustain = 1024;
+        v.release = 20;
+    }
+
+    setBufferSize(WAVETABLE_SYNTHESIZER_BUFFER_SIZE);
+}
+
+/**
+ * Destructor.
+ * Removes all resources held by the instance.
+ */
+WavetableSynthesizer::~WavetableSynthesizer()
+{
+}
+
+/**
+ * Converts a period in milliseconds into a number of samples at the current sample rate.
+ */
+int32_t WavetableSynthesizer::msToSamples(int ms)
+{
+    return (ms / 1000) * sampleRate + ((ms % 1000) * sampleRate) / 1000;
+}
+
+/**
+ * Converts a frequency into a phase increment at the current sample rate.
+ */
+uint32_t WavetableSynthesizer::frequencyToDelta(float frequency)
+{
+    return (uint32_t) (frequency * (4294967296.0f / (float) sampleRate));
+}
+
+/**
+ * Advances a voice into the given envelope stage, calculating the length and gradient of that stage.
+ */
+void WavetableSynthesizer::enterStage(SynthesizerVoice &v, int stage)
+{
+    int32_t target;
+
+    v.stage = stage;
+    v.levelDelta = 0;
+    v.stageSamples = -1;
+
+    switch (stage)
+    {
+        case SYNTHESIZER_VOICE_ATTACK:
+            v.stageSamples = max(1, msToSamples(v.attack));
+            v.levelDelta = (v.peakLevel - v.level) / v.stageSamples;
+            break;
+
+        case SYNTHESIZER_VOICE_DECAY:
+            v.level = v.peakLevel;
+            target = (v.peakLevel >> 10) * v.sustain;
+            v.stageSamples = max(1, msToSamples(v.decay));
+            v.levelDelta = (target - v.level) / v.stageSamples;
+            break;
+
+        case SYNTHESIZER_VOICE_SUSTAIN:
+            v.level = (v.peakLevel >> 10) * v.sustain;
+
+            // A note with no sustain level is complete once its decay has finished.
+            if (v.level == 0)
+                v.stage = SYNTHESIZER_VOICE_IDLE;
+            break;
+
+        case SYNTHESIZER_VOICE_RELEASE:
+            v.stageSamples = max(1, msToSamples(v.release));
+            v.levelDelta = -(v.level / v.stageSamples);
+            break;
+
+        default:
+            v.stage = SYNTHESIZER_VOICE_IDLE;
+            v.level = 0;
+            v.gateSamples = -1;
+            break;
+    }
+}
+
+/**
+ * Renders the given number of samples of a voice into the accumulation buffer,
+ * ramping its envelope linearly. The envelope stage does not change during the call.
+ */
+void WavetableSynthesizer::renderVoice(SynthesizerVoice &v, int32_t *out, int samples)
+{
+    uint32_t phase = v.phase;
+    uint32_t delta = v.phaseDelta;
+    int32_t level = v.level;
+    int32_t levelDelta = v.levelDelta;
+    int32_t *end = out + samples;
+
+    // Each kernel keeps the waveform selection out of the inner loop.
+    // Samples are full scale 16 bit, scaled by the upper 15 bits of the Q24 envelope.
+    switch (v.waveform)
+    {
+        case SYNTHESIZER_WAVEFORM_SINE:
+        case SYNTHESIZER_WAVEFORM_CUSTOM:
+        {
+            const int16_t *table = v.table;
+            int shift = v.tableShift;
+
+            while (out < end)
+            {
+                *out++ += (table[phase >> shift] * (level >> 9)) >> 15;
+                phase += delta;
+                level += levelDelta;
+            }
+            break;
+        }
+
+        case SYNTHESIZER_WAVEFORM_SQUARE:
+            while (out < end)
+            {
+                int32_t amplitude = level >> 9;
+                *out++ += (int32_t) phase < 0 ? -amplitude : amplitude;
+                phase += delta;
+                level += levelDelta;
+            }
+            break;
+
+        case SYNTHESIZER_WAVEFORM_TRIANGLE:
+            while (out < end)
+            {
+                // Fold the phase about its midpoint to produce a ramp up and back down.
+                int32_t s = ((int32_t) (phase ^ ((int32_t) phase >> 31)) >> 15) - 32768;
+                *out++ += (s * (level >> 9)) >> 15;
+                phase += delta;
+                level += levelDelta;
+            }
+            break;
+
+        case SYNTHESIZER_WAVEFORM_SAWTOOTH:
+            while (out < end)
+            {
+                *out++ += (((int32_t) phase >> 16) * (level >> 9)) >> 15;
+                phase += delta;
+                level += levelDelta;
+            }
+            break;
+
+        case SYNTHESIZER_WAVEFORM_NOISE:
+        {
+            // Pitched noise: a new random value is latched sixteen times per waveform cycle.
+            int32_t s = v.noise;
+            uint32_t r = seed;
+
+            while (out < end)
+            {
+                uint32_t next = phase + delta;
+                if ((next ^ phase) >> 28)
+                {
+                    r ^= r << 13;
+                    r ^= r >> 17;
+                    r ^= r << 5;
+                    s = (int16_t) r;
+                }
+
+                *out++ += (s * (level >> 9)) >> 15;
+                phase = next;
+                level += levelDelta;
+            }
+
+            v.noise = s;
+            seed = r;
+            break;
+        }
+    }
+
+    v.phase = phase;
+    v.level = level;
+}
+
+/**
+ * Starts a new note on the next available voice.
+ * If all voices are busy, the voice closest to completion is reused.
+ *
+ * @param frequency The frequency of the note, in Hz.
+ * @param volume The peak amplitude of the note, in the range 0..1024.
+ * @param duration If greater than zero, the note is released automatically after the given number of milliseconds.
+ * @return The voice used to play the note, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::noteOn(float frequency, int volume, int duration)
+{
+    int voice = -1;
+
+    // Prefer an idle voice, then the quietest released voice, then the oldest note.
+    for (int i = 0; i < voiceCount; i++)
+    {
+        SynthesizerVoice &v = voices[i];
+
+        if (v.stage == SYNTHESIZER_VOICE_IDLE)
+        {
+            voice = i;
+            break;
+        }
+
+        if (voice < 0)
+        {
+            voice = i;
+            continue;
+        }
+
+        SynthesizerVoice &best = voices[voice];
+
+        if (v.stage == SYNTHESIZER_VOICE_RELEASE)
+        {
+            if (best.stage != SYNTHESIZER_VOICE_RELEASE || v.level < best.level)
+                voice = i;
+        }
+        else if (best.stage != SYNTHESIZER_VOICE_RELEASE && (int32_t)(v.age - best.age) < 0)
+        {
+            voice = i;
+        }
+    }
+
+    int result = noteOnVoice(voice, frequency, volume, duration);
+
+    return result == DEVICE_OK ? voice : result;
+}
+
+/**
+ * Starts a new note on the given voice, restarting its envelope.
+ *
+ * @param voice The voice to use.
+ * @param frequency The frequency of the note, in Hz.
+ * @param volume The peak amplitude of the note, in the range 0..1024.
+ * @param duration If greater than zero, the note is released automatically after the given number of milliseconds.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::noteOnVoice(int voice, float frequency, int volume, int duration)
+{
+    if (voice < 0 || voice >= voiceCount || frequency < 0.0f || frequency >= sampleRate / 2 || volume < 0 || volume > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    SynthesizerVoice &v = voices[voice];
+
+    v.phase = 0;
+    v.phaseDelta = frequencyToDelta(frequency);
+    v.peakLevel = volume << 14;
+    v.gateSamples = duration > 0 ? max(1, msToSamples(duration)) : -1;
+    v.age = ++noteCount;
+
+    // The attack stage ramps from the current level, so retriggering a voice does not click.
+    enterStage(v, SYNTHESIZER_VOICE_ATTACK);
+
+    if (!playing)
+    {
+        playing = true;
+        output.pullRequest();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Moves the given voice into the release stage of its envelope.
+ *
+ * @param voice The voice to release.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::noteOff(int voice)
+{
+    if (voice < 0 || voice >= voiceCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    SynthesizerVoice &v = voices[voice];
+
+    v.gateSamples = -1;
+
+    if (v.stage != SYNTHESIZER_VOICE_IDLE && v.stage != SYNTHESIZER_VOICE_RELEASE)
+        enterStage(v, SYNTHESIZER_VOICE_RELEASE);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Releases all voices.
+ */
+void WavetableSynthesizer::allNotesOff()
+{
+    for (int i = 0; i < voiceCount; i++)
+        noteOff(i);
+}
+
+/**
+ * Changes the frequency of a voice, without affecting its phase or envelope.
+ *
+ * @param voice The voice to update.
+ * @param frequency The new frequency, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::setFrequency(int voice, float frequency)
+{
+    if (voice < 0 || voice >= voiceCount || frequency < 0.0f || frequency >= sampleRate / 2)
+        return DEVICE_INVALID_PARAMETER;
+
+    voices[voice].phaseDelta = frequencyToDelta(frequency);
+    return DEVICE_OK;
+}
+
+/**
+ * Selects one of the built in waveforms for a voice.
+ *
+ * @param voice The voice to update.
+ * @param waveform One of the SYNTHESIZER_WAVEFORM_ constants, other than SYNTHESIZER_WAVEFORM_CUSTOM.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::setWaveform(int voice, int waveform)
+{
+    if (voice < 0 || voice >= voiceCount || waveform < SYNTHESIZER_WAVEFORM_SINE || waveform >= SYNTHESIZER_WAVEFORM_CUSTOM)
+        return DEVICE_INVALID_PARAMETER;
+
+    SynthesizerVoice &v = voices[voice];
+
+    v.waveform = waveform;
+    v.table = SineTable;
+    v.tableShift = 24;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Selects a custom wavetable for a voice. The table is not copied, and must remain valid while in use.
+ *
+ * @param voice The voice to update.
+ * @param table A single waveform cycle of signed 16 bit samples.
+ * @param length The number of samples in the table. Must be a power of two, between 2 and 65536.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::setWavetable(int voice, const int16_t *table, int length)
+{
+    if (voice < 0 || voice >= voiceCount || table == NULL || length < 2 || length > 65536 || (length & (length - 1)))
+        return DEVICE_INVALID_PARAMETER;
+
+    int bits = 0;
+    while ((1 << bits) < length)
+        bits++;
+
+    SynthesizerVoice &v = voices[voice];
+
+    v.table = table;
+    v.tableShift = 32 - bits;
+    v.waveform = SYNTHESIZER_WAVEFORM_CUSTOM;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the ADSR envelope of a voice. Takes effect from the next note played on that voice.
+ *
+ * @param voice The voice to update.
+ * @param attack The time taken to reach the peak amplitude, in milliseconds.
+ * @param decay The time taken to fall from the peak to the sustain level, in milliseconds.
+ * @param sustain The level held until the note is released, in the range 0..1024 (relative to the peak).
+ * @param release The time taken to fall to silence once released, in milliseconds.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::setEnvelope(int voice, int attack, int decay, int sustain, int release)
+{
+    if (voice < 0 || voice >= voiceCount || attack < 0 || attack > 0xFFFF || decay < 0 || decay > 0xFFFF || sustain < 0 || sustain > 1024 || release < 0 || release > 0xFFFF)
+        return DEVICE_INVALID_PARAMETER;
+
+    SynthesizerVoice &v = voices[voice];
+
+    v.attack = attack;
+    v.decay = decay;
+    v.sustain = sustain;
+    v.release = release;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if the given voice is currently producing sound.
+ *
+ * @param voice The voice to test.
+ * @return true if the voice is active, false otherwise.
+ */
+bool WavetableSynthesizer::isPlaying(int voice)
+{
+    if (voice < 0 || voice >= voiceCount)
+        return false;
+
+    return voices[voice].stage != SYNTHESIZER_VOICE_IDLE;
+}
+
+/**
+ * Defines the master volume of the synthesizer.
+ *
+ * @param volume The new output volume, in the range 0..1024
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+ */
+int WavetableSynthesizer::setVolume(int volume)
+{
+    if (volume < 0 || volume > 1024)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->volume = volume;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the number of samples rendered on each pull.
+ *
+ * @param size The new buffer size, in samples.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER
+ */
+int WavetableSynthesizer::setBufferSize(int size)
+{
+    if (size <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (size != bufferSize)
+    {
+        bufferSize = size;
+        mix = ManagedBuffer(size * sizeof(int32_t));
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determine the sample rate currently in use by this WavetableSynthesizer.
+ * @return the current sample rate, in Hz.
+ */
+float WavetableSynthesizer::getSampleRate()
+{
+    return sampleRate;
+}
+
+/**
+ * Change the sample rate used by this WavetableSynthesizer.
+ *
+ * @param sampleRate The new sample rate, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int WavetableSynthesizer::setSampleRate(int sampleRate)
+{
+    if (sampleRate <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->sampleRate = sampleRate;
+    return DEVICE_OK;
+}
+
+/**
+ *  Determine the data format of the buffers streamed out of this component.
+ */
+int WavetableSynthesizer::getFormat()
+{
+    return isSigned ? DATASTREAM_FORMAT_16BIT_SIGNED : DATASTREAM_FORMAT_16BIT_UNSIGNED;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ *
+ * All active voices are rendered into a 32 bit accumulation buffer, which is then scaled
+ * and saturated to the full 16 bit range of our output format.
+ */
+ManagedBuffer WavetableSynthesizer::pull()
+{
+    ManagedBuffer buffer(bufferSize * 2, BufferInitialize::None);
+    int32_t *acc = (int32_t *) mix.getBytes();
+    bool active = false;
+
+    memclr(acc, bufferSize * sizeof(int32_t));
+
+    for (int i = 0; i < voiceCount; i++)
+    {
+        SynthesizerVoice &v = voices[i];
+        int32_t *out = acc;
+        int remaining = bufferSize;
+
+        // Render in runs that end on envelope stage or gate boundaries.
+        while (remaining > 0 && v.stage != SYNTHESIZER_VOICE_IDLE)
+        {
+            int run = remaining;
+
+            if (v.stageSamples >= 0 && v.stageSamples < run)
+                run = v.stageSamples;
+
+            if (v.gateSamples >= 0 && v.gateSamples < run)
+                run = v.gateSamples;
+
+            renderVoice(v, out, run);
+            out += run;
+            remaining -= run;
+
+            if (v.stageSamples >= 0)
+                v.stageSamples -= run;
+
+            if (v.gateSamples >= 0)
+                v.gateSamples -= run;
+
+            if (v.gateSamples == 0)
+            {
+                v.gateSamples = -1;
+                if (v.stage != SYNTHESIZER_VOICE_RELEASE)
+                    enterStage(v, SYNTHESIZER_VOICE_RELEASE);
+            }
+            else if (v.stageSamples == 0)
+            {
+                enterStage(v, v.stage == SYNTHESIZER_VOICE_RELEASE ? SYNTHESIZER_VOICE_IDLE : v.stage + 1);
+            }
+        }
+
+        if (v.stage != SYNTHESIZER_VOICE_IDLE)
+            active = true;
+    }
+
+    int16_t *ptr = (int16_t *) buffer.getBytes();
+    int16_t *end = ptr + bufferSize;
+    int offset = isSigned ? 0 : 32768;
+    int vol = volume;
+
+    while (ptr < end)
+    {
+        int v = (*acc++ * vol) >> 10;
+
+        if (v < -32768) v = -32768;
+        if (v > 32767) v = 32767;
+
+        *ptr++ = (int16_t) (v + offset);
+    }
+
+    // If any voice is still sounding, let our downstream component know there is more to come.
+    if (active)
+        output.pullRequest();
+    else
+        playing = false;
+
+    return buffer;
+}
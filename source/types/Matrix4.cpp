@@ -50,15 +50,7 @@ DEALINGS IN THE SOFTWARE.
   */
 Matrix4::Matrix4(int rows, int cols)
 {
-	this->rows = rows;
-	this->cols = cols;
-
-	int size = rows * cols;
-
-	if (size > 0)
-		data = new float[size];
-	else
-		data = NULL;
+	allocate(rows, cols);
 }
 
 /**
@@ -73,22 +65,65 @@ Matrix4::Matrix4(int rows, int cols)
   */
 Matrix4::Matrix4(const Matrix4 &matrix)
 {
-	this->rows = matrix.rows;
-	this->cols = matrix.cols;
+	allocate(matrix.rows, matrix.cols);
+
+	for (int i = 0; i < rows * cols; i++)
+		data[i] = matrix.data[i];
+}
+
+/**
+  * Copy assignment operator.
+  *
+  * @param matrix The matrix to copy.
+  */
+Matrix4& Matrix4::operator=(const Matrix4 &matrix)
+{
+	if (this == &matrix)
+		return *this;
+
+	release();
+	allocate(matrix.rows, matrix.cols);
 
+	for (int i = 0; i < rows * cols; i++)
+		data[i] = matrix.data[i];
+
+	return *this;
+}
+
+/**
+  * Sets the dimensions of the matrix, allocating storage as necessary.
+  */
+void Matrix4::allocate(int rows, int cols)
+{
 	int size = rows * cols;
 
-	if (size > 0)
+	if (size <= 0)
 	{
-		data = new float[size];
-		for (int i = 0; i < size; i++)
-			data[i] = matrix.data[i];
+		rows = cols = 0;
+		data = NULL;
+	}
+	else if (size <= MATRIX4_INLINE_SIZE)
+	{
+		data = storage;
 	}
 	else
 	{
-		data = NULL;
+		data = new float[size];
 	}
 
+	this->rows = rows;
+	this->cols = cols;
+}
+
+/**
+  * Releases any storage allocated on the heap.
+  */
+void Matrix4::release()
+{
+	if (data != NULL && data != storage)
+		delete[] data;
+
+	data = NULL;
 }
 
 /**
@@ -174,9 +209,9 @@ Matrix4 Matrix4::transpose()
 {
 	Matrix4 result = Matrix4(cols, rows);
 
-	for (int i = 0; i < width(); i++)
-		for (int j = 0; j < height(); j++)
-			result.set(i, j, get(j, i));
+	for (int r = 0; r < rows; r++)
+		for (int c = 0; c < cols; c++)
+			result.data[c * rows + r] = data[r * cols + c];
 
 	return result;
 }
@@ -196,24 +231,35 @@ Matrix4 Matrix4::transpose()
   */
 Matrix4 Matrix4::multiply(Matrix4 &matrix, bool transpose)
 {
-    int w = transpose ? height() : width();
-    int h = transpose ? width() : height();
+	int w = transpose ? height() : width();
+	int h = transpose ? width() : height();
 
 	if (w != matrix.height())
 		return Matrix4(0, 0);
 
 	Matrix4 result(h, matrix.width());
 
-	for (int r = 0; r < result.height(); r++)
+	// Step through this matrix by row (or by column if transposed).
+	int rowStep = transpose ? 1 : cols;
+	int colStep = transpose ? cols : 1;
+	int k = matrix.cols;
+
+	for (int r = 0; r < h; r++)
 	{
-		for (int c = 0; c < result.width(); c++)
+		for (int c = 0; c < k; c++)
 		{
-			float v = 0.0;
+			const float *a = data + r * rowStep;
+			const float *b = matrix.data + c;
+			float v = 0.0f;
 
 			for (int i = 0; i < w; i++)
-				v += (transpose ? get(i, r) : get(r, i)) * matrix.get(i, c);
+			{
+				v += *a * *b;
+				a += colStep;
+				b += k;
+			}
 
-			result.set(r, c, v);
+			result.data[r * k + c] = v;
 		}
 	}
 
@@ -238,33 +284,9 @@ Matrix4 Matrix4::invert()
 
 	Matrix4 result(width(), height());
 
-	result.data[0] = data[5] * data[10] * data[15] - data[5] * data[11] * data[14] - data[9] * data[6] * data[15] + data[9] * data[7] * data[14] + data[13] * data[6] * data[11] - data[13] * data[7] * data[10];
-	result.data[1] = -data[1] * data[10] * data[15] + data[1] * data[11] * data[14] + data[9] * data[2] * data[15] - data[9] * data[3] * data[14] - data[13] * data[2] * data[11] + data[13] * data[3] * data[10];
-	result.data[2] = data[1] * data[6] * data[15] - data[1] * data[7] * data[14] - data[5] * data[2] * data[15] + data[5] * data[3] * data[14] + data[13] * data[2] * data[7] - data[13] * data[3] * data[6];
-	result.data[3] = -data[1] * data[6] * data[11] + data[1] * data[7] * data[10] + data[5] * data[2] * data[11] - data[5] * data[3] * data[10] - data[9] * data[2] * data[7] + data[9] * data[3] * data[6];
-	result.data[4] = -data[4] * data[10] * data[15] + data[4] * data[11] * data[14] + data[8] * data[6] * data[15] - data[8] * data[7] * data[14] - data[12] * data[6] * data[11] + data[12] * data[7] * data[10];
-	result.data[5] = data[0] * data[10] * data[15] - data[0] * data[11] * data[14] - data[8] * data[2] * data[15] + data[8] * data[3] * data[14] + data[12] * data[2] * data[11] - data[12] * data[3] * data[10];
-	result.data[6] = -data[0] * data[6] * data[15] + data[0] * data[7] * data[14] + data[4] * data[2] * data[15] - data[4] * data[3] * data[14] - data[12] * data[2] * data[7] + data[12] * data[3] * data[6];
-	result.data[7] = data[0] * data[6] * data[11] - data[0] * data[7] * data[10] - data[4] * data[2] * data[11] + data[4] * data[3] * data[10] + data[8] * data[2] * data[7] - data[8] * data[3] * data[6];
-	result.data[8] = data[4] * data[9] * data[15] - data[4] * data[11] * data[13] - data[8] * data[5] * data[15] + data[8] * data[7] * data[13] + data[12] * data[5] * data[11] - data[12] * data[7] * data[9];
-	result.data[9] = -data[0] * data[9] * data[15] + data[0] * data[11] * data[13] + data[8] * data[1] * data[15] - data[8] * data[3] * data[13] - data[12] * data[1] * data[11] + data[12] * data[3] * data[9];
-	result.data[10] = data[0] * data[5] * data[15] - data[0] * data[7] * data[13] - data[4] * data[1] * data[15] + data[4] * data[3] * data[13] + data[12] * data[1] * data[7] - data[12] * data[3] * data[5];
-	result.data[11] = -data[0] * data[5] * data[11] + data[0] * data[7] * data[9] + data[4] * data[1] * data[11] - data[4] * data[3] * data[9] - data[8] * data[1] * data[7] + data[8] * data[3] * data[5];
-	result.data[12] = -data[4] * data[9] * data[14] + data[4] * data[10] * data[13] + data[8] * data[5] * data[14] - data[8] * data[6] * data[13] - data[12] * data[5] * data[10] + data[12] * data[6] * data[9];
-	result.data[13] = data[0] * data[9] * data[14] - data[0] * data[10] * data[13] - data[8] * data[1] * data[14] + data[8] * data[2] * data[13] + data[12] * data[1] * data[10] - data[12] * data[2] * data[9];
-	result.data[14] = -data[0] * data[5] * data[14] + data[0] * data[6] * data[13] + data[4] * data[1] * data[14] - data[4] * data[2] * data[13] - data[12] * data[1] * data[6] + data[12] * data[2] * data[5];
-	result.data[15] = data[0] * data[5] * data[10] - data[0] * data[6] * data[9] - data[4] * data[1] * data[10] + data[4] * data[2] * data[9] + data[8] * data[1] * data[6] - data[8] * data[2] * data[5];
-
-	float det = data[0] * result.data[0] + data[1] * result.data[4] + data[2] * result.data[8] + data[3] * result.data[12];
-
-	if (det == 0)
+	if (codal::MatrixKernel<4, float>::invert(data, result.data) != DEVICE_OK)
 		return Matrix4(0, 0);
 
-	det = 1.0f / det;
-
-	for (int i = 0; i < 16; i++)
-		result.data[i] *= det;
-
 	return result;
 }
 
@@ -275,9 +297,5 @@ Matrix4 Matrix4::invert()
   */
 Matrix4::~Matrix4()
 {
-	if (data != NULL)
-	{
-		delete data;
-		data = NULL;
-	}
+	release();
 }
@@ -0,0 +1,725 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+  * Class definition for a PackedImage.
+  *
+  * A PackedImage is a bitmap holding 1, 2 or 4 bits per pixel, stored column by column.
+  * n.b. This is a mutable, managed type.
+  */
+
+#include "CodalConfig.h"
+#include "PackedImage.h"
+#include "BitmapFont.h"
+#include "CodalCompat.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+// The largest number of bits moved by each step of the blit kernels. This is a multiple of every supported
+// pixel size, and leaves room to align the bits to any bit position within a 32 bit word.
+#define PACKED_IMAGE_CHUNK_BITS     24
+
+/**
+  * The null image. As with Image, this is a single pixel to keep NULL pointers out of the equation.
+  */
+#define REF_TAG REF_TAG_PACKED_IMAGE
+#define EMPTY_DATA ((PackedImageData*)(void*)emptyData)
+
+REF_COUNTED_DEF_EMPTY(1, 1, 1, 1, 1, 0)
+
+PackedImage PackedImage::EmptyImage(EMPTY_DATA);
+
+/**
+  * Reads up to PACKED_IMAGE_CHUNK_BITS bits, starting at the given bit offset.
+  */
+static inline uint32_t readBits(const uint8_t *p, int bit, int n)
+{
+    uint32_t v = 0;
+
+    p += bit >> 3;
+    bit &= 7;
+
+    for (int i = 0; i < bit + n; i += 8)
+        v |= (uint32_t)*p++ << i;
+
+    return (v >> bit) & ((1UL << n) - 1);
+}
+
+/**
+  * Writes up to PACKED_IMAGE_CHUNK_BITS bits starting at the given bit offset. Only those bits set in mask are changed.
+  */
+static inline void writeBits(uint8_t *p, int bit, uint32_t v, uint32_t mask)
+{
+    p += bit >> 3;
+    bit &= 7;
+
+    v <<= bit;
+    mask <<= bit;
+
+    while (mask)
+    {
+        *p = (*p & ~mask) | (v & mask);
+        p++;
+        v >>= 8;
+        mask >>= 8;
+    }
+}
+
+/**
+  * Determines which bits of a packed run of pixels belong to pixels with a non-zero value.
+  */
+static inline uint32_t opaqueMask(uint32_t v, int bitsPerPixel)
+{
+    uint32_t t;
+
+    switch (bitsPerPixel)
+    {
+        case 1:
+            return v;
+
+        case 2:
+            t = (v | (v >> 1)) & 0x55555555;
+            return t | (t << 1);
+
+        default:
+            t = v | (v >> 1);
+            t |= t >> 2;
+            return (t & 0x11111111) * 0xF;
+    }
+}
+
+/**
+  * Copies a run of bits, which may be at any alignment. If the source and destination overlap,
+  * the run is copied in the direction that preserves the source.
+  */
+static void copyBits(uint8_t *dst, int dstBit, const uint8_t *src, int srcBit, int n, int bitsPerPixel, bool alpha)
+{
+    if (!alpha && ((dstBit | srcBit) & 7) == 0)
+    {
+        // Byte aligned, so we can move most of the run as a block. Any bits left over are copied on their own,
+        // before the block if it could overwrite them, otherwise after.
+        int bytes = n >> 3;
+        int tail = n & 7;
+        bool backwards = dst == src && dstBit > srcBit;
+
+        if (tail && backwards)
+            writeBits(dst, dstBit + (bytes << 3), readBits(src, srcBit + (bytes << 3), tail), (1 << tail) - 1);
+
+        memmove(dst + (dstBit >> 3), src + (srcBit >> 3), bytes);
+
+        if (tail && !backwards)
+            writeBits(dst, dstBit + (bytes << 3), readBits(src, srcBit + (bytes << 3), tail), (1 << tail) - 1);
+
+        return;
+    }
+
+    if (dst == src && dstBit > srcBit)
+    {
+        while (n > 0)
+        {
+            int c = min(n, PACKED_IMAGE_CHUNK_BITS);
+            n -= c;
+
+            uint32_t v = readBits(src, srcBit + n, c);
+            writeBits(dst, dstBit + n, v, alpha ? opaqueMask(v, bitsPerPixel) : (1UL << c) - 1);
+        }
+    }
+    else
+    {
+        while (n > 0)
+        {
+            int c = min(n, PACKED_IMAGE_CHUNK_BITS);
+
+            uint32_t v = readBits(src, srcBit, c);
+            writeBits(dst, dstBit, v, alpha ? opaqueMask(v, bitsPerPixel) : (1UL << c) - 1);
+
+            dstBit += c;
+            srcBit += c;
+            n -= c;
+        }
+    }
+}
+
+/**
+  * Sets a run of bits, which may be at any alignment, to zero.
+  */
+static void clearBits(uint8_t *p, int bit, int n)
+{
+    while (n > 0)
+    {
+        int c = min(n, PACKED_IMAGE_CHUNK_BITS);
+
+        writeBits(p, bit, 0, (1UL << c) - 1);
+
+        bit += c;
+        n -= c;
+    }
+}
+
+/**
+  * Default Constructor.
+  * Creates a new reference to the empty PackedImage bitmap
+  */
+PackedImage::PackedImage()
+{
+    init_empty();
+}
+
+/**
+  * Constructor.
+  * Create an image from a specially prepared constant array, with no copying. Will call ptr->incr().
+  *
+  * @param ptr The literal - first two bytes should be 0xff, then width, height and stride as 16 bit values,
+  * the number of bits per pixel, a zero byte and the bitmap. The literal has to be 4-byte aligned.
+  */
+PackedImage::PackedImage(PackedImageData *p)
+{
+    if(p == NULL)
+    {
+        init_empty();
+        return;
+    }
+
+    ptr = p;
+    ptr->incr();
+}
+
+/**
+  * Copy Constructor.
+  * Add ourselves as a reference to an existing PackedImage.
+  *
+  * @param image The PackedImage to reference.
+  */
+PackedImage::PackedImage(const PackedImage &image)
+{
+    ptr = image.ptr;
+    ptr->incr();
+}
+
+/**
+  * Constructor.
+  * Create a blank bitmap representation of a given size.
+  *
+  * @param x the width of the image.
+  *
+  * @param y the height of the image.
+  *
+  * @param bitsPerPixel the number of bits used to represent each pixel: 1, 2 or 4. Defaults to 1.
+  *
+  * @code
+  * PackedImage i(160, 128, 4); // a 4 bit image the size of a 1.8" ST7735 screen, in 10240 bytes
+  * @endcode
+  */
+PackedImage::PackedImage(const int16_t x, const int16_t y, int bitsPerPixel)
+{
+    this->init(x, y, bitsPerPixel);
+}
+
+/**
+  * Constructor.
+  * Create a packed copy of the given Image. Pixel values are scaled from the range 0..255 into the range
+  * of the chosen format, rounding up so that no lit pixel is lost.
+  *
+  * @param image the Image to convert.
+  *
+  * @param bitsPerPixel the number of bits used to represent each pixel: 1, 2 or 4. Defaults to 1.
+  */
+PackedImage::PackedImage(Image &image, int bitsPerPixel)
+{
+    this->init(image.getWidth(), image.getHeight(), bitsPerPixel);
+
+    int maxValue = (1 << getBitsPerPixel()) - 1;
+    int width = getWidth();
+    uint8_t *in = image.getBitmap();
+
+    for (int x = 0; x < width; x++)
+    {
+        uint8_t *out = getBitmap() + x * getStride();
+        uint8_t *pixel = in + x;
+        uint32_t v = 0;
+        int bit = 0;
+
+        for (int y = 0; y < getHeight(); y++)
+        {
+            v |= ((*pixel * maxValue + 254) / 255) << bit;
+            pixel += width;
+            bit += getBitsPerPixel();
+
+            if (bit == 8)
+            {
+                *out++ = v;
+                v = 0;
+                bit = 0;
+            }
+        }
+
+        if (bit)
+            *out = v;
+    }
+}
+
+/**
+  * Destructor.
+  *
+  * Removes buffer resources held by the instance.
+  */
+PackedImage::~PackedImage()
+{
+    ptr->decr();
+}
+
+/**
+  * Internal constructor which defaults to the EmptyImage instance variable
+  */
+void PackedImage::init_empty()
+{
+    ptr = EMPTY_DATA;
+}
+
+/**
+  * Internal constructor which provides sanity checking and initialises class properties.
+  *
+  * @param x the width of the image
+  *
+  * @param y the height of the image
+  *
+  * @param bitsPerPixel the number of bits used to represent each pixel.
+  */
+void PackedImage::init(const int16_t x, const int16_t y, int bitsPerPixel)
+{
+    // Sanity check the size and format of the image.
+    if (x < 0 || y < 0 || (bitsPerPixel != 1 && bitsPerPixel != 2 && bitsPerPixel != 4))
+    {
+        init_empty();
+        return;
+    }
+
+    int stride = (y * bitsPerPixel + 7) >> 3;
+
+    ptr = (PackedImageData*)malloc(sizeof(PackedImageData) + x * stride);
+    REF_COUNTED_INIT(ptr);
+    ptr->width = x;
+    ptr->height = y;
+    ptr->stride = stride;
+    ptr->bitsPerPixel = bitsPerPixel;
+    ptr->reserved = 0;
+
+    this->clear();
+}
+
+/**
+  * Copy assign operation.
+  *
+  * @param i The PackedImage to reference.
+  */
+PackedImage& PackedImage::operator = (const PackedImage& i)
+{
+    if(ptr == i.ptr)
+        return *this;
+
+    ptr->decr();
+    ptr = i.ptr;
+    ptr->incr();
+
+    return *this;
+}
+
+/**
+  * Equality operation.
+  *
+  * @param i The PackedImage to test ourselves against.
+  *
+  * @return true if this PackedImage is identical to the one supplied, false otherwise.
+  */
+bool PackedImage::operator== (const PackedImage& i)
+{
+    if (ptr == i.ptr)
+        return true;
+    else
+        return (ptr->width == i.ptr->width && ptr->height == i.ptr->height && ptr->bitsPerPixel == i.ptr->bitsPerPixel &&
+                memcmp(getBitmap(), i.ptr->data, getSize()) == 0);
+}
+
+/**
+  * Resets all pixels in this image to 0.
+  */
+void PackedImage::clear()
+{
+    memclr(getBitmap(), getSize());
+}
+
+/**
+  * Sets every pixel in this image to the given value.
+  *
+  * @param value the pixel value, which is truncated to the range of this image.
+  */
+void PackedImage::fill(int value)
+{
+    int bpp = getBitsPerPixel();
+    int padding = getStride() * 8 - getHeight() * bpp;
+    uint8_t b = value & ((1 << bpp) - 1);
+
+    for (int shift = bpp; shift < 8; shift <<= 1)
+        b |= b << shift;
+
+    memset(getBitmap(), b, getSize());
+
+    // Keep the padding at the end of each column clear, so that images can be compared and sent as they are.
+    if (padding)
+        for (int x = 0; x < getWidth(); x++)
+            getBitmap()[(x + 1) * getStride() - 1] &= 0xFF >> padding;
+}
+
+/**
+  * Sets the pixel at the given co-ordinates to a given value.
+  *
+  * @param x The co-ordinate of the pixel to change.
+  *
+  * @param y The co-ordinate of the pixel to change.
+  *
+  * @param value The new value of the pixel, which is truncated to the range of this image.
+  *
+  * @return DEVICE_OK, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::setPixelValue(int16_t x , int16_t y, uint8_t value)
+{
+    //sanity check
+    if(x >= getWidth() || y >= getHeight() || x < 0 || y < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    int bpp = getBitsPerPixel();
+    writeBits(getBitmap() + x * getStride(), y * bpp, value, (1 << bpp) - 1);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Retrieves the value of a given pixel.
+  *
+  * @param x The x co-ordinate of the pixel to read. Must be within the dimensions of the image.
+  *
+  * @param y The y co-ordinate of the pixel to read. Must be within the dimensions of the image.
+  *
+  * @return The value assigned to the given pixel location, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::getPixelValue(int16_t x , int16_t y)
+{
+    //sanity check
+    if(x >= getWidth() || y >= getHeight() || x < 0 || y < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    int bpp = getBitsPerPixel();
+    return readBits(getBitmap() + x * getStride(), y * bpp, bpp);
+}
+
+/**
+  * Pastes a given image at the given co-ordinates.
+  *
+  * Any pixels in the relevant area of this image are replaced. Both images must use the same number of bits per pixel.
+  *
+  * @param image The PackedImage to paste.
+  *
+  * @param x The leftmost X co-ordinate in this image where the given image should be pasted. Defaults to 0.
+  *
+  * @param y The uppermost Y co-ordinate in this image where the given image should be pasted. Defaults to 0.
+  *
+  * @param alpha set to 1 if transparency clear pixels in given image should be treated as transparent. Set to 0 otherwise.  Defaults to 0.
+  *
+  * @return The number of pixels in the area written, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::paste(const PackedImage &image, int16_t x, int16_t y, uint8_t alpha)
+{
+    int cx, cy;
+    int bpp = getBitsPerPixel();
+
+    if (image.getBitsPerPixel() != bpp)
+        return DEVICE_INVALID_PARAMETER;
+
+    // We permit writes that overlap us, but ones that are clearly out of scope we can filter early.
+    if (x >= getWidth() || y >= getHeight() || x+image.getWidth() <= 0 || y+image.getHeight() <= 0)
+        return 0;
+
+    // Calculate the number of pixels we need to copy in each dimension.
+    cx = x < 0 ? min(image.getWidth() + x, getWidth()) : min(image.getWidth(), getWidth() - x);
+    cy = y < 0 ? min(image.getHeight() + y, getHeight()) : min(image.getHeight(), getHeight() - y);
+
+    const uint8_t *pIn = image.ptr->data + ((x < 0) ? -x : 0) * image.getStride();
+    uint8_t *pOut = getBitmap() + ((x > 0) ? x : 0) * getStride();
+    int srcBit = ((y < 0) ? -y : 0) * bpp;
+    int dstBit = ((y > 0) ? y : 0) * bpp;
+
+    // Copy the image column by column. If we're pasting part of this image onto itself further to the right,
+    // work from right to left so that no column is overwritten before it is copied.
+    if (image.ptr == ptr && x > 0)
+    {
+        for (int i = cx - 1; i >= 0; i--)
+            copyBits(pOut + i * getStride(), dstBit, pIn + i * getStride(), srcBit, cy * bpp, bpp, alpha);
+    }
+    else
+    {
+        for (int i = 0; i < cx; i++)
+            copyBits(pOut + i * getStride(), dstBit, pIn + i * image.getStride(), srcBit, cy * bpp, bpp, alpha);
+    }
+
+    return cx * cy;
+}
+
+/**
+  * Prints a character to the image at the given location, using the system font.
+  *
+  * @param c The character to display.
+  *
+  * @param x The x co-ordinate of on the image to place the top left of the character. Defaults to 0.
+  *
+  * @param y The y co-ordinate of on the image to place the top left of the character. Defaults to 0.
+  *
+  * @param value The value given to lit pixels of the character. Defaults to the maximum value of this image.
+  *
+  * @param alpha set to 1 if unlit pixels of the character should leave the image unchanged, or 0 to clear them. Defaults to 0.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::print(char c, int16_t x, int16_t y, int value, uint8_t alpha)
+{
+    BitmapFont font = BitmapFont::getSystemFont();
+
+    int bpp = getBitsPerPixel();
+    uint32_t pixelMask = (1 << bpp) - 1;
+
+    // Sanity check. Silently ignore anything out of bounds.
+    if (x >= getWidth() || y >= getHeight() || c < BITMAP_FONT_ASCII_START || c > font.asciiEnd)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (value < 0)
+        value = pixelMask;
+
+    // Determine which rows of the character are visible.
+    int firstRow = max(0, -y);
+    int lastRow = min(BITMAP_FONT_HEIGHT, getHeight() - y);
+
+    if (firstRow >= lastRow)
+        return DEVICE_OK;
+
+    const uint8_t *v = font.get(c);
+
+    for (int col = 0; col < BITMAP_FONT_WIDTH; col++)
+    {
+        int x1 = x + col;
+
+        if (x1 < 0 || x1 >= getWidth())
+            continue;
+
+        // Build the packed column of the character, and write it in a single step.
+        uint32_t bits = 0;
+        uint32_t mask = 0;
+
+        for (int row = firstRow; row < lastRow; row++)
+        {
+            int shift = (row - firstRow) * bpp;
+
+            if (v[row] & (0x10 >> col))
+            {
+                bits |= (value & pixelMask) << shift;
+                mask |= pixelMask << shift;
+            }
+            else if (!alpha)
+            {
+                mask |= pixelMask << shift;
+            }
+        }
+
+        writeBits(getBitmap() + x1 * getStride(), (y + firstRow) * bpp, bits, mask);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Shifts the pixels in this image a given number of pixels to the left.
+  *
+  * @param n The number of pixels to shift.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::shiftLeft(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getWidth())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    // Columns are contiguous, so this is a single block move.
+    int bytes = n * getStride();
+
+    memmove(getBitmap(), getBitmap() + bytes, getSize() - bytes);
+    memclr(getBitmap() + getSize() - bytes, bytes);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Shifts the pixels in this image a given number of pixels to the right.
+  *
+  * @param n The number of pixels to shift.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::shiftRight(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getWidth())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int bytes = n * getStride();
+
+    memmove(getBitmap() + bytes, getBitmap(), getSize() - bytes);
+    memclr(getBitmap(), bytes);
+
+    return DEVICE_OK;
+}
+
+/**
+  * Shifts the pixels in this image a given number of pixels upward.
+  *
+  * @param n The number of pixels to shift.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::shiftUp(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getHeight())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int bpp = getBitsPerPixel();
+    int remaining = (getHeight() - n) * bpp;
+
+    for (int x = 0; x < getWidth(); x++)
+    {
+        uint8_t *p = getBitmap() + x * getStride();
+
+        copyBits(p, 0, p, n * bpp, remaining, bpp, false);
+        clearBits(p, remaining, n * bpp);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Shifts the pixels in this image a given number of pixels downward.
+  *
+  * @param n The number of pixels to shift.
+  *
+  * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+  */
+int PackedImage::shiftDown(int16_t n)
+{
+    if (n <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (n >= getHeight())
+    {
+        clear();
+        return DEVICE_OK;
+    }
+
+    int bpp = getBitsPerPixel();
+
+    for (int x = 0; x < getWidth(); x++)
+    {
+        uint8_t *p = getBitmap() + x * getStride();
+
+        copyBits(p, n * bpp, p, 0, (getHeight() - n) * bpp, bpp, false);
+        clearBits(p, 0, n * bpp);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+  * Creates an unpacked copy of this image. Pixel values are scaled into the range 0..255.
+  *
+  * @return an Image holding one byte per pixel.
+  */
+Image PackedImage::toImage()
+{
+    Image image(getWidth(), getHeight());
+
+    int bpp = getBitsPerPixel();
+    int maxValue = (1 << bpp) - 1;
+    int width = getWidth();
+
+    for (int x = 0; x < width; x++)
+    {
+        const uint8_t *in = getBitmap() + x * getStride();
+        uint8_t *out = image.getBitmap() + x;
+
+        for (int y = 0; y < getHeight(); y++)
+        {
+            *out = (((in[(y * bpp) >> 3] >> ((y * bpp) & 7)) & maxValue) * 255) / maxValue;
+            out += width;
+        }
+    }
+
+    return image;
+}
+
+/**
+  * Determines if this image points to a static bitmap held in flash.
+  *
+  * @return true if the image is read only, false otherwise.
+  */
+bool PackedImage::isReadOnly()
+{
+    return ptr->isReadOnly();
+}
+
+/**
+  * Create a copy of the image bitmap. Used particularly, when isReadOnly() is true.
+  *
+  * @return an instance of PackedImage which can be modified independently of the current instance
+  */
+PackedImage PackedImage::clone()
+{
+    PackedImage image(getWidth(), getHeight(), getBitsPerPixel());
+
+    memcpy(image.getBitmap(), getBitmap(), getSize());
+
+    return image;
+}